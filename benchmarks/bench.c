@@ -0,0 +1,491 @@
+/*
+ * Round-trip benchmark for nanoMODBUS.
+ *
+ * A client and a server run in the same process and exchange requests for every supported function code over:
+ * - "memory": a pure in-memory transport. The server is polled from inside the client read function, so no threads or
+ *   syscalls are involved and the numbers reflect the library overhead only (TCP framing).
+ * - "ring": the lock-free in-memory ring transport of examples/linux/ring_transport.h, with the server running in its
+ *   own thread (RTU framing).
+ * - "socketpair": a UNIX socket pair, with the server running in its own thread (TCP framing).
+ * - "pty": a pseudo-terminal pair in raw mode, with the server running in its own thread (RTU framing).
+ *
+ * For each scenario and function code, latency percentiles and sustained requests/second are written as JSON to the
+ * standard output (or to the file passed with -o).
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "nanomodbus.h"
+#include "ring_transport.h"
+
+#define SERVER_ADDR_RTU 1
+
+#define WARMUP_ITERATIONS 100
+
+
+// In-memory transport
+
+typedef struct mem_pipe {
+    uint8_t buf[1024];
+    uint16_t head;
+    uint16_t tail;
+} mem_pipe;
+
+static mem_pipe client_to_server;
+static mem_pipe server_to_client;
+static nmbs_t mem_server;
+
+
+static uint16_t mem_pipe_read(mem_pipe* p, uint8_t* buf, uint16_t count) {
+    const uint16_t available = (uint16_t) (p->head - p->tail);
+    if (count > available)
+        count = available;
+
+    memcpy(buf, p->buf + p->tail, count);
+    p->tail = (uint16_t) (p->tail + count);
+    if (p->tail == p->head) {
+        p->head = 0;
+        p->tail = 0;
+    }
+
+    return count;
+}
+
+
+static int32_t mem_pipe_write(mem_pipe* p, const uint8_t* buf, uint16_t count) {
+    if (p->head + count > (int) sizeof(p->buf))
+        return -1;
+
+    memcpy(p->buf + p->head, buf, count);
+    p->head = (uint16_t) (p->head + count);
+    return count;
+}
+
+
+static int32_t read_mem_server(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    UNUSED_PARAM(arg);
+    return mem_pipe_read(&client_to_server, buf, count);
+}
+
+
+static int32_t write_mem_server(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    UNUSED_PARAM(arg);
+    return mem_pipe_write(&server_to_client, buf, count);
+}
+
+
+static int32_t read_mem_client(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    UNUSED_PARAM(arg);
+
+    // Run the server when the client waits for a response
+    if (server_to_client.head == server_to_client.tail && client_to_server.head != client_to_server.tail)
+        nmbs_server_poll(&mem_server);
+
+    return mem_pipe_read(&server_to_client, buf, count);
+}
+
+
+static int32_t write_mem_client(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    UNUSED_PARAM(arg);
+    return mem_pipe_write(&client_to_server, buf, count);
+}
+
+
+// File descriptor transport, used for the socketpair and pty scenarios
+
+static int32_t read_fd(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        const int ret = poll(&pfd, 1, timeout_ms);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        const ssize_t r = read(fd, buf + total, count - total);
+        if (r <= 0)
+            return -1;
+
+        total = (uint16_t) (total + r);
+    }
+
+    return total;
+}
+
+
+static int32_t write_fd(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+        const int ret = poll(&pfd, 1, timeout_ms);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        const ssize_t w = write(fd, buf + total, count - total);
+        if (w <= 0)
+            return -1;
+
+        total = (uint16_t) (total + w);
+    }
+
+    return total;
+}
+
+
+typedef struct threaded_server {
+    nmbs_t nmbs;
+    pthread_t thread;
+    volatile bool stop;
+} threaded_server;
+
+
+static void* server_thread(void* arg) {
+    threaded_server* server = arg;
+    while (!server->stop)
+        nmbs_server_poll(&server->nmbs);
+
+    return NULL;
+}
+
+
+static int open_pty_pair(int fds[2]) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0)
+        return -1;
+
+    if (grantpt(master) != 0 || unlockpt(master) != 0) {
+        close(master);
+        return -1;
+    }
+
+    const int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0) {
+        close(master);
+        return -1;
+    }
+
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+
+    fds[0] = master;
+    fds[1] = slave;
+    return 0;
+}
+
+
+// Measurement
+
+static int compare_u64(const void* a, const void* b) {
+    const uint64_t x = *(const uint64_t*) a;
+    const uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+static uint64_t percentile(const uint64_t* sorted, unsigned long count, double p) {
+    unsigned long idx = (unsigned long) (p * (double) count);
+    if (idx >= count)
+        idx = count - 1;
+
+    return sorted[idx];
+}
+
+
+static bool first_scenario = true;
+
+
+static int run_scenario(FILE* out, const char* name, nmbs_transport transport, nmbs_t* client, unsigned long iterations) {
+    uint64_t* latencies = malloc(iterations * sizeof(uint64_t));
+    if (!latencies) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    fprintf(out, "%s\n    {\n      \"name\": \"%s\",\n      \"transport\": \"%s\",\n      \"results\": [", first_scenario ? "" : ",",
+            name, transport == NMBS_TRANSPORT_RTU ? "rtu" : "tcp");
+    first_scenario = false;
+
+    int ret = 0;
+    for (size_t o = 0; o < sizeof(bench_ops) / sizeof(bench_op); o++) {
+        const bench_op* op = &bench_ops[o];
+
+        for (unsigned long i = 0; i < WARMUP_ITERATIONS; i++) {
+            if (op->run(client) != NMBS_ERROR_NONE) {
+                fprintf(stderr, "%s: FC %d failed during warmup\n", name, op->fc);
+                ret = -1;
+                goto end;
+            }
+        }
+
+        unsigned long errors = 0;
+        const uint64_t start = now_ns();
+        for (unsigned long i = 0; i < iterations; i++) {
+            const uint64_t req_start = now_ns();
+            if (op->run(client) != NMBS_ERROR_NONE)
+                errors++;
+            latencies[i] = now_ns() - req_start;
+        }
+        const uint64_t total = now_ns() - start;
+
+        uint64_t sum = 0;
+        for (unsigned long i = 0; i < iterations; i++)
+            sum += latencies[i];
+
+        qsort(latencies, iterations, sizeof(uint64_t), compare_u64);
+
+        fprintf(out,
+                "%s\n        {\"fc\": %d, \"name\": \"%s\", \"requests\": %lu, \"errors\": %lu, \"req_per_s\": %.1f, "
+                "\"latency_ns\": {\"min\": %llu, \"mean\": %llu, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, "
+                "\"p999\": %llu, \"max\": %llu}}",
+                o ? "," : "", op->fc, op->name, iterations, errors, (double) iterations * 1e9 / (double) total,
+                (unsigned long long) latencies[0], (unsigned long long) (sum / iterations),
+                (unsigned long long) percentile(latencies, iterations, 0.5),
+                (unsigned long long) percentile(latencies, iterations, 0.9),
+                (unsigned long long) percentile(latencies, iterations, 0.99),
+                (unsigned long long) percentile(latencies, iterations, 0.999),
+                (unsigned long long) latencies[iterations - 1]);
+    }
+
+end:
+    fprintf(out, "\n      ]\n    }");
+    free(latencies);
+    return ret;
+}
+
+
+static int bench_memory(FILE* out, unsigned long iterations) {
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    nmbs_platform_conf server_conf;
+    nmbs_platform_conf_create(&server_conf);
+    server_conf.transport = NMBS_TRANSPORT_TCP;
+    server_conf.read = read_mem_server;
+    server_conf.write = write_mem_server;
+
+    nmbs_platform_conf client_conf;
+    nmbs_platform_conf_create(&client_conf);
+    client_conf.transport = NMBS_TRANSPORT_TCP;
+    client_conf.read = read_mem_client;
+    client_conf.write = write_mem_client;
+
+    nmbs_t client;
+    if (nmbs_server_create(&mem_server, 0, &server_conf, &callbacks) != NMBS_ERROR_NONE ||
+        nmbs_client_create(&client, &client_conf) != NMBS_ERROR_NONE)
+        return -1;
+
+    return run_scenario(out, "memory", NMBS_TRANSPORT_TCP, &client, iterations);
+}
+
+
+static int bench_threaded(FILE* out, const char* name, const nmbs_platform_conf* server_conf,
+                          const nmbs_platform_conf* client_conf, unsigned long iterations) {
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    static threaded_server server;
+    server.stop = false;
+
+    nmbs_t client;
+    if (nmbs_server_create(&server.nmbs, SERVER_ADDR_RTU, server_conf, &callbacks) != NMBS_ERROR_NONE ||
+        nmbs_client_create(&client, client_conf) != NMBS_ERROR_NONE)
+        return -1;
+
+    nmbs_set_read_timeout(&server.nmbs, 100);
+    nmbs_set_byte_timeout(&server.nmbs, 100);
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, 100);
+    nmbs_set_destination_rtu_address(&client, SERVER_ADDR_RTU);
+
+    if (pthread_create(&server.thread, NULL, server_thread, &server) != 0)
+        return -1;
+
+    const int ret = run_scenario(out, name, client_conf->transport, &client, iterations);
+
+    server.stop = true;
+    pthread_join(server.thread, NULL);
+
+    return ret;
+}
+
+
+static int bench_fd(FILE* out, const char* name, nmbs_transport transport, int fds[2], unsigned long iterations) {
+    nmbs_platform_conf server_conf;
+    nmbs_platform_conf_create(&server_conf);
+    server_conf.transport = transport;
+    server_conf.read = read_fd;
+    server_conf.write = write_fd;
+    server_conf.arg = &fds[0];
+
+    nmbs_platform_conf client_conf;
+    nmbs_platform_conf_create(&client_conf);
+    client_conf.transport = transport;
+    client_conf.read = read_fd;
+    client_conf.write = write_fd;
+    client_conf.arg = &fds[1];
+
+    return bench_threaded(out, name, &server_conf, &client_conf, iterations);
+}
+
+
+static int bench_ring(FILE* out, unsigned long iterations) {
+    static ring_transport rt;
+    ring_transport_init(&rt, 2);
+
+    nmbs_platform_conf server_conf;
+    ring_transport_platform_conf(&rt, 0, NMBS_TRANSPORT_RTU, &server_conf);
+
+    nmbs_platform_conf client_conf;
+    ring_transport_platform_conf(&rt, 1, NMBS_TRANSPORT_RTU, &client_conf);
+
+    return bench_threaded(out, "ring", &server_conf, &client_conf, iterations);
+}
+
+
+static int bench_socketpair(FILE* out, unsigned long iterations) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        fprintf(stderr, "socketpair() failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    const int ret = bench_fd(out, "socketpair", NMBS_TRANSPORT_TCP, fds, iterations);
+
+    close(fds[0]);
+    close(fds[1]);
+    return ret;
+}
+
+
+static int bench_pty(FILE* out, unsigned long iterations) {
+    int fds[2];
+    if (open_pty_pair(fds) != 0) {
+        fprintf(stderr, "Unable to open a pty pair: %s\n", strerror(errno));
+        return -1;
+    }
+
+    const int ret = bench_fd(out, "pty", NMBS_TRANSPORT_RTU, fds, iterations);
+
+    close(fds[0]);
+    close(fds[1]);
+    return ret;
+}
+
+
+typedef struct scenario {
+    const char* name;
+    int (*run)(FILE* out, unsigned long iterations);
+    unsigned long default_iterations;
+} scenario;
+
+
+static const scenario scenarios[] = {
+        {"memory", bench_memory, 100000},
+        {"ring", bench_ring, 20000},
+        {"socketpair", bench_socketpair, 5000},
+        {"pty", bench_pty, 1000},
+};
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-n iterations] [-s scenario[,scenario...]] [-o output.json]\n"
+            "  scenarios: memory, ring, socketpair, pty (default: all)\n",
+            name);
+}
+
+
+int main(int argc, char* argv[]) {
+    unsigned long iterations = 0;
+    const char* selected = NULL;
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:o:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                selected = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    FILE* out = stdout;
+    if (output) {
+        out = fopen(output, "w");
+        if (!out) {
+            fprintf(stderr, "Error opening %s: %s\n", output, strerror(errno));
+            return 1;
+        }
+    }
+
+    bench_data_init();
+
+    fprintf(out, "{\n  \"library\": \"nanoMODBUS\",\n  \"scenarios\": [");
+
+    int ret = 0;
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenario); s++) {
+        if (selected) {
+            const char* match = strstr(selected, scenarios[s].name);
+            const size_t len = strlen(scenarios[s].name);
+            if (!match || (match != selected && match[-1] != ',') || (match[len] != 0 && match[len] != ','))
+                continue;
+        }
+
+        if (scenarios[s].run(out, iterations ? iterations : scenarios[s].default_iterations) != 0)
+            ret = 1;
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+
+    if (out != stdout)
+        fclose(out);
+
+    return ret;
+}
@@ -0,0 +1,252 @@
+/*
+ * Data model, server callbacks and client requests shared by the nanoMODBUS benchmarks.
+ */
+
+#ifndef NMBS_BENCH_COMMON_H
+#define NMBS_BENCH_COMMON_H
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "nanomodbus.h"
+
+#define UNUSED_PARAM(x) ((x) = (x))
+
+
+// Server data model
+
+static nmbs_bitfield server_coils;
+static uint16_t server_registers[0x10000];
+static uint16_t server_file[0x10000];
+
+
+static void bench_data_init(void) {
+    for (int i = 0; i < 0x10000; i++) {
+        server_registers[i] = (uint16_t) i;
+        server_file[i] = (uint16_t) ~i;
+    }
+}
+
+
+static nmbs_error bench_read_coils(uint16_t address, uint16_t quantity, nmbs_bitfield coils_out, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    if (address + quantity > NMBS_BITFIELD_MAX)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    nmbs_bitfield_copy(coils_out, 0, server_coils, address, quantity);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_read_registers(uint16_t address, uint16_t quantity, uint16_t* registers_out, uint8_t unit_id,
+                                 void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(registers_out, server_registers + address, quantity * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_write_single_coil(uint16_t address, bool value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    nmbs_bitfield_write(server_coils, address % NMBS_BITFIELD_MAX, value);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_write_single_register(uint16_t address, uint16_t value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    server_registers[address] = value;
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_write_multiple_coils(uint16_t address, uint16_t quantity, const nmbs_bitfield coils, uint8_t unit_id,
+                                       void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    if (address + quantity > NMBS_BITFIELD_MAX)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    nmbs_bitfield_copy(server_coils, address, coils, 0, quantity);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_write_multiple_registers(uint16_t address, uint16_t quantity, const uint16_t* registers,
+                                           uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(server_registers + address, registers, quantity * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_read_file_record(uint16_t file_number, uint16_t record_number, uint16_t* registers, uint16_t count,
+                                   uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(file_number);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(registers, server_file + record_number, count * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_write_file_record(uint16_t file_number, uint16_t record_number, const uint16_t* registers,
+                                    uint16_t count, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(file_number);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(server_file + record_number, registers, count * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_read_device_identification_map(nmbs_bitfield_256 map) {
+    nmbs_bitfield_set(map, 0x00);
+    nmbs_bitfield_set(map, 0x01);
+    nmbs_bitfield_set(map, 0x02);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error bench_read_device_identification(uint8_t object_id, char buffer[NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH]) {
+    switch (object_id) {
+        case 0x00:
+            strcpy(buffer, "nanoMODBUS");
+            break;
+        case 0x01:
+            strcpy(buffer, "bench");
+            break;
+        case 0x02:
+            strcpy(buffer, "1.0");
+            break;
+        default:
+            return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+    }
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static void bench_callbacks_init(nmbs_callbacks* callbacks) {
+    nmbs_callbacks_create(callbacks);
+    callbacks->read_coils = bench_read_coils;
+    callbacks->read_discrete_inputs = bench_read_coils;
+    callbacks->read_holding_registers = bench_read_registers;
+    callbacks->read_input_registers = bench_read_registers;
+    callbacks->write_single_coil = bench_write_single_coil;
+    callbacks->write_single_register = bench_write_single_register;
+    callbacks->write_multiple_coils = bench_write_multiple_coils;
+    callbacks->write_multiple_registers = bench_write_multiple_registers;
+    callbacks->read_file_record = bench_read_file_record;
+    callbacks->write_file_record = bench_write_file_record;
+    callbacks->read_device_identification = bench_read_device_identification;
+    callbacks->read_device_identification_map = bench_read_device_identification_map;
+}
+
+
+// Client requests. Quantities are the largest allowed by each function code
+
+static nmbs_bitfield client_coils;
+static uint16_t client_registers[125];
+static char client_strings[3][NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH];
+
+
+static nmbs_error run_fc1(nmbs_t* client) {
+    return nmbs_read_coils(client, 0, 2000, client_coils);
+}
+
+
+static nmbs_error run_fc2(nmbs_t* client) {
+    return nmbs_read_discrete_inputs(client, 0, 2000, client_coils);
+}
+
+
+static nmbs_error run_fc3(nmbs_t* client) {
+    return nmbs_read_holding_registers(client, 0, 125, client_registers);
+}
+
+
+static nmbs_error run_fc4(nmbs_t* client) {
+    return nmbs_read_input_registers(client, 0, 125, client_registers);
+}
+
+
+static nmbs_error run_fc5(nmbs_t* client) {
+    return nmbs_write_single_coil(client, 1, true);
+}
+
+
+static nmbs_error run_fc6(nmbs_t* client) {
+    return nmbs_write_single_register(client, 1, 0x1234);
+}
+
+
+static nmbs_error run_fc15(nmbs_t* client) {
+    return nmbs_write_multiple_coils(client, 0, 1968, client_coils);
+}
+
+
+static nmbs_error run_fc16(nmbs_t* client) {
+    return nmbs_write_multiple_registers(client, 0, 123, client_registers);
+}
+
+
+static nmbs_error run_fc20(nmbs_t* client) {
+    return nmbs_read_file_record(client, 1, 0, client_registers, 120);
+}
+
+
+static nmbs_error run_fc21(nmbs_t* client) {
+    return nmbs_write_file_record(client, 1, 0, client_registers, 120);
+}
+
+
+static nmbs_error run_fc23(nmbs_t* client) {
+    return nmbs_read_write_registers(client, 0, 125, client_registers, 0, 121, client_registers);
+}
+
+
+static nmbs_error run_fc43(nmbs_t* client) {
+    return nmbs_read_device_identification_basic(client, client_strings[0], client_strings[1], client_strings[2],
+                                                 NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH);
+}
+
+
+typedef struct bench_op {
+    uint8_t fc;
+    const char* name;
+    nmbs_error (*run)(nmbs_t* client);
+} bench_op;
+
+
+static const bench_op bench_ops[] = {
+        {1, "read_coils", run_fc1},
+        {2, "read_discrete_inputs", run_fc2},
+        {3, "read_holding_registers", run_fc3},
+        {4, "read_input_registers", run_fc4},
+        {5, "write_single_coil", run_fc5},
+        {6, "write_single_register", run_fc6},
+        {15, "write_multiple_coils", run_fc15},
+        {16, "write_multiple_registers", run_fc16},
+        {20, "read_file_record", run_fc20},
+        {21, "write_file_record", run_fc21},
+        {23, "read_write_registers", run_fc23},
+        {43, "read_device_identification", run_fc43},
+};
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+#endif    // NMBS_BENCH_COMMON_H
@@ -0,0 +1,219 @@
+/*
+ * Platform binding benchmark for nanoMODBUS.
+ *
+ * A server is polled in a loop with canned requests served by an in-memory transport. nanomodbus.c is included after
+ * the transport functions, so that when they are bound at compile time (NMBS_PLATFORM_TRANSPORT, NMBS_PLATFORM_READ,
+ * NMBS_PLATFORM_WRITE and NMBS_PLATFORM_CRC_CALC) the compiler can inline them and drop the code of the unused
+ * transport. Build it with and without the bindings to compare the two; BENCH_TRANSPORT selects the transport.
+ * Results are reported in ns/request and, on x86, TSC ticks/request.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define UNUSED_PARAM(x) ((x) = (x))
+
+#ifndef BENCH_TRANSPORT
+#define BENCH_TRANSPORT NMBS_TRANSPORT_RTU
+#endif
+
+#define REQUESTS 2000000
+
+
+// In-memory transport, serving the same request over and over
+
+typedef struct canned_transport {
+    uint8_t req[16];
+    uint16_t req_len;
+    uint16_t pos;
+    uint32_t responses;
+} canned_transport;
+
+
+int32_t canned_read(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    canned_transport* t = (canned_transport*) arg;
+
+    if (t->pos + count > t->req_len)
+        return 0;
+
+    memcpy(buf, t->req + t->pos, count);
+    t->pos += count;
+    return count;
+}
+
+
+int32_t canned_write(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(buf);
+    UNUSED_PARAM(byte_timeout_ms);
+    canned_transport* t = (canned_transport*) arg;
+
+    t->pos = 0;
+    t->responses++;
+    return count;
+}
+
+
+#include "nanomodbus.c"
+
+
+static uint16_t registers[16];
+
+
+static nmbs_error read_holding_registers(uint16_t address, uint16_t quantity, uint16_t* registers_out, uint8_t unit_id,
+                                         void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(registers_out, registers + address, quantity * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error write_single_register(uint16_t address, uint16_t value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    registers[address] = value;
+    return NMBS_ERROR_NONE;
+}
+
+
+static void canned_request(canned_transport* t, uint8_t fc, uint16_t a, uint16_t b) {
+    uint16_t i = 0;
+    if (BENCH_TRANSPORT == NMBS_TRANSPORT_TCP) {
+        const uint8_t mbap[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01};
+        memcpy(t->req, mbap, sizeof(mbap));
+        i = sizeof(mbap);
+    }
+    else {
+        t->req[i++] = 0x01;
+    }
+
+    t->req[i++] = fc;
+    t->req[i++] = (uint8_t) (a >> 8);
+    t->req[i++] = (uint8_t) a;
+    t->req[i++] = (uint8_t) (b >> 8);
+    t->req[i++] = (uint8_t) b;
+
+    if (BENCH_TRANSPORT == NMBS_TRANSPORT_RTU) {
+        const uint16_t crc = nmbs_crc_calc(t->req, i, NULL);
+        t->req[i++] = (uint8_t) (crc >> 8);
+        t->req[i++] = (uint8_t) crc;
+    }
+
+    t->req_len = i;
+    t->pos = 0;
+    t->responses = 0;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+static uint64_t ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+
+static int bench_request(nmbs_t* server, canned_transport* t, const char* name, uint8_t fc, uint16_t a, uint16_t b,
+                         uint32_t requests) {
+    canned_request(t, fc, a, b);
+
+    int result = 0;
+    const uint64_t start_ticks = ticks();
+    const uint64_t start = now_ns();
+    for (uint32_t i = 0; i < requests; i++) {
+        if (nmbs_server_poll(server) != NMBS_ERROR_NONE)
+            result = 1;
+    }
+    const uint64_t elapsed = now_ns() - start;
+    const uint64_t elapsed_ticks = ticks() - start_ticks;
+
+    if (t->responses != requests)
+        result = 1;
+
+    printf("%-32s %12.1f", name, (double) elapsed / requests);
+    if (elapsed_ticks)
+        printf(" %14.1f\n", (double) elapsed_ticks / requests);
+    else
+        printf(" %14s\n", "n/a");
+
+    return result;
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n requests]\n", name);
+}
+
+
+int main(int argc, char* argv[]) {
+    uint32_t requests = REQUESTS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                requests = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    canned_transport t;
+    memset(&t, 0, sizeof(t));
+
+    nmbs_platform_conf platform_conf;
+    nmbs_platform_conf_create(&platform_conf);
+    platform_conf.transport = BENCH_TRANSPORT;
+    platform_conf.read = canned_read;
+    platform_conf.write = canned_write;
+    platform_conf.arg = &t;
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_single_register = write_single_register;
+
+    nmbs_t server;
+    if (nmbs_server_create(&server, 0x01, &platform_conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&server, 0);
+    nmbs_set_byte_timeout(&server, 0);
+
+#ifdef NMBS_PLATFORM_READ
+    printf("%s, compile-time binding\n", BENCH_TRANSPORT == NMBS_TRANSPORT_RTU ? "RTU" : "TCP");
+#else
+    printf("%s, runtime binding\n", BENCH_TRANSPORT == NMBS_TRANSPORT_RTU ? "RTU" : "TCP");
+#endif
+    printf("%-32s %12s %14s\n", "request", "ns/request", "ticks/request");
+
+    int result = 0;
+    result |= bench_request(&server, &t, "read_holding_registers(0, 8)", 3, 0, 8, requests);
+    result |= bench_request(&server, &t, "write_single_register(1, 42)", 6, 1, 42, requests);
+
+    if (result != 0)
+        fprintf(stderr, "Some requests failed\n");
+
+    return result;
+}
@@ -0,0 +1,253 @@
+/*
+ * Per-connection memory footprint benchmark for nanoMODBUS servers.
+ *
+ * N server instances are created from the same profile, each with a tiny transport state of its own, and polled once
+ * per round in a shuffled order, so that every poll touches a different nmbs_t, like a gateway serving many mostly idle
+ * connections would. Every poll serves the same canned Read Holding Registers request.
+ * Results are reported in ns/poll and, where perf_event_open() is available, last-level cache misses/poll.
+ *
+ * Build it with and without NMBS_SHARED_PROFILE to compare the two instance layouts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "nanomodbus.h"
+
+#define UNUSED_PARAM(x) ((x) = (x))
+
+#define POLLS_PER_STEP 2000000
+#define ROUNDS_MIN 3
+
+
+// Read Holding Registers, address 0, quantity 8
+static const uint8_t request[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x08};
+
+static uint16_t registers[8];
+
+// Per-connection transport state
+typedef struct connection {
+    uint16_t pos;
+    uint32_t responses;
+} connection;
+
+
+static int32_t conn_read(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    connection* conn = (connection*) arg;
+
+    if (conn->pos + count > (uint16_t) sizeof(request))
+        return 0;
+
+    memcpy(buf, request + conn->pos, count);
+    conn->pos += count;
+    return count;
+}
+
+
+static int32_t conn_write(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(buf);
+    UNUSED_PARAM(byte_timeout_ms);
+    connection* conn = (connection*) arg;
+
+    // The response has been sent, the next request is ready
+    conn->pos = 0;
+    conn->responses++;
+    return count;
+}
+
+
+static nmbs_error read_holding_registers(uint16_t address, uint16_t quantity, uint16_t* registers_out, uint8_t unit_id,
+                                         void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    memcpy(registers_out, registers + address, quantity * 2);
+    return NMBS_ERROR_NONE;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+static int perf_open(void) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+
+static void perf_start(int fd) {
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    UNUSED_PARAM(fd);
+#endif
+}
+
+
+static uint64_t perf_stop(int fd) {
+    uint64_t count = 0;
+#ifdef __linux__
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+    }
+#else
+    UNUSED_PARAM(fd);
+#endif
+    return count;
+}
+
+
+static int run_step(const nmbs_profile* profile, uint32_t n, int perf_fd) {
+    nmbs_t* servers = malloc(n * sizeof(nmbs_t));
+    connection* conns = calloc(n, sizeof(connection));
+    uint32_t* order = malloc(n * sizeof(uint32_t));
+    if (!servers || !conns || !order) {
+        fprintf(stderr, "Out of memory with %u connections\n", n);
+        free(servers);
+        free(conns);
+        free(order);
+        return 1;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        nmbs_create_from_profile(&servers[i], profile);
+        nmbs_set_platform_arg(&servers[i], &conns[i]);
+        order[i] = i;
+    }
+
+    for (uint32_t i = n - 1; i > 0; i--) {
+        const uint32_t j = (uint32_t) rand() % (i + 1);
+        const uint32_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    uint32_t rounds = POLLS_PER_STEP / n;
+    if (rounds < ROUNDS_MIN)
+        rounds = ROUNDS_MIN;
+
+    // Warm-up round, faults in all the pages
+    for (uint32_t i = 0; i < n; i++)
+        nmbs_server_poll(&servers[order[i]]);
+
+    int result = 0;
+    perf_start(perf_fd);
+    const uint64_t start = now_ns();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (nmbs_server_poll(&servers[order[i]]) != NMBS_ERROR_NONE)
+                result = 1;
+        }
+    }
+    const uint64_t elapsed = now_ns() - start;
+    const uint64_t misses = perf_stop(perf_fd);
+
+    const double polls = (double) rounds * n;
+    printf("%12u %12.1f", n, (double) elapsed / polls);
+    if (perf_fd >= 0)
+        printf(" %18.2f\n", (double) misses / polls);
+    else
+        printf(" %18s\n", "n/a");
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (conns[i].responses != rounds + 1)
+            result = 1;
+    }
+
+    if (result != 0)
+        fprintf(stderr, "Some polls failed with %u connections\n", n);
+
+    free(servers);
+    free(conns);
+    free(order);
+    return result;
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n max_connections]\n", name);
+}
+
+
+int main(int argc, char* argv[]) {
+    uint32_t max_connections = 100000;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                max_connections = (uint32_t) strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    nmbs_platform_conf platform_conf;
+    nmbs_platform_conf_create(&platform_conf);
+    platform_conf.transport = NMBS_TRANSPORT_TCP;
+    platform_conf.read = conn_read;
+    platform_conf.write = conn_write;
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_holding_registers;
+
+    nmbs_profile profile;
+    if (nmbs_profile_server_create(&profile, 0, &platform_conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating server profile\n");
+        return 1;
+    }
+
+    nmbs_profile_set_read_timeout(&profile, 0);
+    nmbs_profile_set_byte_timeout(&profile, 0);
+
+    const int perf_fd = perf_open();
+
+#ifdef NMBS_SHARED_PROFILE
+    printf("Shared profile, sizeof(nmbs_t) %zu, sizeof(nmbs_profile) %zu\n", sizeof(nmbs_t), sizeof(nmbs_profile));
+#else
+    printf("Embedded profile, sizeof(nmbs_t) %zu, sizeof(nmbs_profile) %zu\n", sizeof(nmbs_t), sizeof(nmbs_profile));
+#endif
+    printf("%12s %12s %18s\n", "connections", "ns/poll", "cache-misses/poll");
+
+    int result = 0;
+    for (uint32_t n = 1; n <= max_connections; n *= 10)
+        result |= run_step(&profile, n, perf_fd);
+
+    if (perf_fd >= 0)
+        close(perf_fd);
+
+    return result;
+}
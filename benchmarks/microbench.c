@@ -0,0 +1,495 @@
+/*
+ * Encode/decode microbenchmarks for nanoMODBUS, isolated from I/O.
+ *
+ * nanomodbus.c is included directly, so that its internal functions can be measured on their own. Requests and
+ * responses are served from pre-filled buffers by a transport that does no syscalls and never sleeps:
+ * - "client" runs a full client call for each function code, with the response already in the buffer;
+ * - "server" runs nmbs_server_poll() (request header parsing and the handle_*() function) on a recorded request.
+ * Canned frames are recorded at startup by running each request once against the server.
+ *
+ * Internal primitives (put_req_header(), put_regs(), get_regs_in_place(), recv_read_registers_res()) are measured
+ * separately, as are the swap_regs() byte-swap kernel over 1..125 register blocks at even and odd buffer offsets (-S
+ * skips it) and the bitfield copy/pack/unpack and multi-register value codec functions.
+ * Results are reported in ns/op and bytes/op, where bytes are the ones moved through the transport (or through the
+ * message buffer, for primitives).
+ */
+
+#include "nanomodbus.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+
+#define BATCHES 5
+#define BATCH_TARGET_NS 20000000ULL
+
+
+typedef struct buffer_transport {
+    uint8_t in[260];
+    uint16_t in_len;
+    uint16_t in_pos;
+
+    // Client mode: the response is only available after a request has been written
+    bool in_after_write;
+    bool armed;
+    bool tcp;
+
+    uint8_t out[260];
+    uint16_t out_len;
+} buffer_transport;
+
+
+static int32_t buffer_read(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    NMBS_UNUSED_PARAM(byte_timeout_ms);
+    buffer_transport* t = arg;
+
+    if (t->in_after_write && !t->armed)
+        return 0;
+
+    uint16_t left = (uint16_t) (t->in_len - t->in_pos);
+    if (count > left)
+        count = left;
+
+    memcpy(buf, t->in + t->in_pos, count);
+    t->in_pos = (uint16_t) (t->in_pos + count);
+    return count;
+}
+
+
+static int32_t buffer_write(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    NMBS_UNUSED_PARAM(byte_timeout_ms);
+    buffer_transport* t = arg;
+
+    if (count > sizeof(t->out))
+        return -1;
+
+    memcpy(t->out, buf, count);
+    t->out_len = count;
+
+    if (t->in_after_write) {
+        // Make the canned TCP response match the transaction id of the request
+        if (t->tcp)
+            memcpy(t->in, buf, 2);
+        t->armed = true;
+        t->in_pos = 0;
+    }
+
+    return count;
+}
+
+
+static void platform_conf_buffer(nmbs_platform_conf* conf, nmbs_transport transport, buffer_transport* t) {
+    nmbs_platform_conf_create(conf);
+    conf->transport = transport;
+    conf->read = buffer_read;
+    conf->write = buffer_write;
+    conf->arg = t;
+    t->tcp = transport == NMBS_TRANSPORT_TCP;
+}
+
+
+// Runs op() in batches sized to last about BATCH_TARGET_NS, returns the best ns/op
+typedef void (*micro_op)(void* ctx);
+
+static double measure(micro_op op, void* ctx) {
+    uint64_t iterations = 1;
+    while (true) {
+        const uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+            op(ctx);
+        const uint64_t elapsed = now_ns() - start;
+
+        if (elapsed >= BATCH_TARGET_NS / 10)
+            break;
+
+        iterations *= 2;
+    }
+
+    iterations *= 10;
+
+    double best = 0;
+    for (int b = 0; b < BATCHES; b++) {
+        const uint64_t start = now_ns();
+        for (uint64_t i = 0; i < iterations; i++)
+            op(ctx);
+        const double ns = (double) (now_ns() - start) / (double) iterations;
+
+        if (b == 0 || ns < best)
+            best = ns;
+    }
+
+    return best;
+}
+
+
+static void print_result(const char* transport, const char* side, const char* name, int fc, double ns, unsigned bytes) {
+    char fc_str[12] = "-";
+    if (fc >= 0)
+        snprintf(fc_str, sizeof(fc_str), "%d", fc);
+
+    printf("%-4s %-10s %-4s %-32s %10.1f %9u %8.2f\n", transport, side, fc_str, name, ns, bytes,
+           bytes ? ns / bytes : 0.0);
+}
+
+
+// Per function code
+
+typedef struct fc_ctx {
+    nmbs_t nmbs;
+    buffer_transport t;
+    const bench_op* op;
+    volatile nmbs_error err;
+} fc_ctx;
+
+
+static void client_op(void* arg) {
+    fc_ctx* ctx = arg;
+    ctx->t.armed = false;
+    ctx->err = ctx->op->run(&ctx->nmbs);
+}
+
+
+static void server_op(void* arg) {
+    fc_ctx* ctx = arg;
+    ctx->t.in_pos = 0;
+    ctx->err = nmbs_server_poll(&ctx->nmbs);
+}
+
+
+static int bench_fc(nmbs_transport transport, const char* transport_str, const bench_op* op) {
+    static fc_ctx client;
+    static fc_ctx server;
+
+    nmbs_platform_conf conf;
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    // Record the request
+    memset(&client, 0, sizeof(fc_ctx));
+    client.op = op;
+    platform_conf_buffer(&conf, transport, &client.t);
+    nmbs_client_create(&client.nmbs, &conf);
+    nmbs_set_destination_rtu_address(&client.nmbs, 1);
+    nmbs_set_read_timeout(&client.nmbs, 0);
+    nmbs_set_byte_timeout(&client.nmbs, 0);
+    client.t.in_after_write = true;
+    op->run(&client.nmbs);
+
+    // Record the response
+    memset(&server, 0, sizeof(fc_ctx));
+    platform_conf_buffer(&conf, transport, &server.t);
+    nmbs_server_create(&server.nmbs, 1, &conf, &callbacks);
+    nmbs_set_read_timeout(&server.nmbs, 0);
+    nmbs_set_byte_timeout(&server.nmbs, 0);
+    memcpy(server.t.in, client.t.out, client.t.out_len);
+    server.t.in_len = client.t.out_len;
+    server_op(&server);
+    if (server.err != NMBS_ERROR_NONE || server.t.out_len == 0) {
+        fprintf(stderr, "%s FC %d: error recording the response\n", transport_str, op->fc);
+        return -1;
+    }
+
+    memcpy(client.t.in, server.t.out, server.t.out_len);
+    client.t.in_len = server.t.out_len;
+    client_op(&client);
+    if (client.err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "%s FC %d: client error %s\n", transport_str, op->fc, nmbs_strerror(client.err));
+        return -1;
+    }
+
+    const unsigned bytes = (unsigned) (server.t.in_len + server.t.out_len);
+    print_result(transport_str, "client", op->name, op->fc, measure(client_op, &client), bytes);
+    print_result(transport_str, "server", op->name, op->fc, measure(server_op, &server), bytes);
+
+    return 0;
+}
+
+
+// Primitives
+
+typedef struct primitive_ctx {
+    nmbs_t nmbs;
+    buffer_transport t;
+    uint16_t regs[125];
+    volatile nmbs_error err;
+} primitive_ctx;
+
+
+static void put_req_header_op(void* arg) {
+    primitive_ctx* ctx = arg;
+    msg_state_req(&ctx->nmbs, 3);
+    put_req_header(&ctx->nmbs, 5);
+}
+
+
+static void put_regs_op(void* arg) {
+    primitive_ctx* ctx = arg;
+    ctx->nmbs.msg.buf_idx = 8;
+    put_regs(&ctx->nmbs, ctx->regs, 125);
+}
+
+
+static void get_regs_in_place_op(void* arg) {
+    primitive_ctx* ctx = arg;
+    ctx->nmbs.msg.buf_idx = 9;
+    get_regs_in_place(&ctx->nmbs, 125);
+}
+
+
+static void recv_read_registers_res_op(void* arg) {
+    primitive_ctx* ctx = arg;
+    ctx->nmbs.current_tid = 0;
+    ctx->t.armed = false;
+    msg_state_req(&ctx->nmbs, 3);
+    ctx->t.armed = true;
+    ctx->t.in_pos = 0;
+    ctx->err = recv_read_registers_res(&ctx->nmbs, 125, ctx->regs);
+}
+
+
+// Register byte-swap kernel, over block sizes and buffer alignments
+
+typedef struct swap_ctx {
+    uint8_t buf[2 + 250];
+    uint16_t regs[125];
+    uint16_t offset;
+    uint16_t n;
+} swap_ctx;
+
+
+static void swap_regs_op(void* arg) {
+    swap_ctx* ctx = arg;
+    swap_regs(ctx->buf + ctx->offset, ctx->regs, ctx->n);
+}
+
+
+// One register per iteration through a byte pointer, for reference
+static void swap_regs_bytewise_op(void* arg) {
+    swap_ctx* ctx = arg;
+    uint8_t* d = ctx->buf + ctx->offset;
+    for (uint16_t i = 0; i < ctx->n; i++) {
+        d[i * 2] = (uint8_t) (ctx->regs[i] >> 8);
+        d[i * 2 + 1] = (uint8_t) ctx->regs[i];
+    }
+}
+
+
+static int bench_swap_regs(void) {
+    static swap_ctx ctx;
+    static const uint16_t sizes[] = {1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 63, 64, 100, 124, 125};
+
+    for (int i = 0; i < 125; i++)
+        ctx.regs[i] = (uint16_t) (i * 0x0101 + 1);
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        ctx.n = sizes[s];
+
+        // Check the kernel against the reference at every alignment
+        for (ctx.offset = 0; ctx.offset < 2; ctx.offset++) {
+            uint8_t expected[250];
+            swap_regs_bytewise_op(&ctx);
+            memcpy(expected, ctx.buf + ctx.offset, ctx.n * 2);
+            memset(ctx.buf, 0, sizeof(ctx.buf));
+            swap_regs_op(&ctx);
+            if (memcmp(expected, ctx.buf + ctx.offset, ctx.n * 2) != 0) {
+                fprintf(stderr, "swap_regs(%d) at offset %d: wrong result\n", ctx.n, ctx.offset);
+                return -1;
+            }
+        }
+
+        for (ctx.offset = 0; ctx.offset < 2; ctx.offset++) {
+            char name[40];
+            snprintf(name, sizeof(name), "swap_regs(%d)%s", ctx.n, ctx.offset ? " unaligned" : "");
+            print_result("-", "primitive", name, -1, measure(swap_regs_op, &ctx), ctx.n * 2);
+            snprintf(name, sizeof(name), "swap_regs_bytewise(%d)%s", ctx.n, ctx.offset ? " unaligned" : "");
+            print_result("-", "primitive", name, -1, measure(swap_regs_bytewise_op, &ctx), ctx.n * 2);
+        }
+    }
+
+    return 0;
+}
+
+
+// Coil copies between bitfields at unaligned offsets, as done by coil callbacks
+
+typedef struct bitfield_ctx {
+    nmbs_bitfield src;
+    nmbs_bitfield dst;
+    uint8_t values[NMBS_BITFIELD_MAX];
+} bitfield_ctx;
+
+
+static void bitfield_copy_op(void* arg) {
+    bitfield_ctx* ctx = arg;
+    nmbs_bitfield_copy(ctx->dst, 0, ctx->src, 3, 1997);
+}
+
+
+static void bitfield_copy_bitwise_op(void* arg) {
+    bitfield_ctx* ctx = arg;
+    for (uint16_t i = 0; i < 1997; i++)
+        nmbs_bitfield_write(ctx->dst, i, nmbs_bitfield_read(ctx->src, 3 + i));
+}
+
+
+static void bitfield_pack_op(void* arg) {
+    bitfield_ctx* ctx = arg;
+    nmbs_bitfield_pack(ctx->dst, 0, ctx->values, NMBS_BITFIELD_MAX);
+}
+
+
+static void bitfield_unpack_op(void* arg) {
+    bitfield_ctx* ctx = arg;
+    nmbs_bitfield_unpack(ctx->values, ctx->src, 0, NMBS_BITFIELD_MAX);
+}
+
+
+static void bench_bitfield(void) {
+    static bitfield_ctx ctx;
+    for (size_t i = 0; i < sizeof(ctx.src); i++)
+        ctx.src[i] = (uint8_t) (i * 37);
+
+    print_result("-", "primitive", "bitfield_copy(1997, offset 3)", -1, measure(bitfield_copy_op, &ctx), 250);
+    print_result("-", "primitive", "bitfield_copy_bitwise(1997)", -1, measure(bitfield_copy_bitwise_op, &ctx), 250);
+    print_result("-", "primitive", "bitfield_pack(2000)", -1, measure(bitfield_pack_op, &ctx), 250);
+    print_result("-", "primitive", "bitfield_unpack(2000)", -1, measure(bitfield_unpack_op, &ctx), 250);
+}
+
+
+// Multi-register values, as decoded from a full read response
+
+typedef struct values_ctx {
+    uint8_t wire[248];
+    float floats[62];
+    double doubles[31];
+    nmbs_word_order order;
+} values_ctx;
+
+
+static void values_decode_float_op(void* arg) {
+    values_ctx* ctx = arg;
+    nmbs_values_decode(ctx->floats, ctx->wire, 62, sizeof(float), ctx->order);
+}
+
+
+static void values_decode_double_op(void* arg) {
+    values_ctx* ctx = arg;
+    nmbs_values_decode(ctx->doubles, ctx->wire, 31, sizeof(double), ctx->order);
+}
+
+
+static void bench_values(void) {
+    static values_ctx ctx;
+    static const char* orders[] = {"ABCD", "CDAB", "BADC", "DCBA"};
+
+    for (size_t i = 0; i < sizeof(ctx.wire); i++)
+        ctx.wire[i] = (uint8_t) i;
+
+    for (int o = 0; o < 4; o++) {
+        char name[40];
+        ctx.order = (nmbs_word_order) o;
+        snprintf(name, sizeof(name), "values_decode(62 float, %s)", orders[o]);
+        print_result("-", "primitive", name, -1, measure(values_decode_float_op, &ctx), 248);
+        snprintf(name, sizeof(name), "values_decode(31 double, %s)", orders[o]);
+        print_result("-", "primitive", name, -1, measure(values_decode_double_op, &ctx), 248);
+    }
+}
+
+
+static int bench_primitives(nmbs_transport transport, const char* transport_str) {
+    static primitive_ctx ctx;
+    memset(&ctx, 0, sizeof(primitive_ctx));
+
+    nmbs_platform_conf conf;
+    platform_conf_buffer(&conf, transport, &ctx.t);
+    nmbs_client_create(&ctx.nmbs, &conf);
+    nmbs_set_destination_rtu_address(&ctx.nmbs, 1);
+    nmbs_set_read_timeout(&ctx.nmbs, 0);
+    nmbs_set_byte_timeout(&ctx.nmbs, 0);
+    ctx.t.in_after_write = true;
+
+    for (int i = 0; i < 125; i++)
+        ctx.regs[i] = (uint16_t) (i * 0x0101);
+
+    const unsigned header_len = transport == NMBS_TRANSPORT_TCP ? 8 : 2;
+    print_result(transport_str, "primitive", "put_req_header", -1, measure(put_req_header_op, &ctx), header_len);
+    print_result(transport_str, "primitive", "put_regs(125)", -1, measure(put_regs_op, &ctx), 250);
+    print_result(transport_str, "primitive", "get_regs_in_place(125)", -1, measure(get_regs_in_place_op, &ctx), 250);
+
+    // FC 3 response with 125 registers, transaction id 1
+    nmbs_t* nmbs = &ctx.nmbs;
+    nmbs->current_tid = 0;
+    msg_state_req(nmbs, 3);
+    put_res_header(nmbs, 1 + 250);
+    put_1(nmbs, 250);
+    put_regs(nmbs, ctx.regs, 125);
+    if (transport == NMBS_TRANSPORT_RTU) {
+        const uint16_t crc = nmbs_crc_calc(nmbs->msg.buf, nmbs->msg.buf_idx, NULL);
+        put_2(nmbs, crc);
+    }
+    memcpy(ctx.t.in, nmbs->msg.buf, nmbs->msg.buf_idx);
+    ctx.t.in_len = nmbs->msg.buf_idx;
+    ctx.t.in_after_write = true;
+
+    recv_read_registers_res_op(&ctx);
+    if (ctx.err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "%s recv_read_registers_res: %s\n", transport_str, nmbs_strerror(ctx.err));
+        return -1;
+    }
+
+    print_result(transport_str, "primitive", "recv_read_registers_res(125)", -1,
+                 measure(recv_read_registers_res_op, &ctx), ctx.t.in_len);
+
+    return 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    bool tcp = true;
+    bool rtu = true;
+    bool swap = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:S")) != -1) {
+        if (opt == 't' && strcmp(optarg, "tcp") == 0)
+            rtu = false;
+        else if (opt == 't' && strcmp(optarg, "rtu") == 0)
+            tcp = false;
+        else if (opt == 'S')
+            swap = false;
+        else {
+            fprintf(stderr, "Usage: %s [-t tcp|rtu] [-S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bench_data_init();
+
+    printf("%-4s %-10s %-4s %-32s %10s %9s %8s\n", "tr", "side", "fc", "operation", "ns/op", "bytes/op", "ns/byte");
+
+    int ret = 0;
+    for (int i = 0; i < 2; i++) {
+        const nmbs_transport transport = i == 0 ? NMBS_TRANSPORT_TCP : NMBS_TRANSPORT_RTU;
+        const char* transport_str = i == 0 ? "tcp" : "rtu";
+        if ((i == 0 && !tcp) || (i == 1 && !rtu))
+            continue;
+
+        for (size_t o = 0; o < sizeof(bench_ops) / sizeof(bench_op); o++) {
+            if (bench_fc(transport, transport_str, &bench_ops[o]) != 0)
+                ret = 1;
+        }
+
+        if (bench_primitives(transport, transport_str) != 0)
+            ret = 1;
+    }
+
+    if (swap && bench_swap_regs() != 0)
+        ret = 1;
+
+    bench_bitfield();
+    bench_values();
+
+    return ret;
+}
@@ -0,0 +1,1161 @@
+/*
+ * Offline replay benchmark for the nanoMODBUS server.
+ *
+ * Reads recorded Modbus traffic and pushes every request through nmbs_server_poll() via an in-memory transport, as fast
+ * as possible. Reports requests/second, per-FC latency and the number of responses that differ from the recorded ones.
+ *
+ * Supported inputs:
+ * - pcapng and classic pcap files. Modbus/TCP is extracted from Ethernet, Linux cooked (SLL/SLL2), raw IP and BSD
+ *   loopback link types (IPv4 and IPv6). LINKTYPE_USER0 captures, such as the RTU ones written by
+ *   examples/linux/capture.h, are read as raw RTU frames.
+ * - A simple binary frame log: the 8 bytes "NMBSLOG\0", one transport byte (1 = RTU, 2 = TCP), then one record per
+ *   frame made of a flags byte (bit 0 set for responses), the frame length as little-endian uint16 and the frame bytes.
+ *
+ * The server callbacks answer with the data found in the recorded responses (values, exceptions, device identification
+ * objects), so any mismatch points at a difference in the library's parsing or encoding. Requests without a recorded
+ * response are answered from a deterministic data model and are counted as unverified.
+ *
+ * RTU traffic is replayed as seen on the bus: requests addressed to other units are fed to the server together with
+ * their recorded response, exactly as a real server on a multi-drop line would receive them.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nanomodbus.h"
+
+#define UNUSED_PARAM(x) ((x) = (x))
+
+#define MAX_ADU_SIZE 260
+#define MAX_FLOWS 1024
+#define PAIRING_WINDOW 4096
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_USER0 147
+#define LINKTYPE_LINUX_SLL2 276
+
+
+typedef struct transaction {
+    size_t req_off;
+    size_t res_off;
+    uint16_t req_len;
+    uint16_t res_len;
+    uint32_t flow;
+    bool has_res;
+} transaction;
+
+
+typedef struct flow_dir {
+    uint8_t buf[MAX_ADU_SIZE * 2];
+    uint16_t len;
+    uint32_t next_seq;
+    bool seq_valid;
+} flow_dir;
+
+
+typedef struct flow {
+    uint8_t client_addr[16];
+    uint8_t server_addr[16];
+    uint16_t client_port;
+    flow_dir to_server;
+    flow_dir to_client;
+} flow;
+
+
+typedef struct fc_stats {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t mismatches;
+} fc_stats;
+
+
+// Loaded traffic
+
+static nmbs_transport transport;
+static bool transport_known = false;
+static uint16_t server_port = 502;
+
+static uint8_t* arena = NULL;
+static size_t arena_len = 0;
+static size_t arena_cap = 0;
+
+static transaction* transactions = NULL;
+static size_t transactions_count = 0;
+static size_t transactions_cap = 0;
+
+static flow flows[MAX_FLOWS];
+static uint32_t flows_count = 0;
+
+static uint64_t frames_skipped = 0;
+static uint64_t responses_unpaired = 0;
+
+// RTU direction tracking
+static int rtu_request_dir = -1;
+
+
+static void* xrealloc(void* p, size_t size) {
+    p = realloc(p, size);
+    if (!p) {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return p;
+}
+
+
+static size_t arena_push(const uint8_t* data, uint16_t len) {
+    if (arena_len + len > arena_cap) {
+        arena_cap = arena_cap ? arena_cap * 2 : 1 << 16;
+        arena = xrealloc(arena, arena_cap);
+    }
+
+    const size_t off = arena_len;
+    memcpy(arena + off, data, len);
+    arena_len += len;
+    return off;
+}
+
+
+static uint16_t be16(const uint8_t* p) {
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+
+static uint32_t be32(const uint8_t* p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+
+static uint8_t frame_unit_id(const uint8_t* frame) {
+    return transport == NMBS_TRANSPORT_TCP ? frame[6] : frame[0];
+}
+
+
+static uint8_t frame_fc(const uint8_t* frame) {
+    return transport == NMBS_TRANSPORT_TCP ? frame[7] : frame[1];
+}
+
+
+static void add_request(const uint8_t* data, uint16_t len, uint32_t flow_id) {
+    if (transactions_count == transactions_cap) {
+        transactions_cap = transactions_cap ? transactions_cap * 2 : 1024;
+        transactions = xrealloc(transactions, transactions_cap * sizeof(transaction));
+    }
+
+    transaction* t = &transactions[transactions_count++];
+    memset(t, 0, sizeof(transaction));
+    t->req_off = arena_push(data, len);
+    t->req_len = len;
+    t->flow = flow_id;
+}
+
+
+static void add_response(const uint8_t* data, uint16_t len, uint32_t flow_id) {
+    const size_t window_end = transactions_count > PAIRING_WINDOW ? transactions_count - PAIRING_WINDOW : 0;
+
+    for (size_t i = transactions_count; i > window_end; i--) {
+        transaction* t = &transactions[i - 1];
+        if (t->flow != flow_id)
+            continue;
+
+        if (transport == NMBS_TRANSPORT_TCP) {
+            // Pair by transaction id
+            if (t->has_res || memcmp(arena + t->req_off, data, 2) != 0)
+                continue;
+        }
+        else {
+            // RTU responses always follow their request. Broadcast requests have none
+            const uint8_t req_unit_id = frame_unit_id(arena + t->req_off);
+            if (t->has_res || req_unit_id == 0 || frame_unit_id(data) != req_unit_id)
+                break;
+        }
+
+        t->res_off = arena_push(data, len);
+        t->res_len = len;
+        t->has_res = true;
+        return;
+    }
+
+    responses_unpaired++;
+}
+
+
+static bool rtu_awaiting_response(void) {
+    if (transactions_count == 0)
+        return false;
+
+    const transaction* t = &transactions[transactions_count - 1];
+    return !t->has_res && frame_unit_id(arena + t->req_off) != 0;
+}
+
+
+// dir: 0 inbound, 1 outbound, -1 unknown
+static void add_rtu_frame(const uint8_t* data, uint32_t len, int dir) {
+    if (len < 4 || len > MAX_ADU_SIZE) {
+        frames_skipped++;
+        return;
+    }
+
+    if (rtu_request_dir == -1 && dir != -1 && transactions_count == 0)
+        rtu_request_dir = dir;
+
+    bool is_request;
+    if (dir == -1 || rtu_request_dir == -1)
+        is_request = !rtu_awaiting_response();
+    else
+        is_request = dir == rtu_request_dir;
+
+    if (is_request)
+        add_request(data, (uint16_t) len, 0);
+    else
+        add_response(data, (uint16_t) len, 0);
+}
+
+
+static void add_tcp_adu(const uint8_t* data, uint16_t len, uint32_t flow_id, bool is_response) {
+    if (is_response)
+        add_response(data, len, flow_id);
+    else
+        add_request(data, len, flow_id);
+}
+
+
+// Reassemble a TCP byte stream and split it into MBAP-delimited ADUs
+static void flow_feed(flow_dir* d, uint32_t flow_id, bool is_response, uint32_t seq, const uint8_t* data, uint32_t len,
+                      bool syn) {
+    if (syn) {
+        d->next_seq = seq + 1;
+        d->seq_valid = true;
+        d->len = 0;
+        seq++;
+    }
+
+    if (len == 0)
+        return;
+
+    if (!d->seq_valid) {
+        d->next_seq = seq;
+        d->seq_valid = true;
+    }
+
+    const int32_t delta = (int32_t) (seq - d->next_seq);
+    if (delta < 0) {
+        // Retransmission, skip the part we already have
+        if ((uint32_t) -delta >= len)
+            return;
+
+        data += -delta;
+        len -= (uint32_t) -delta;
+        seq = d->next_seq;
+    }
+    else if (delta > 0) {
+        // Lost data, restart from here
+        d->len = 0;
+        frames_skipped++;
+    }
+
+    d->next_seq = seq + len;
+
+    while (len > 0) {
+        uint32_t chunk = sizeof(d->buf) - d->len;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy(d->buf + d->len, data, chunk);
+        d->len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        while (d->len >= 7) {
+            const uint16_t length = be16(d->buf + 4);
+            const uint32_t adu_len = 6 + (uint32_t) length;
+            if (length < 2 || adu_len > MAX_ADU_SIZE || be16(d->buf + 2) != 0) {
+                // Not Modbus/TCP or out of sync, drop what we have
+                d->len = 0;
+                frames_skipped++;
+                break;
+            }
+
+            if (d->len < adu_len)
+                break;
+
+            add_tcp_adu(d->buf, (uint16_t) adu_len, flow_id, is_response);
+            memmove(d->buf, d->buf + adu_len, d->len - adu_len);
+            d->len -= adu_len;
+        }
+    }
+}
+
+
+static void add_tcp_segment(const uint8_t* src_addr, const uint8_t* dst_addr, uint8_t addr_len, const uint8_t* tcp,
+                            uint32_t tcp_len) {
+    if (tcp_len < 20)
+        return;
+
+    const uint16_t src_port = be16(tcp);
+    const uint16_t dst_port = be16(tcp + 2);
+    const uint32_t seq = be32(tcp + 4);
+    const uint32_t header_len = (uint32_t) (tcp[12] >> 4) * 4;
+    const bool syn = tcp[13] & 0x02;
+    if (header_len < 20 || header_len > tcp_len)
+        return;
+
+    bool is_response;
+    if (dst_port == server_port)
+        is_response = false;
+    else if (src_port == server_port)
+        is_response = true;
+    else
+        return;
+
+    const uint8_t* client_addr = is_response ? dst_addr : src_addr;
+    const uint8_t* server_addr = is_response ? src_addr : dst_addr;
+    const uint16_t client_port = is_response ? dst_port : src_port;
+
+    uint32_t f = 0;
+    for (; f < flows_count; f++) {
+        if (flows[f].client_port == client_port && memcmp(flows[f].client_addr, client_addr, addr_len) == 0 &&
+            memcmp(flows[f].server_addr, server_addr, addr_len) == 0)
+            break;
+    }
+
+    if (f == flows_count) {
+        if (flows_count == MAX_FLOWS) {
+            frames_skipped++;
+            return;
+        }
+
+        memset(&flows[f], 0, sizeof(flow));
+        memcpy(flows[f].client_addr, client_addr, addr_len);
+        memcpy(flows[f].server_addr, server_addr, addr_len);
+        flows[f].client_port = client_port;
+        flows_count++;
+    }
+
+    flow_feed(is_response ? &flows[f].to_client : &flows[f].to_server, f, is_response, seq, tcp + header_len,
+              tcp_len - header_len, syn);
+}
+
+
+static void add_ip_packet(const uint8_t* ip, uint32_t len) {
+    if (len < 1)
+        return;
+
+    const uint8_t version = ip[0] >> 4;
+    if (version == 4) {
+        if (len < 20)
+            return;
+
+        const uint32_t ihl = (uint32_t) (ip[0] & 0x0F) * 4;
+        uint32_t total_len = be16(ip + 2);
+        if (ip[9] != 6 || ihl < 20 || total_len < ihl)
+            return;
+
+        // Ethernet padding may follow the IP packet
+        if (total_len > len)
+            total_len = len;
+
+        add_tcp_segment(ip + 12, ip + 16, 4, ip + ihl, total_len - ihl);
+    }
+    else if (version == 6) {
+        if (len < 40 || ip[6] != 6)
+            return;
+
+        uint32_t payload_len = be16(ip + 4);
+        if (payload_len > len - 40)
+            payload_len = len - 40;
+
+        add_tcp_segment(ip + 8, ip + 24, 16, ip + 40, payload_len);
+    }
+}
+
+
+static void add_ethertype_packet(uint16_t ethertype, const uint8_t* p, uint32_t len) {
+    if (ethertype == 0x0800 || ethertype == 0x86DD)
+        add_ip_packet(p, len);
+}
+
+
+static void add_packet(uint32_t linktype, const uint8_t* p, uint32_t len, int dir) {
+    switch (linktype) {
+        case LINKTYPE_USER0:
+            add_rtu_frame(p, len, dir);
+            break;
+
+        case LINKTYPE_ETHERNET: {
+            if (len < 14)
+                return;
+
+            uint32_t off = 12;
+            uint16_t ethertype = be16(p + off);
+            while ((ethertype == 0x8100 || ethertype == 0x88A8) && len >= off + 6) {
+                off += 4;
+                ethertype = be16(p + off);
+            }
+
+            add_ethertype_packet(ethertype, p + off + 2, len - off - 2);
+            break;
+        }
+
+        case LINKTYPE_LINUX_SLL:
+            if (len >= 16)
+                add_ethertype_packet(be16(p + 14), p + 16, len - 16);
+            break;
+
+        case LINKTYPE_LINUX_SLL2:
+            if (len >= 20)
+                add_ethertype_packet(be16(p), p + 20, len - 20);
+            break;
+
+        case LINKTYPE_RAW:
+            add_ip_packet(p, len);
+            break;
+
+        case LINKTYPE_NULL:
+            if (len >= 4)
+                add_ip_packet(p + 4, len - 4);
+            break;
+
+        default:
+            frames_skipped++;
+            break;
+    }
+}
+
+
+// File formats
+
+static bool swapped = false;
+
+
+static uint16_t rd16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swapped ? (uint16_t) (v >> 8 | v << 8) : v;
+}
+
+
+static uint32_t rd32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swapped ? __builtin_bswap32(v) : v;
+}
+
+
+static void set_transport_from_linktype(uint32_t linktype) {
+    if (transport_known)
+        return;
+
+    transport = linktype == LINKTYPE_USER0 ? NMBS_TRANSPORT_RTU : NMBS_TRANSPORT_TCP;
+    transport_known = true;
+}
+
+
+static int load_pcapng(const uint8_t* data, size_t size) {
+    uint32_t linktypes[64] = {0};
+    uint32_t interfaces = 0;
+    size_t off = 0;
+
+    while (off + 12 <= size) {
+        const uint8_t* b = data + off;
+        uint32_t type;
+        memcpy(&type, b, 4);
+
+        if (type == 0x0A0D0D0A) {
+            const uint32_t bom = *(const uint32_t*) (const void*) (b + 8);
+            if (bom == 0x1A2B3C4D)
+                swapped = false;
+            else if (bom == 0x4D3C2B1A)
+                swapped = true;
+            else
+                return -1;
+
+            interfaces = 0;
+        }
+        else {
+            type = rd32(b);
+        }
+
+        const uint32_t block_len = rd32(b + 4);
+        if (block_len < 12 || block_len % 4 || off + block_len > size)
+            return -1;
+
+        if (type == 0x00000001 && interfaces < 64) {
+            linktypes[interfaces] = rd16(b + 8);
+            set_transport_from_linktype(linktypes[interfaces]);
+            interfaces++;
+        }
+        else if (type == 0x00000006 && block_len >= 32) {
+            const uint32_t iface = rd32(b + 8);
+            const uint32_t caplen = rd32(b + 20);
+            if (iface >= interfaces || 28 + caplen > block_len - 4)
+                return -1;
+
+            // Look for the epb_flags option to know the direction of the packet
+            int dir = -1;
+            uint32_t opt = 28 + ((caplen + 3) & ~3U);
+            while (opt + 4 <= block_len - 4) {
+                const uint16_t code = rd16(b + opt);
+                const uint16_t len = rd16(b + opt + 2);
+                if (code == 0)
+                    break;
+
+                if (code == 2 && len == 4 && opt + 8 <= block_len - 4) {
+                    const uint32_t flags = rd32(b + opt + 4) & 0x03;
+                    if (flags == 1)
+                        dir = 0;
+                    else if (flags == 2)
+                        dir = 1;
+                }
+
+                opt += 4 + ((len + 3U) & ~3U);
+            }
+
+            add_packet(linktypes[iface], b + 28, caplen, dir);
+        }
+        else if (type == 0x00000003 && block_len >= 16 && interfaces > 0) {
+            const uint32_t caplen = block_len - 16;
+            const uint32_t orig_len = rd32(b + 8);
+            add_packet(linktypes[0], b + 12, orig_len < caplen ? orig_len : caplen, -1);
+        }
+
+        off += block_len;
+    }
+
+    return 0;
+}
+
+
+static int load_pcap(const uint8_t* data, size_t size) {
+    if (size < 24)
+        return -1;
+
+    const uint32_t magic = *(const uint32_t*) (const void*) data;
+    swapped = magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1;
+
+    const uint32_t linktype = rd32(data + 20) & 0x0FFFFFFF;
+    set_transport_from_linktype(linktype);
+
+    size_t off = 24;
+    while (off + 16 <= size) {
+        const uint32_t caplen = rd32(data + off + 8);
+        if (off + 16 + caplen > size)
+            return -1;
+
+        add_packet(linktype, data + off + 16, caplen, -1);
+        off += 16 + caplen;
+    }
+
+    return 0;
+}
+
+
+static int load_frame_log(const uint8_t* data, size_t size) {
+    if (size < 9)
+        return -1;
+
+    if (!transport_known) {
+        if (data[8] == 1)
+            transport = NMBS_TRANSPORT_RTU;
+        else if (data[8] == 2)
+            transport = NMBS_TRANSPORT_TCP;
+        else
+            return -1;
+
+        transport_known = true;
+    }
+
+    size_t off = 9;
+    while (off + 3 <= size) {
+        const bool is_response = data[off] & 0x01;
+        const uint16_t len = (uint16_t) (data[off + 1] | data[off + 2] << 8);
+        off += 3;
+        if (off + len > size)
+            return -1;
+
+        const uint8_t* frame = data + off;
+        off += len;
+
+        if (len > MAX_ADU_SIZE || len < (transport == NMBS_TRANSPORT_TCP ? 8 : 4)) {
+            frames_skipped++;
+            continue;
+        }
+
+        if (transport == NMBS_TRANSPORT_TCP)
+            add_tcp_adu(frame, len, 0, is_response);
+        else
+            add_rtu_frame(frame, len, is_response ? 1 : 0);
+    }
+
+    return 0;
+}
+
+
+static int load_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    uint8_t* data = NULL;
+    size_t size = 0;
+    size_t cap = 0;
+    while (true) {
+        if (size == cap) {
+            cap = cap ? cap * 2 : 1 << 20;
+            data = xrealloc(data, cap);
+        }
+
+        const size_t r = fread(data + size, 1, cap - size, f);
+        if (r == 0)
+            break;
+
+        size += r;
+    }
+
+    fclose(f);
+
+    int ret = -1;
+    if (size >= 4) {
+        const uint32_t magic = *(const uint32_t*) (const void*) data;
+        if (magic == 0x0A0D0D0A)
+            ret = load_pcapng(data, size);
+        else if (magic == 0xA1B2C3D4 || magic == 0xD4C3B2A1 || magic == 0xA1B23C4D || magic == 0x4D3CB2A1)
+            ret = load_pcap(data, size);
+        else if (size >= 8 && memcmp(data, "NMBSLOG\0", 8) == 0)
+            ret = load_frame_log(data, size);
+        else
+            fprintf(stderr, "Unknown file format\n");
+    }
+
+    if (ret != 0)
+        fprintf(stderr, "Error parsing %s\n", path);
+
+    free(data);
+    return ret;
+}
+
+
+// Server callbacks. They answer with the data of the recorded response PDU, if available
+
+static const uint8_t* oracle = NULL;
+static uint16_t oracle_len = 0;
+static uint16_t oracle_file_off = 0;
+
+
+static nmbs_error oracle_exception(void) {
+    if (oracle && oracle_len >= 2 && (oracle[0] & 0x80))
+        return (nmbs_error) oracle[1];
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error read_discrete(uint16_t address, uint16_t quantity, nmbs_bitfield out, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    const nmbs_error err = oracle_exception();
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    uint16_t bytes = (uint16_t) ((quantity + 7) / 8);
+    if (oracle && oracle_len >= 2) {
+        if (bytes > oracle[1])
+            bytes = oracle[1];
+        if (bytes > oracle_len - 2)
+            bytes = (uint16_t) (oracle_len - 2);
+
+        memcpy(out, oracle + 2, bytes);
+        return NMBS_ERROR_NONE;
+    }
+
+    for (uint16_t i = 0; i < quantity; i++)
+        nmbs_bitfield_write(out, i, (address + i) & 1);
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error read_registers(uint16_t address, uint16_t quantity, uint16_t* registers_out, uint8_t unit_id,
+                                 void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    const nmbs_error err = oracle_exception();
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (oracle && oracle_len >= 2) {
+        for (uint16_t i = 0; i < quantity && i < oracle[1] / 2 && 2 + i * 2 + 1 < oracle_len; i++)
+            registers_out[i] = be16(oracle + 2 + i * 2);
+
+        return NMBS_ERROR_NONE;
+    }
+
+    for (uint16_t i = 0; i < quantity; i++)
+        registers_out[i] = (uint16_t) (address + i);
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error write_single_coil(uint16_t address, bool value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(address);
+    UNUSED_PARAM(value);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    return oracle_exception();
+}
+
+
+static nmbs_error write_single_register(uint16_t address, uint16_t value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(address);
+    UNUSED_PARAM(value);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    return oracle_exception();
+}
+
+
+static nmbs_error write_multiple_coils(uint16_t address, uint16_t quantity, const nmbs_bitfield coils, uint8_t unit_id,
+                                       void* arg) {
+    UNUSED_PARAM(address);
+    UNUSED_PARAM(quantity);
+    UNUSED_PARAM(coils);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    return oracle_exception();
+}
+
+
+static nmbs_error write_multiple_registers(uint16_t address, uint16_t quantity, const uint16_t* registers,
+                                           uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(address);
+    UNUSED_PARAM(quantity);
+    UNUSED_PARAM(registers);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    return oracle_exception();
+}
+
+
+static nmbs_error read_file_record(uint16_t file_number, uint16_t record_number, uint16_t* registers, uint16_t count,
+                                   uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    const nmbs_error err = oracle_exception();
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (oracle && oracle_len >= 2) {
+        // Sub-responses are laid out as [length][reference type][data], in request order
+        if (oracle_file_off + 2 > oracle_len)
+            return NMBS_ERROR_NONE;
+
+        const uint8_t sub_len = oracle[oracle_file_off];
+        const uint8_t* sub_data = oracle + oracle_file_off + 2;
+        for (uint16_t i = 0; i < count && i < (sub_len - 1) / 2 && oracle_file_off + 2 + i * 2 + 1 < oracle_len; i++)
+            registers[i] = be16(sub_data + i * 2);
+
+        oracle_file_off = (uint16_t) (oracle_file_off + 1 + sub_len);
+        return NMBS_ERROR_NONE;
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+        registers[i] = (uint16_t) (file_number + record_number + i);
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error write_file_record(uint16_t file_number, uint16_t record_number, const uint16_t* registers,
+                                    uint16_t count, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(file_number);
+    UNUSED_PARAM(record_number);
+    UNUSED_PARAM(registers);
+    UNUSED_PARAM(count);
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    return oracle_exception();
+}
+
+
+// Find a device identification object in the recorded response
+static const uint8_t* oracle_device_id_object(uint8_t object_id, uint8_t* len_out) {
+    if (!oracle || oracle_len < 7 || oracle[0] != 0x2B)
+        return NULL;
+
+    uint16_t off = 7;
+    for (uint8_t i = 0; i < oracle[6] && off + 2 <= oracle_len; i++) {
+        const uint8_t id = oracle[off];
+        const uint8_t len = oracle[off + 1];
+        if (off + 2 + len > oracle_len)
+            return NULL;
+
+        if (id == object_id) {
+            *len_out = len;
+            return oracle + off + 2;
+        }
+
+        off = (uint16_t) (off + 2 + len);
+    }
+
+    return NULL;
+}
+
+
+static nmbs_error read_device_identification_map(nmbs_bitfield_256 map) {
+    const nmbs_error err = oracle_exception();
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (oracle && oracle_len >= 7 && oracle[0] == 0x2B) {
+        for (uint16_t id = 0; id < 256; id++) {
+            uint8_t len;
+            if (oracle_device_id_object((uint8_t) id, &len))
+                nmbs_bitfield_set(map, id);
+        }
+
+        // Objects left out of the recorded response because of its size
+        if (oracle[4] == 0xFF)
+            for (uint16_t id = oracle[5]; id < 256; id++)
+                nmbs_bitfield_set(map, id);
+
+        return NMBS_ERROR_NONE;
+    }
+
+    nmbs_bitfield_set(map, 0x00);
+    nmbs_bitfield_set(map, 0x01);
+    nmbs_bitfield_set(map, 0x02);
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error read_device_identification(uint8_t object_id, char buffer[NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH]) {
+    uint8_t len = 0;
+    const uint8_t* obj = oracle_device_id_object(object_id, &len);
+    if (obj) {
+        if (len >= NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH)
+            len = NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH - 1;
+
+        memcpy(buffer, obj, len);
+        buffer[len] = 0;
+        return NMBS_ERROR_NONE;
+    }
+
+    // Filler long enough to make responses split like the recorded ones
+    memset(buffer, 'x', 90);
+    buffer[90] = 0;
+    if (object_id <= 0x02)
+        strcpy(buffer, "nanoMODBUS");
+
+    return NMBS_ERROR_NONE;
+}
+
+
+// In-memory transport. The request (and, for requests addressed to other RTU units, the recorded response) is read
+// from memory, the response is written to memory
+
+typedef struct replay_io {
+    const uint8_t* seg[2];
+    uint16_t seg_len[2];
+    uint8_t seg_idx;
+    uint16_t pos;
+
+    uint8_t out[MAX_ADU_SIZE * 2];
+    uint16_t out_len;
+} replay_io;
+
+
+static int32_t read_mem(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    replay_io* io = arg;
+
+    uint16_t total = 0;
+    while (total < count && io->seg_idx < 2) {
+        const uint16_t left = (uint16_t) (io->seg_len[io->seg_idx] - io->pos);
+        if (left == 0) {
+            io->seg_idx++;
+            io->pos = 0;
+            continue;
+        }
+
+        const uint16_t n = (uint16_t) (count - total) < left ? (uint16_t) (count - total) : left;
+        memcpy(buf + total, io->seg[io->seg_idx] + io->pos, n);
+        io->pos = (uint16_t) (io->pos + n);
+        total = (uint16_t) (total + n);
+    }
+
+    return total;
+}
+
+
+static int32_t write_mem(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    UNUSED_PARAM(byte_timeout_ms);
+    replay_io* io = arg;
+
+    if (io->out_len + count > sizeof(io->out))
+        return -1;
+
+    memcpy(io->out + io->out_len, buf, count);
+    io->out_len = (uint16_t) (io->out_len + count);
+    return count;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+static void print_hex(const char* label, const uint8_t* data, uint16_t len) {
+    fprintf(stderr, "  %s:", label);
+    for (uint16_t i = 0; i < len; i++)
+        fprintf(stderr, " %02X", data[i]);
+    fprintf(stderr, "\n");
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options] capture\n"
+            "  -t rtu|tcp   transport, overrides the one detected from the capture\n"
+            "  -u unit_id   RTU address of the replayed server (default: unit id of the first request)\n"
+            "  -p port      Modbus/TCP server port in the capture (default: 502)\n"
+            "  -n count     number of times the whole capture is replayed (default: 1)\n"
+            "  -v           print mismatching responses\n",
+            name);
+}
+
+
+int main(int argc, char* argv[]) {
+    int unit_id = -1;
+    unsigned long repetitions = 1;
+    bool verbose = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:u:p:n:v")) != -1) {
+        switch (opt) {
+            case 't':
+                if (strcmp(optarg, "rtu") == 0)
+                    transport = NMBS_TRANSPORT_RTU;
+                else if (strcmp(optarg, "tcp") == 0)
+                    transport = NMBS_TRANSPORT_TCP;
+                else {
+                    usage(argv[0]);
+                    return 1;
+                }
+                transport_known = true;
+                break;
+            case 'u':
+                unit_id = atoi(optarg);
+                break;
+            case 'p':
+                server_port = (uint16_t) atoi(optarg);
+                break;
+            case 'n':
+                repetitions = strtoul(optarg, NULL, 10);
+                break;
+            case 'v':
+                verbose = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (load_file(argv[optind]) != 0)
+        return 1;
+
+    if (transactions_count == 0) {
+        fprintf(stderr, "No Modbus requests found\n");
+        return 1;
+    }
+
+    if (unit_id < 0) {
+        unit_id = 1;
+        for (size_t i = 0; i < transactions_count; i++) {
+            const uint8_t id = frame_unit_id(arena + transactions[i].req_off);
+            if (id != 0) {
+                unit_id = id;
+                break;
+            }
+        }
+    }
+
+    replay_io io;
+    memset(&io, 0, sizeof(replay_io));
+
+    nmbs_platform_conf platform_conf;
+    nmbs_platform_conf_create(&platform_conf);
+    platform_conf.transport = transport;
+    platform_conf.read = read_mem;
+    platform_conf.write = write_mem;
+    platform_conf.arg = &io;
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_coils = read_discrete;
+    callbacks.read_discrete_inputs = read_discrete;
+    callbacks.read_holding_registers = read_registers;
+    callbacks.read_input_registers = read_registers;
+    callbacks.write_single_coil = write_single_coil;
+    callbacks.write_single_register = write_single_register;
+    callbacks.write_multiple_coils = write_multiple_coils;
+    callbacks.write_multiple_registers = write_multiple_registers;
+    callbacks.read_file_record = read_file_record;
+    callbacks.write_file_record = write_file_record;
+    callbacks.read_device_identification = read_device_identification;
+    callbacks.read_device_identification_map = read_device_identification_map;
+
+    nmbs_t nmbs;
+    nmbs_error err = nmbs_server_create(&nmbs, (uint8_t) unit_id, &platform_conf, &callbacks);
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&nmbs, 0);
+    nmbs_set_byte_timeout(&nmbs, 0);
+
+    static fc_stats stats[256];
+    for (int i = 0; i < 256; i++)
+        stats[i].min_ns = UINT64_MAX;
+
+    uint64_t requests = 0;
+    uint64_t mismatches = 0;
+    uint64_t unverified = 0;
+    uint64_t poll_errors = 0;
+    uint64_t other_units = 0;
+
+    const uint16_t pdu_offset = transport == NMBS_TRANSPORT_TCP ? 7 : 1;
+    const uint16_t footer_len = transport == NMBS_TRANSPORT_TCP ? 0 : 2;
+
+    const uint64_t start = now_ns();
+
+    for (unsigned long rep = 0; rep < repetitions; rep++) {
+        for (size_t i = 0; i < transactions_count; i++) {
+            const transaction* t = &transactions[i];
+            const uint8_t* req = arena + t->req_off;
+            const uint8_t* res = t->has_res ? arena + t->res_off : NULL;
+            const uint8_t req_unit_id = frame_unit_id(req);
+            const uint8_t fc = frame_fc(req);
+
+            const bool for_us = transport == NMBS_TRANSPORT_TCP || req_unit_id == unit_id || req_unit_id == 0;
+            const bool expect_response = for_us && (transport == NMBS_TRANSPORT_TCP || req_unit_id != 0);
+
+            io.seg[0] = req;
+            io.seg_len[0] = t->req_len;
+            io.seg[1] = res;
+            io.seg_len[1] = (!for_us && res) ? t->res_len : 0;
+            io.seg_idx = 0;
+            io.pos = 0;
+            io.out_len = 0;
+
+            if (res && t->res_len >= pdu_offset + footer_len + 2) {
+                oracle = res + pdu_offset;
+                oracle_len = (uint16_t) (t->res_len - pdu_offset - footer_len);
+            }
+            else {
+                oracle = NULL;
+                oracle_len = 0;
+            }
+            oracle_file_off = 2;
+
+            const uint64_t req_start = now_ns();
+            err = nmbs_server_poll(&nmbs);
+            const uint64_t elapsed = now_ns() - req_start;
+
+            requests++;
+
+            if (!for_us) {
+                other_units++;
+                if (err != NMBS_ERROR_NONE && !(err == NMBS_ERROR_TIMEOUT && !res))
+                    poll_errors++;
+                continue;
+            }
+
+            fc_stats* s = &stats[fc];
+            s->count++;
+            s->total_ns += elapsed;
+            if (elapsed < s->min_ns)
+                s->min_ns = elapsed;
+            if (elapsed > s->max_ns)
+                s->max_ns = elapsed;
+
+            if (err != NMBS_ERROR_NONE)
+                poll_errors++;
+
+            if (expect_response && !res) {
+                unverified++;
+                continue;
+            }
+
+            const uint16_t expected_len = expect_response ? t->res_len : 0;
+            if (io.out_len != expected_len || memcmp(io.out, res, expected_len) != 0) {
+                mismatches++;
+                s->mismatches++;
+
+                if (verbose && rep == 0) {
+                    fprintf(stderr, "Mismatch on request %zu (FC %d):\n", i, fc);
+                    print_hex("request ", req, t->req_len);
+                    if (expect_response)
+                        print_hex("recorded", res, t->res_len);
+                    print_hex("replayed", io.out, io.out_len);
+                }
+            }
+        }
+    }
+
+    const uint64_t total_ns = now_ns() - start;
+
+    printf("Transport:        %s\n", transport == NMBS_TRANSPORT_TCP ? "TCP" : "RTU");
+    if (transport == NMBS_TRANSPORT_RTU)
+        printf("Server unit id:   %d\n", unit_id);
+    printf("Transactions:     %zu (%llu unpaired responses, %llu frames skipped)\n", transactions_count,
+           (unsigned long long) responses_unpaired, (unsigned long long) frames_skipped);
+    printf("Requests:         %llu in %.3f ms\n", (unsigned long long) requests, (double) total_ns / 1e6);
+    printf("Throughput:       %.0f req/s\n", total_ns ? (double) requests * 1e9 / (double) total_ns : 0.0);
+    if (other_units)
+        printf("Other units:      %llu\n", (unsigned long long) other_units);
+    printf("Mismatches:       %llu\n", (unsigned long long) mismatches);
+    printf("Unverified:       %llu\n", (unsigned long long) unverified);
+    printf("Poll errors:      %llu\n", (unsigned long long) poll_errors);
+
+    printf("\n  FC      count    avg ns    min ns    max ns  mismatches\n");
+    for (int fc = 0; fc < 256; fc++) {
+        const fc_stats* s = &stats[fc];
+        if (!s->count)
+            continue;
+
+        printf("%4d %10llu %9llu %9llu %9llu %11llu\n", fc, (unsigned long long) s->count,
+               (unsigned long long) (s->total_ns / s->count), (unsigned long long) s->min_ns,
+               (unsigned long long) s->max_ns, (unsigned long long) s->mismatches);
+    }
+
+    free(transactions);
+    free(arena);
+
+    return mismatches ? 2 : 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * RTU bus capacity benchmark for the inter-frame timing of nmbs_set_rtu_timing().
+ *
+ * A client and a server exchange Read Holding Registers requests over a simulated half-duplex bus, a pseudo-terminal
+ * pair whose writes are delayed by the time their characters take on the wire at 9600..115200 baud. Each baud rate is
+ * run twice:
+ * - fixed: the platform write function sleeps a fixed delay before every frame (-d, 5 ms by default), the usual way
+ *   of keeping the inter-frame silence in platform code
+ * - exact: the library waits for exactly t3.5 of silence since the last byte on the bus
+ * Results are reported as transactions per second, next to the limit set by the wire time and two t3.5 silences per
+ * transaction, and as the average turnaround, from the last byte on the bus to the start of the next frame.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "nanomodbus.h"
+#include "serial.h"
+
+#define SERVER_ADDR_RTU 1
+#define REGISTERS 10
+
+// Request and response sizes of Read Holding Registers, in characters
+#define TRANSACTION_CHARS (8 + 5 + REGISTERS * 2)
+
+
+static const uint32_t bauds[] = {9600, 19200, 38400, 57600, 115200};
+
+static bool fixed;
+static uint32_t fixed_delay_us = 5000;
+static volatile bool server_stop;
+
+
+static void sleep_until(const struct timespec* ts) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) != 0)
+        ;
+}
+
+
+static void sleep_us(uint32_t us) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += (long) us * 1000;
+    while (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    sleep_until(&ts);
+}
+
+
+// Delivers the frame once its characters have been on the wire, after the fixed delay in fixed mode
+static int32_t bus_write(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const serial_port* p = (const serial_port*) arg;
+    if (fixed)
+        sleep_us(fixed_delay_us);
+
+    sleep_us(p->char_time_us * count);
+    return serial_write(buf, count, timeout_ms, arg);
+}
+
+
+static void* server_thread(void* arg) {
+    nmbs_t* server = (nmbs_t*) arg;
+    while (!server_stop)
+        nmbs_server_poll(server);
+
+    return NULL;
+}
+
+
+static int bench_baud(uint32_t baud, unsigned long iterations) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "Unable to open a pty pair\n");
+        return 1;
+    }
+
+    // Pseudo-terminals refuse parity on both ends
+    serial_port server_port;
+    serial_port client_port;
+    if (serial_configure(&server_port, master, baud, 'N') != 0 ||
+        serial_open(&client_port, ptsname(master), baud, 'N') != 0) {
+        fprintf(stderr, "Unable to configure the pty pair\n");
+        close(master);
+        return 1;
+    }
+
+    nmbs_platform_conf conf;
+    serial_platform_conf(&server_port, &conf);
+    conf.write = bus_write;
+
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    nmbs_t server;
+    nmbs_server_create(&server, SERVER_ADDR_RTU, &conf, &callbacks);
+    nmbs_set_read_timeout(&server, 100);
+    nmbs_set_byte_timeout(&server, serial_frame_timeout_ms(&server_port));
+
+    serial_platform_conf(&client_port, &conf);
+    conf.write = bus_write;
+
+    nmbs_t client;
+    nmbs_client_create(&client, &conf);
+    nmbs_set_destination_rtu_address(&client, SERVER_ADDR_RTU);
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, serial_frame_timeout_ms(&client_port));
+
+    nmbs_rtu_timing client_timing;
+    nmbs_rtu_timing server_timing;
+    if (!fixed) {
+        nmbs_rtu_timing_init(&server_timing, baud, NULL);
+        nmbs_rtu_timing_init(&client_timing, baud, NULL);
+        nmbs_set_rtu_timing(&server, &server_timing);
+        nmbs_set_rtu_timing(&client, &client_timing);
+    }
+
+    server_stop = false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, &server);
+
+    uint16_t regs[REGISTERS];
+    unsigned long errors = 0;
+    const uint64_t start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        if (nmbs_read_holding_registers(&client, 0, REGISTERS, regs) != NMBS_ERROR_NONE)
+            errors++;
+    }
+    const double elapsed_s = (double) (now_ns() - start) / 1e9;
+
+    server_stop = true;
+    pthread_join(thread, NULL);
+
+    // In fixed mode the library keeps no silence of its own, the turnaround is the fixed delay
+    double turnaround_us = fixed_delay_us;
+    if (!fixed) {
+        // The first request follows no bus activity
+        const uint32_t frames = client_timing.frames - 1 + server_timing.frames;
+        turnaround_us = (double) (client_timing.turnaround_us + server_timing.turnaround_us) / (frames ? frames : 1);
+    }
+
+    const double t35_us = baud > 19200 ? 1750.0 : 38.5e6 / baud;
+    const double wire_us = (double) TRANSACTION_CHARS * client_port.char_time_us;
+    const double limit = 1e6 / (wire_us + 2 * t35_us);
+
+    printf("%6u baud %-6s %8.1f transactions/s  (limit %8.1f)  turnaround %7.0f us  t3.5 %5.0f us  %lu errors\n", baud,
+           fixed ? "fixed" : "exact", (double) iterations / elapsed_s, limit, turnaround_us, t35_us, errors);
+
+    serial_close(&client_port);
+    serial_close(&server_port);
+    return errors ? 1 : 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    unsigned long iterations = 200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                fixed_delay_us = (uint32_t) strtoul(optarg, NULL, 10) * 1000;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-d fixed delay ms]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (iterations == 0)
+        iterations = 1;
+
+    bench_data_init();
+
+    int ret = 0;
+    for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        fixed = true;
+        ret |= bench_baud(bauds[b], iterations);
+        fixed = false;
+        ret |= bench_baud(bauds[b], iterations);
+    }
+
+    return ret;
+}
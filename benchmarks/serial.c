@@ -0,0 +1,214 @@
+/*
+ * RTU latency benchmark for the Linux serial platform of examples/linux/serial.h.
+ *
+ * A client and a server exchange Read Holding Registers requests over a pseudo-terminal pair. Pseudo-terminals have no
+ * baud rate, so writes are paced to emulate the wire at 9600..115200 baud, and delivered in bursts of up to -f
+ * characters, like a UART with a receive FIFO would (8 by default, the usual 16550A trigger level). Each baud rate is
+ * run with the chunked reads of serial.h and with one poll() and one 1-byte read() per byte, like the functions of
+ * examples/linux/platform.h. Results are reported as round-trip latency percentiles, the overhead over the time the
+ * frames take on the wire, and read() calls per transaction.
+ *
+ * The byte timeout is t3.5 plus the time a FIFO burst takes on the wire, the silence a reader sees between bursts.
+ */
+
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "nanomodbus.h"
+#include "serial.h"
+
+#define SERVER_ADDR_RTU 1
+#define REGISTERS 10
+
+// Request and response sizes of Read Holding Registers, in characters
+#define TRANSACTION_CHARS (8 + 5 + REGISTERS * 2)
+
+
+static const uint32_t bauds[] = {9600, 19200, 38400, 57600, 115200};
+
+static bool bytewise;
+static uint16_t fifo_chars = 8;
+static volatile bool server_stop;
+
+
+static void sleep_until(const struct timespec* ts) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, ts, NULL) != 0)
+        ;
+}
+
+
+// Writes the characters in bursts of fifo_chars, each one once its characters have been on the wire
+static int32_t paced_write(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const serial_port* p = (const serial_port*) arg;
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint16_t i = 0; i < count; i += fifo_chars) {
+        const uint16_t burst = (uint16_t) (count - i < fifo_chars ? count - i : fifo_chars);
+        next.tv_nsec += (long) p->char_time_us * 1000 * burst;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+
+        sleep_until(&next);
+        if (serial_write(buf + i, burst, timeout_ms, arg) != burst)
+            return i;
+    }
+
+    return count;
+}
+
+
+static int32_t bytewise_read(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    for (uint16_t i = 0; i < count; i++) {
+        const int32_t ret = serial_read(buf + i, 1, timeout_ms, arg);
+        if (ret <= 0)
+            return ret < 0 ? ret : i;
+    }
+
+    return count;
+}
+
+
+static int32_t bench_read(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    return bytewise ? bytewise_read(buf, count, timeout_ms, arg) : serial_read(buf, count, timeout_ms, arg);
+}
+
+
+static void* server_thread(void* arg) {
+    nmbs_t* server = (nmbs_t*) arg;
+    while (!server_stop)
+        nmbs_server_poll(server);
+
+    return NULL;
+}
+
+
+static int compare_u64(const void* a, const void* b) {
+    const uint64_t x = *(const uint64_t*) a;
+    const uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+static int bench_baud(uint32_t baud, unsigned long iterations) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "Unable to open a pty pair\n");
+        return 1;
+    }
+
+    // Pseudo-terminals refuse parity on both ends
+    serial_port server_port;
+    serial_port client_port;
+    if (serial_configure(&server_port, master, baud, 'N') != 0 ||
+        serial_open(&client_port, ptsname(master), baud, 'N') != 0) {
+        fprintf(stderr, "Unable to configure the pty pair\n");
+        close(master);
+        return 1;
+    }
+
+    nmbs_platform_conf conf;
+    serial_platform_conf(&server_port, &conf);
+    conf.read = bench_read;
+    conf.write = paced_write;
+
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    nmbs_t server;
+    nmbs_server_create(&server, SERVER_ADDR_RTU, &conf, &callbacks);
+    nmbs_set_read_timeout(&server, 100);
+    const int32_t byte_timeout_ms =
+            serial_frame_timeout_ms(&server_port) + (int32_t) ((fifo_chars * server_port.char_time_us + 999) / 1000);
+    nmbs_set_byte_timeout(&server, byte_timeout_ms);
+
+    serial_platform_conf(&client_port, &conf);
+    conf.read = bench_read;
+    conf.write = paced_write;
+
+    nmbs_t client;
+    nmbs_client_create(&client, &conf);
+    nmbs_set_destination_rtu_address(&client, SERVER_ADDR_RTU);
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, byte_timeout_ms);
+
+    server_stop = false;
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_thread, &server);
+
+    uint64_t* samples = malloc(iterations * sizeof(uint64_t));
+    uint16_t regs[REGISTERS];
+    unsigned long errors = 0;
+    const uint64_t reads = server_port.rx_calls + client_port.rx_calls;
+    for (unsigned long i = 0; i < iterations; i++) {
+        const uint64_t start = now_ns();
+        if (nmbs_read_holding_registers(&client, 0, REGISTERS, regs) != NMBS_ERROR_NONE)
+            errors++;
+        samples[i] = now_ns() - start;
+    }
+
+    const double reads_per_transaction =
+            (double) (server_port.rx_calls + client_port.rx_calls - reads) / (double) iterations;
+
+    server_stop = true;
+    pthread_join(thread, NULL);
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    const double p50 = (double) samples[iterations / 2] / 1000.0;
+    const double p99 = (double) samples[iterations * 99 / 100] / 1000.0;
+    const double wire = (double) TRANSACTION_CHARS * client_port.char_time_us;
+    printf("%6u baud %-8s p50 %8.0f us  p99 %8.0f us  overhead %6.0f us  %5.1f reads/transaction  %lu errors\n",
+           baud, bytewise ? "bytewise" : "chunked", p50, p99, p50 - wire, reads_per_transaction, errors);
+
+    free(samples);
+    serial_close(&client_port);
+    serial_close(&server_port);
+    return errors ? 1 : 0;
+}
+
+
+int main(int argc, char* argv[]) {
+    unsigned long iterations = 100;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = strtoul(optarg, NULL, 10);
+                break;
+            case 'f':
+                fifo_chars = (uint16_t) atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n iterations] [-f FIFO characters]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (iterations == 0)
+        iterations = 1;
+
+    if (fifo_chars == 0)
+        fifo_chars = 1;
+
+    bench_data_init();
+
+    int ret = 0;
+    for (size_t b = 0; b < sizeof(bauds) / sizeof(bauds[0]); b++) {
+        bytewise = false;
+        ret |= bench_baud(bauds[b], iterations);
+        bytewise = true;
+        ret |= bench_baud(bauds[b], iterations);
+    }
+
+    return ret;
+}
@@ -0,0 +1,610 @@
+/*
+ * TCP server benchmark for nanoMODBUS on Linux, comparing the ways a server can wait for and read its requests:
+ * - "select": select() over all the connections, then one select() and one 1-byte read() per received byte, like the
+ *   functions of examples/linux/platform.h.
+ * - "epoll": level-triggered epoll_wait() over all the connections, then reads of the size requested by the library.
+ * - "pipelined": server_poll_pipelined() of examples/linux/platform.h, serving every request received on a connection
+ *   and sending all of the responses at once.
+ * - "uring": the io_uring transport of examples/linux/uring_transport.h.
+ *
+ * The load is generated locally by client threads, each with a connection of its own, sending Read Holding Registers
+ * requests back to back, through blocking sockets or, with -u, through io_uring clients. With -p, clients pipeline
+ * their requests instead, sending that many at once before reading the responses. Results are reported in
+ * requests/second and server system calls/request, which are not counted for the pipelined server.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench_common.h"
+#include "nanomodbus.h"
+#include "platform.h"
+#include "uring_transport.h"
+
+#define CLIENTS_MAX 64
+
+
+static volatile bool server_stop;
+static uint64_t server_syscalls;
+
+
+// Blocking file descriptor transport, used by the load generator and by the epoll server
+
+static int32_t read_fd(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+        const int ret = poll(&pfd, 1, timeout_ms);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        const ssize_t r = read(fd, buf + total, count - total);
+        if (r <= 0)
+            return -1;
+
+        total = (uint16_t) (total + r);
+    }
+
+    return total;
+}
+
+
+static int32_t write_fd(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    UNUSED_PARAM(timeout_ms);
+    const int fd = *(int*) arg;
+    const ssize_t w = send(fd, buf, count, MSG_NOSIGNAL);
+    return w < 0 ? -1 : (int32_t) w;
+}
+
+
+// The epoll server counts its system calls, the data is already there when it polls the instance
+
+static int32_t read_fd_counted(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        const ssize_t r = recv(fd, buf + total, count - total, MSG_DONTWAIT);
+        server_syscalls++;
+        if (r > 0) {
+            total = (uint16_t) (total + r);
+            continue;
+        }
+
+        if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return -1;
+
+        struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+        server_syscalls++;
+        if (poll(&pfd, 1, timeout_ms) <= 0)
+            return total;
+    }
+
+    return total;
+}
+
+
+static int32_t write_fd_counted(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    server_syscalls++;
+    return write_fd(buf, count, timeout_ms, arg);
+}
+
+
+// Same as read_fd_linux() and write_fd_linux() of examples/linux/platform.h
+
+static int32_t read_fd_select(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(fd, &rfds);
+
+        struct timeval tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+        server_syscalls++;
+        const int ret = select(fd + 1, &rfds, NULL, NULL, timeout_ms < 0 ? NULL : &tv);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0)
+            return -1;
+
+        server_syscalls++;
+        const ssize_t r = read(fd, buf + total, 1);
+        if (r <= 0)
+            return -1;
+
+        total++;
+    }
+
+    return total;
+}
+
+
+static int32_t write_fd_select(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    const int fd = *(int*) arg;
+
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(fd, &wfds);
+
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+    server_syscalls += 2;
+    if (select(fd + 1, NULL, &wfds, NULL, timeout_ms < 0 ? NULL : &tv) <= 0)
+        return -1;
+
+    const ssize_t w = send(fd, buf, count, MSG_NOSIGNAL);
+    return w < 0 ? -1 : (int32_t) w;
+}
+
+
+static int create_listener(struct sockaddr_in* addr) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(struct sockaddr_in);
+    if (bind(fd, (struct sockaddr*) addr, len) != 0 || listen(fd, CLIENTS_MAX) != 0 ||
+        getsockname(fd, (struct sockaddr*) addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static int accept_nodelay(int listen_fd) {
+    const int fd = accept(listen_fd, NULL, NULL);
+    if (fd >= 0) {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    return fd;
+}
+
+
+// Servers
+
+typedef struct server_args {
+    int listen_fd;
+    int clients;
+} server_args;
+
+
+static int server_create(nmbs_t* server, int32_t (*read)(uint8_t*, uint16_t, int32_t, void*),
+                         int32_t (*write)(const uint8_t*, uint16_t, int32_t, void*)) {
+    nmbs_platform_conf conf;
+    nmbs_platform_conf_create(&conf);
+    conf.transport = NMBS_TRANSPORT_TCP;
+    conf.read = read;
+    conf.write = write;
+
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    if (nmbs_server_create(server, 0, &conf, &callbacks) != NMBS_ERROR_NONE)
+        return -1;
+
+    nmbs_set_read_timeout(server, 1000);
+    nmbs_set_byte_timeout(server, 100);
+    return 0;
+}
+
+
+static void* run_select_server(void* arg) {
+    const server_args* args = (const server_args*) arg;
+    int fds[CLIENTS_MAX];
+    for (int i = 0; i < args->clients; i++)
+        fds[i] = accept_nodelay(args->listen_fd);
+
+    nmbs_t server;
+    if (server_create(&server, read_fd_select, write_fd_select) != 0)
+        return NULL;
+
+    while (!server_stop) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        int max_fd = -1;
+        for (int i = 0; i < args->clients; i++) {
+            if (fds[i] >= 0) {
+                FD_SET(fds[i], &rfds);
+                if (fds[i] > max_fd)
+                    max_fd = fds[i];
+            }
+        }
+
+        struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+        server_syscalls++;
+        if (select(max_fd + 1, &rfds, NULL, NULL, &tv) <= 0)
+            continue;
+
+        for (int i = 0; i < args->clients; i++) {
+            if (fds[i] >= 0 && FD_ISSET(fds[i], &rfds)) {
+                nmbs_set_platform_arg(&server, &fds[i]);
+                if (nmbs_server_poll(&server) != NMBS_ERROR_NONE) {
+                    close(fds[i]);
+                    fds[i] = -1;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < args->clients; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+
+    return NULL;
+}
+
+
+static void* run_epoll_server(void* arg) {
+    const server_args* args = (const server_args*) arg;
+    int fds[CLIENTS_MAX];
+    const int epfd = epoll_create1(0);
+    for (int i = 0; i < args->clients; i++) {
+        fds[i] = accept_nodelay(args->listen_fd);
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t) i};
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev);
+    }
+
+    nmbs_t server;
+    if (server_create(&server, read_fd_counted, write_fd_counted) != 0)
+        return NULL;
+
+    while (!server_stop) {
+        struct epoll_event events[CLIENTS_MAX];
+        server_syscalls++;
+        const int n = epoll_wait(epfd, events, CLIENTS_MAX, 100);
+        for (int e = 0; e < n; e++) {
+            const int i = (int) events[e].data.u32;
+            nmbs_set_platform_arg(&server, &fds[i]);
+            if (nmbs_server_poll(&server) != NMBS_ERROR_NONE) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, fds[i], NULL);
+                close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < args->clients; i++)
+        if (fds[i] >= 0)
+            close(fds[i]);
+
+    close(epfd);
+    return NULL;
+}
+
+
+static uring_loop loop;
+
+
+static void* run_uring_server(void* arg) {
+    const server_args* args = (const server_args*) arg;
+    uring_server_listen(&loop, args->listen_fd);
+
+    nmbs_platform_conf conf;
+    uring_platform_conf(&loop, &conf);
+
+    nmbs_callbacks callbacks;
+    bench_callbacks_init(&callbacks);
+
+    nmbs_t server;
+    if (nmbs_server_create(&server, 0, &conf, &callbacks) != NMBS_ERROR_NONE)
+        return NULL;
+
+    nmbs_set_byte_timeout(&server, 100);
+
+    while (!server_stop)
+        if (uring_server_run(&loop, &server, 100) != 0)
+            break;
+
+    return NULL;
+}
+
+
+static void* run_pipelined_server(void* arg) {
+    const server_args* args = (const server_args*) arg;
+
+    // The connections are accepted here, to keep platform.h quiet
+    server_fd = args->listen_fd;
+    FD_ZERO(&client_connections);
+    for (int i = 0; i < args->clients; i++) {
+        const int fd = accept_nodelay(args->listen_fd);
+        if (fd >= 0)
+            FD_SET(fd, &client_connections);
+    }
+
+    nmbs_t server;
+    if (server_create(&server, read_conn_buffered, write_conn_buffered) != 0)
+        return NULL;
+
+    while (!server_stop)
+        server_poll_pipelined(&server, 100);
+
+    for (int fd = 0; fd < FD_SETSIZE; fd++) {
+        if (FD_ISSET(fd, &client_connections)) {
+            FD_CLR(fd, &client_connections);
+            close(fd);
+            free(tcp_conns[fd]);
+            tcp_conns[fd] = NULL;
+        }
+    }
+
+    return NULL;
+}
+
+
+// Load generator
+
+typedef struct client_args {
+    struct sockaddr_in addr;
+    unsigned long requests;
+    unsigned int depth;
+    bool uring;
+    int fd;
+    int result;
+} client_args;
+
+
+// Sends depth requests at once, then reads their responses
+static int run_pipelined_requests(int fd, unsigned long requests, unsigned int depth) {
+    uint8_t reqs[64 * 12];
+    uint8_t res[64 * 29];
+
+    for (unsigned long i = 0; i < requests; i += depth) {
+        const unsigned int n = requests - i < depth ? (unsigned int) (requests - i) : depth;
+        for (unsigned int r = 0; r < n; r++) {
+            const uint8_t req[] = {(uint8_t) (r >> 8), (uint8_t) r, 0, 0, 0, 6, 0xFF, 3, 0, (uint8_t) r, 0, 10};
+            memcpy(reqs + r * 12, req, sizeof(req));
+        }
+
+        if (write_fd(reqs, (uint16_t) (n * 12), 1000, &fd) != (int32_t) (n * 12))
+            return 1;
+
+        if (read_fd(res, (uint16_t) (n * 29), 1000, &fd) != (int32_t) (n * 29))
+            return 1;
+
+        for (unsigned int r = 0; r < n; r++) {
+            const uint8_t* p = res + r * 29;
+            if (p[1] != (uint8_t) r || p[7] != 3 || p[8] != 20 || p[10] != (uint8_t) r)
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+static void* run_client(void* arg) {
+    client_args* args = (client_args*) arg;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*) &args->addr, sizeof(args->addr)) != 0) {
+        args->result = 1;
+        return NULL;
+    }
+
+    const int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    // Connections are closed once the server is stopped
+    args->fd = fd;
+
+    if (args->depth > 1) {
+        args->result = run_pipelined_requests(fd, args->requests, args->depth);
+        return NULL;
+    }
+
+    nmbs_platform_conf conf;
+    nmbs_platform_conf_create(&conf);
+    conf.transport = NMBS_TRANSPORT_TCP;
+    conf.read = read_fd;
+    conf.write = write_fd;
+    conf.arg = &fd;
+
+    uring_loop* client_loop = NULL;
+    if (args->uring) {
+        client_loop = malloc(sizeof(uring_loop));
+        if (!client_loop || uring_loop_init(client_loop) != 0) {
+            free(client_loop);
+            args->result = 1;
+            return NULL;
+        }
+
+        uring_client_connect(client_loop, fd);
+        uring_platform_conf(client_loop, &conf);
+    }
+
+    nmbs_t client;
+    if (nmbs_client_create(&client, &conf) != NMBS_ERROR_NONE) {
+        args->result = 1;
+        return NULL;
+    }
+
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, 100);
+
+    uint16_t regs[10];
+    for (unsigned long i = 0; i < args->requests; i++) {
+        if (nmbs_read_holding_registers(&client, (uint16_t) (i % 100), 10, regs) != NMBS_ERROR_NONE ||
+            regs[0] != (uint16_t) (i % 100)) {
+            args->result = 1;
+            break;
+        }
+    }
+
+    if (client_loop) {
+        client_loop->conns[0].fd = -1;
+        uring_loop_close(client_loop);
+        free(client_loop);
+    }
+
+    return NULL;
+}
+
+
+static int bench_server(const char* name, void* (*server_fn)(void*), int clients, unsigned long requests,
+                        unsigned int depth, bool uring_clients) {
+    server_args s_args;
+    struct sockaddr_in addr;
+    s_args.listen_fd = create_listener(&addr);
+    s_args.clients = clients;
+    if (s_args.listen_fd < 0) {
+        fprintf(stderr, "Error creating listening socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    server_stop = false;
+    server_syscalls = 0;
+    loop.enter_calls = 0;
+
+    pthread_t server_thread;
+    if (pthread_create(&server_thread, NULL, server_fn, &s_args) != 0) {
+        close(s_args.listen_fd);
+        return 1;
+    }
+
+    client_args c_args[CLIENTS_MAX];
+    pthread_t client_threads[CLIENTS_MAX];
+    const uint64_t start = now_ns();
+    for (int i = 0; i < clients; i++) {
+        c_args[i].addr = addr;
+        c_args[i].requests = requests;
+        c_args[i].depth = depth;
+        c_args[i].uring = uring_clients;
+        c_args[i].fd = -1;
+        c_args[i].result = 0;
+        pthread_create(&client_threads[i], NULL, run_client, &c_args[i]);
+    }
+
+    int result = 0;
+    for (int i = 0; i < clients; i++) {
+        pthread_join(client_threads[i], NULL);
+        result |= c_args[i].result;
+    }
+
+    const uint64_t elapsed = now_ns() - start;
+    server_stop = true;
+    pthread_join(server_thread, NULL);
+    close(s_args.listen_fd);
+
+    for (int i = 0; i < clients; i++)
+        if (c_args[i].fd >= 0)
+            close(c_args[i].fd);
+
+    const double total = (double) clients * (double) requests;
+    const uint64_t syscalls = server_fn == run_uring_server ? loop.enter_calls : server_syscalls;
+    printf("%-9s %3d clients, depth %2u %10.0f req/s ", name, clients, depth, total * 1e9 / (double) elapsed);
+    if (server_fn == run_pipelined_server)
+        printf("%8s syscalls/req", "-");
+    else
+        printf("%8.2f syscalls/req", (double) syscalls / total);
+
+    printf("%s\n", result ? " (errors)" : "");
+
+    return result;
+}
+
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-c clients] [-n requests per client] [-s server[,server...]] [-p depth] [-u]\n"
+            "  servers: select, epoll, pipelined, uring (default: all)\n"
+            "  -p: requests sent at once by pipelining clients, up to 64\n"
+            "  -u: io_uring clients in the load generator\n",
+            name);
+}
+
+
+int main(int argc, char* argv[]) {
+    int clients = 8;
+    unsigned long requests = 20000;
+    const char* selected = "select,epoll,pipelined,uring";
+    unsigned int depth = 1;
+    bool uring_clients = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:n:s:p:u")) != -1) {
+        switch (opt) {
+            case 'c':
+                clients = atoi(optarg);
+                break;
+            case 'n':
+                requests = strtoul(optarg, NULL, 10);
+                break;
+            case 's':
+                selected = optarg;
+                break;
+            case 'p':
+                depth = (unsigned int) atoi(optarg);
+                break;
+            case 'u':
+                uring_clients = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (clients < 1 || clients > CLIENTS_MAX || depth < 1 || depth > 64 || (depth > 1 && uring_clients)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bench_data_init();
+
+    int ret = 0;
+    if (strstr(selected, "select"))
+        ret |= bench_server("select", run_select_server, clients, requests, depth, uring_clients);
+
+    if (strstr(selected, "epoll"))
+        ret |= bench_server("epoll", run_epoll_server, clients, requests, depth, uring_clients);
+
+    if (strstr(selected, "pipelined"))
+        ret |= bench_server("pipelined", run_pipelined_server, clients, requests, depth, uring_clients);
+
+    if (strstr(selected, "uring")) {
+        if (uring_loop_init(&loop) != 0) {
+            fprintf(stderr, "io_uring is not available, skipping\n");
+        }
+        else {
+            ret |= bench_server("uring", run_uring_server, clients, requests, depth, uring_clients);
+            uring_loop_close(&loop);
+        }
+    }
+
+    return ret;
+}
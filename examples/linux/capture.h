@@ -0,0 +1,325 @@
+/*
+ * Streaming pcapng writer for nanoMODBUS traffic, to be used from the capture() platform function.
+ *
+ * Frames are copied into a fixed-size queue and written to the file by a background thread, so that capturing never
+ * blocks the modbus poll loop on disk I/O. If the queue is full, frames are dropped and counted in `dropped`.
+ *
+ * TCP frames are wrapped in synthetic Ethernet/IPv4/TCP headers (server 10.0.0.1:502, one client address/port per
+ * stream id) so they can be dissected as regular Modbus/TCP traffic. RTU frames are written as-is with the
+ * LINKTYPE_USER0 link type.
+ */
+
+#ifndef NMBS_CAPTURE_H
+#define NMBS_CAPTURE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "nanomodbus.h"
+
+#define CAPTURE_QUEUE_SIZE 4096
+#define CAPTURE_STREAMS_MAX 256
+
+#define CAPTURE_LINKTYPE_ETHERNET 1
+#define CAPTURE_LINKTYPE_USER0 147
+
+#define CAPTURE_MODBUS_TCP_PORT 502
+
+
+typedef struct capture_record {
+    uint64_t timestamp_us;
+    uint32_t stream_id;
+    uint16_t length;
+    bool tx;
+    uint8_t data[260];
+} capture_record;
+
+
+typedef struct capture {
+    FILE* file;
+    nmbs_transport transport;
+    bool server;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool stop;
+
+    capture_record queue[CAPTURE_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint64_t dropped;
+
+    // Writer thread state, synthetic TCP sequence numbers per stream
+    uint32_t seq_client[CAPTURE_STREAMS_MAX];
+    uint32_t seq_server[CAPTURE_STREAMS_MAX];
+} capture;
+
+
+static void capture_put_u16(uint8_t* p, uint16_t v) {
+    memcpy(p, &v, 2);
+}
+
+
+static void capture_put_u32(uint8_t* p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+
+static void capture_put_be16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t) (v >> 8);
+    p[1] = (uint8_t) v;
+}
+
+
+static void capture_put_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+
+static uint16_t capture_ip_checksum(const uint8_t* p, uint16_t len) {
+    uint32_t sum = 0;
+    for (uint16_t i = 0; i < len; i += 2)
+        sum += (uint32_t) (p[i] << 8 | p[i + 1]);
+
+    while (sum >> 16)
+        sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return (uint16_t) ~sum;
+}
+
+
+static void capture_write_block(capture* c, uint32_t type, const uint8_t* body, uint32_t body_len) {
+    const uint32_t padded_len = (body_len + 3) & ~3U;
+    const uint32_t total_len = 12 + padded_len;
+    const uint8_t pad[4] = {0};
+
+    fwrite(&type, 4, 1, c->file);
+    fwrite(&total_len, 4, 1, c->file);
+    fwrite(body, 1, body_len, c->file);
+    fwrite(pad, 1, padded_len - body_len, c->file);
+    fwrite(&total_len, 4, 1, c->file);
+}
+
+
+// Wrap a Modbus/TCP ADU in Ethernet + IPv4 + TCP headers
+static uint32_t capture_build_tcp_packet(capture* c, const capture_record* r, uint8_t* out) {
+    const uint32_t stream = r->stream_id % CAPTURE_STREAMS_MAX;
+    uint8_t client_mac[6] = {0x02, 0, 0, 0, (uint8_t) (r->stream_id >> 8), (uint8_t) r->stream_id};
+    uint8_t server_mac[6] = {0x02, 0, 0, 0, 0, 1};
+    uint8_t client_ip[4] = {10, 1, (uint8_t) (r->stream_id >> 8), (uint8_t) r->stream_id};
+    uint8_t server_ip[4] = {10, 0, 0, 1};
+    const uint16_t client_port = (uint16_t) (1024 + (r->stream_id % 64512));
+
+    // Modbus/TCP dissectors tell requests and responses apart by port 502, so frames have to be attributed to the
+    // right side depending on whether the capturing instance is a server or a client
+    const bool from_server = c->server ? r->tx : !r->tx;
+
+    uint8_t* eth = out;
+    memcpy(eth, from_server ? client_mac : server_mac, 6);
+    memcpy(eth + 6, from_server ? server_mac : client_mac, 6);
+    capture_put_be16(eth + 12, 0x0800);
+
+    uint8_t* ip = eth + 14;
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    capture_put_be16(ip + 2, (uint16_t) (20 + 20 + r->length));
+    ip[6] = 0x40;    // Don't fragment
+    ip[8] = 64;      // TTL
+    ip[9] = 6;       // TCP
+    memcpy(ip + 12, from_server ? server_ip : client_ip, 4);
+    memcpy(ip + 16, from_server ? client_ip : server_ip, 4);
+    capture_put_be16(ip + 10, capture_ip_checksum(ip, 20));
+
+    uint8_t* tcp = ip + 20;
+    memset(tcp, 0, 20);
+    capture_put_be16(tcp, from_server ? CAPTURE_MODBUS_TCP_PORT : client_port);
+    capture_put_be16(tcp + 2, from_server ? client_port : CAPTURE_MODBUS_TCP_PORT);
+    capture_put_be32(tcp + 4, from_server ? c->seq_server[stream] : c->seq_client[stream]);
+    capture_put_be32(tcp + 8, from_server ? c->seq_client[stream] : c->seq_server[stream]);
+    tcp[12] = 5 << 4;
+    tcp[13] = 0x18;    // PSH, ACK
+    capture_put_be16(tcp + 14, 0xFFFF);
+
+    if (from_server)
+        c->seq_server[stream] += r->length;
+    else
+        c->seq_client[stream] += r->length;
+
+    memcpy(tcp + 20, r->data, r->length);
+
+    return 14 + 20 + 20 + r->length;
+}
+
+
+static void capture_write_record(capture* c, const capture_record* r) {
+    // 20 bytes of EPB fixed fields, packet, 12 bytes of options
+    uint8_t body[20 + 14 + 20 + 20 + sizeof(r->data) + 3 + 12];
+    uint8_t* packet = body + 20;
+
+    uint32_t packet_len;
+    if (c->transport == NMBS_TRANSPORT_TCP) {
+        packet_len = capture_build_tcp_packet(c, r, packet);
+    }
+    else {
+        memcpy(packet, r->data, r->length);
+        packet_len = r->length;
+    }
+
+    capture_put_u32(body, 0);    // Interface id
+    capture_put_u32(body + 4, (uint32_t) (r->timestamp_us >> 32));
+    capture_put_u32(body + 8, (uint32_t) r->timestamp_us);
+    capture_put_u32(body + 12, packet_len);
+    capture_put_u32(body + 16, packet_len);
+
+    uint32_t len = 20 + packet_len;
+    while (len % 4)
+        body[len++] = 0;
+
+    // epb_flags option, inbound/outbound direction
+    capture_put_u16(body + len, 2);
+    capture_put_u16(body + len + 2, 4);
+    capture_put_u32(body + len + 4, r->tx ? 2 : 1);
+    // opt_endofopt
+    capture_put_u32(body + len + 8, 0);
+    len += 12;
+
+    capture_write_block(c, 0x00000006, body, len);
+}
+
+
+static void* capture_thread(void* arg) {
+    capture* c = (capture*) arg;
+
+    pthread_mutex_lock(&c->mutex);
+    while (true) {
+        while (c->head == c->tail && !c->stop)
+            pthread_cond_wait(&c->cond, &c->mutex);
+
+        if (c->head == c->tail && c->stop)
+            break;
+
+        // Write everything that is queued without holding the lock. Producers only touch slots outside [tail, head)
+        const uint32_t head = c->head;
+        uint32_t tail = c->tail;
+        pthread_mutex_unlock(&c->mutex);
+
+        while (tail != head) {
+            capture_write_record(c, &c->queue[tail % CAPTURE_QUEUE_SIZE]);
+            tail++;
+        }
+
+        fflush(c->file);
+
+        pthread_mutex_lock(&c->mutex);
+        c->tail = tail;
+    }
+    pthread_mutex_unlock(&c->mutex);
+
+    return NULL;
+}
+
+
+/**
+ * Open a pcapng capture file and start its writer thread.
+ * @param server whether frames are captured by a modbus server (true) or client (false)
+ * @return 0 on success, -1 otherwise
+ */
+static int capture_open(capture* c, const char* path, nmbs_transport transport, bool server) {
+    memset(c, 0, sizeof(capture));
+    c->transport = transport;
+    c->server = server;
+
+    c->file = fopen(path, "wb");
+    if (!c->file)
+        return -1;
+
+    // Section Header Block
+    uint8_t shb[16];
+    capture_put_u32(shb, 0x1A2B3C4D);
+    capture_put_u16(shb + 4, 1);
+    capture_put_u16(shb + 6, 0);
+    memset(shb + 8, 0xFF, 8);    // Section length not specified
+    capture_write_block(c, 0x0A0D0D0A, shb, sizeof(shb));
+
+    // Interface Description Block, microsecond timestamps (default resolution)
+    uint8_t idb[8];
+    capture_put_u16(idb, transport == NMBS_TRANSPORT_TCP ? CAPTURE_LINKTYPE_ETHERNET : CAPTURE_LINKTYPE_USER0);
+    capture_put_u16(idb + 2, 0);
+    capture_put_u32(idb + 4, 0);
+    capture_write_block(c, 0x00000001, idb, sizeof(idb));
+
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->cond, NULL);
+
+    if (pthread_create(&c->thread, NULL, capture_thread, c) != 0) {
+        fclose(c->file);
+        c->file = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * Queue a frame for writing. Never blocks on I/O.
+ * @param stream_id identifies the connection the frame belongs to, used to build synthetic TCP endpoints
+ */
+static void capture_frame(capture* c, const uint8_t* buf, uint16_t count, bool tx, uint32_t stream_id) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    if (count > sizeof(c->queue[0].data))
+        count = sizeof(c->queue[0].data);
+
+    pthread_mutex_lock(&c->mutex);
+
+    if (c->head - c->tail == CAPTURE_QUEUE_SIZE) {
+        c->dropped++;
+        pthread_mutex_unlock(&c->mutex);
+        return;
+    }
+
+    capture_record* r = &c->queue[c->head % CAPTURE_QUEUE_SIZE];
+    r->timestamp_us = (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+    r->stream_id = stream_id;
+    r->length = count;
+    r->tx = tx;
+    memcpy(r->data, buf, count);
+    c->head++;
+
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+
+/**
+ * Flush the queued frames, stop the writer thread and close the file.
+ */
+static void capture_close(capture* c) {
+    if (!c->file)
+        return;
+
+    pthread_mutex_lock(&c->mutex);
+    c->stop = true;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+
+    pthread_join(c->thread, NULL);
+
+    fclose(c->file);
+    c->file = NULL;
+
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->mutex);
+}
+
+#endif    // NMBS_CAPTURE_H
@@ -8,6 +8,7 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -119,6 +120,25 @@ int create_tcp_server(const char* address, const char* port) {
 }
 
 
+void accept_client(void) {
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_size = sizeof(client_addr);
+
+    int client = accept(server_fd, (struct sockaddr*) &client_addr, &client_addr_size);
+    if (client < 0) {
+        fprintf(stderr, "Error accepting client connection from %s - %s\n", inet_ntoa(client_addr.sin_addr),
+                strerror(errno));
+        return;
+    }
+
+    // Responses are sent as soon as they are written, without waiting for the ACK of the previous ones
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+    FD_SET(client, &client_connections);
+    printf("Accepted connection %d from %s\n", client, inet_ntoa(client_addr.sin_addr));
+}
+
+
 void* server_poll(void) {
     fd_set read_fd_set;
     FD_ZERO(&read_fd_set);
@@ -134,18 +154,7 @@ void* server_poll(void) {
         for (int i = 0; i < FD_SETSIZE; ++i) {
             if (FD_ISSET(i, &read_fd_set)) {
                 if (i == server_fd) {
-                    struct sockaddr_in client_addr;
-                    socklen_t client_addr_size = sizeof(client_addr);
-
-                    int client = accept(server_fd, (struct sockaddr*) &client_addr, &client_addr_size);
-                    if (client < 0) {
-                        fprintf(stderr, "Error accepting client connection from %s - %s\n",
-                                inet_ntoa(client_addr.sin_addr), strerror(errno));
-                        continue;
-                    }
-
-                    FD_SET(client, &client_connections);
-                    printf("Accepted connection %d from %s\n", client, inet_ntoa(client_addr.sin_addr));
+                    accept_client();
                 }
                 else {
                     client_read_fd = i;
@@ -157,11 +166,171 @@ void* server_poll(void) {
 }
 
 
+// Pipelined connections, see server_poll_pipelined()
+
+#define CONN_BUF_SIZE 4096
+
+typedef struct tcp_conn {
+    int fd;    // First, so that the platform arg points to the connection fd like with server_poll()
+    uint16_t in_pos;
+    uint16_t in_len;
+    uint16_t frame_end;
+    uint16_t out_len;
+    uint8_t in[CONN_BUF_SIZE];
+    uint8_t out[CONN_BUF_SIZE];
+} tcp_conn;
+
+tcp_conn* tcp_conns[FD_SETSIZE];
+
+
 void disconnect(void* conn) {
     int fd = *(int*) conn;
     FD_CLR(fd, &client_connections);
     close(fd);
     printf("Closed connection %d\n", fd);
+
+    free(tcp_conns[fd]);
+    tcp_conns[fd] = NULL;
+}
+
+
+// Sends the buffered responses, with MSG_MORE if more of them will follow right away
+int flush_conn(tcp_conn* conn, bool more) {
+    uint16_t total = 0;
+    while (total != conn->out_len) {
+        ssize_t w = send(conn->fd, conn->out + total, conn->out_len - total, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (w < 0 && errno == EINTR)
+            continue;
+
+        if (w <= 0)
+            return -1;
+
+        total += (uint16_t) w;
+    }
+
+    conn->out_len = 0;
+    return 0;
+}
+
+
+// Length of the complete MBAP frame at the start of the buffered data, 0 if it's not complete yet, -1 if invalid
+int32_t conn_frame_length(const tcp_conn* conn) {
+    uint16_t available = conn->in_len - conn->in_pos;
+    if (available < 6)
+        return 0;
+
+    uint16_t length = (uint16_t) (conn->in[conn->in_pos + 4] << 8 | conn->in[conn->in_pos + 5]);
+    if (length < 2 || length > NMBS_MAX_PDU_SIZE + 1)
+        return -1;
+
+    return available >= 6 + length ? 6 + length : 0;
+}
+
+
+nmbs_error serve_conn(nmbs_t* nmbs, int fd) {
+    if (!tcp_conns[fd]) {
+        tcp_conns[fd] = calloc(1, sizeof(tcp_conn));
+        if (!tcp_conns[fd])
+            return NMBS_ERROR_TRANSPORT;
+
+        tcp_conns[fd]->fd = fd;
+    }
+
+    tcp_conn* conn = tcp_conns[fd];
+
+    memmove(conn->in, conn->in + conn->in_pos, conn->in_len - conn->in_pos);
+    conn->in_len -= conn->in_pos;
+    conn->in_pos = 0;
+
+    // Everything received so far, with a single recv()
+    ssize_t r = recv(fd, conn->in + conn->in_len, CONN_BUF_SIZE - conn->in_len, MSG_DONTWAIT);
+    if (r == 0) {
+        disconnect(conn);
+        return NMBS_ERROR_NONE;
+    }
+
+    if (r < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            return NMBS_ERROR_NONE;
+
+        disconnect(conn);
+        return NMBS_ERROR_TRANSPORT;
+    }
+
+    conn->in_len += (uint16_t) r;
+
+    nmbs_set_platform_arg(nmbs, conn);
+
+    nmbs_error err = NMBS_ERROR_NONE;
+    int32_t frame_length;
+    while ((frame_length = conn_frame_length(conn)) > 0) {
+        if (CONN_BUF_SIZE - conn->out_len < NMBS_MSG_BUF_SIZE && flush_conn(conn, true) != 0) {
+            err = NMBS_ERROR_TRANSPORT;
+            break;
+        }
+
+        conn->frame_end = (uint16_t) (conn->in_pos + frame_length);
+        err = nmbs_server_poll(nmbs);
+
+        // Whatever the instance didn't read of the frame is discarded
+        conn->in_pos = conn->frame_end;
+        if (err != NMBS_ERROR_NONE)
+            break;
+    }
+
+    if (frame_length < 0)
+        err = NMBS_ERROR_INVALID_TCP_MBAP;
+
+    if (flush_conn(conn, false) != 0 && err == NMBS_ERROR_NONE)
+        err = NMBS_ERROR_TRANSPORT;
+
+    // The stream can't be resynchronized
+    if (err != NMBS_ERROR_NONE)
+        disconnect(conn);
+
+    return err;
+}
+
+
+/*
+ * Waits up to timeout_ms for requests, like server_poll(), then serves every complete request received on each readable
+ * connection, in order, and sends all of their responses with a single send(). Pipelining clients get all their
+ * responses for one recv() and one send() on the server side. The instance must use read_conn_buffered() and
+ * write_conn_buffered() as its read/write functions. Returns the last error of the instance, connections are closed on
+ * errors.
+ */
+nmbs_error server_poll_pipelined(nmbs_t* nmbs, int32_t timeout_ms) {
+    fd_set read_fd_set = client_connections;
+    FD_SET(server_fd, &read_fd_set);
+
+    struct timeval* tv_p = NULL;
+    struct timeval tv;
+    if (timeout_ms >= 0) {
+        tv_p = &tv;
+        tv.tv_sec = timeout_ms / 1000;
+        tv.tv_usec = (int64_t) (timeout_ms % 1000) * 1000;
+    }
+
+    int ret = select(FD_SETSIZE, &read_fd_set, NULL, NULL, tv_p);
+    if (ret < 0)
+        return errno == EINTR ? NMBS_ERROR_NONE : NMBS_ERROR_TRANSPORT;
+
+    nmbs_error result = NMBS_ERROR_NONE;
+    for (int i = 0; i < FD_SETSIZE && ret > 0; ++i) {
+        if (FD_ISSET(i, &read_fd_set)) {
+            ret--;
+            if (i == server_fd) {
+                accept_client();
+            }
+            else {
+                nmbs_error err = serve_conn(nmbs, i);
+                if (err != NMBS_ERROR_NONE)
+                    result = err;
+            }
+        }
+    }
+
+    return result;
 }
 
 
@@ -253,3 +422,32 @@ int32_t write_fd_linux(const uint8_t* buf, uint16_t count, int32_t timeout_ms, v
 
     return total;
 }
+
+
+// Read/write functions of pipelined connections, they only serve the frame being processed by server_poll_pipelined()
+
+int32_t read_conn_buffered(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    UNUSED_PARAM(timeout_ms);
+    tcp_conn* conn = (tcp_conn*) arg;
+
+    uint16_t n = conn->frame_end - conn->in_pos;
+    if (n > count)
+        n = count;
+
+    memcpy(buf, conn->in + conn->in_pos, n);
+    conn->in_pos += n;
+    return n;
+}
+
+
+int32_t write_conn_buffered(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    UNUSED_PARAM(timeout_ms);
+    tcp_conn* conn = (tcp_conn*) arg;
+
+    if (CONN_BUF_SIZE - conn->out_len < count && flush_conn(conn, true) != 0)
+        return -1;
+
+    memcpy(conn->out + conn->out_len, buf, count);
+    conn->out_len += count;
+    return count;
+}
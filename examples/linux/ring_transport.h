@@ -0,0 +1,344 @@
+/*
+ * In-memory transport for running nanoMODBUS clients and servers in the same process, e.g. in tests and benchmarks.
+ *
+ * Every pair of nodes is connected by a single-producer/single-consumer lock-free ring per direction, so exchanging
+ * bytes involves no locks and no system calls. A reader that finds no data sleeps on a futex (a condition variable on
+ * non-Linux systems) until a writer wakes it up or its timeout expires.
+ *
+ * With more than two nodes the transport behaves as an RTU multi-drop bus: every write is delivered to all the other
+ * nodes. Each write is stamped with a bus-wide ticket and published to all the nodes in ticket order, so a node receiving
+ * from several sources reads the frames in the order they were put on the wire. If the ring towards a node is full, the write is dropped for that node, like bytes sent
+ * to a device that is not listening.
+ *
+ * Usage:
+ *     static ring_transport bus;
+ *     ring_transport_init(&bus, 2);
+ *     ring_transport_platform_conf(&bus, 0, NMBS_TRANSPORT_TCP, &client_conf);
+ *     ring_transport_platform_conf(&bus, 1, NMBS_TRANSPORT_TCP, &server_conf);
+ */
+
+#ifndef NMBS_RING_TRANSPORT_H
+#define NMBS_RING_TRANSPORT_H
+
+#include <errno.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "nanomodbus.h"
+
+// Must be a power of two
+#ifndef RING_TRANSPORT_SIZE
+#define RING_TRANSPORT_SIZE 4096
+#endif
+
+#ifndef RING_TRANSPORT_NODES_MAX
+#define RING_TRANSPORT_NODES_MAX 4
+#endif
+
+// Number of polling iterations before going to sleep when no data is available. Not used on single-CPU systems, where
+// the writer cannot make progress while the reader spins
+#ifndef RING_TRANSPORT_SPIN
+#define RING_TRANSPORT_SPIN 64
+#endif
+
+#define RING_TRANSPORT_RECORD_HEADER 6
+#define RING_TRANSPORT_CACHE_LINE 64
+
+
+typedef struct ring_buffer {
+    // Producer side
+    uint32_t head __attribute__((aligned(RING_TRANSPORT_CACHE_LINE)));
+
+    // Consumer side
+    uint32_t tail __attribute__((aligned(RING_TRANSPORT_CACHE_LINE)));
+    uint16_t record_left;
+
+    uint8_t data[RING_TRANSPORT_SIZE] __attribute__((aligned(RING_TRANSPORT_CACHE_LINE)));
+} ring_buffer;
+
+
+struct ring_transport;
+
+typedef struct ring_node {
+    struct ring_transport* rt;
+    uint8_t id;
+    int8_t current_src;
+
+    // Incremented by writers on every delivery, readers sleep on it
+    uint32_t seq __attribute__((aligned(RING_TRANSPORT_CACHE_LINE)));
+    uint32_t waiters;
+#ifndef __linux__
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+} ring_node;
+
+
+typedef struct ring_transport {
+    uint8_t nodes_count;
+    int spin;
+    uint32_t ticket __attribute__((aligned(RING_TRANSPORT_CACHE_LINE)));
+    uint32_t published;    // Writes with a lower ticket are visible to all the nodes
+    uint64_t dropped;
+    ring_node nodes[RING_TRANSPORT_NODES_MAX];
+    ring_buffer rings[RING_TRANSPORT_NODES_MAX][RING_TRANSPORT_NODES_MAX];    // [src][dst]
+} ring_transport;
+
+
+static void ring_buffer_put(ring_buffer* r, uint32_t head, const uint8_t* data, uint16_t count) {
+    const uint32_t idx = head & (RING_TRANSPORT_SIZE - 1);
+    const uint32_t first = RING_TRANSPORT_SIZE - idx < count ? RING_TRANSPORT_SIZE - idx : count;
+    memcpy(r->data + idx, data, first);
+    memcpy(r->data, data + first, count - first);
+}
+
+
+static void ring_buffer_get(const ring_buffer* r, uint32_t tail, uint8_t* data, uint16_t count) {
+    const uint32_t idx = tail & (RING_TRANSPORT_SIZE - 1);
+    const uint32_t first = RING_TRANSPORT_SIZE - idx < count ? RING_TRANSPORT_SIZE - idx : count;
+    memcpy(data, r->data + idx, first);
+    memcpy(data + first, r->data, count - first);
+}
+
+
+static void ring_node_wake(ring_node* node) {
+#ifdef __linux__
+    __atomic_fetch_add(&node->seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&node->waiters, __ATOMIC_SEQ_CST))
+        syscall(SYS_futex, &node->seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&node->mutex);
+    __atomic_fetch_add(&node->seq, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_broadcast(&node->cond);
+    pthread_mutex_unlock(&node->mutex);
+#endif
+}
+
+
+// Returns false if the timeout expired
+static bool ring_node_wait(ring_node* node, uint32_t seen_seq, int32_t timeout_ms) {
+#ifdef __linux__
+    struct timespec ts;
+    struct timespec* ts_p = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long) (timeout_ms % 1000) * 1000000;
+        ts_p = &ts;
+    }
+
+    __atomic_fetch_add(&node->waiters, 1, __ATOMIC_SEQ_CST);
+    const long ret = syscall(SYS_futex, &node->seq, FUTEX_WAIT_PRIVATE, seen_seq, ts_p, NULL, 0);
+    __atomic_fetch_sub(&node->waiters, 1, __ATOMIC_SEQ_CST);
+
+    return !(ret != 0 && errno == ETIMEDOUT);
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    bool woken = true;
+    pthread_mutex_lock(&node->mutex);
+    while (__atomic_load_n(&node->seq, __ATOMIC_SEQ_CST) == seen_seq) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&node->cond, &node->mutex);
+        else if (pthread_cond_timedwait(&node->cond, &node->mutex, &deadline) != 0) {
+            woken = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&node->mutex);
+
+    return woken;
+#endif
+}
+
+
+// Copy available bytes to buf, picking the source whose oldest pending write came first
+static uint16_t ring_node_pull(ring_node* node, uint8_t* buf, uint16_t count) {
+    ring_transport* rt = node->rt;
+    uint16_t total = 0;
+
+    while (total < count) {
+        ring_buffer* r = NULL;
+
+        if (node->current_src >= 0) {
+            r = &rt->rings[node->current_src][node->id];
+        }
+        else {
+            uint32_t best_ticket = 0;
+            for (uint8_t src = 0; src < rt->nodes_count; src++) {
+                ring_buffer* candidate = &rt->rings[src][node->id];
+                if (src == node->id || __atomic_load_n(&candidate->head, __ATOMIC_ACQUIRE) == candidate->tail)
+                    continue;
+
+                uint32_t ticket;
+                ring_buffer_get(candidate, candidate->tail, (uint8_t*) &ticket, sizeof(ticket));
+                if ((int32_t) (ticket - __atomic_load_n(&rt->published, __ATOMIC_ACQUIRE)) >= 0)
+                    continue;
+
+                if (!r || (int32_t) (ticket - best_ticket) < 0) {
+                    r = candidate;
+                    best_ticket = ticket;
+                    node->current_src = (int8_t) src;
+                }
+            }
+
+            if (!r)
+                break;
+
+            uint16_t record_len;
+            ring_buffer_get(r, r->tail + sizeof(uint32_t), (uint8_t*) &record_len, sizeof(record_len));
+            r->record_left = record_len;
+            __atomic_store_n(&r->tail, r->tail + RING_TRANSPORT_RECORD_HEADER, __ATOMIC_RELEASE);
+        }
+
+        const uint16_t n = (uint16_t) (count - total) < r->record_left ? (uint16_t) (count - total) : r->record_left;
+        ring_buffer_get(r, r->tail, buf + total, n);
+        __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+        r->record_left = (uint16_t) (r->record_left - n);
+        total = (uint16_t) (total + n);
+
+        if (r->record_left == 0)
+            node->current_src = -1;
+    }
+
+    return total;
+}
+
+
+static int32_t ring_transport_read(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    ring_node* node = (ring_node*) arg;
+    uint16_t total = 0;
+
+    while (total < count) {
+        const uint16_t n = ring_node_pull(node, buf + total, (uint16_t) (count - total));
+        if (n) {
+            total = (uint16_t) (total + n);
+            continue;
+        }
+
+        if (byte_timeout_ms == 0)
+            break;
+
+        bool got_data = false;
+        for (int spin = 0; spin < node->rt->spin && !got_data; spin++) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            const uint16_t m = ring_node_pull(node, buf + total, (uint16_t) (count - total));
+            if (m) {
+                total = (uint16_t) (total + m);
+                got_data = true;
+            }
+        }
+
+        if (got_data)
+            continue;
+
+        // Check again after reading the sequence number, so that a write happening in between is not missed
+        const uint32_t seen_seq = __atomic_load_n(&node->seq, __ATOMIC_SEQ_CST);
+        const uint16_t m = ring_node_pull(node, buf + total, (uint16_t) (count - total));
+        if (m) {
+            total = (uint16_t) (total + m);
+            continue;
+        }
+
+        if (!ring_node_wait(node, seen_seq, byte_timeout_ms))
+            break;
+    }
+
+    return total;
+}
+
+
+static int32_t ring_transport_write(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg) {
+    (void) byte_timeout_ms;
+    ring_node* node = (ring_node*) arg;
+    ring_transport* rt = node->rt;
+
+    const uint32_t ticket = __atomic_fetch_add(&rt->ticket, 1, __ATOMIC_ACQ_REL);
+
+    for (uint8_t dst = 0; dst < rt->nodes_count; dst++) {
+        if (dst == node->id)
+            continue;
+
+        ring_buffer* r = &rt->rings[node->id][dst];
+        const uint32_t head = r->head;
+        const uint32_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (RING_TRANSPORT_SIZE - used < (uint32_t) RING_TRANSPORT_RECORD_HEADER + count) {
+            __atomic_fetch_add(&rt->dropped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        ring_buffer_put(r, head, (const uint8_t*) &ticket, sizeof(ticket));
+        ring_buffer_put(r, head + sizeof(ticket), (const uint8_t*) &count, sizeof(count));
+        ring_buffer_put(r, head + RING_TRANSPORT_RECORD_HEADER, buf, count);
+        __atomic_store_n(&r->head, head + RING_TRANSPORT_RECORD_HEADER + count, __ATOMIC_RELEASE);
+    }
+
+    // Make the write visible to all the nodes at once and in ticket order. Otherwise, on a bus, a node could answer
+    // this frame before another node sees it, and the latter would receive the answer first
+    while (__atomic_load_n(&rt->published, __ATOMIC_ACQUIRE) != ticket)
+        sched_yield();
+
+    __atomic_store_n(&rt->published, ticket + 1, __ATOMIC_RELEASE);
+
+    for (uint8_t dst = 0; dst < rt->nodes_count; dst++) {
+        if (dst != node->id)
+            ring_node_wake(&rt->nodes[dst]);
+    }
+
+    return count;
+}
+
+
+/**
+ * Initialize a ring transport connecting `nodes` nodes (at most RING_TRANSPORT_NODES_MAX).
+ */
+static void ring_transport_init(ring_transport* rt, uint8_t nodes) {
+    memset(rt, 0, sizeof(ring_transport));
+    rt->nodes_count = nodes;
+    rt->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_TRANSPORT_SPIN : 0;
+
+    for (uint8_t i = 0; i < nodes; i++) {
+        rt->nodes[i].rt = rt;
+        rt->nodes[i].id = i;
+        rt->nodes[i].current_src = -1;
+#ifndef __linux__
+        pthread_mutex_init(&rt->nodes[i].mutex, NULL);
+        pthread_cond_init(&rt->nodes[i].cond, NULL);
+#endif
+    }
+}
+
+
+/**
+ * Fill a nmbs_platform_conf to make a nanoMODBUS instance act as node `node` of the transport.
+ */
+static void ring_transport_platform_conf(ring_transport* rt, uint8_t node, nmbs_transport transport,
+                                         nmbs_platform_conf* conf) {
+    nmbs_platform_conf_create(conf);
+    conf->transport = transport;
+    conf->read = ring_transport_read;
+    conf->write = ring_transport_write;
+    conf->arg = &rt->nodes[node];
+}
+
+#endif    // NMBS_RING_TRANSPORT_H
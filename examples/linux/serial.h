@@ -0,0 +1,289 @@
+/*
+ * Serial port (termios) RTU platform for nanoMODBUS on Linux.
+ *
+ * The port is put in raw mode with the Modbus character format, 8E1, 8O1 or 8N2, and the driver is asked for low
+ * latency (ASYNC_LOW_LATENCY), so received bytes are pushed to the reader without the usual flip buffer delay. Reads
+ * wait with poll() and then take every byte available, up to the requested count, with a single read(), instead of one
+ * byte at a time.
+ *
+ * The byte timeout of the instance is the silence that ends an RTU frame, serial_frame_timeout_ms() returns t3.5 for
+ * the baud rate of the port, rounded up to the millisecond. VMIN and VTIME can be set with serial_set_read_mode() to
+ * let the driver gather characters before waking the reader, but VTIME counts tenths of a second, which is far longer
+ * than t3.5 at any common baud rate; they are 0 by default, leaving frame timing to poll().
+ *
+ * serial_platform_conf() also sets a CLOCK_MONOTONIC clock_us() function, so that nmbs_set_rtu_timing() can keep
+ * exactly t3.5 of silence before every frame sent.
+ *
+ * On RS-485 transceivers whose driver supports it, serial_set_rs485() lets the kernel drive RTS around transmissions
+ * for half-duplex operation.
+ *
+ * Usage:
+ *     static serial_port port;
+ *     static nmbs_rtu_timing timing;
+ *     serial_open(&port, "/dev/ttyUSB0", 19200, 'E');
+ *     serial_platform_conf(&port, &conf);
+ *     nmbs_client_create(&client, &conf);
+ *     nmbs_set_byte_timeout(&client, serial_frame_timeout_ms(&port));
+ *     nmbs_rtu_timing_init(&timing, 19200, NULL);
+ *     nmbs_set_rtu_timing(&client, &timing);
+ */
+
+#ifndef NMBS_SERIAL_H
+#define NMBS_SERIAL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/serial.h>
+#include <sys/ioctl.h>
+
+#include "nanomodbus.h"
+
+
+typedef struct serial_port {
+    int fd;
+    uint32_t baud;
+
+    // Time to transmit one character, 11 bits with the start, parity and stop bits
+    uint32_t char_time_us;
+
+    // read() and write() system calls, and bytes received
+    uint64_t rx_calls;
+    uint64_t rx_bytes;
+    uint64_t tx_calls;
+} serial_port;
+
+
+static speed_t serial_speed(uint32_t baud) {
+    switch (baud) {
+        case 1200:
+            return B1200;
+        case 2400:
+            return B2400;
+        case 4800:
+            return B4800;
+        case 9600:
+            return B9600;
+        case 19200:
+            return B19200;
+        case 38400:
+            return B38400;
+        case 57600:
+            return B57600;
+        case 115200:
+            return B115200;
+        case 230400:
+            return B230400;
+        case 460800:
+            return B460800;
+        case 921600:
+            return B921600;
+        default:
+            return B0;
+    }
+}
+
+
+// Configures an open terminal, parity is 'E', 'O' or 'N'. Returns 0 if successful, -1 otherwise
+static int serial_configure(serial_port* p, int fd, uint32_t baud, char parity) {
+    memset(p, 0, sizeof(serial_port));
+    p->fd = fd;
+    p->baud = baud;
+    p->char_time_us = baud ? (11 * 1000000 + baud - 1) / baud : 0;
+
+    const speed_t speed = serial_speed(baud);
+    if (speed == B0)
+        return -1;
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+        return -1;
+
+    cfmakeraw(&tio);
+    tio.c_cflag &= (tcflag_t) ~(CSIZE | PARENB | PARODD | CSTOPB | CRTSCTS);
+    tio.c_cflag |= CS8 | CLOCAL | CREAD;
+    switch (parity) {
+        case 'E':
+            tio.c_cflag |= PARENB;
+            break;
+        case 'O':
+            tio.c_cflag |= PARENB | PARODD;
+            break;
+        case 'N':
+            // Without parity, a second stop bit keeps the character 11 bits long
+            tio.c_cflag |= CSTOPB;
+            break;
+        default:
+            return -1;
+    }
+
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    if (cfsetispeed(&tio, speed) != 0 || cfsetospeed(&tio, speed) != 0)
+        return -1;
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+        return -1;
+
+    // Best effort, USB adapters and pseudo-terminals don't support it
+    struct serial_struct ss;
+    if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+        ss.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &ss);
+    }
+
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+
+// Opens and configures a serial port. Returns 0 if successful, -1 otherwise
+static int serial_open(serial_port* p, const char* path, uint32_t baud, char parity) {
+    // Non-blocking, so that the open doesn't wait for the carrier, then blocking again for VMIN/VTIME to apply
+    const int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    if (fcntl(fd, F_SETFL, 0) != 0 || serial_configure(p, fd, baud, parity) != 0) {
+        close(fd);
+        p->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void serial_close(serial_port* p) {
+    if (p->fd >= 0) {
+        close(p->fd);
+        p->fd = -1;
+    }
+}
+
+
+// Sets VMIN and VTIME, VTIME in tenths of a second. Returns 0 if successful, -1 otherwise
+static inline int serial_set_read_mode(serial_port* p, cc_t vmin, cc_t vtime) {
+    struct termios tio;
+    if (tcgetattr(p->fd, &tio) != 0)
+        return -1;
+
+    tio.c_cc[VMIN] = vmin;
+    tio.c_cc[VTIME] = vtime;
+    return tcsetattr(p->fd, TCSANOW, &tio);
+}
+
+
+// Enables or disables kernel RTS control for RS-485 half-duplex transceivers, with the given delays before and after
+// sending. Returns 0 if successful, -1 if the driver doesn't support it
+static inline int serial_set_rs485(serial_port* p, bool enable, uint32_t delay_before_ms, uint32_t delay_after_ms) {
+    struct serial_rs485 rs485;
+    memset(&rs485, 0, sizeof(rs485));
+    if (enable) {
+        rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+        rs485.delay_rts_before_send = delay_before_ms;
+        rs485.delay_rts_after_send = delay_after_ms;
+    }
+
+    return ioctl(p->fd, TIOCSRS485, &rs485) == 0 ? 0 : -1;
+}
+
+
+// t3.5 in milliseconds, rounded up. Above 19200 baud the specification fixes it at 1.75 ms
+static int32_t serial_frame_timeout_ms(const serial_port* p) {
+    if (p->baud > 19200)
+        return 2;
+
+    return (int32_t) ((p->char_time_us * 7 / 2 + 999) / 1000);
+}
+
+
+static int32_t serial_read(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    serial_port* p = (serial_port*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        struct pollfd pfd = {.fd = p->fd, .events = POLLIN, .revents = 0};
+        const int ret = poll(&pfd, 1, timeout_ms < 0 ? -1 : timeout_ms);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        const ssize_t r = read(p->fd, buf + total, count - total);
+        p->rx_calls++;
+        if (r < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+
+        if (r == 0)
+            return -1;
+
+        p->rx_bytes += (uint64_t) r;
+        total = (uint16_t) (total + r);
+    }
+
+    return total;
+}
+
+
+static int32_t serial_write(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    serial_port* p = (serial_port*) arg;
+    uint16_t total = 0;
+
+    while (total != count) {
+        const ssize_t w = write(p->fd, buf + total, count - total);
+        p->tx_calls++;
+        if (w > 0) {
+            total = (uint16_t) (total + w);
+            continue;
+        }
+
+        if (w < 0 && errno != EAGAIN && errno != EINTR)
+            return -1;
+
+        struct pollfd pfd = {.fd = p->fd, .events = POLLOUT, .revents = 0};
+        const int ret = poll(&pfd, 1, timeout_ms < 0 ? -1 : timeout_ms);
+        if (ret == 0)
+            return total;
+
+        if (ret < 0 && errno != EINTR)
+            return -1;
+    }
+
+    return total;
+}
+
+
+static uint64_t serial_clock_us(void* arg) {
+    (void) arg;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+
+static void serial_platform_conf(serial_port* p, nmbs_platform_conf* conf) {
+    nmbs_platform_conf_create(conf);
+    conf->transport = NMBS_TRANSPORT_RTU;
+    conf->read = serial_read;
+    conf->write = serial_write;
+    conf->clock_us = serial_clock_us;
+    conf->arg = p;
+}
+
+#endif    // NMBS_SERIAL_H
@@ -2,13 +2,20 @@
  * This example application sets up a TCP server at the specified address and port, and polls from modbus requests
  * from more than one modbus client (more specifically from maximum 1024 clients, since it uses select())
  *
- * Since the platform for this example is linux, the platform arg is used to pass (to the linux file descriptor
- * read/write functions) a pointer to the file descriptor of the current read client connection
+ * Since the platform for this example is linux, the platform arg is used to pass (to the linux read/write functions) a
+ * pointer to the current client connection, whose first member is its file descriptor
+ *
+ * Requests are served with server_poll_pipelined(), so a client may send several requests without waiting for the
+ * responses: all the complete requests received on a connection are served in order and their responses are sent
+ * together
+ *
+ * If a third argument is provided, all the modbus traffic is dumped to that pcapng file
  *
  */
 
 #include <stdio.h>
 
+#include "capture.h"
 #include "nanomodbus.h"
 #include "platform.h"
 
@@ -24,12 +31,20 @@ nmbs_bitfield server_coils = {0};
 uint16_t server_registers[REGS_ADDR_MAX + 1] = {0};
 uint16_t server_file[FILE_SIZE_MAX];
 
+capture server_capture;
+
 
 void sighandler(int s) {
     UNUSED_PARAM(s);
     terminate = true;
 }
 
+void handle_capture(const uint8_t* buf, uint16_t count, bool tx, void* arg) {
+    // Our platform arg is the client connection fd, use it to tell apart the TCP streams in the dump
+    capture_frame(&server_capture, buf, count, tx, (uint32_t) *(int*) arg);
+}
+
+
 nmbs_error handle_read_coils(uint16_t address, uint16_t quantity, nmbs_bitfield coils_out, uint8_t unit_id, void* arg) {
     UNUSED_PARAM(arg);
     UNUSED_PARAM(unit_id);
@@ -38,10 +53,7 @@ nmbs_error handle_read_coils(uint16_t address, uint16_t quantity, nmbs_bitfield
         return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
 
     // Read our coils values into coils_out
-    for (int i = 0; i < quantity; i++) {
-        bool value = nmbs_bitfield_read(server_coils, address + i);
-        nmbs_bitfield_write(coils_out, i, value);
-    }
+    nmbs_bitfield_copy(coils_out, 0, server_coils, address, quantity);
 
     return NMBS_ERROR_NONE;
 }
@@ -56,9 +68,7 @@ nmbs_error handle_write_multiple_coils(uint16_t address, uint16_t quantity, cons
         return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
 
     // Write coils values to our server_coils
-    for (int i = 0; i < quantity; i++) {
-        nmbs_bitfield_write(server_coils, address + i, nmbs_bitfield_read(coils, i));
-    }
+    nmbs_bitfield_copy(server_coils, address, coils, 0, quantity);
 
     return NMBS_ERROR_NONE;
 }
@@ -171,7 +181,7 @@ int main(int argc, char* argv[]) {
     signal(SIGQUIT, sighandler);
 
     if (argc < 3) {
-        fprintf(stderr, "Usage: server-tcp [address] [port]\n");
+        fprintf(stderr, "Usage: server-tcp [address] [port] [capture.pcapng]\n");
         return 1;
     }
 
@@ -185,9 +195,18 @@ int main(int argc, char* argv[]) {
     nmbs_platform_conf platform_conf;
     nmbs_platform_conf_create(&platform_conf);
     platform_conf.transport = NMBS_TRANSPORT_TCP;
-    platform_conf.read = read_fd_linux;
-    platform_conf.write = write_fd_linux;
-    platform_conf.arg = NULL;    // We will set the arg (socket fd) later
+    platform_conf.read = read_conn_buffered;
+    platform_conf.write = write_conn_buffered;
+    platform_conf.arg = NULL;    // server_poll_pipelined() will set the arg (client connection)
+
+    if (argc > 3) {
+        if (capture_open(&server_capture, argv[3], NMBS_TRANSPORT_TCP, true) != 0) {
+            fprintf(stderr, "Error opening capture file %s\n", argv[3]);
+            return 1;
+        }
+
+        platform_conf.capture = handle_capture;
+    }
 
     nmbs_callbacks callbacks;
     nmbs_callbacks_create(&callbacks);
@@ -215,23 +234,20 @@ int main(int argc, char* argv[]) {
 
     // Our server supports requests from more than one client
     while (!terminate) {
-        // Our server_poll() function will return the next client TCP connection to read from
-        void* conn = server_poll();
-        if (conn) {
-            // Set the next connection handler used by the read/write platform functions
-            nmbs_set_platform_arg(&nmbs, conn);
-
-            err = nmbs_server_poll(&nmbs);
-            if (err != NMBS_ERROR_NONE) {
-                printf("Error on modbus connection - %s\n", nmbs_strerror(err));
-                // In a more complete example, we would handle this error by checking its nmbs_error value
-            }
+        // Serves the requests received on every readable client TCP connection, setting the platform arg of the
+        // instance to each connection in turn
+        err = server_poll_pipelined(&nmbs, 1000);
+        if (err != NMBS_ERROR_NONE) {
+            printf("Error on modbus connection - %s\n", nmbs_strerror(err));
+            // In a more complete example, we would handle this error by checking its nmbs_error value
         }
     }
 
     // Close the TCP server
     close_tcp_server();
 
+    capture_close(&server_capture);
+
     // No need to destroy the nmbs instance, bye bye
     return 0;
 }
@@ -0,0 +1,201 @@
+/*
+ * Batched Modbus/UDP transport for nanoMODBUS on Linux.
+ *
+ * Datagrams are received in batches with recvmmsg(), and the frames written by the instance are queued and sent in
+ * batches with sendmmsg(), so a server polled in a loop makes two system calls per batch of requests instead of two per
+ * request. Reads return the received datagrams one at a time; once none is left, the queued frames are sent and a new
+ * batch is received, waiting up to the read timeout for its first datagram.
+ *
+ * Frames are written to the source of the last datagram read, so a server answers every request to its sender, even
+ * when a single socket serves many clients. A client sets its server with udp_batch_set_peer(), or leaves it unset on a
+ * connected socket; its requests are sent when it starts waiting for the response, or with udp_batch_flush().
+ *
+ * Usage:
+ *     static udp_batch batch;
+ *     udp_batch_init(&batch, fd);
+ *     udp_batch_platform_conf(&batch, &server_conf);
+ *     nmbs_server_create(&server, 0, &server_conf, &callbacks);
+ *     while (true)
+ *         nmbs_server_poll(&server);
+ */
+
+#ifndef NMBS_UDP_BATCH_H
+#define NMBS_UDP_BATCH_H
+
+// recvmmsg() and sendmmsg() need _GNU_SOURCE: include this header before any system header, or define it when building
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <sys/socket.h>
+
+#include "nanomodbus.h"
+
+#ifndef UDP_BATCH_SIZE
+#define UDP_BATCH_SIZE 64
+#endif
+
+
+typedef struct udp_batch {
+    int fd;
+
+    // Received datagrams, rx_next is the next one returned by reads
+    struct mmsghdr rx_msgs[UDP_BATCH_SIZE];
+    struct iovec rx_iovs[UDP_BATCH_SIZE];
+    struct sockaddr_storage rx_addrs[UDP_BATCH_SIZE];
+    uint8_t rx_bufs[UDP_BATCH_SIZE][NMBS_MSG_BUF_SIZE];
+    unsigned int rx_count;
+    unsigned int rx_next;
+
+    // Queued frames
+    struct mmsghdr tx_msgs[UDP_BATCH_SIZE];
+    struct iovec tx_iovs[UDP_BATCH_SIZE];
+    struct sockaddr_storage tx_addrs[UDP_BATCH_SIZE];
+    uint8_t tx_bufs[UDP_BATCH_SIZE][NMBS_MSG_BUF_SIZE];
+    unsigned int tx_count;
+
+    // Destination of writes, no address on a connected socket
+    struct sockaddr_storage peer;
+    socklen_t peer_len;
+
+    // System calls and datagrams, in each direction
+    uint64_t rx_calls;
+    uint64_t rx_datagrams;
+    uint64_t tx_calls;
+    uint64_t tx_datagrams;
+} udp_batch;
+
+
+static void udp_batch_init(udp_batch* b, int fd) {
+    memset(b, 0, sizeof(udp_batch));
+    b->fd = fd;
+
+    for (unsigned int i = 0; i < UDP_BATCH_SIZE; i++) {
+        b->rx_iovs[i].iov_base = b->rx_bufs[i];
+        b->rx_msgs[i].msg_hdr.msg_iov = &b->rx_iovs[i];
+        b->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+        b->rx_msgs[i].msg_hdr.msg_name = &b->rx_addrs[i];
+
+        b->tx_iovs[i].iov_base = b->tx_bufs[i];
+        b->tx_msgs[i].msg_hdr.msg_iov = &b->tx_iovs[i];
+        b->tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+
+static void udp_batch_set_peer(udp_batch* b, const struct sockaddr* addr, socklen_t addr_len) {
+    memcpy(&b->peer, addr, addr_len);
+    b->peer_len = addr_len;
+}
+
+
+// Sends the queued frames. Returns 0 if successful, -1 otherwise, in which case the frames are dropped
+static int udp_batch_flush(udp_batch* b) {
+    unsigned int sent = 0;
+    while (sent < b->tx_count) {
+        const int ret = sendmmsg(b->fd, b->tx_msgs + sent, b->tx_count - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+
+            b->tx_count = 0;
+            return -1;
+        }
+
+        b->tx_calls++;
+        sent += (unsigned int) ret;
+    }
+
+    b->tx_datagrams += sent;
+    b->tx_count = 0;
+    return 0;
+}
+
+
+// Receives a batch of datagrams, waiting up to timeout_ms for the first one. Returns their number, 0 on timeout
+static int udp_batch_receive(udp_batch* b, int32_t timeout_ms) {
+    struct pollfd pfd = {.fd = b->fd, .events = POLLIN, .revents = 0};
+    const int ready = poll(&pfd, 1, timeout_ms < 0 ? -1 : timeout_ms);
+    if (ready < 0)
+        return errno == EINTR ? 0 : -1;
+
+    if (ready == 0)
+        return 0;
+
+    for (unsigned int i = 0; i < UDP_BATCH_SIZE; i++) {
+        b->rx_iovs[i].iov_len = NMBS_MSG_BUF_SIZE;
+        b->rx_msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    }
+
+    const int ret = recvmmsg(b->fd, b->rx_msgs, UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (ret < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+
+    b->rx_calls++;
+    b->rx_datagrams += (unsigned int) ret;
+    b->rx_count = (unsigned int) ret;
+    b->rx_next = 0;
+    return ret;
+}
+
+
+static int32_t udp_batch_read(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    udp_batch* b = (udp_batch*) arg;
+
+    if (b->rx_next == b->rx_count) {
+        // The instance is waiting for new frames, it's time to send the queued ones
+        if (udp_batch_flush(b) < 0)
+            return -1;
+
+        const int ret = udp_batch_receive(b, timeout_ms);
+        if (ret <= 0)
+            return ret;
+    }
+
+    const unsigned int i = b->rx_next++;
+    uint32_t size = b->rx_msgs[i].msg_len;
+    if (size > count)
+        size = count;
+
+    memcpy(buf, b->rx_bufs[i], size);
+
+    memcpy(&b->peer, &b->rx_addrs[i], b->rx_msgs[i].msg_hdr.msg_namelen);
+    b->peer_len = b->rx_msgs[i].msg_hdr.msg_namelen;
+
+    return (int32_t) size;
+}
+
+
+static int32_t udp_batch_write(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    udp_batch* b = (udp_batch*) arg;
+    (void) timeout_ms;
+
+    if (b->tx_count == UDP_BATCH_SIZE && udp_batch_flush(b) < 0)
+        return -1;
+
+    const unsigned int i = b->tx_count++;
+    memcpy(b->tx_bufs[i], buf, count);
+    b->tx_iovs[i].iov_len = count;
+
+    memcpy(&b->tx_addrs[i], &b->peer, b->peer_len);
+    b->tx_msgs[i].msg_hdr.msg_name = b->peer_len ? &b->tx_addrs[i] : NULL;
+    b->tx_msgs[i].msg_hdr.msg_namelen = b->peer_len;
+
+    return count;
+}
+
+
+static void udp_batch_platform_conf(udp_batch* b, nmbs_platform_conf* conf) {
+    nmbs_platform_conf_create(conf);
+    conf->transport = NMBS_TRANSPORT_UDP;
+    conf->read = udp_batch_read;
+    conf->write = udp_batch_write;
+    conf->arg = b;
+}
+
+#endif    // NMBS_UDP_BATCH_H
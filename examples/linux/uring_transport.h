@@ -0,0 +1,677 @@
+/*
+ * io_uring transport for nanoMODBUS TCP servers and clients on Linux.
+ *
+ * The select()-based functions of platform.h make one select() and one read() system call per received byte. Here
+ * connections are accepted with a multishot accept and read with a multishot recv into a ring of provided buffers, so
+ * once a connection is set up, receiving data takes no system call besides the io_uring_enter() that waits for
+ * completions. Received bytes are appended to the input buffer of their connection, and the server instance is polled
+ * only once a whole MBAP frame is buffered, so the library never waits on a read. Responses are appended to the output
+ * buffer of the connection and sent with one send per loop iteration, linked to a timeout if the instance has a byte
+ * timeout. Under load, a single io_uring_enter() submits the sends of an iteration and waits for the completions of the
+ * next one.
+ *
+ * A client uses a loop of its own with a single connection: its request is queued and submitted together with the wait
+ * for the response, with one io_uring_enter() per transaction.
+ *
+ * The ring is set up with the raw system calls, liburing is not needed. Requires Linux 6.0 or later.
+ *
+ * Usage:
+ *     static uring_loop loop;
+ *     uring_loop_init(&loop);
+ *     uring_server_listen(&loop, listen_fd);
+ *     uring_platform_conf(&loop, &server_conf);
+ *     nmbs_server_create(&server, 0, &server_conf, &callbacks);
+ *     while (true)
+ *         uring_server_run(&loop, &server, 1000);
+ *
+ *     static uring_loop client_loop;
+ *     uring_loop_init(&client_loop);
+ *     uring_client_connect(&client_loop, connected_fd);
+ *     uring_platform_conf(&client_loop, &client_conf);
+ *     nmbs_client_create(&client, &client_conf);
+ */
+
+#ifndef NMBS_URING_TRANSPORT_H
+#define NMBS_URING_TRANSPORT_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "nanomodbus.h"
+
+#ifndef URING_ENTRIES
+#define URING_ENTRIES 256
+#endif
+
+#ifndef URING_CONNS_MAX
+#define URING_CONNS_MAX 64
+#endif
+
+// Per-connection input and output buffers, they hold a few pipelined frames
+#ifndef URING_CONN_BUF_SIZE
+#define URING_CONN_BUF_SIZE 2048
+#endif
+
+// Provided buffers for multishot recv, the count must be a power of two
+#ifndef URING_BUFS
+#define URING_BUFS 64
+#endif
+
+#ifndef URING_BUF_SIZE
+#define URING_BUF_SIZE 2048
+#endif
+
+#define URING_BUF_GROUP 0
+
+#define URING_OP_ACCEPT 1
+#define URING_OP_RECV 2
+#define URING_OP_SEND 3
+#define URING_OP_TIMEOUT 4
+
+
+typedef struct uring_conn {
+    int fd;    // -1 if the slot is free
+    bool recv_armed;
+    bool send_pending;
+    bool closing;
+    bool ready;    // In the ready list, it has input to serve or output to send
+
+    uint16_t in_pos;
+    uint16_t in_len;
+    uint16_t out_len;
+    int32_t send_timeout_ms;
+    struct __kernel_timespec send_timeout;
+
+    uint8_t in[URING_CONN_BUF_SIZE];
+    uint8_t out[URING_CONN_BUF_SIZE];
+} uring_conn;
+
+
+typedef struct uring_loop {
+    int ring_fd;
+    int listen_fd;
+
+    // Submission queue
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int* sq_array;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int to_submit;
+    struct io_uring_sqe* sqes;
+
+    // Completion queue
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe* cqes;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    // Provided buffer ring
+    struct io_uring_buf_ring* buf_ring;
+    uint16_t buf_ring_tail;
+    uint8_t bufs[URING_BUFS][URING_BUF_SIZE];
+
+    // Connection served by the read and write functions, and whether it is a server connection, whose frames are
+    // complete, or a client one, whose reads wait for data
+    uint16_t current;
+    bool serving;
+    uint16_t frame_end;
+
+    uint16_t ready[URING_CONNS_MAX];
+    uint16_t ready_count;
+
+    uring_conn conns[URING_CONNS_MAX];
+
+    uint64_t enter_calls;
+} uring_loop;
+
+
+static int uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, const void* arg,
+                       size_t arg_size) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+
+static void uring_submit(uring_loop* l) {
+    if (l->to_submit == 0)
+        return;
+
+    uring_enter(l->ring_fd, l->to_submit, 0, 0, NULL, 0);
+    l->enter_calls++;
+    l->to_submit = 0;
+}
+
+
+// Makes room for n SQEs, so that linked ones are submitted together
+static void uring_sq_reserve(uring_loop* l, unsigned int n) {
+    const unsigned int head = __atomic_load_n(l->sq_head, __ATOMIC_ACQUIRE);
+    if (*l->sq_tail - head + n > l->sq_entries)
+        uring_submit(l);
+}
+
+
+static struct io_uring_sqe* uring_get_sqe(uring_loop* l) {
+    uring_sq_reserve(l, 1);
+
+    const unsigned int tail = *l->sq_tail;
+    struct io_uring_sqe* sqe = &l->sqes[tail & l->sq_mask];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    l->sq_array[tail & l->sq_mask] = tail & l->sq_mask;
+    __atomic_store_n(l->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    l->to_submit++;
+
+    return sqe;
+}
+
+
+static uint64_t uring_user_data(uint32_t op, uint16_t conn) {
+    return (uint64_t) op << 32 | conn;
+}
+
+
+static void uring_buf_add(uring_loop* l, uint16_t bid) {
+    struct io_uring_buf* buf = &l->buf_ring->bufs[l->buf_ring_tail & (URING_BUFS - 1)];
+    buf->addr = (uint64_t) (uintptr_t) l->bufs[bid];
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    l->buf_ring_tail++;
+}
+
+
+static void uring_buf_publish(uring_loop* l) {
+    __atomic_store_n(&l->buf_ring->tail, l->buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+
+// Returns 0 if successful, -1 if io_uring or one of the required features is not available
+static int uring_loop_init(uring_loop* l) {
+    memset(l, 0, sizeof(uring_loop));
+    l->listen_fd = -1;
+    for (int i = 0; i < URING_CONNS_MAX; i++)
+        l->conns[i].fd = -1;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    l->ring_fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (l->ring_fd < 0)
+        return -1;
+
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+        close(l->ring_fd);
+        return -1;
+    }
+
+    l->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    l->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (l->cq_ring_size > l->sq_ring_size)
+        l->sq_ring_size = l->cq_ring_size;
+
+    l->sq_ring = mmap(NULL, l->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l->ring_fd,
+                      IORING_OFF_SQ_RING);
+    if (l->sq_ring == MAP_FAILED) {
+        close(l->ring_fd);
+        return -1;
+    }
+
+    l->cq_ring = l->sq_ring;
+
+    l->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    l->sqes = mmap(NULL, l->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_SQES);
+    if (l->sqes == MAP_FAILED) {
+        munmap(l->sq_ring, l->sq_ring_size);
+        close(l->ring_fd);
+        return -1;
+    }
+
+    uint8_t* sq = (uint8_t*) l->sq_ring;
+    l->sq_head = (unsigned int*) (void*) (sq + p.sq_off.head);
+    l->sq_tail = (unsigned int*) (void*) (sq + p.sq_off.tail);
+    l->sq_array = (unsigned int*) (void*) (sq + p.sq_off.array);
+    l->sq_mask = *(unsigned int*) (void*) (sq + p.sq_off.ring_mask);
+    l->sq_entries = p.sq_entries;
+
+    l->cq_head = (unsigned int*) (void*) (sq + p.cq_off.head);
+    l->cq_tail = (unsigned int*) (void*) (sq + p.cq_off.tail);
+    l->cq_mask = *(unsigned int*) (void*) (sq + p.cq_off.ring_mask);
+    l->cqes = (struct io_uring_cqe*) (void*) (sq + p.cq_off.cqes);
+
+    l->buf_ring = mmap(NULL, URING_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (l->buf_ring == MAP_FAILED) {
+        munmap(l->sqes, l->sqes_size);
+        munmap(l->sq_ring, l->sq_ring_size);
+        close(l->ring_fd);
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) l->buf_ring;
+    reg.ring_entries = URING_BUFS;
+    reg.bgid = URING_BUF_GROUP;
+    if (syscall(__NR_io_uring_register, l->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        munmap(l->buf_ring, URING_BUFS * sizeof(struct io_uring_buf));
+        munmap(l->sqes, l->sqes_size);
+        munmap(l->sq_ring, l->sq_ring_size);
+        close(l->ring_fd);
+        return -1;
+    }
+
+    for (uint16_t i = 0; i < URING_BUFS; i++)
+        uring_buf_add(l, i);
+
+    uring_buf_publish(l);
+
+    return 0;
+}
+
+
+static void uring_loop_close(uring_loop* l) {
+    for (int i = 0; i < URING_CONNS_MAX; i++) {
+        if (l->conns[i].fd >= 0) {
+            close(l->conns[i].fd);
+            l->conns[i].fd = -1;
+        }
+    }
+
+    munmap(l->buf_ring, URING_BUFS * sizeof(struct io_uring_buf));
+    munmap(l->sqes, l->sqes_size);
+    munmap(l->sq_ring, l->sq_ring_size);
+    close(l->ring_fd);
+}
+
+
+static void uring_arm_accept(uring_loop* l) {
+    struct io_uring_sqe* sqe = uring_get_sqe(l);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = l->listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = uring_user_data(URING_OP_ACCEPT, 0);
+}
+
+
+static void uring_arm_recv(uring_loop* l, uint16_t idx) {
+    struct io_uring_sqe* sqe = uring_get_sqe(l);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = l->conns[idx].fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = uring_user_data(URING_OP_RECV, idx);
+    l->conns[idx].recv_armed = true;
+}
+
+
+static void uring_send(uring_loop* l, uint16_t idx) {
+    uring_conn* c = &l->conns[idx];
+    const bool linked = c->send_timeout_ms >= 0;
+    uring_sq_reserve(l, linked ? 2 : 1);
+
+    struct io_uring_sqe* sqe = uring_get_sqe(l);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = c->fd;
+    sqe->addr = (uint64_t) (uintptr_t) c->out;
+    sqe->len = c->out_len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_user_data(URING_OP_SEND, idx);
+    c->send_pending = true;
+
+    if (linked) {
+        // The send is canceled if it doesn't complete within the byte timeout
+        sqe->flags = IOSQE_IO_LINK;
+        c->send_timeout.tv_sec = c->send_timeout_ms / 1000;
+        c->send_timeout.tv_nsec = (long long) (c->send_timeout_ms % 1000) * 1000000;
+
+        struct io_uring_sqe* timeout = uring_get_sqe(l);
+        timeout->opcode = IORING_OP_LINK_TIMEOUT;
+        timeout->addr = (uint64_t) (uintptr_t) &c->send_timeout;
+        timeout->len = 1;
+        timeout->user_data = uring_user_data(URING_OP_TIMEOUT, idx);
+    }
+}
+
+
+static void uring_mark_ready(uring_loop* l, uint16_t idx) {
+    if (!l->conns[idx].ready) {
+        l->conns[idx].ready = true;
+        l->ready[l->ready_count++] = idx;
+    }
+}
+
+
+// Closing a connection shuts its socket down, which terminates the multishot recv. The slot is freed once no request
+// refers to it anymore
+static void uring_conn_close(uring_loop* l, uint16_t idx) {
+    uring_conn* c = &l->conns[idx];
+    if (!c->closing) {
+        c->closing = true;
+        shutdown(c->fd, SHUT_RDWR);
+    }
+
+    if (!c->recv_armed && !c->send_pending) {
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+
+static void uring_conn_open(uring_loop* l, int fd) {
+    for (uint16_t i = 0; i < URING_CONNS_MAX; i++) {
+        uring_conn* c = &l->conns[i];
+        if (c->fd < 0 && !c->ready) {
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            c->fd = fd;
+            c->recv_armed = false;
+            c->send_pending = false;
+            c->closing = false;
+            c->in_pos = 0;
+            c->in_len = 0;
+            c->out_len = 0;
+            c->send_timeout_ms = -1;
+            uring_arm_recv(l, i);
+            return;
+        }
+    }
+
+    close(fd);
+}
+
+
+static void uring_handle_recv(uring_loop* l, uint16_t idx, const struct io_uring_cqe* cqe) {
+    uring_conn* c = &l->conns[idx];
+
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        const uint16_t bid = (uint16_t) (cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        if (cqe->res > 0 && !c->closing) {
+            uint16_t len = (uint16_t) cqe->res;
+            if (c->in_len + len > URING_CONN_BUF_SIZE) {
+                memmove(c->in, c->in + c->in_pos, c->in_len - c->in_pos);
+                c->in_len -= c->in_pos;
+                c->in_pos = 0;
+            }
+
+            if (c->in_len + len <= URING_CONN_BUF_SIZE) {
+                memcpy(c->in + c->in_len, l->bufs[bid], len);
+                c->in_len += len;
+                uring_mark_ready(l, idx);
+            }
+            else {
+                // The peer sends faster than its requests are answered
+                uring_conn_close(l, idx);
+            }
+        }
+
+        uring_buf_add(l, bid);
+        uring_buf_publish(l);
+    }
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        c->recv_armed = false;
+        if (c->closing || (cqe->res <= 0 && cqe->res != -ENOBUFS))
+            uring_conn_close(l, idx);
+        else
+            uring_arm_recv(l, idx);
+    }
+}
+
+
+static void uring_handle_send(uring_loop* l, uint16_t idx, const struct io_uring_cqe* cqe) {
+    uring_conn* c = &l->conns[idx];
+    c->send_pending = false;
+
+    if (cqe->res < 0 || c->closing) {
+        uring_conn_close(l, idx);
+        return;
+    }
+
+    const uint16_t sent = (uint16_t) cqe->res;
+    memmove(c->out, c->out + sent, c->out_len - sent);
+    c->out_len -= sent;
+    if (c->out_len > 0)
+        uring_send(l, idx);
+
+    // Room for the responses to the requests left in the input buffer
+    if (l->listen_fd >= 0)
+        uring_mark_ready(l, idx);
+}
+
+
+// Handles the available completions, returns their number
+static int uring_reap(uring_loop* l) {
+    unsigned int head = *l->cq_head;
+    const unsigned int tail = __atomic_load_n(l->cq_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    while (head != tail) {
+        const struct io_uring_cqe* cqe = &l->cqes[head & l->cq_mask];
+        const uint32_t op = (uint32_t) (cqe->user_data >> 32);
+        const uint16_t idx = (uint16_t) cqe->user_data;
+
+        switch (op) {
+            case URING_OP_ACCEPT:
+                if (cqe->res >= 0)
+                    uring_conn_open(l, cqe->res);
+
+                if (!(cqe->flags & IORING_CQE_F_MORE))
+                    uring_arm_accept(l);
+                break;
+            case URING_OP_RECV:
+                uring_handle_recv(l, idx, cqe);
+                break;
+            case URING_OP_SEND:
+                uring_handle_send(l, idx, cqe);
+                break;
+            default:
+                break;
+        }
+
+        head++;
+        n++;
+    }
+
+    __atomic_store_n(l->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+
+// Submits the queued requests and waits up to timeout_ms for completions. Returns their number, 0 on timeout, -1 on
+// error
+static int uring_wait(uring_loop* l, int32_t timeout_ms) {
+    const int reaped = uring_reap(l);
+    if (reaped > 0 && l->to_submit == 0)
+        return reaped;
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (long long) (timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    const int ret = uring_enter(l->ring_fd, l->to_submit, reaped > 0 ? 0 : 1,
+                                IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    l->enter_calls++;
+    l->to_submit = 0;
+    if (ret < 0 && errno != ETIME && errno != EINTR)
+        return -1;
+
+    return reaped + uring_reap(l);
+}
+
+
+static int64_t uring_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static int32_t uring_read(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    uring_loop* l = (uring_loop*) arg;
+    uring_conn* c = &l->conns[l->current];
+
+    uint16_t limit = l->frame_end;
+    if (!l->serving) {
+        const int64_t deadline = uring_now_ms() + timeout_ms;
+        while (c->in_len - c->in_pos < count && !c->closing) {
+            int32_t left = -1;
+            if (timeout_ms >= 0) {
+                left = (int32_t) (deadline - uring_now_ms());
+                if (left < 0)
+                    left = 0;
+            }
+
+            const int ret = uring_wait(l, left);
+            if (ret < 0)
+                return -1;
+
+            if (ret == 0 && left >= 0)
+                break;
+        }
+
+        if (c->closing && c->in_len == c->in_pos)
+            return -1;
+
+        limit = c->in_len;
+    }
+
+    // A server instance never reads past the frame being served, even when flushing
+    uint16_t n = (uint16_t) (limit - c->in_pos);
+    if (n > count)
+        n = count;
+
+    memcpy(buf, c->in + c->in_pos, n);
+    c->in_pos += n;
+    if (c->in_pos == c->in_len) {
+        c->in_pos = 0;
+        c->in_len = 0;
+        l->frame_end = 0;
+    }
+
+    return n;
+}
+
+
+static int32_t uring_write(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
+    uring_loop* l = (uring_loop*) arg;
+    uring_conn* c = &l->conns[l->current];
+
+    if (c->closing || URING_CONN_BUF_SIZE - c->out_len < count)
+        return -1;
+
+    memcpy(c->out + c->out_len, buf, count);
+    c->out_len += count;
+    c->send_timeout_ms = timeout_ms;
+
+    // Client requests are submitted with the wait for the response, server responses once the input is served
+    if (!l->serving && !c->send_pending)
+        uring_send(l, l->current);
+
+    return count;
+}
+
+
+static void uring_platform_conf(uring_loop* l, nmbs_platform_conf* conf) {
+    nmbs_platform_conf_create(conf);
+    conf->transport = NMBS_TRANSPORT_TCP;
+    conf->read = uring_read;
+    conf->write = uring_write;
+    conf->arg = l;
+}
+
+
+static void uring_server_listen(uring_loop* l, int listen_fd) {
+    l->listen_fd = listen_fd;
+    uring_arm_accept(l);
+}
+
+
+static void uring_client_connect(uring_loop* l, int fd) {
+    l->conns[0].fd = fd;
+    l->conns[0].send_timeout_ms = -1;
+    l->current = 0;
+    l->serving = false;
+    uring_arm_recv(l, 0);
+}
+
+
+// Polls the server instance for every complete frame buffered on the connection, while there is room for the
+// responses, then sends them
+static void uring_conn_serve(uring_loop* l, nmbs_t* server, uint16_t idx) {
+    uring_conn* c = &l->conns[idx];
+    if (c->closing)
+        return;
+
+    l->current = idx;
+    l->serving = true;
+
+    while (URING_CONN_BUF_SIZE - c->out_len >= NMBS_MSG_BUF_SIZE) {
+        const uint16_t available = (uint16_t) (c->in_len - c->in_pos);
+        if (available < 6)
+            break;
+
+        const uint16_t length = (uint16_t) (c->in[c->in_pos + 4] << 8 | c->in[c->in_pos + 5]);
+        if (length < 2 || length > NMBS_MAX_PDU_SIZE + 1) {
+            uring_conn_close(l, idx);
+            return;
+        }
+
+        if (available < 6 + length)
+            break;
+
+        l->frame_end = (uint16_t) (c->in_pos + 6 + length);
+        if (nmbs_server_poll(server) != NMBS_ERROR_NONE) {
+            uring_conn_close(l, idx);
+            return;
+        }
+
+        // Whatever the instance didn't read of the frame is discarded
+        if (c->in_len > 0)
+            c->in_pos = l->frame_end;
+    }
+
+    if (c->out_len > 0 && !c->send_pending)
+        uring_send(l, idx);
+}
+
+
+// Waits up to timeout_ms for completions, then serves the connections with new input. Returns -1 on error
+static int uring_server_run(uring_loop* l, nmbs_t* server, int32_t timeout_ms) {
+    if (uring_wait(l, timeout_ms) < 0)
+        return -1;
+
+    nmbs_set_platform_arg(server, l);
+
+    // Serving a connection may make it ready again, after a send
+    while (l->ready_count > 0) {
+        const uint16_t idx = l->ready[--l->ready_count];
+        l->conns[idx].ready = false;
+        if (l->conns[idx].fd >= 0)
+            uring_conn_serve(l, server, idx);
+    }
+
+    return 0;
+}
+
+#endif    // NMBS_URING_TRANSPORT_H
@@ -113,13 +113,10 @@ static nmbs_error server_read_coils(uint16_t address, uint16_t quantity, nmbs_bi
                                     void* arg) {
     nmbs_server_t* server = get_server(unit_id);
 
-    for (size_t i = 0; i < quantity; i++) {
-        if ((address >> 3) > COIL_BUF_SIZE) {
-            return NMBS_ERROR_INVALID_REQUEST;
-        }
-        nmbs_bitfield_write(coils_out, address, nmbs_bitfield_read(server->coils, address));
-        address++;
+    if (((address + quantity - 1) >> 3) >= COIL_BUF_SIZE) {
+        return NMBS_ERROR_INVALID_REQUEST;
     }
+    nmbs_bitfield_copy(coils_out, 0, server->coils, address, quantity);
     return NMBS_ERROR_NONE;
 }
 
@@ -148,13 +145,10 @@ static nmbs_error server_write_multiple_coils(uint16_t address, uint16_t quantit
                                               uint8_t unit_id, void* arg) {
     nmbs_server_t* server = get_server(unit_id);
 
-    for (size_t i = 0; i < quantity; i++) {
-        if ((address >> 3) > COIL_BUF_SIZE) {
-            return NMBS_ERROR_INVALID_REQUEST;
-        }
-        nmbs_bitfield_write(server->coils, address, nmbs_bitfield_read(coils, i));
-        address++;
+    if (((address + quantity - 1) >> 3) >= COIL_BUF_SIZE) {
+        return NMBS_ERROR_INVALID_REQUEST;
     }
+    nmbs_bitfield_copy(server->coils, address, coils, 0, quantity);
     return NMBS_ERROR_NONE;
 }
 
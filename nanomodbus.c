@@ -32,6 +32,87 @@
 
 #define NMBS_UNUSED_PARAM(x) ((x) = (x))
 
+#define NMBS_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+// Largest quantities whose request and response PDUs fit in NMBS_MAX_PDU_SIZE, capped to the protocol limits
+#define NMBS_READ_BITS_MAX NMBS_MIN(NMBS_MIN(2000, NMBS_BITFIELD_MAX), (NMBS_MAX_PDU_SIZE - 2) * 8)
+#define NMBS_WRITE_BITS_MAX NMBS_MIN(NMBS_MIN(1968, NMBS_BITFIELD_MAX), (NMBS_MAX_PDU_SIZE - 6) * 8)
+#define NMBS_READ_REGISTERS_MAX NMBS_MIN(125, (NMBS_MAX_PDU_SIZE - 2) / 2)
+#define NMBS_WRITE_REGISTERS_MAX NMBS_MIN(123, (NMBS_MAX_PDU_SIZE - 6) / 2)
+#define NMBS_READ_WRITE_REGISTERS_MAX NMBS_MIN(121, (NMBS_MAX_PDU_SIZE - 10) / 2)
+#define NMBS_READ_FILE_RECORD_MAX ((NMBS_MAX_PDU_SIZE - 4) / 2)
+#define NMBS_WRITE_FILE_RECORD_MAX ((NMBS_MAX_PDU_SIZE - 9) / 2)
+#define NMBS_FILE_RECORD_REQUEST_MAX NMBS_MIN(245, NMBS_MAX_PDU_SIZE - 2)
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NMBS_BIG_ENDIAN
+#endif
+
+#ifndef NMBS_SIMD_DISABLED
+#if defined(__SSE2__) || defined(__SSSE3__) || defined(__AVX2__) || defined(__BMI2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#endif
+
+// Instance configuration is either embedded in nmbs_t or shared by all the instances created from the same profile
+#ifdef NMBS_SHARED_PROFILE
+#define NMBS_PLATFORM(nmbs) ((nmbs)->profile->platform)
+#define NMBS_PLATFORM_ARG(nmbs) ((nmbs)->platform_arg)
+#define NMBS_CALLBACKS(nmbs) ((nmbs)->profile->callbacks)
+#define NMBS_CALLBACKS_ARG(nmbs) ((nmbs)->callbacks_arg)
+#define NMBS_BYTE_TIMEOUT_MS(nmbs) ((nmbs)->profile->byte_timeout_ms)
+#define NMBS_READ_TIMEOUT_MS(nmbs) ((nmbs)->profile->read_timeout_ms)
+#define NMBS_TRANSACTION_TIMEOUT_MS(nmbs) ((nmbs)->profile->transaction_timeout_ms)
+#define NMBS_ADDRESS_RTU(nmbs) ((nmbs)->profile->address_rtu)
+#else
+#define NMBS_PLATFORM(nmbs) ((nmbs)->platform)
+#define NMBS_PLATFORM_ARG(nmbs) ((nmbs)->platform.arg)
+#define NMBS_CALLBACKS(nmbs) ((nmbs)->callbacks)
+#define NMBS_CALLBACKS_ARG(nmbs) ((nmbs)->callbacks.arg)
+#define NMBS_BYTE_TIMEOUT_MS(nmbs) ((nmbs)->byte_timeout_ms)
+#define NMBS_READ_TIMEOUT_MS(nmbs) ((nmbs)->read_timeout_ms)
+#define NMBS_TRANSACTION_TIMEOUT_MS(nmbs) ((nmbs)->transaction_timeout_ms)
+#define NMBS_ADDRESS_RTU(nmbs) ((nmbs)->address_rtu)
+#endif
+
+// Platform members bound at compile time replace the ones of the instance configuration
+#ifdef NMBS_PLATFORM_TRANSPORT
+#define NMBS_TRANSPORT(nmbs) (NMBS_PLATFORM_TRANSPORT)
+#else
+#define NMBS_TRANSPORT(nmbs) (NMBS_PLATFORM(nmbs).transport)
+#endif
+
+// RTU over TCP uses the RTU framing, unit id and CRC, on a stream socket
+#define NMBS_RTU_FRAMING(nmbs)                                                                                         \
+    (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_RTU || NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_RTU_OVER_TCP)
+
+// UDP carries the same MBAP framing as TCP, one ADU per datagram
+#define NMBS_MBAP_FRAMING(nmbs)                                                                                        \
+    (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_TCP || NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_UDP)
+
+#ifdef NMBS_PLATFORM_READ
+#define NMBS_READ_FN(nmbs) NMBS_PLATFORM_READ
+#else
+#define NMBS_READ_FN(nmbs) NMBS_PLATFORM(nmbs).read
+#endif
+
+#ifdef NMBS_PLATFORM_WRITE
+#define NMBS_WRITE_FN(nmbs) NMBS_PLATFORM_WRITE
+#else
+#define NMBS_WRITE_FN(nmbs) NMBS_PLATFORM(nmbs).write
+#endif
+
+// Frames sent in segments can only have their CRC computed incrementally with the default function
+#ifdef NMBS_PLATFORM_CRC_CALC
+#define NMBS_CRC_CALC_FN(nmbs) NMBS_PLATFORM_CRC_CALC
+#define NMBS_CRC_CALC_DEFAULT(nmbs) false
+#else
+#define NMBS_CRC_CALC_FN(nmbs) NMBS_PLATFORM(nmbs).crc_calc
+#define NMBS_CRC_CALC_DEFAULT(nmbs) (NMBS_PLATFORM(nmbs).crc_calc == nmbs_crc_calc)
+#endif
+
 #ifdef NMBS_DEBUG
 #include <stdio.h>
 #define NMBS_DEBUG_PRINT(...) printf(__VA_ARGS__)
@@ -58,13 +139,9 @@ static void discard_1(nmbs_t* nmbs) {
 }
 
 
-#ifndef NMBS_SERVER_DISABLED
-#if !defined(NMBS_SERVER_READ_FILE_RECORD_DISABLED) || !defined(NMBS_SERVER_WRITE_FILE_RECORD_DISABLED)
 static void discard_n(nmbs_t* nmbs, uint16_t n) {
     nmbs->msg.buf_idx += n;
 }
-#endif
-#endif
 
 
 static uint16_t get_2(nmbs_t* nmbs) {
@@ -111,46 +188,225 @@ static void put_n(nmbs_t* nmbs, const uint8_t* data, uint8_t size) {
     nmbs->msg.buf_idx += size;
 }
 #endif
+#endif
 
 
-#if !defined(NMBS_SERVER_WRITE_FILE_RECORD_DISABLED)
-static uint16_t* get_regs(nmbs_t* nmbs, uint16_t n) {
-    uint16_t* msg_buf_ptr = (uint16_t*) (nmbs->msg.buf + nmbs->msg.buf_idx);
-    nmbs->msg.buf_idx += n * 2;
-    while (n--) {
-        msg_buf_ptr[n] = (msg_buf_ptr[n] << 8) | ((msg_buf_ptr[n] >> 8) & 0xFF);
+/* Copies n registers between host byte order and the big-endian order of the message buffer, in either direction.
+ * dst and src can have any alignment and can point to the same memory (in-place swap), but must not otherwise overlap.
+ * Blocks are processed with the widest kernel the target supports, the remainder is swapped one byte pair at a time. */
+static void swap_regs(void* dst, const void* src, uint16_t n) {
+#ifdef NMBS_BIG_ENDIAN
+    if (dst != src)
+        memcpy(dst, src, n * 2);
+#else
+    uint8_t* d = (uint8_t*) dst;
+    const uint8_t* s = (const uint8_t*) src;
+    uint16_t i = 0;
+
+#ifndef NMBS_SIMD_DISABLED
+#if defined(__AVX2__)
+    const __m256i shuffle_256 = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, 1, 0, 3, 2, 5, 4,
+                                                 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; i + 16 <= n; i += 16) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*) (s + i * 2));
+        _mm256_storeu_si256((__m256i*) (d + i * 2), _mm256_shuffle_epi8(v, shuffle_256));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i shuffle_128 = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (s + i * 2));
+        _mm_storeu_si128((__m128i*) (d + i * 2), _mm_shuffle_epi8(v, shuffle_128));
+    }
+#elif defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (s + i * 2));
+        _mm_storeu_si128((__m128i*) (d + i * 2), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 8 <= n; i += 8)
+        vst1q_u8(d + i * 2, vrev16q_u8(vld1q_u8(s + i * 2)));
+#endif
+#endif
+
+#if SIZE_MAX > 0xFFFFFFFF || SIZE_MAX == 0xFFFFFFFF
+    // Word at a time, swapping the bytes of each 16-bit lane with masks and shifts. memcpy() keeps the accesses
+    // alignment-safe and compiles to a plain load/store where unaligned accesses are allowed
+#if SIZE_MAX > 0xFFFFFFFF
+    typedef uint64_t word_t;
+    const word_t mask = 0x00FF00FF00FF00FFULL;
+#else
+    typedef uint32_t word_t;
+    const word_t mask = 0x00FF00FFUL;
+#endif
+    for (; i + sizeof(word_t) / 2 <= n; i += sizeof(word_t) / 2) {
+        word_t w;
+        memcpy(&w, s + i * 2, sizeof(word_t));
+        w = ((w & mask) << 8) | ((w >> 8) & mask);
+        memcpy(d + i * 2, &w, sizeof(word_t));
     }
-    return msg_buf_ptr;
-}
 #endif
+
+    for (; i < n; i++) {
+        const uint8_t hi = s[i * 2];
+        d[i * 2] = s[i * 2 + 1];
+        d[i * 2 + 1] = hi;
+    }
+#endif
+}
+
+
+#ifndef NMBS_SERVER_DISABLED
+/* Server handlers exchange registers with callbacks through an aligned array inside msg.buf, instead of a stack copy.
+ * msg.buf is at least 2-byte aligned, the array starts at the current index rounded down to an even offset: at odd
+ * indexes it overlaps the byte preceding the registers. */
+static uint16_t* regs_in_place(nmbs_t* nmbs) {
+    return (uint16_t*) (void*) (nmbs->msg.buf + (nmbs->msg.buf_idx & ~1U));
+}
+
+
+// Converts the n registers at the current index to host byte order, into the array returned by regs_in_place()
+static const uint16_t* get_regs_in_place(nmbs_t* nmbs, uint16_t n) {
+    uint16_t* regs = regs_in_place(nmbs);
+    memmove(regs, nmbs->msg.buf + nmbs->msg.buf_idx, n * 2);
+    swap_regs(regs, regs, n);
+    nmbs->msg.buf_idx += n * 2;
+    return regs;
+}
+
+
+// Converts the n registers of the array returned by regs_in_place() back to big-endian at the current index, then
+// restores prev_byte, the byte preceding the registers
+static void put_regs_in_place(nmbs_t* nmbs, uint16_t n, uint8_t prev_byte) {
+    uint16_t* regs = regs_in_place(nmbs);
+    swap_regs(regs, regs, n);
+    memmove(nmbs->msg.buf + nmbs->msg.buf_idx, regs, n * 2);
+    nmbs->msg.buf[nmbs->msg.buf_idx - 1] = prev_byte;
+    nmbs->msg.buf_idx += n * 2;
+}
 #endif
 
 
 #ifndef NMBS_CLIENT_DISABLED
 static void put_regs(nmbs_t* nmbs, const uint16_t* data, uint16_t n) {
-    uint16_t* msg_buf_ptr = (uint16_t*) (nmbs->msg.buf + nmbs->msg.buf_idx);
+    swap_regs(nmbs->msg.buf + nmbs->msg.buf_idx, data, n);
     nmbs->msg.buf_idx += n * 2;
-    while (n--) {
-        msg_buf_ptr[n] = (data[n] << 8) | ((data[n] >> 8) & 0xFF);
-    }
 }
 #endif
 
 
-static void swap_regs(uint16_t* data, uint16_t n) {
-    while (n--) {
-        data[n] = (data[n] << 8) | ((data[n] >> 8) & 0xFF);
+// Starts the transaction timeout, if there is one
+static void deadline_start(nmbs_t* nmbs) {
+    nmbs->deadline_set = NMBS_TRANSACTION_TIMEOUT_MS(nmbs) >= 0 && NMBS_PLATFORM(nmbs).clock_us;
+    if (nmbs->deadline_set)
+        nmbs->deadline_us = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs)) +
+                            (uint64_t) NMBS_TRANSACTION_TIMEOUT_MS(nmbs) * 1000;
+}
+
+
+// Limits a read/write timeout to the time left in the transaction. Returns false if there is none left
+static bool deadline_clamp(const nmbs_t* nmbs, int32_t* timeout_ms) {
+    if (!nmbs->deadline_set)
+        return true;
+
+    const uint64_t now = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
+    if (now >= nmbs->deadline_us)
+        return false;
+
+    // Rounded up, a timeout of 0 would make a single non-blocking attempt
+    const uint64_t left_ms = (nmbs->deadline_us - now + 999) / 1000;
+    if (*timeout_ms < 0 || (uint64_t) *timeout_ms > left_ms)
+        *timeout_ms = (int32_t) left_ms;
+
+    return true;
+}
+
+
+#ifndef NMBS_RTU_TIMING_DISABLED
+// Records that bytes have just been received or sent, when RTU timing is enabled
+static void bus_activity(nmbs_t* nmbs, int32_t bytes) {
+    if (bytes > 0 && nmbs->rtu_timing && NMBS_PLATFORM(nmbs).clock_us)
+        nmbs->rtu_timing->bus_activity_us = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
+}
+
+
+// Busy-polls the clock until wait_us have passed since start. A clock going backwards or not advancing for 65536
+// readings in a row ends the wait early
+static void bus_spin(const nmbs_t* nmbs, uint64_t start, uint32_t wait_us) {
+    uint64_t last = start;
+    uint32_t still = 0;
+    while (still < 65536) {
+        const uint64_t now = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
+        if (now < last || now - start >= wait_us)
+            return;
+
+        still = now == last ? still + 1 : 0;
+        last = now;
     }
 }
 
 
-static nmbs_error recv(nmbs_t* nmbs, uint16_t count) {
+// Waits until the bus has been silent for t3.5, when RTU timing is enabled. The wait is never longer than t3.5, even
+// if the clock went backwards since the last byte on the bus
+static void bus_turnaround(nmbs_t* nmbs) {
+    nmbs_rtu_timing* t = nmbs->rtu_timing;
+    if (!t || !NMBS_PLATFORM(nmbs).clock_us)
+        return;
+
+    uint64_t now = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
+    if (t->bus_activity_us) {
+        uint32_t wait_us = 0;
+        if (now < t->bus_activity_us)
+            wait_us = t->t35_us;
+        else if (now - t->bus_activity_us < t->t35_us)
+            wait_us = t->t35_us - (uint32_t) (now - t->bus_activity_us);
+
+        if (wait_us) {
+            if (t->delay_us)
+                t->delay_us(wait_us, NMBS_PLATFORM_ARG(nmbs));
+            else
+                bus_spin(nmbs, now, wait_us);
+
+            now = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
+            t->waits++;
+            t->wait_us += wait_us;
+            if (wait_us > t->max_wait_us)
+                t->max_wait_us = wait_us;
+        }
+
+        const uint64_t turnaround = now > t->bus_activity_us ? now - t->bus_activity_us : 0;
+        const uint32_t turnaround_us = turnaround > UINT32_MAX ? UINT32_MAX : (uint32_t) turnaround;
+        t->turnaround_us += turnaround_us;
+        if (turnaround_us > t->max_turnaround_us)
+            t->max_turnaround_us = turnaround_us;
+    }
+
+    t->frames++;
+}
+#else
+static void bus_activity(nmbs_t* nmbs, int32_t bytes) {
+    NMBS_UNUSED_PARAM(nmbs);
+    NMBS_UNUSED_PARAM(bytes);
+}
+
+
+static void bus_turnaround(nmbs_t* nmbs) {
+    NMBS_UNUSED_PARAM(nmbs);
+}
+#endif
+
+
+static nmbs_error recv_timeout(nmbs_t* nmbs, uint16_t count, int32_t timeout_ms) {
     if (nmbs->msg.complete) {
         return NMBS_ERROR_NONE;
     }
 
+    if (!deadline_clamp(nmbs, &timeout_ms))
+        return NMBS_ERROR_TIMEOUT;
+
     const int32_t ret =
-            nmbs->platform.read(nmbs->msg.buf + nmbs->msg.buf_idx, count, nmbs->byte_timeout_ms, nmbs->platform.arg);
+            NMBS_READ_FN(nmbs)(nmbs->msg.buf + nmbs->msg.buf_idx, count, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+    bus_activity(nmbs, ret);
 
     if (ret == count)
         return NMBS_ERROR_NONE;
@@ -166,8 +422,20 @@ static nmbs_error recv(nmbs_t* nmbs, uint16_t count) {
 }
 
 
-static nmbs_error send(const nmbs_t* nmbs, uint16_t count) {
-    const int32_t ret = nmbs->platform.write(nmbs->msg.buf, count, nmbs->byte_timeout_ms, nmbs->platform.arg);
+static nmbs_error recv(nmbs_t* nmbs, uint16_t count) {
+    return recv_timeout(nmbs, count, NMBS_BYTE_TIMEOUT_MS(nmbs));
+}
+
+
+static nmbs_error send(nmbs_t* nmbs, uint16_t count) {
+    // The inter-frame silence comes first, so that the time it takes is clamped from the write timeout
+    bus_turnaround(nmbs);
+    int32_t timeout_ms = NMBS_BYTE_TIMEOUT_MS(nmbs);
+    if (!deadline_clamp(nmbs, &timeout_ms))
+        return NMBS_ERROR_TIMEOUT;
+
+    const int32_t ret = NMBS_WRITE_FN(nmbs)(nmbs->msg.buf, count, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+    bus_activity(nmbs, ret);
 
     if (ret == count)
         return NMBS_ERROR_NONE;
@@ -184,7 +452,11 @@ static nmbs_error send(const nmbs_t* nmbs, uint16_t count) {
 
 
 static void flush(nmbs_t* nmbs) {
-    nmbs->platform.read(nmbs->msg.buf, sizeof(nmbs->msg.buf), 0, nmbs->platform.arg);
+    // Datagrams are received whole, there is never a partial frame to discard
+    if (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_UDP)
+        return;
+
+    bus_activity(nmbs, NMBS_READ_FN(nmbs)(nmbs->msg.buf, NMBS_MSG_BUF_SIZE, 0, NMBS_PLATFORM_ARG(nmbs)));
 }
 
 
@@ -204,8 +476,350 @@ static void msg_state_reset(nmbs_t* nmbs) {
 }
 
 
+#ifdef NMBS_BUFFER_POOL
+#if !defined(__GNUC__)
+#error "NMBS_BUFFER_POOL requires the GCC/Clang __atomic builtins"
+#endif
+
+void nmbs_buffer_pool_init(nmbs_buffer_pool* pool, nmbs_buffer* buffers, uint32_t count) {
+    pool->buffers = buffers;
+    pool->count = count;
+
+    for (uint32_t i = 0; i < count; i++)
+        buffers[i].next = i + 1 < count ? i + 2 : 0;
+
+    pool->head = count > 0 ? 1 : 0;
+}
+
+
+// Treiber stack, the ABA counter in the high half of head is incremented on every change
+static nmbs_buffer* buffer_pool_pop(nmbs_buffer_pool* pool) {
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    while (true) {
+        const uint32_t index = (uint32_t) head;
+        if (index == 0)
+            return NULL;
+
+        nmbs_buffer* buffer = &pool->buffers[index - 1];
+        const uint64_t next = __atomic_load_n(&buffer->next, __ATOMIC_RELAXED);
+        const uint64_t new_head = (((head >> 32) + 1) << 32) | next;
+        if (__atomic_compare_exchange_n(&pool->head, &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+            return buffer;
+    }
+}
+
+
+static void buffer_pool_push(nmbs_buffer_pool* pool, nmbs_buffer* buffer) {
+    const uint64_t index = (uint64_t) (buffer - pool->buffers) + 1;
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    while (true) {
+        __atomic_store_n(&buffer->next, (uint32_t) head, __ATOMIC_RELAXED);
+        const uint64_t new_head = (((head >> 32) + 1) << 32) | index;
+        if (__atomic_compare_exchange_n(&pool->head, &head, new_head, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return;
+    }
+}
+
+
+static nmbs_error msg_buf_acquire(nmbs_t* nmbs) {
+    if (!nmbs->msg.buf) {
+        nmbs_buffer* buffer = buffer_pool_pop(NMBS_PLATFORM(nmbs).buffer_pool);
+        if (!buffer)
+            return NMBS_ERROR_NO_BUFFER;
+
+        nmbs->msg.buf = buffer->data;
+    }
+
+    return NMBS_ERROR_NONE;
+}
+
+
+void nmbs_release_buffer(nmbs_t* nmbs) {
+    if (nmbs->msg.buf) {
+        // data is the first member of nmbs_buffer
+        buffer_pool_push(NMBS_PLATFORM(nmbs).buffer_pool, (nmbs_buffer*) (void*) nmbs->msg.buf);
+        nmbs->msg.buf = NULL;
+    }
+}
+#endif
+
+
+// Receives the first byte of a message, waiting for the given timeout
+static nmbs_error recv_first_byte(nmbs_t* nmbs, int32_t timeout_ms) {
+#ifdef NMBS_BUFFER_POOL
+    // A buffer is borrowed only once a message starts arriving. If the pool is exhausted, the byte is kept for the
+    // next call and the rest of the message is left on the transport
+    if (!nmbs->msg.first_byte_pending) {
+        if (!deadline_clamp(nmbs, &timeout_ms))
+            return NMBS_ERROR_TIMEOUT;
+
+        const int32_t ret = NMBS_READ_FN(nmbs)(&nmbs->msg.first_byte, 1, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+        bus_activity(nmbs, ret);
+        if (ret == 0)
+            return NMBS_ERROR_TIMEOUT;
+
+        if (ret != 1)
+            return NMBS_ERROR_TRANSPORT;
+
+        nmbs->msg.first_byte_pending = true;
+    }
+
+    const nmbs_error err = msg_buf_acquire(nmbs);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    nmbs->msg.buf[nmbs->msg.buf_idx] = nmbs->msg.first_byte;
+    nmbs->msg.first_byte_pending = false;
+
+    return NMBS_ERROR_NONE;
+#else
+    return recv_timeout(nmbs, 1, timeout_ms);
+#endif
+}
+
+
+// Receives a whole datagram, waiting for the given timeout
+static nmbs_error recv_datagram(nmbs_t* nmbs, uint16_t* size, int32_t timeout_ms) {
+#ifdef NMBS_BUFFER_POOL
+    // What is not read of a datagram is lost, so the buffer is borrowed before reading
+    const nmbs_error err = msg_buf_acquire(nmbs);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+#endif
+
+    if (!deadline_clamp(nmbs, &timeout_ms))
+        return NMBS_ERROR_TIMEOUT;
+
+    const int32_t ret = NMBS_READ_FN(nmbs)(nmbs->msg.buf, NMBS_MSG_BUF_SIZE, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+    if (ret == 0)
+        return NMBS_ERROR_TIMEOUT;
+
+    if (ret < 0 || ret > NMBS_MSG_BUF_SIZE)
+        return NMBS_ERROR_TRANSPORT;
+
+    *size = (uint16_t) ret;
+    return NMBS_ERROR_NONE;
+}
+
+
 #ifndef NMBS_CLIENT_DISABLED
-static void msg_state_req(nmbs_t* nmbs, uint8_t fc) {
+// Round-trip time estimate of a unit id, looked up like health_entry(): with `claim` set a new unit id takes the first
+// free entry, which it keeps, and it's left without an estimate if there is none
+static nmbs_rtt* rtt_entry(const nmbs_t* nmbs, uint8_t unit_id, bool claim) {
+    if (!nmbs->rtt_table || !NMBS_PLATFORM(nmbs).clock_us)
+        return NULL;
+
+    const uint16_t count = nmbs->rtt_table->count;
+    uint16_t idx = unit_id % count;
+    for (uint16_t i = 0; i < count; i++) {
+        nmbs_rtt* rtt = &nmbs->rtt_table->entries[idx];
+        if (!rtt->valid) {
+            if (!claim)
+                return NULL;
+
+            rtt->unit_id = unit_id;
+            return rtt;
+        }
+
+        if (rtt->unit_id == unit_id)
+            return rtt;
+
+        idx = idx + 1 == count ? 0 : idx + 1;
+    }
+
+    return NULL;
+}
+
+
+// Response timeout of a unit id, from its round-trip time estimate if there is one
+static int32_t rtt_timeout_ms(const nmbs_t* nmbs, uint8_t unit_id) {
+    const nmbs_rtt* rtt = rtt_entry(nmbs, unit_id, false);
+    if (!rtt)
+        return NMBS_READ_TIMEOUT_MS(nmbs);
+
+    // At least a millisecond of variation, like the clock granularity term of RFC 6298
+    const uint64_t var_us = (uint64_t) rtt->rttvar_us * 4;
+    uint64_t timeout_ms = (rtt->srtt_us + (var_us > 1000 ? var_us : 1000) + 999) / 1000;
+    if (timeout_ms < (uint64_t) nmbs->rtt_table->min_timeout_ms)
+        timeout_ms = (uint64_t) nmbs->rtt_table->min_timeout_ms;
+
+    timeout_ms <<= rtt->backoff;
+
+    // No upper limit of its own, the read timeout is used, if it's not infinite
+    int32_t max_timeout_ms = nmbs->rtt_table->max_timeout_ms;
+    if (max_timeout_ms == 0)
+        max_timeout_ms = NMBS_READ_TIMEOUT_MS(nmbs);
+
+    if (max_timeout_ms >= 0 && timeout_ms > (uint64_t) max_timeout_ms)
+        return max_timeout_ms;
+
+    return (int32_t) timeout_ms;
+}
+
+
+// Updates the round-trip time estimate of a unit id with a response, or with its timeout
+static void rtt_update(const nmbs_t* nmbs, uint8_t unit_id, bool response) {
+    // Only a response claims an entry, a unit id that never answered keeps the read timeout
+    nmbs_rtt* rtt = rtt_entry(nmbs, unit_id, response);
+    if (!rtt)
+        return;
+
+    if (!response) {
+        if (rtt->backoff < 16)
+            rtt->backoff++;
+
+        return;
+    }
+
+    const uint64_t elapsed_us = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs)) - nmbs->req_start_us;
+    const uint32_t sample_us = elapsed_us > UINT32_MAX ? UINT32_MAX : (uint32_t) elapsed_us;
+
+    if (!rtt->valid) {
+        rtt->srtt_us = sample_us;
+        rtt->rttvar_us = sample_us / 2;
+        rtt->valid = true;
+    }
+    else {
+        const uint32_t delta_us = rtt->srtt_us > sample_us ? rtt->srtt_us - sample_us : sample_us - rtt->srtt_us;
+        rtt->rttvar_us = (uint32_t) (((uint64_t) rtt->rttvar_us * 3 + delta_us) / 4);
+        rtt->srtt_us = (uint32_t) (((uint64_t) rtt->srtt_us * 7 + sample_us) / 8);
+    }
+
+    rtt->backoff = 0;
+}
+
+
+// Health state of a unit id, from the entry it took the first time it was seen. Entries are looked up by open
+// addressing from the unit id modulo the table size, and never taken back: with `claim` set a new unit id takes the
+// first free entry, and it's left untracked if there is none
+static nmbs_unit_health* health_entry(const nmbs_t* nmbs, uint8_t unit_id, bool claim) {
+    if (!nmbs->health_table || !NMBS_PLATFORM(nmbs).clock_us)
+        return NULL;
+
+    const uint16_t count = nmbs->health_table->count;
+    uint16_t idx = unit_id % count;
+    for (uint16_t i = 0; i < count; i++) {
+        nmbs_unit_health* health = &nmbs->health_table->entries[idx];
+        if (!health->valid) {
+            if (!claim)
+                return NULL;
+
+            memset(health, 0, sizeof(nmbs_unit_health));
+            health->unit_id = unit_id;
+            health->valid = true;
+            return health;
+        }
+
+        if (health->unit_id == unit_id)
+            return health;
+
+        idx = idx + 1 == count ? 0 : idx + 1;
+    }
+
+    return NULL;
+}
+
+
+// Fails a request to an offline unit id with NMBS_ERROR_UNIT_OFFLINE, unless it's time to probe it
+static nmbs_error health_check(const nmbs_t* nmbs, uint8_t unit_id) {
+    nmbs_unit_health* health = health_entry(nmbs, unit_id, false);
+    if (!health || !health->offline)
+        return NMBS_ERROR_NONE;
+
+    if (NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs)) < health->next_probe_us) {
+        health->rejected++;
+        return NMBS_ERROR_UNIT_OFFLINE;
+    }
+
+    return NMBS_ERROR_NONE;
+}
+
+
+// Counts a request sent to a unit id. A request to an offline unit id is its probe: the next one is let through a
+// backoff interval later, or sooner if this one is answered
+static void health_sent(const nmbs_t* nmbs, uint8_t unit_id) {
+    nmbs_unit_health* health = health_entry(nmbs, unit_id, true);
+    if (!health)
+        return;
+
+    if (health->offline)
+        health->next_probe_us =
+                NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs)) + (uint64_t) health->backoff_ms * 1000;
+
+    health->requests++;
+}
+
+
+// Updates the health state of a unit id with a response, or with its timeout
+static void health_update(const nmbs_t* nmbs, uint8_t unit_id, bool response) {
+    nmbs_unit_health* health = health_entry(nmbs, unit_id, false);
+    if (!health)
+        return;
+
+    if (response) {
+        health->responses++;
+        health->timeouts_in_row = 0;
+        health->offline = false;
+        health->backoff_ms = 0;
+        return;
+    }
+
+    health->timeouts++;
+    if (health->timeouts_in_row < UINT16_MAX)
+        health->timeouts_in_row++;
+
+    if (health->timeouts_in_row < nmbs->health_table->threshold)
+        return;
+
+    if (!health->offline) {
+        health->offline = true;
+        health->backoff_ms = nmbs->health_table->min_backoff_ms;
+    }
+    else {
+        const uint32_t max = nmbs->health_table->max_backoff_ms;
+        health->backoff_ms = health->backoff_ms > max / 2 ? max : health->backoff_ms * 2;
+    }
+
+    health->next_probe_us =
+            NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs)) + (uint64_t) health->backoff_ms * 1000;
+}
+
+
+// Marks the response being received as coming from the unit id of the request, once its header has been validated.
+// It counts as a response of the unit id only if its footer is received too
+static void res_header_valid(nmbs_t* nmbs, uint8_t unit_id) {
+    nmbs->res_unit_id = unit_id;
+    nmbs->res_pending = true;
+}
+
+
+// Counts the request in the health table once it has been sent
+static void req_sent(nmbs_t* nmbs) {
+    if (nmbs->req_pending) {
+        nmbs->req_pending = false;
+        health_sent(nmbs, nmbs->msg.unit_id);
+    }
+}
+
+
+static nmbs_error msg_state_req(nmbs_t* nmbs, uint8_t fc) {
+    // Requests to offline servers fail before taking a frame buffer or a transaction id
+    nmbs->req_pending = nmbs->dest_address_rtu != NMBS_BROADCAST_ADDRESS || !NMBS_RTU_FRAMING(nmbs);
+    nmbs_error err = NMBS_ERROR_NONE;
+    if (nmbs->req_pending)
+        err = health_check(nmbs, nmbs->dest_address_rtu);
+
+    if (err != NMBS_ERROR_NONE) {
+        nmbs->req_pending = false;
+        return err;
+    }
+
+#ifdef NMBS_BUFFER_POOL
+    err = msg_buf_acquire(nmbs);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+#endif
+
     if (nmbs->current_tid == UINT16_MAX)
         nmbs->current_tid = 1;
     else
@@ -213,124 +827,774 @@ static void msg_state_req(nmbs_t* nmbs, uint8_t fc) {
 
     // Flush the remaining data on the line before sending the request
     flush(nmbs);
+    deadline_start(nmbs);
+    if (nmbs->rtt_table && NMBS_PLATFORM(nmbs).clock_us)
+        nmbs->req_start_us = NMBS_PLATFORM(nmbs).clock_us(NMBS_PLATFORM_ARG(nmbs));
 
     msg_state_reset(nmbs);
     nmbs->msg.unit_id = nmbs->dest_address_rtu;
     nmbs->msg.fc = fc;
     nmbs->msg.transaction_id = nmbs->current_tid;
-    if (nmbs->msg.unit_id == NMBS_BROADCAST_ADDRESS && nmbs->platform.transport == NMBS_TRANSPORT_RTU)
+    if (nmbs->msg.unit_id == NMBS_BROADCAST_ADDRESS && NMBS_RTU_FRAMING(nmbs))
         nmbs->msg.broadcast = true;
+
+    return NMBS_ERROR_NONE;
+}
+#endif
+
+
+#ifndef NMBS_SERVER_DISABLED
+static bool is_rtu_transport(nmbs_transport transport) {
+    return transport == NMBS_TRANSPORT_RTU || transport == NMBS_TRANSPORT_RTU_OVER_TCP;
 }
 #endif
 
 
+static nmbs_error platform_conf_check(const nmbs_platform_conf* platform_conf) {
+    if (!platform_conf || platform_conf->initialized != 0xFFFFDEBE)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+#ifdef NMBS_PLATFORM_TRANSPORT
+    if (platform_conf->transport != NMBS_PLATFORM_TRANSPORT)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+#else
+    if (platform_conf->transport != NMBS_TRANSPORT_RTU && platform_conf->transport != NMBS_TRANSPORT_TCP &&
+        platform_conf->transport != NMBS_TRANSPORT_RTU_OVER_TCP && platform_conf->transport != NMBS_TRANSPORT_UDP)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+#endif
+
+#ifndef NMBS_PLATFORM_READ
+    if (!platform_conf->read)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+#endif
+
+#ifndef NMBS_PLATFORM_WRITE
+    if (!platform_conf->write)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+#endif
+
+#ifdef NMBS_BUFFER_POOL
+    if (!platform_conf->buffer_pool)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+#endif
+
+    return NMBS_ERROR_NONE;
+}
+
+
+#ifndef NMBS_SHARED_PROFILE
 nmbs_error nmbs_create(nmbs_t* nmbs, const nmbs_platform_conf* platform_conf) {
     if (!nmbs)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    memset(nmbs, 0, sizeof(nmbs_t));
+    memset(nmbs, 0, sizeof(nmbs_t));
+
+    nmbs->byte_timeout_ms = -1;
+    nmbs->read_timeout_ms = -1;
+    nmbs->transaction_timeout_ms = -1;
+
+    const nmbs_error err = platform_conf_check(platform_conf);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    nmbs->platform = *platform_conf;
+
+    return NMBS_ERROR_NONE;
+}
+
+
+void nmbs_set_read_timeout(nmbs_t* nmbs, int32_t timeout_ms) {
+    nmbs->read_timeout_ms = timeout_ms;
+}
+
+
+void nmbs_set_byte_timeout(nmbs_t* nmbs, int32_t timeout_ms) {
+    nmbs->byte_timeout_ms = timeout_ms;
+}
+
+
+void nmbs_set_transaction_timeout(nmbs_t* nmbs, int32_t timeout_ms) {
+    nmbs->transaction_timeout_ms = timeout_ms;
+}
+#endif
+
+
+static nmbs_error profile_create(nmbs_profile* profile, const nmbs_platform_conf* platform_conf) {
+    if (!profile)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    memset(profile, 0, sizeof(nmbs_profile));
+
+    profile->byte_timeout_ms = -1;
+    profile->read_timeout_ms = -1;
+    profile->transaction_timeout_ms = -1;
+
+    const nmbs_error err = platform_conf_check(platform_conf);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    profile->platform = *platform_conf;
+
+    return NMBS_ERROR_NONE;
+}
+
+
+#ifndef NMBS_SERVER_DISABLED
+nmbs_error nmbs_profile_server_create(nmbs_profile* profile, uint8_t address_rtu,
+                                      const nmbs_platform_conf* platform_conf, const nmbs_callbacks* callbacks) {
+    if (!platform_conf || (is_rtu_transport(platform_conf->transport) && address_rtu == 0))
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    if (!callbacks || callbacks->initialized != 0xFFFFDEBE)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    const nmbs_error err = profile_create(profile, platform_conf);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    profile->address_rtu = address_rtu;
+    profile->callbacks = *callbacks;
+
+    return NMBS_ERROR_NONE;
+}
+#endif
+
+
+#ifndef NMBS_CLIENT_DISABLED
+nmbs_error nmbs_profile_client_create(nmbs_profile* profile, const nmbs_platform_conf* platform_conf) {
+    return profile_create(profile, platform_conf);
+}
+#endif
+
+
+void nmbs_profile_set_read_timeout(nmbs_profile* profile, int32_t timeout_ms) {
+    profile->read_timeout_ms = timeout_ms;
+}
+
+
+void nmbs_profile_set_byte_timeout(nmbs_profile* profile, int32_t timeout_ms) {
+    profile->byte_timeout_ms = timeout_ms;
+}
+
+
+void nmbs_profile_set_transaction_timeout(nmbs_profile* profile, int32_t timeout_ms) {
+    profile->transaction_timeout_ms = timeout_ms;
+}
+
+
+nmbs_error nmbs_create_from_profile(nmbs_t* nmbs, const nmbs_profile* profile) {
+    if (!nmbs || !profile)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    memset(nmbs, 0, sizeof(nmbs_t));
+
+#ifdef NMBS_SHARED_PROFILE
+    nmbs->profile = profile;
+    nmbs->platform_arg = profile->platform.arg;
+    nmbs->callbacks_arg = profile->callbacks.arg;
+#else
+    nmbs->platform = profile->platform;
+    nmbs->callbacks = profile->callbacks;
+    nmbs->byte_timeout_ms = profile->byte_timeout_ms;
+    nmbs->read_timeout_ms = profile->read_timeout_ms;
+    nmbs->transaction_timeout_ms = profile->transaction_timeout_ms;
+    nmbs->address_rtu = profile->address_rtu;
+#endif
+
+    return NMBS_ERROR_NONE;
+}
+
+
+void nmbs_platform_conf_create(nmbs_platform_conf* platform_conf) {
+    memset(platform_conf, 0, sizeof(nmbs_platform_conf));
+    platform_conf->crc_calc = nmbs_crc_calc;
+#ifdef NMBS_PLATFORM_TRANSPORT
+    platform_conf->transport = NMBS_PLATFORM_TRANSPORT;
+#endif
+    // Workaround for older user code not calling nmbs_platform_conf_create()
+    platform_conf->initialized = 0xFFFFDEBE;
+}
+
+
+void nmbs_set_destination_rtu_address(nmbs_t* nmbs, uint8_t address) {
+    nmbs->dest_address_rtu = address;
+}
+
+
+void nmbs_set_platform_arg(nmbs_t* nmbs, void* arg) {
+    NMBS_PLATFORM_ARG(nmbs) = arg;
+}
+
+
+#ifndef NMBS_RTU_TIMING_DISABLED
+void nmbs_rtu_timing_init(nmbs_rtu_timing* timing, uint32_t baud_rate, void (*delay_us)(uint32_t us, void* arg)) {
+    memset(timing, 0, sizeof(nmbs_rtu_timing));
+    timing->delay_us = delay_us;
+    if (baud_rate > 19200) {
+        timing->t15_us = 750;
+        timing->t35_us = 1750;
+    }
+    else if (baud_rate > 0) {
+        // 11 bits per character, rounded up
+        timing->t15_us = (uint32_t) ((UINT64_C(16500000) + baud_rate - 1) / baud_rate);
+        timing->t35_us = (uint32_t) ((UINT64_C(38500000) + baud_rate - 1) / baud_rate);
+    }
+}
+
+
+void nmbs_set_rtu_timing(nmbs_t* nmbs, nmbs_rtu_timing* timing) {
+    nmbs->rtu_timing = timing && timing->t35_us ? timing : NULL;
+}
+#endif
+
+
+static uint16_t crc_update(uint16_t crc, const uint8_t* data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= (uint16_t) data[i];
+        for (int j = 8; j != 0; j--) {
+            if ((crc & 0x0001) != 0) {
+                crc >>= 1;
+                crc ^= 0xA001;
+            }
+            else
+                crc >>= 1;
+        }
+    }
+
+    return crc;
+}
+
+
+uint16_t nmbs_crc_calc(const uint8_t* data, uint32_t length, void* arg) {
+    NMBS_UNUSED_PARAM(arg);
+    const uint16_t crc = crc_update(0xFFFF, data, length);
+    return (uint16_t) (crc << 8) | (uint16_t) (crc >> 8);
+}
+
+// Bitfields are little-endian bit arrays: bit b of a 64-bit word loaded from byte i is bit i * 8 + b of the bitfield
+static uint64_t bitfield_load_64(const uint8_t* p) {
+    uint64_t w;
+#ifdef NMBS_BIG_ENDIAN
+    w = 0;
+    for (int i = 7; i >= 0; i--)
+        w = (w << 8) | p[i];
+#else
+    memcpy(&w, p, 8);
+#endif
+    return w;
+}
+
+
+static void bitfield_store_64(uint8_t* p, uint64_t w) {
+#ifdef NMBS_BIG_ENDIAN
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t) (w >> (i * 8));
+#else
+    memcpy(p, &w, 8);
+#endif
+}
+
+
+// Read up to 8 bits starting at bit offset, touching only the bytes that contain them
+static uint8_t bitfield_get_bits(const uint8_t* bf, uint16_t offset, uint8_t n) {
+    const uint8_t shift = offset & 7;
+    uint16_t bits = bf[offset >> 3] >> shift;
+    if (shift + n > 8)
+        bits |= (uint16_t) (bf[(offset >> 3) + 1] << (8 - shift));
+
+    return (uint8_t) (bits & ((1U << n) - 1));
+}
+
+
+// Write n <= 8 - (offset & 7) bits, so that they fall in a single byte
+static void bitfield_put_bits(uint8_t* bf, uint16_t offset, uint8_t bits, uint8_t n) {
+    const uint8_t shift = offset & 7;
+    const uint8_t mask = (uint8_t) (((1U << n) - 1) << shift);
+    bf[offset >> 3] = (uint8_t) ((bf[offset >> 3] & ~mask) | ((bits << shift) & mask));
+}
+
+
+void nmbs_bitfield_copy(uint8_t* dst, uint16_t dst_offset, const uint8_t* src, uint16_t src_offset, uint16_t count) {
+    // Align the destination to a byte boundary
+    if (dst_offset & 7) {
+        uint8_t n = 8 - (dst_offset & 7);
+        if (n > count)
+            n = (uint8_t) count;
+
+        bitfield_put_bits(dst, dst_offset, bitfield_get_bits(src, src_offset, n), n);
+        dst_offset += n;
+        src_offset += n;
+        count -= n;
+    }
+
+    uint8_t* d = dst + (dst_offset >> 3);
+    const uint8_t* s = src + (src_offset >> 3);
+    const uint8_t shift = src_offset & 7;
+
+    if (shift == 0) {
+        memcpy(d, s, count >> 3);
+    }
+    else {
+        // 64 destination bits per iteration, taken from 9 source bytes
+        uint16_t i = 0;
+        for (; i + 64 <= count; i += 64) {
+            const uint64_t w = (bitfield_load_64(s) >> shift) | ((uint64_t) s[8] << (64 - shift));
+            bitfield_store_64(d, w);
+            d += 8;
+            s += 8;
+        }
+
+        for (; i + 8 <= count; i += 8) {
+            *d = (uint8_t) ((s[0] >> shift) | (s[1] << (8 - shift)));
+            d++;
+            s++;
+        }
+    }
+
+    const uint16_t done = count & ~7U;
+    if (count > done) {
+        const uint8_t n = (uint8_t) (count - done);
+        bitfield_put_bits(dst, dst_offset + done, bitfield_get_bits(src, src_offset + done, n), n);
+    }
+}
+
+
+// Collect 8 values into 8 bits, value i into bit i
+static uint8_t bitfield_pack_8(const uint8_t* values) {
+    uint64_t w = bitfield_load_64(values);
+    // High bit of each byte set if the byte is non-zero, then moved to bit 0
+    w = ((((w & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | w) >> 7) & 0x0101010101010101ULL;
+#if defined(__BMI2__) && !defined(NMBS_SIMD_DISABLED)
+    return (uint8_t) _pext_u64(w, 0x0101010101010101ULL);
+#else
+    return (uint8_t) ((w * 0x0102040810204080ULL) >> 56);
+#endif
+}
+
+
+// Spread 8 bits into 8 values of 0 or 1, bit i into value i
+static void bitfield_unpack_8(uint8_t* values, uint8_t bits) {
+#if defined(__BMI2__) && !defined(NMBS_SIMD_DISABLED)
+    const uint64_t w = _pdep_u64(bits, 0x0101010101010101ULL);
+#else
+    // Broadcast the byte, keep bit i in byte i, then turn each non-zero byte into 1
+    uint64_t w = (bits * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+    w = ((((w & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | w) >> 7) & 0x0101010101010101ULL;
+#endif
+    bitfield_store_64(values, w);
+}
+
+
+void nmbs_bitfield_pack(uint8_t* bf, uint16_t offset, const uint8_t* values, uint16_t count) {
+    uint16_t i = 0;
+
+    // Align the destination to a byte boundary
+    for (; i < count && ((offset + i) & 7); i++)
+        nmbs_bitfield_write(bf, offset + i, values[i] != 0);
+
+    uint8_t* d = bf + ((offset + i) >> 3);
+
+#ifndef NMBS_SIMD_DISABLED
+#if defined(__AVX2__)
+    for (; i + 32 <= count; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*) (values + i));
+        const uint32_t zero = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        const uint32_t bits = ~zero;
+        memcpy(d, &bits, 4);
+        d += 4;
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (values + i));
+        const int zero = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        d[0] = (uint8_t) ~zero;
+        d[1] = (uint8_t) (~zero >> 8);
+        d += 2;
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t weights = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vld1q_u8(values + i);
+        const uint8x16_t m = vandq_u8(vtstq_u8(v, v), weights);
+        d[0] = vaddv_u8(vget_low_u8(m));
+        d[1] = vaddv_u8(vget_high_u8(m));
+        d += 2;
+    }
+#endif
+#endif
+
+    for (; i + 8 <= count; i += 8) {
+        *d = bitfield_pack_8(values + i);
+        d++;
+    }
+
+    for (; i < count; i++)
+        nmbs_bitfield_write(bf, offset + i, values[i] != 0);
+}
+
+
+void nmbs_bitfield_unpack(uint8_t* values, const uint8_t* bf, uint16_t offset, uint16_t count) {
+    uint16_t i = 0;
+
+    for (; i < count && ((offset + i) & 7); i++)
+        values[i] = nmbs_bitfield_read(bf, offset + i);
+
+    const uint8_t* s = bf + ((offset + i) >> 3);
+
+#if defined(__SSSE3__) && !defined(NMBS_SIMD_DISABLED)
+    // Each byte gets a copy of its source byte, then is compared against the bit it represents
+    const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+    const __m128i mask = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 1, 2, 4, 8, 16, 32, 64, (char) 128);
+    const __m128i one = _mm_set1_epi8(1);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i v = _mm_shuffle_epi8(_mm_cvtsi32_si128(s[0] | (s[1] << 8)), spread);
+        const __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, mask), mask), one);
+        _mm_storeu_si128((__m128i*) (values + i), bits);
+        s += 2;
+    }
+#elif defined(__ARM_NEON) && !defined(NMBS_SIMD_DISABLED)
+    const uint8x16_t mask = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t v = vcombine_u8(vdup_n_u8(s[0]), vdup_n_u8(s[1]));
+        vst1q_u8(values + i, vshrq_n_u8(vtstq_u8(v, mask), 7));
+        s += 2;
+    }
+#endif
+
+    for (; i + 8 <= count; i += 8) {
+        bitfield_unpack_8(values + i, *s);
+        s++;
+    }
+
+    // Fewer than 8 bits remain, all in the current source byte starting at its bit 0
+    for (uint8_t b = 0; b < 8 && i < count; b++, i++)
+        values[i] = (uint8_t) ((*s >> b) & 1);
+}
+
+
+static uint32_t bswap_32(uint32_t w) {
+#ifdef __GNUC__
+    return __builtin_bswap32(w);
+#else
+    return (w >> 24) | ((w >> 8) & 0xFF00U) | ((w << 8) & 0xFF0000U) | (w << 24);
+#endif
+}
+
 
-    nmbs->byte_timeout_ms = -1;
-    nmbs->read_timeout_ms = -1;
+static uint64_t bswap_64(uint64_t w) {
+#ifdef __GNUC__
+    return __builtin_bswap64(w);
+#else
+    return ((uint64_t) bswap_32((uint32_t) w) << 32) | bswap_32((uint32_t) (w >> 32));
+#endif
+}
 
-    if (!platform_conf || platform_conf->initialized != 0xFFFFDEBE)
-        return NMBS_ERROR_INVALID_ARGUMENT;
 
-    if (platform_conf->transport != NMBS_TRANSPORT_RTU && platform_conf->transport != NMBS_TRANSPORT_TCP)
-        return NMBS_ERROR_INVALID_ARGUMENT;
+/* Copies count values of size bytes, permuting the bytes of each value: reversing them, then swapping the bytes of each
+ * 16-bit lane. Any word order is a combination of the two, relative to the host memory layout. */
+static void values_transform(void* dst, const void* src, uint16_t count, uint8_t size, bool reverse, bool swap) {
+    uint8_t* d = (uint8_t*) dst;
+    const uint8_t* s = (const uint8_t*) src;
+    uint32_t i = 0;
+    const uint32_t bytes = (uint32_t) count * size;
 
-    if (!platform_conf->read || !platform_conf->write)
-        return NMBS_ERROR_INVALID_ARGUMENT;
+    if (!reverse && !swap) {
+        memcpy(d, s, bytes);
+        return;
+    }
 
-    nmbs->platform = *platform_conf;
+#ifndef NMBS_SIMD_DISABLED
+#if defined(__SSSE3__) || (defined(__ARM_NEON) && defined(__aarch64__))
+    uint8_t shuffle[16];
+    for (uint8_t j = 0; j < 16; j++) {
+        const uint8_t base = j & ~(size - 1);
+        const uint8_t k = j & (size - 1);
+        shuffle[j] = (uint8_t) (base + ((reverse ? size - 1 - k : k) ^ (swap ? 1 : 0)));
+    }
+#endif
+#if defined(__AVX2__)
+    const __m256i shuffle_256 = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) shuffle));
+    for (; i + 32 <= bytes; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*) (s + i));
+        _mm256_storeu_si256((__m256i*) (d + i), _mm256_shuffle_epi8(v, shuffle_256));
+    }
+#endif
+#if defined(__SSSE3__)
+    const __m128i shuffle_128 = _mm_loadu_si128((const __m128i*) shuffle);
+    for (; i + 16 <= bytes; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*) (s + i));
+        _mm_storeu_si128((__m128i*) (d + i), _mm_shuffle_epi8(v, shuffle_128));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const uint8x16_t shuffle_128 = vld1q_u8(shuffle);
+    for (; i + 16 <= bytes; i += 16)
+        vst1q_u8(d + i, vqtbl1q_u8(vld1q_u8(s + i), shuffle_128));
+#endif
+#endif
 
-    return NMBS_ERROR_NONE;
+    if (size == 2) {
+        // Reversing and swapping are the same thing on a single register
+        if (reverse != swap)
+            swap_regs(d + i, s + i, (uint16_t) ((bytes - i) / 2));
+        else
+            memcpy(d + i, s + i, bytes - i);
+    }
+    else if (size == 4) {
+        for (; i < bytes; i += 4) {
+            uint32_t w;
+            memcpy(&w, s + i, 4);
+            if (reverse)
+                w = bswap_32(w);
+            if (swap)
+                w = ((w & 0x00FF00FFU) << 8) | ((w >> 8) & 0x00FF00FFU);
+            memcpy(d + i, &w, 4);
+        }
+    }
+    else {
+        for (; i < bytes; i += 8) {
+            uint64_t w;
+            memcpy(&w, s + i, 8);
+            if (reverse)
+                w = bswap_64(w);
+            if (swap)
+                w = ((w & 0x00FF00FF00FF00FFULL) << 8) | ((w >> 8) & 0x00FF00FF00FF00FFULL);
+            memcpy(d + i, &w, 8);
+        }
+    }
 }
 
 
-void nmbs_set_read_timeout(nmbs_t* nmbs, int32_t timeout_ms) {
-    nmbs->read_timeout_ms = timeout_ms;
+// The permutation between values in host memory and their wire bytes (or their registers) in a given order
+static void values_order(nmbs_word_order order, bool registers, bool* reverse, bool* swap) {
+    *reverse = order == NMBS_ORDER_ABCD || order == NMBS_ORDER_BADC;
+    *swap = order == NMBS_ORDER_CDAB || order == NMBS_ORDER_BADC;
+#ifdef NMBS_BIG_ENDIAN
+    *reverse = !*reverse;
+    NMBS_UNUSED_PARAM(registers);
+#else
+    // Registers in host memory are their wire bytes with each 16-bit lane swapped
+    if (registers)
+        *swap = !*swap;
+#endif
 }
 
 
-void nmbs_set_byte_timeout(nmbs_t* nmbs, int32_t timeout_ms) {
-    nmbs->byte_timeout_ms = timeout_ms;
+void nmbs_values_decode(void* values_out, const uint8_t* data, uint16_t count, uint8_t value_size,
+                        nmbs_word_order order) {
+    bool reverse, swap;
+    values_order(order, false, &reverse, &swap);
+    values_transform(values_out, data, count, value_size, reverse, swap);
 }
 
 
-void nmbs_platform_conf_create(nmbs_platform_conf* platform_conf) {
-    memset(platform_conf, 0, sizeof(nmbs_platform_conf));
-    platform_conf->crc_calc = nmbs_crc_calc;
-    // Workaround for older user code not calling nmbs_platform_conf_create()
-    platform_conf->initialized = 0xFFFFDEBE;
+void nmbs_values_encode(uint8_t* data_out, const void* values, uint16_t count, uint8_t value_size,
+                        nmbs_word_order order) {
+    bool reverse, swap;
+    values_order(order, false, &reverse, &swap);
+    values_transform(data_out, values, count, value_size, reverse, swap);
 }
 
 
-void nmbs_set_destination_rtu_address(nmbs_t* nmbs, uint8_t address) {
-    nmbs->dest_address_rtu = address;
+void nmbs_values_from_registers(void* values_out, const uint16_t* registers, uint16_t count, uint8_t value_size,
+                                nmbs_word_order order) {
+    bool reverse, swap;
+    values_order(order, true, &reverse, &swap);
+    values_transform(values_out, registers, count, value_size, reverse, swap);
 }
 
 
-void nmbs_set_platform_arg(nmbs_t* nmbs, void* arg) {
-    nmbs->platform.arg = arg;
+void nmbs_values_to_registers(uint16_t* registers_out, const void* values, uint16_t count, uint8_t value_size,
+                              nmbs_word_order order) {
+    bool reverse, swap;
+    values_order(order, true, &reverse, &swap);
+    values_transform(registers_out, values, count, value_size, reverse, swap);
 }
 
 
-uint16_t nmbs_crc_calc(const uint8_t* data, uint32_t length, void* arg) {
-    NMBS_UNUSED_PARAM(arg);
-    uint16_t crc = 0xFFFF;
-    for (uint32_t i = 0; i < length; i++) {
-        crc ^= (uint16_t) data[i];
-        for (int j = 8; j != 0; j--) {
-            if ((crc & 0x0001) != 0) {
-                crc >>= 1;
-                crc ^= 0xA001;
-            }
-            else
-                crc >>= 1;
-        }
-    }
-
-    return (uint16_t) (crc << 8) | (uint16_t) (crc >> 8);
+static void capture(const nmbs_t* nmbs, uint16_t count, bool tx) {
+    if (NMBS_PLATFORM(nmbs).capture)
+        NMBS_PLATFORM(nmbs).capture(nmbs->msg.buf, count, tx, NMBS_PLATFORM_ARG(nmbs));
 }
 
+
 static nmbs_error recv_msg_footer(nmbs_t* nmbs) {
     NMBS_DEBUG_PRINT("\n");
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
-        const uint16_t crc = nmbs->platform.crc_calc(nmbs->msg.buf, nmbs->msg.buf_idx, nmbs->platform.arg);
+    if (NMBS_RTU_FRAMING(nmbs)) {
+        const uint16_t crc = NMBS_CRC_CALC_FN(nmbs)(nmbs->msg.buf, nmbs->msg.buf_idx, NMBS_PLATFORM_ARG(nmbs));
 
         const nmbs_error err = recv(nmbs, 2);
         if (err != NMBS_ERROR_NONE)
             return err;
 
         const uint16_t recv_crc = get_2(nmbs);
-        if (recv_crc != crc)
+        capture(nmbs, nmbs->msg.buf_idx, false);
+
+        if (recv_crc != crc) {
+#ifndef NMBS_CLIENT_DISABLED
+            nmbs->res_pending = false;
+#endif
             return NMBS_ERROR_CRC;
+        }
+    }
+
+#ifndef NMBS_CLIENT_DISABLED
+    if (nmbs->res_pending) {
+        nmbs->res_pending = false;
+        rtt_update(nmbs, nmbs->res_unit_id, true);
+        health_update(nmbs, nmbs->res_unit_id, true);
     }
+#endif
 
     return NMBS_ERROR_NONE;
 }
 
 
-static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received) {
-    // We wait for the read timeout here, just for the first message byte
-    int32_t old_byte_timeout = nmbs->byte_timeout_ms;
-    nmbs->byte_timeout_ms = nmbs->read_timeout_ms;
+// Layout of the data of standard PDUs: a fixed part, optionally ending with the byte count of a variable part.
+// Returns false for function codes whose data size can't be derived this way.
+static bool pdu_data_layout(uint8_t fc, bool response, uint16_t* fixed, bool* byte_count) {
+    *byte_count = false;
 
-    msg_state_reset(nmbs);
+    if (response) {
+        if (fc & 0x80) {
+            *fixed = 1;
+            return true;
+        }
 
-    *first_byte_received = false;
+        switch (fc) {
+            case 1:
+            case 2:
+            case 3:
+            case 4:
+            case 20:
+            case 21:
+            case 23:
+                *fixed = 1;
+                *byte_count = true;
+                return true;
+            case 5:
+            case 6:
+            case 15:
+            case 16:
+                *fixed = 4;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    switch (fc) {
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 5:
+        case 6:
+            *fixed = 4;
+            return true;
+        case 15:
+        case 16:
+            *fixed = 5;
+            *byte_count = true;
+            return true;
+        case 20:
+        case 21:
+            *fixed = 1;
+            *byte_count = true;
+            return true;
+        case 23:
+            *fixed = 9;
+            *byte_count = true;
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+// Receives the data of a PDU of unknown size, and the message footer.
+// On RTU the frame ends when no more bytes arrive within the byte timeout, on RTU over TCP standard PDUs are framed by
+// their layout instead. Returns NMBS_ERROR_INVALID_ARGUMENT when the end of the frame can't be detected.
+static nmbs_error recv_pdu_data(nmbs_t* nmbs, bool response, uint16_t* length) {
+    const uint16_t data_idx = nmbs->msg.buf_idx;
+    uint16_t fixed = 0;
+    bool byte_count = false;
+
+    if (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_RTU_OVER_TCP &&
+        pdu_data_layout(nmbs->msg.fc, response, &fixed, &byte_count)) {
+        nmbs_error err = recv(nmbs, fixed);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+
+        *length = fixed;
+        if (byte_count)
+            *length += nmbs->msg.buf[data_idx + fixed - 1];
+
+        if (data_idx + *length + 2 > NMBS_MSG_BUF_SIZE)
+            return NMBS_ERROR_INVALID_REQUEST;
+
+        discard_n(nmbs, fixed);
+        if (*length > fixed) {
+            err = recv(nmbs, *length - fixed);
+            if (err != NMBS_ERROR_NONE)
+                return err;
+        }
+
+        discard_n(nmbs, *length - fixed);
+    }
+    else if (NMBS_RTU_FRAMING(nmbs)) {
+        if (NMBS_BYTE_TIMEOUT_MS(nmbs) < 0)
+            return NMBS_ERROR_INVALID_ARGUMENT;
+
+        // The frame ends when no more bytes arrive within the byte timeout, the last two are the CRC. A frame still
+        // arriving when the transaction timeout expires is not complete
+        int32_t timeout_ms = NMBS_BYTE_TIMEOUT_MS(nmbs);
+        if (!deadline_clamp(nmbs, &timeout_ms))
+            return NMBS_ERROR_TIMEOUT;
+
+        const uint16_t available = NMBS_MSG_BUF_SIZE - data_idx;
+        const int32_t ret =
+                NMBS_READ_FN(nmbs)(nmbs->msg.buf + data_idx, available, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+        bus_activity(nmbs, ret);
+        if (ret < 0 || ret > available)
+            return NMBS_ERROR_TRANSPORT;
+
+        if (timeout_ms < NMBS_BYTE_TIMEOUT_MS(nmbs) && !deadline_clamp(nmbs, &timeout_ms))
+            return NMBS_ERROR_TIMEOUT;
+
+        if (ret < 2 || ret == available)
+            return NMBS_ERROR_INVALID_REQUEST;
+
+        *length = (uint16_t) (ret - 2);
+        nmbs->msg.complete = true;
+        discard_n(nmbs, *length);
+    }
+    else {
+        // The MBAP length field counts the unit id and the function code too
+        *length = (uint16_t) (((uint16_t) nmbs->msg.buf[4] << 8 | nmbs->msg.buf[5]) - 2);
+        discard_n(nmbs, *length);
+    }
+
+    return recv_msg_footer(nmbs);
+}
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
-        nmbs_error err = recv(nmbs, 1);
 
-        nmbs->byte_timeout_ms = old_byte_timeout;
+// Receives the header of a message, waiting for its first byte up to timeout_ms
+static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received, int32_t timeout_ms) {
+    msg_state_reset(nmbs);
+
+    *first_byte_received = false;
 
+    if (NMBS_RTU_FRAMING(nmbs)) {
+        // We wait for the read timeout here, just for the first message byte
+        nmbs_error err = recv_first_byte(nmbs, timeout_ms);
         if (err != NMBS_ERROR_NONE)
             return err;
 
         *first_byte_received = true;
+        if (!nmbs->deadline_set)
+            deadline_start(nmbs);
 
         nmbs->msg.unit_id = get_1(nmbs);
 
@@ -340,15 +1604,15 @@ static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received) {
 
         nmbs->msg.fc = get_1(nmbs);
     }
-    else if (nmbs->platform.transport == NMBS_TRANSPORT_TCP) {
-        nmbs_error err = recv(nmbs, 1);
-
-        nmbs->byte_timeout_ms = old_byte_timeout;
-
+    else if (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_TCP) {
+        // We wait for the read timeout here, just for the first message byte
+        nmbs_error err = recv_first_byte(nmbs, timeout_ms);
         if (err != NMBS_ERROR_NONE)
             return err;
 
         *first_byte_received = true;
+        if (!nmbs->deadline_set)
+            deadline_start(nmbs);
 
         // Advance buf_idx
         discard_1(nmbs);
@@ -366,7 +1630,7 @@ static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received) {
         nmbs->msg.unit_id = get_1(nmbs);
         nmbs->msg.fc = get_1(nmbs);
 
-        if (length < 2 || length > 255)
+        if (length < 2 || length > NMBS_MAX_PDU_SIZE + 1)
             return NMBS_ERROR_INVALID_TCP_MBAP;
 
         // Receive the rest of the message
@@ -374,11 +1638,39 @@ static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received) {
         if (err != NMBS_ERROR_NONE)
             return err;
 
+        capture(nmbs, 6 + length, false);
+
         if (protocol_id != 0)
             return NMBS_ERROR_INVALID_TCP_MBAP;
 
         nmbs->msg.complete = true;
     }
+    else if (NMBS_TRANSPORT(nmbs) == NMBS_TRANSPORT_UDP) {
+        uint16_t size = 0;
+        nmbs_error err = recv_datagram(nmbs, &size, timeout_ms);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+
+        *first_byte_received = true;
+        if (!nmbs->deadline_set)
+            deadline_start(nmbs);
+        capture(nmbs, size, false);
+
+        if (size < 8)
+            return NMBS_ERROR_INVALID_TCP_MBAP;
+
+        nmbs->msg.transaction_id = get_2(nmbs);
+        const uint16_t protocol_id = get_2(nmbs);
+        const uint16_t length = get_2(nmbs);
+        nmbs->msg.unit_id = get_1(nmbs);
+        nmbs->msg.fc = get_1(nmbs);
+
+        // The MBAP length has to match the datagram size
+        if (protocol_id != 0 || length != size - 6)
+            return NMBS_ERROR_INVALID_TCP_MBAP;
+
+        nmbs->msg.complete = true;
+    }
 
     return NMBS_ERROR_NONE;
 }
@@ -387,10 +1679,10 @@ static nmbs_error recv_msg_header(nmbs_t* nmbs, bool* first_byte_received) {
 static void put_msg_header(nmbs_t* nmbs, uint16_t data_length) {
     msg_buf_reset(nmbs);
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
+    if (NMBS_RTU_FRAMING(nmbs)) {
         put_1(nmbs, nmbs->msg.unit_id);
     }
-    else if (nmbs->platform.transport == NMBS_TRANSPORT_TCP) {
+    else if (NMBS_MBAP_FRAMING(nmbs)) {
         put_2(nmbs, nmbs->msg.transaction_id);
         put_2(nmbs, 0);
         put_2(nmbs, (uint16_t) (1 + 1 + data_length));
@@ -404,7 +1696,7 @@ static void put_msg_header(nmbs_t* nmbs, uint16_t data_length) {
 #ifndef NMBS_SERVER_DISABLED
 #if !defined(NMBS_SERVER_READ_DEVICE_IDENTIFICATION_DISABLED)
 static void set_msg_header_size(nmbs_t* nmbs, uint16_t data_length) {
-    if (nmbs->platform.transport == NMBS_TRANSPORT_TCP) {
+    if (NMBS_MBAP_FRAMING(nmbs)) {
         data_length += 2;
         set_2(nmbs, data_length, 4);
     }
@@ -416,28 +1708,88 @@ static void set_msg_header_size(nmbs_t* nmbs, uint16_t data_length) {
 static nmbs_error send_msg(nmbs_t* nmbs) {
     NMBS_DEBUG_PRINT("\n");
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
-        const uint16_t crc = nmbs->platform.crc_calc(nmbs->msg.buf, nmbs->msg.buf_idx, nmbs->platform.arg);
+    if (NMBS_RTU_FRAMING(nmbs)) {
+        const uint16_t crc = NMBS_CRC_CALC_FN(nmbs)(nmbs->msg.buf, nmbs->msg.buf_idx, NMBS_PLATFORM_ARG(nmbs));
         put_2(nmbs, crc);
     }
 
+    capture(nmbs, nmbs->msg.buf_idx, true);
+
     const nmbs_error err = send(nmbs, nmbs->msg.buf_idx);
+#ifndef NMBS_CLIENT_DISABLED
+    if (err == NMBS_ERROR_NONE)
+        req_sent(nmbs);
+#endif
 
     return err;
 }
 
 
+#if !defined(NMBS_CLIENT_DISABLED) ||                                                                                  \
+        (!defined(NMBS_SERVER_DISABLED) && (!defined(NMBS_SERVER_READ_HOLDING_REGISTERS_DISABLED) ||                   \
+                                            !defined(NMBS_SERVER_READ_INPUT_REGISTERS_DISABLED)))
+// Sends the message in the frame buffer followed by `length` bytes of data from elsewhere. With a writev() platform
+// function the data is sent in place, unless the CRC or the capture need the whole frame contiguous
+static nmbs_error send_msg_data(nmbs_t* nmbs, const uint8_t* data, uint16_t length) {
+    const bool gather = NMBS_PLATFORM(nmbs).writev && !NMBS_PLATFORM(nmbs).capture &&
+                        (!NMBS_RTU_FRAMING(nmbs) || NMBS_CRC_CALC_DEFAULT(nmbs));
+    if (!gather) {
+        memcpy(nmbs->msg.buf + nmbs->msg.buf_idx, data, length);
+        nmbs->msg.buf_idx += length;
+        return send_msg(nmbs);
+    }
+
+    NMBS_DEBUG_PRINT("\n");
+
+    nmbs_segment segments[3] = {{nmbs->msg.buf, nmbs->msg.buf_idx}, {data, length}, {NULL, 0}};
+    uint8_t crc_bytes[2];
+    uint8_t count = 2;
+    if (NMBS_RTU_FRAMING(nmbs)) {
+        const uint16_t crc = crc_update(crc_update(0xFFFF, nmbs->msg.buf, nmbs->msg.buf_idx), data, length);
+        crc_bytes[0] = (uint8_t) crc;
+        crc_bytes[1] = (uint8_t) (crc >> 8);
+        segments[2].data = crc_bytes;
+        segments[2].length = 2;
+        count = 3;
+    }
+
+    int32_t total = 0;
+    for (uint8_t i = 0; i < count; i++)
+        total += segments[i].length;
+
+    bus_turnaround(nmbs);
+    int32_t timeout_ms = NMBS_BYTE_TIMEOUT_MS(nmbs);
+    if (!deadline_clamp(nmbs, &timeout_ms))
+        return NMBS_ERROR_TIMEOUT;
+
+    const int32_t ret = NMBS_PLATFORM(nmbs).writev(segments, count, timeout_ms, NMBS_PLATFORM_ARG(nmbs));
+    bus_activity(nmbs, ret);
+    if (ret == total) {
+#ifndef NMBS_CLIENT_DISABLED
+        req_sent(nmbs);
+#endif
+        return NMBS_ERROR_NONE;
+    }
+
+    if (ret >= 0 && ret < total)
+        return NMBS_ERROR_TIMEOUT;
+
+    return NMBS_ERROR_TRANSPORT;
+}
+#endif
+
+
 #ifndef NMBS_SERVER_DISABLED
 static nmbs_error recv_req_header(nmbs_t* nmbs, bool* first_byte_received) {
-    const nmbs_error err = recv_msg_header(nmbs, first_byte_received);
+    const nmbs_error err = recv_msg_header(nmbs, first_byte_received, NMBS_READ_TIMEOUT_MS(nmbs));
     if (err != NMBS_ERROR_NONE)
         return err;
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
+    if (NMBS_RTU_FRAMING(nmbs)) {
         // Check if request is for us
         if (nmbs->msg.unit_id == NMBS_BROADCAST_ADDRESS)
             nmbs->msg.broadcast = true;
-        else if (nmbs->msg.unit_id != nmbs->address_rtu)
+        else if (nmbs->msg.unit_id != NMBS_ADDRESS_RTU(nmbs))
             nmbs->msg.ignored = true;
         else
             nmbs->msg.ignored = false;
@@ -449,7 +1801,8 @@ static nmbs_error recv_req_header(nmbs_t* nmbs, bool* first_byte_received) {
 
 static void put_res_header(nmbs_t* nmbs, uint16_t data_length) {
     put_msg_header(nmbs, data_length);
-    NMBS_DEBUG_PRINT("%d NMBS res -> address_rtu %d\tfc %d\t", nmbs->address_rtu, nmbs->address_rtu, nmbs->msg.fc);
+    NMBS_DEBUG_PRINT("%d NMBS res -> address_rtu %d\tfc %d\t", NMBS_ADDRESS_RTU(nmbs), NMBS_ADDRESS_RTU(nmbs),
+                     nmbs->msg.fc);
 }
 
 
@@ -462,33 +1815,55 @@ static nmbs_error send_exception_msg(nmbs_t* nmbs, uint8_t exception) {
     put_msg_header(nmbs, 1);
     put_1(nmbs, exception);
 
-    NMBS_DEBUG_PRINT("%d NMBS res -> address_rtu %d\texception %d", nmbs->address_rtu, nmbs->address_rtu, exception);
+    NMBS_DEBUG_PRINT("%d NMBS res -> address_rtu %d\texception %d", NMBS_ADDRESS_RTU(nmbs), NMBS_ADDRESS_RTU(nmbs),
+                     exception);
 
     return send_msg(nmbs);
 }
 #endif
 
 
+// Receives the header of a response, waiting for it up to the response timeout of its unit id
+static nmbs_error recv_res_msg_header(nmbs_t* nmbs) {
+    bool first_byte_received = false;
+#ifdef NMBS_CLIENT_DISABLED
+    return recv_msg_header(nmbs, &first_byte_received, NMBS_READ_TIMEOUT_MS(nmbs));
+#else
+    const uint8_t req_unit_id = nmbs->msg.unit_id;
+    nmbs->res_pending = false;
+    const nmbs_error err = recv_msg_header(nmbs, &first_byte_received, rtt_timeout_ms(nmbs, req_unit_id));
+    if (err == NMBS_ERROR_TIMEOUT && !first_byte_received) {
+        rtt_update(nmbs, req_unit_id, false);
+        health_update(nmbs, req_unit_id, false);
+    }
+
+    return err;
+#endif
+}
+
+
 static nmbs_error recv_res_header(nmbs_t* nmbs) {
     const uint16_t req_transaction_id = nmbs->msg.transaction_id;
     const uint8_t req_unit_id = nmbs->msg.unit_id;
     const uint8_t req_fc = nmbs->msg.fc;
 
-    bool first_byte_received = false;
-    nmbs_error err = recv_msg_header(nmbs, &first_byte_received);
+    nmbs_error err = recv_res_msg_header(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_TCP) {
+    if (NMBS_MBAP_FRAMING(nmbs)) {
         if (nmbs->msg.transaction_id != req_transaction_id)
             return NMBS_ERROR_INVALID_TCP_MBAP;
     }
 
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU && nmbs->msg.unit_id != req_unit_id)
+    if (NMBS_RTU_FRAMING(nmbs) && nmbs->msg.unit_id != req_unit_id)
         return NMBS_ERROR_INVALID_UNIT_ID;
 
     if (nmbs->msg.fc != req_fc) {
         if (nmbs->msg.fc - 0x80 == req_fc) {
+#ifndef NMBS_CLIENT_DISABLED
+            res_header_valid(nmbs, req_unit_id);
+#endif
             err = recv(nmbs, 1);
             if (err != NMBS_ERROR_NONE)
                 return err;
@@ -501,7 +1876,7 @@ static nmbs_error recv_res_header(nmbs_t* nmbs) {
             if (exception < 1 || exception > 4)
                 return NMBS_ERROR_INVALID_RESPONSE;
 
-            NMBS_DEBUG_PRINT("%d NMBS res <- address_rtu %d\texception %d\n", nmbs->address_rtu, nmbs->msg.unit_id,
+            NMBS_DEBUG_PRINT("%d NMBS res <- address_rtu %d\texception %d\n", NMBS_ADDRESS_RTU(nmbs), nmbs->msg.unit_id,
                              exception);
             return (nmbs_error) exception;
         }
@@ -509,7 +1884,10 @@ static nmbs_error recv_res_header(nmbs_t* nmbs) {
         return NMBS_ERROR_INVALID_RESPONSE;
     }
 
-    NMBS_DEBUG_PRINT("%d NMBS res <- address_rtu %d\tfc %d\t", nmbs->address_rtu, nmbs->msg.unit_id, nmbs->msg.fc);
+#ifndef NMBS_CLIENT_DISABLED
+    res_header_valid(nmbs, req_unit_id);
+#endif
+    NMBS_DEBUG_PRINT("%d NMBS res <- address_rtu %d\tfc %d\t", NMBS_ADDRESS_RTU(nmbs), nmbs->msg.unit_id, nmbs->msg.fc);
 
     return NMBS_ERROR_NONE;
 }
@@ -519,9 +1897,9 @@ static nmbs_error recv_res_header(nmbs_t* nmbs) {
 static void put_req_header(nmbs_t* nmbs, uint16_t data_length) {
     put_msg_header(nmbs, data_length);
 #ifdef NMBS_DEBUG
-    printf("%d ", nmbs->address_rtu);
+    printf("%d ", NMBS_ADDRESS_RTU(nmbs));
     printf("NMBS req -> ");
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
+    if (NMBS_RTU_FRAMING(nmbs)) {
         if (nmbs->msg.broadcast)
             printf("broadcast\t");
         else
@@ -549,7 +1927,7 @@ static nmbs_error recv_read_discrete_res(nmbs_t* nmbs, nmbs_bitfield values) {
     const uint8_t coils_bytes = get_1(nmbs);
     NMBS_DEBUG_PRINT("b %d\t", coils_bytes);
 
-    if (coils_bytes > NMBS_BITFIELD_BYTES_MAX) {
+    if (coils_bytes > (NMBS_READ_BITS_MAX + 7) / 8) {
         return NMBS_ERROR_INVALID_RESPONSE;
     }
 
@@ -577,7 +1955,8 @@ static nmbs_error recv_read_discrete_res(nmbs_t* nmbs, nmbs_bitfield values) {
 #if !defined(NMBS_CLIENT_DISABLED) ||                                                                                  \
         (!defined(NMBS_SERVER_DISABLED) && (!defined(NMBS_SERVER_READ_HOLDING_REGISTERS_DISABLED) ||                   \
                                             !defined(NMBS_SERVER_READ_INPUT_REGISTERS_DISABLED)))
-static nmbs_error recv_read_registers_res(nmbs_t* nmbs, uint16_t quantity, uint16_t* registers) {
+// Receives a read registers response, data points to the registers bytes in msg.buf
+static nmbs_error recv_read_registers_data(nmbs_t* nmbs, uint16_t quantity, const uint8_t** data) {
     nmbs_error err = recv_res_header(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
@@ -589,20 +1968,14 @@ static nmbs_error recv_read_registers_res(nmbs_t* nmbs, uint16_t quantity, uint1
     const uint8_t registers_bytes = get_1(nmbs);
     NMBS_DEBUG_PRINT("b %d\t", registers_bytes);
 
-    if (registers_bytes > 250)
+    if (registers_bytes > NMBS_READ_REGISTERS_MAX * 2)
         return NMBS_ERROR_INVALID_RESPONSE;
 
     err = recv(nmbs, registers_bytes);
     if (err != NMBS_ERROR_NONE)
         return err;
 
-    NMBS_DEBUG_PRINT("regs ");
-    for (int i = 0; i < registers_bytes / 2; i++) {
-        uint16_t reg = get_2(nmbs);
-        if (registers)
-            registers[i] = reg;
-        NMBS_DEBUG_PRINT("%d ", reg);
-    }
+    *data = get_n(nmbs, registers_bytes);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
@@ -613,6 +1986,24 @@ static nmbs_error recv_read_registers_res(nmbs_t* nmbs, uint16_t quantity, uint1
 
     return NMBS_ERROR_NONE;
 }
+
+
+static nmbs_error recv_read_registers_res(nmbs_t* nmbs, uint16_t quantity, uint16_t* registers) {
+    const uint8_t* registers_data = NULL;
+    const nmbs_error err = recv_read_registers_data(nmbs, quantity, &registers_data);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (registers) {
+        swap_regs(registers, registers_data, quantity);
+
+        NMBS_DEBUG_PRINT("regs ");
+        for (int i = 0; i < quantity; i++)
+            NMBS_DEBUG_PRINT("%d ", registers[i]);
+    }
+
+    return NMBS_ERROR_NONE;
+}
 #endif
 
 
@@ -735,7 +2126,7 @@ nmbs_error recv_read_file_record_res(nmbs_t* nmbs, uint16_t* registers, uint16_t
         return err;
 
     const uint8_t response_size = get_1(nmbs);
-    if (response_size > 250) {
+    if (response_size > NMBS_MAX_PDU_SIZE - 3) {
         return NMBS_ERROR_INVALID_RESPONSE;
     }
 
@@ -745,7 +2136,7 @@ nmbs_error recv_read_file_record_res(nmbs_t* nmbs, uint16_t* registers, uint16_t
 
     const uint8_t subreq_data_size = get_1(nmbs) - 1;
     const uint8_t subreq_reference_type = get_1(nmbs);
-    uint16_t* subreq_record_data = (uint16_t*) get_n(nmbs, subreq_data_size);
+    const uint8_t* subreq_record_data = get_n(nmbs, subreq_data_size);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
@@ -758,8 +2149,7 @@ nmbs_error recv_read_file_record_res(nmbs_t* nmbs, uint16_t* registers, uint16_t
         if (count != (subreq_data_size / 2))
             return NMBS_ERROR_INVALID_RESPONSE;
 
-        swap_regs(subreq_record_data, subreq_data_size / 2);
-        memcpy(registers, subreq_record_data, subreq_data_size);
+        swap_regs(registers, subreq_record_data, count);
     }
 
     return NMBS_ERROR_NONE;
@@ -777,7 +2167,7 @@ nmbs_error recv_write_file_record_res(nmbs_t* nmbs, uint16_t file_number, uint16
         return err;
 
     const uint8_t response_size = get_1(nmbs);
-    if (response_size > 251)
+    if (response_size > NMBS_MAX_PDU_SIZE - 2)
         return NMBS_ERROR_INVALID_RESPONSE;
 
     err = recv(nmbs, response_size);
@@ -791,7 +2181,7 @@ nmbs_error recv_write_file_record_res(nmbs_t* nmbs, uint16_t file_number, uint16
     NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fwrite ", subreq_file_number, subreq_record_number, subreq_record_length);
 
     uint16_t subreq_data_size = subreq_record_length * 2;
-    uint16_t* subreq_record_data = (uint16_t*) get_n(nmbs, subreq_data_size);
+    const uint8_t* subreq_record_data = get_n(nmbs, subreq_data_size);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
@@ -810,9 +2200,10 @@ nmbs_error recv_write_file_record_res(nmbs_t* nmbs, uint16_t file_number, uint16
         if (subreq_record_length != count)
             return NMBS_ERROR_INVALID_RESPONSE;
 
-        swap_regs(subreq_record_data, subreq_record_length);
-        if (memcmp(registers, subreq_record_data, subreq_data_size) != 0)
-            return NMBS_ERROR_INVALID_RESPONSE;
+        for (uint16_t i = 0; i < count; i++) {
+            if (registers[i] != ((uint16_t) subreq_record_data[i * 2] << 8 | subreq_record_data[i * 2 + 1]))
+                return NMBS_ERROR_INVALID_RESPONSE;
+        }
     }
 
     return NMBS_ERROR_NONE;
@@ -863,8 +2254,11 @@ nmbs_error recv_read_device_identification_res(nmbs_t* nmbs, uint8_t buffers_cou
     if (next_object_id_out)
         *next_object_id_out = next_object_id;
 
-    uint8_t res_size_left = 253 - 7;
+    uint8_t res_size_left = NMBS_MAX_PDU_SIZE - 7;
     for (int i = 0; i < objects_count; i++) {
+        if (res_size_left < 2)
+            return NMBS_ERROR_INVALID_RESPONSE;
+
         err = recv(nmbs, 2);
         if (err != NMBS_ERROR_NONE)
             return err;
@@ -920,15 +2314,23 @@ static nmbs_error handle_read_discrete(nmbs_t* nmbs,
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (quantity < 1 || quantity > 2000)
+        if (quantity < 1 || quantity > NMBS_READ_BITS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
         if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
         if (callback) {
-            nmbs_bitfield bitfield = {0};
-            err = callback(address, quantity, bitfield, nmbs->msg.unit_id, nmbs->callbacks.arg);
+            const uint8_t discrete_bytes = (quantity + 7) / 8;
+            put_res_header(nmbs, 1 + discrete_bytes);
+
+            put_1(nmbs, discrete_bytes);
+
+            // The callback writes the bits straight into the response
+            uint8_t* bitfield = get_n(nmbs, discrete_bytes);
+            memset(bitfield, 0, discrete_bytes);
+
+            err = callback(address, quantity, bitfield, nmbs->msg.unit_id, NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -937,18 +2339,11 @@ static nmbs_error handle_read_discrete(nmbs_t* nmbs,
             }
 
             if (!nmbs->msg.broadcast) {
-                uint8_t discrete_bytes = (quantity + 7) / 8;
-                put_res_header(nmbs, 1 + discrete_bytes);
-
-                put_1(nmbs, discrete_bytes);
-
                 NMBS_DEBUG_PRINT("b %d\t", discrete_bytes);
 
                 NMBS_DEBUG_PRINT("coils ");
-                for (int i = 0; i < discrete_bytes; i++) {
-                    put_1(nmbs, bitfield[i]);
+                for (int i = 0; i < discrete_bytes; i++)
                     NMBS_DEBUG_PRINT("%d ", bitfield[i]);
-                }
 
                 err = send_msg(nmbs);
                 if (err != NMBS_ERROR_NONE)
@@ -970,7 +2365,9 @@ static nmbs_error handle_read_discrete(nmbs_t* nmbs,
 
 #if !defined(NMBS_SERVER_READ_HOLDING_REGISTERS_DISABLED) || !defined(NMBS_SERVER_READ_INPUT_REGISTERS_DISABLED)
 static nmbs_error handle_read_registers(nmbs_t* nmbs,
-                                        nmbs_error (*callback)(uint16_t, uint16_t, uint16_t*, uint8_t, void*)) {
+                                        nmbs_error (*callback)(uint16_t, uint16_t, uint16_t*, uint8_t, void*),
+                                        nmbs_error (*callback_raw)(uint16_t, uint16_t, const uint8_t**, uint8_t,
+                                                                   void*)) {
     nmbs_error err = recv(nmbs, 4);
     if (err != NMBS_ERROR_NONE)
         return err;
@@ -985,15 +2382,20 @@ static nmbs_error handle_read_registers(nmbs_t* nmbs,
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (quantity < 1 || quantity > 125)
+        if (quantity < 1 || quantity > NMBS_READ_REGISTERS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
         if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-        if (callback) {
-            uint16_t regs[125] = {0};
-            err = callback(address, quantity, regs, nmbs->msg.unit_id, nmbs->callbacks.arg);
+        if (callback_raw) {
+            const uint8_t regs_bytes = quantity * 2;
+            put_res_header(nmbs, 1 + regs_bytes);
+
+            put_1(nmbs, regs_bytes);
+
+            const uint8_t* data = NULL;
+            err = callback_raw(address, quantity, &data, nmbs->msg.unit_id, NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1001,20 +2403,43 @@ static nmbs_error handle_read_registers(nmbs_t* nmbs,
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
             }
 
-            // TODO check all these read request broadcast use cases
+            if (!data)
+                return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+
             if (!nmbs->msg.broadcast) {
-                const uint8_t regs_bytes = quantity * 2;
-                put_res_header(nmbs, 1 + regs_bytes);
+                NMBS_DEBUG_PRINT("b %d\t", regs_bytes);
+
+                err = send_msg_data(nmbs, data, regs_bytes);
+                if (err != NMBS_ERROR_NONE)
+                    return err;
+            }
+        }
+        else if (callback) {
+            const uint8_t regs_bytes = quantity * 2;
+            put_res_header(nmbs, 1 + regs_bytes);
 
-                put_1(nmbs, regs_bytes);
+            put_1(nmbs, regs_bytes);
+
+            uint16_t* regs = regs_in_place(nmbs);
+            memset(regs, 0, regs_bytes);
+
+            err = callback(address, quantity, regs, nmbs->msg.unit_id, NMBS_CALLBACKS_ARG(nmbs));
+            if (err != NMBS_ERROR_NONE) {
+                if (nmbs_error_is_exception(err))
+                    return send_exception_msg(nmbs, err);
+
+                return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+            }
 
+            // TODO check all these read request broadcast use cases
+            if (!nmbs->msg.broadcast) {
                 NMBS_DEBUG_PRINT("b %d\t", regs_bytes);
 
                 NMBS_DEBUG_PRINT("regs ");
-                for (int i = 0; i < quantity; i++) {
-                    put_2(nmbs, regs[i]);
+                for (int i = 0; i < quantity; i++)
                     NMBS_DEBUG_PRINT("%d ", regs[i]);
-                }
+
+                put_regs_in_place(nmbs, quantity, regs_bytes);
 
                 err = send_msg(nmbs);
                 if (err != NMBS_ERROR_NONE)
@@ -1036,28 +2461,30 @@ static nmbs_error handle_read_registers(nmbs_t* nmbs,
 
 #ifndef NMBS_SERVER_READ_COILS_DISABLED
 static nmbs_error handle_read_coils(nmbs_t* nmbs) {
-    return handle_read_discrete(nmbs, nmbs->callbacks.read_coils);
+    return handle_read_discrete(nmbs, NMBS_CALLBACKS(nmbs).read_coils);
 }
 #endif
 
 
 #ifndef NMBS_SERVER_READ_DISCRETE_INPUTS_DISABLED
 static nmbs_error handle_read_discrete_inputs(nmbs_t* nmbs) {
-    return handle_read_discrete(nmbs, nmbs->callbacks.read_discrete_inputs);
+    return handle_read_discrete(nmbs, NMBS_CALLBACKS(nmbs).read_discrete_inputs);
 }
 #endif
 
 
 #ifndef NMBS_SERVER_READ_HOLDING_REGISTERS_DISABLED
 static nmbs_error handle_read_holding_registers(nmbs_t* nmbs) {
-    return handle_read_registers(nmbs, nmbs->callbacks.read_holding_registers);
+    return handle_read_registers(nmbs, NMBS_CALLBACKS(nmbs).read_holding_registers,
+                                 NMBS_CALLBACKS(nmbs).read_holding_registers_raw);
 }
 #endif
 
 
 #ifndef NMBS_SERVER_READ_INPUT_REGISTERS_DISABLED
 static nmbs_error handle_read_input_registers(nmbs_t* nmbs) {
-    return handle_read_registers(nmbs, nmbs->callbacks.read_input_registers);
+    return handle_read_registers(nmbs, NMBS_CALLBACKS(nmbs).read_input_registers,
+                                 NMBS_CALLBACKS(nmbs).read_input_registers_raw);
 }
 #endif
 
@@ -1078,12 +2505,12 @@ static nmbs_error handle_write_single_coil(nmbs_t* nmbs) {
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (nmbs->callbacks.write_single_coil) {
+        if (NMBS_CALLBACKS(nmbs).write_single_coil) {
             if (value != 0 && value != 0xFF00)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
-            err = nmbs->callbacks.write_single_coil(address, value == 0 ? false : true, nmbs->msg.unit_id,
-                                                    nmbs->callbacks.arg);
+            err = NMBS_CALLBACKS(nmbs).write_single_coil(address, value == 0 ? false : true, nmbs->msg.unit_id,
+                                                         NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1132,8 +2559,9 @@ static nmbs_error handle_write_single_register(nmbs_t* nmbs) {
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (nmbs->callbacks.write_single_register) {
-            err = nmbs->callbacks.write_single_register(address, value, nmbs->msg.unit_id, nmbs->callbacks.arg);
+        if (NMBS_CALLBACKS(nmbs).write_single_register) {
+            err = NMBS_CALLBACKS(nmbs).write_single_register(address, value, nmbs->msg.unit_id,
+                                                             NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1178,25 +2606,24 @@ static nmbs_error handle_write_multiple_coils(nmbs_t* nmbs) {
 
     NMBS_DEBUG_PRINT("a %d\tq %d\tb %d\tcoils ", address, quantity, coils_bytes);
 
-    if (coils_bytes > 246)
+    if (coils_bytes > (NMBS_WRITE_BITS_MAX + 7) / 8)
         return NMBS_ERROR_INVALID_REQUEST;
 
     err = recv(nmbs, coils_bytes);
     if (err != NMBS_ERROR_NONE)
         return err;
 
-    nmbs_bitfield coils = {0};
-    for (int i = 0; i < coils_bytes; i++) {
-        coils[i] = get_1(nmbs);
+    // The callback reads the bits straight from the request
+    const uint8_t* coils = get_n(nmbs, coils_bytes);
+    for (int i = 0; i < coils_bytes; i++)
         NMBS_DEBUG_PRINT("%d ", coils[i]);
-    }
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (quantity < 1 || quantity > 0x07B0)
+        if (quantity < 1 || quantity > NMBS_WRITE_BITS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
         if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
@@ -1208,9 +2635,9 @@ static nmbs_error handle_write_multiple_coils(nmbs_t* nmbs) {
         if ((quantity + 7) / 8 != coils_bytes)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
-        if (nmbs->callbacks.write_multiple_coils) {
-            err = nmbs->callbacks.write_multiple_coils(address, quantity, coils, nmbs->msg.unit_id,
-                                                       nmbs->callbacks.arg);
+        if (NMBS_CALLBACKS(nmbs).write_multiple_coils) {
+            err = NMBS_CALLBACKS(nmbs).write_multiple_coils(address, quantity, coils, nmbs->msg.unit_id,
+                                                            NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1255,25 +2682,23 @@ static nmbs_error handle_write_multiple_registers(nmbs_t* nmbs) {
 
     NMBS_DEBUG_PRINT("a %d\tq %d\tb %d\tregs ", address, quantity, registers_bytes);
 
+    if (registers_bytes > NMBS_WRITE_REGISTERS_MAX * 2)
+        return NMBS_ERROR_INVALID_REQUEST;
+
     err = recv(nmbs, registers_bytes);
     if (err != NMBS_ERROR_NONE)
         return err;
 
-    if (registers_bytes > 246)
-        return NMBS_ERROR_INVALID_REQUEST;
-
-    uint16_t registers[0x007B];
-    for (int i = 0; i < registers_bytes / 2; i++) {
-        registers[i] = get_2(nmbs);
-        NMBS_DEBUG_PRINT("%d ", registers[i]);
-    }
+    // Registers are converted in place once the footer has been checked
+    const uint16_t registers_idx = nmbs->msg.buf_idx;
+    discard_n(nmbs, registers_bytes);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (quantity < 1 || quantity > 0x007B)
+        if (quantity < 1 || quantity > NMBS_WRITE_REGISTERS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
         if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
@@ -1285,9 +2710,14 @@ static nmbs_error handle_write_multiple_registers(nmbs_t* nmbs) {
         if (registers_bytes != quantity * 2)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
-        if (nmbs->callbacks.write_multiple_registers) {
-            err = nmbs->callbacks.write_multiple_registers(address, quantity, registers, nmbs->msg.unit_id,
-                                                           nmbs->callbacks.arg);
+        nmbs->msg.buf_idx = registers_idx;
+        const uint16_t* registers = get_regs_in_place(nmbs, quantity);
+        for (int i = 0; i < quantity; i++)
+            NMBS_DEBUG_PRINT("%d ", registers[i]);
+
+        if (NMBS_CALLBACKS(nmbs).write_multiple_registers) {
+            err = NMBS_CALLBACKS(nmbs).write_multiple_registers(address, quantity, registers, nmbs->msg.unit_id,
+                                                                NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1320,13 +2750,33 @@ static nmbs_error handle_write_multiple_registers(nmbs_t* nmbs) {
 #endif
 
 #ifndef NMBS_SERVER_READ_FILE_RECORD_DISABLED
+static void reverse_bytes(uint8_t* buf, uint16_t n) {
+    for (uint16_t i = 0; i < n / 2; i++) {
+        const uint8_t tmp = buf[i];
+        buf[i] = buf[n - 1 - i];
+        buf[n - 1 - i] = tmp;
+    }
+}
+
+
+// Rotates the n bytes of buf left by shift, in place
+static void rotate_left(uint8_t* buf, uint16_t shift, uint16_t n) {
+    if (shift == 0)
+        return;
+
+    reverse_bytes(buf, shift);
+    reverse_bytes(buf + shift, n - shift);
+    reverse_bytes(buf, n);
+}
+
+
 static nmbs_error handle_read_file_record(nmbs_t* nmbs) {
     nmbs_error err = recv(nmbs, 1);
     if (err != NMBS_ERROR_NONE)
         return err;
 
     const uint8_t request_size = get_1(nmbs);
-    if (request_size > 245)
+    if (request_size > NMBS_FILE_RECORD_REQUEST_MAX)
         return NMBS_ERROR_INVALID_REQUEST;
 
     err = recv(nmbs, request_size);
@@ -1336,30 +2786,9 @@ static nmbs_error handle_read_file_record(nmbs_t* nmbs) {
     const uint8_t subreq_header_size = 7;
     const uint8_t subreq_count = request_size / subreq_header_size;
 
-    struct {
-        uint8_t reference_type;
-        uint16_t file_number;
-        uint16_t record_number;
-        uint16_t record_length;
-    }
-#if defined(__STDC_NO_VLA__) || defined(_MSC_VER)
-    subreq[35];    // 245 / subreq_header_size
-#else
-    subreq[subreq_count];
-#endif
-
-    uint8_t response_data_size = 0;
-
-    for (uint8_t i = 0; i < subreq_count; i++) {
-        subreq[i].reference_type = get_1(nmbs);
-        subreq[i].file_number = get_2(nmbs);
-        subreq[i].record_number = get_2(nmbs);
-        subreq[i].record_length = get_2(nmbs);
-
-        response_data_size += 2 + subreq[i].record_length * 2;
-    }
-
-    discard_n(nmbs, request_size % subreq_header_size);
+    // Sub-requests are decoded in place once the footer has been checked
+    const uint16_t request_idx = nmbs->msg.buf_idx;
+    discard_n(nmbs, request_size);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
@@ -1372,47 +2801,101 @@ static nmbs_error handle_read_file_record(nmbs_t* nmbs) {
         if (request_size < 0x07 || request_size > 0xF5)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
+        uint16_t response_data_size = 0;
+        nmbs->msg.buf_idx = request_idx;
         for (uint8_t i = 0; i < subreq_count; i++) {
-            if (subreq[i].reference_type != 0x06)
+            const uint8_t reference_type = get_1(nmbs);
+            const uint16_t file_number = get_2(nmbs);
+            const uint16_t record_number = get_2(nmbs);
+            const uint16_t record_length = get_2(nmbs);
+
+            if (reference_type != 0x06)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-            if (subreq[i].file_number == 0x0000)
+            if (file_number == 0x0000)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-            if (subreq[i].record_number > 0x270F)
+            if (record_number > 0x270F)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-            if (subreq[i].record_length > 124)
+            if (record_length > NMBS_READ_FILE_RECORD_MAX)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-            NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fread ", subreq[i].file_number, subreq[i].record_number,
-                             subreq[i].record_length);
+            NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fread ", file_number, record_number, record_length);
+
+            response_data_size += 2 + record_length * 2;
         }
 
+        if (response_data_size > NMBS_MAX_PDU_SIZE - 2)
+            return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+        if (!NMBS_CALLBACKS(nmbs).read_file_record)
+            return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+
+        /* The response is built over the request. Sub-request headers are moved to the end of msg.buf, their reference
+         * type replaced by their position, then sub-responses are written from request_idx shortest record first: in
+         * this order the pending headers always have room, as long as the response fits in the PDU. Each sub-response
+         * keeps the position of its sub-request in place of the reference type until they are rotated back in order.
+         * The response header has the same size as the request one, so sub-responses start at request_idx too. */
+        uint16_t subreq_idx = NMBS_MSG_BUF_SIZE - request_size;
+        memmove(nmbs->msg.buf + subreq_idx, nmbs->msg.buf + request_idx, request_size);
+        for (uint8_t i = 0; i < subreq_count; i++)
+            nmbs->msg.buf[subreq_idx + i * subreq_header_size] = i;
+
         put_res_header(nmbs, 1 + response_data_size);
-        put_1(nmbs, response_data_size);
+        put_1(nmbs, (uint8_t) response_data_size);
+        const uint16_t subres_idx = nmbs->msg.buf_idx;
+
+        for (; subreq_idx < NMBS_MSG_BUF_SIZE; subreq_idx += subreq_header_size) {
+            uint8_t* subreq = nmbs->msg.buf + subreq_idx;
+            for (uint16_t h = subreq_idx + subreq_header_size; h < NMBS_MSG_BUF_SIZE; h += subreq_header_size) {
+                uint8_t* other = nmbs->msg.buf + h;
+                const int cmp = memcmp(other + 5, subreq + 5, 2);
+                if (cmp < 0 || (cmp == 0 && other[0] < subreq[0]))
+                    subreq = other;
+            }
+
+            for (uint8_t b = 0; b < subreq_header_size; b++) {
+                const uint8_t tmp = nmbs->msg.buf[subreq_idx + b];
+                nmbs->msg.buf[subreq_idx + b] = subreq[b];
+                subreq[b] = tmp;
+            }
 
-        if (nmbs->callbacks.read_file_record) {
-            for (uint8_t i = 0; i < subreq_count; i++) {
-                uint16_t subreq_data_size = subreq[i].record_length * 2;
-                put_1(nmbs, subreq_data_size + 1);
-                put_1(nmbs, 0x06);    // add Reference Type const
-                uint16_t* subreq_data = (uint16_t*) get_n(nmbs, subreq_data_size);
+            const uint16_t response_idx = nmbs->msg.buf_idx;
+            nmbs->msg.buf_idx = subreq_idx;
+            const uint8_t position = get_1(nmbs);
+            const uint16_t file_number = get_2(nmbs);
+            const uint16_t record_number = get_2(nmbs);
+            const uint16_t record_length = get_2(nmbs);
+            nmbs->msg.buf_idx = response_idx;
 
-                err = nmbs->callbacks.read_file_record(subreq[i].file_number, subreq[i].record_number, subreq_data,
-                                                       subreq[i].record_length, nmbs->msg.unit_id, nmbs->callbacks.arg);
-                if (err != NMBS_ERROR_NONE) {
-                    if (nmbs_error_is_exception(err))
-                        return send_exception_msg(nmbs, err);
+            put_1(nmbs, record_length * 2 + 1);
+            put_1(nmbs, position);
 
-                    return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
-                }
+            uint16_t* subreq_data = regs_in_place(nmbs);
+            err = NMBS_CALLBACKS(nmbs).read_file_record(file_number, record_number, subreq_data, record_length,
+                                                        nmbs->msg.unit_id, NMBS_CALLBACKS_ARG(nmbs));
+            if (err != NMBS_ERROR_NONE) {
+                if (nmbs_error_is_exception(err))
+                    return send_exception_msg(nmbs, err);
 
-                swap_regs(subreq_data, subreq[i].record_length);
+                return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
             }
+
+            put_regs_in_place(nmbs, record_length, position);
         }
-        else {
-            return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+
+        // Rotates every sub-response to the position of its sub-request, restoring its reference type
+        uint16_t idx = subres_idx;
+        for (uint8_t i = 0; i < subreq_count; i++) {
+            uint16_t found = idx;
+            while (nmbs->msg.buf[found + 1] != i)
+                found += nmbs->msg.buf[found] + 1;
+
+            const uint16_t size = nmbs->msg.buf[found] + 1;
+            rotate_left(nmbs->msg.buf + idx, found - idx, found - idx + size);
+            nmbs->msg.buf[idx + 1] = 0x06;
+            idx += size;
         }
 
         if (!nmbs->msg.broadcast) {
@@ -1436,7 +2919,7 @@ static nmbs_error handle_write_file_record(nmbs_t* nmbs) {
         return err;
 
     const uint8_t request_size = get_1(nmbs);
-    if (request_size > 251) {
+    if (request_size > NMBS_MAX_PDU_SIZE - 2) {
         return NMBS_ERROR_INVALID_REQUEST;
     }
 
@@ -1476,7 +2959,7 @@ static nmbs_error handle_write_file_record(nmbs_t* nmbs) {
             if (subreq_record_number_c > 0x270F)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-            if (subreq_record_length_c > 122)
+            if (subreq_record_length_c > NMBS_WRITE_FILE_RECORD_MAX)
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
             NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fwrite ", subreq_file_number_c, subreq_record_number_c,
@@ -1497,11 +2980,13 @@ static nmbs_error handle_write_file_record(nmbs_t* nmbs) {
             const uint16_t subreq_file_number = get_2(nmbs);
             const uint16_t subreq_record_number = get_2(nmbs);
             const uint16_t subreq_record_length = get_2(nmbs);
-            uint16_t* subreq_data = get_regs(nmbs, subreq_record_length);
 
-            if (nmbs->callbacks.write_file_record) {
-                err = nmbs->callbacks.write_file_record(subreq_file_number, subreq_record_number, subreq_data,
-                                                        subreq_record_length, nmbs->msg.unit_id, nmbs->callbacks.arg);
+            if (NMBS_CALLBACKS(nmbs).write_file_record) {
+                const uint16_t subreq_data_idx = nmbs->msg.buf_idx;
+                const uint16_t* subreq_data = get_regs_in_place(nmbs, subreq_record_length);
+                err = NMBS_CALLBACKS(nmbs).write_file_record(subreq_file_number, subreq_record_number, subreq_data,
+                                                             subreq_record_length, nmbs->msg.unit_id,
+                                                             NMBS_CALLBACKS_ARG(nmbs));
                 if (err != NMBS_ERROR_NONE) {
                     if (nmbs_error_is_exception(err))
                         return send_exception_msg(nmbs, err);
@@ -1509,7 +2994,9 @@ static nmbs_error handle_write_file_record(nmbs_t* nmbs) {
                     return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
                 }
 
-                swap_regs(subreq_data, subreq_record_length);    // restore swapping
+                // Put the records back as they were received, the response echoes them
+                nmbs->msg.buf_idx = subreq_data_idx;
+                put_regs_in_place(nmbs, subreq_record_length, (uint8_t) subreq_record_length);
             }
             else {
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
@@ -1553,32 +3040,26 @@ static nmbs_error handle_read_write_registers(nmbs_t* nmbs) {
     NMBS_DEBUG_PRINT("ra %d\trq %d\t wa %d\t wq %d\t b %d\tregs ", read_address, read_quantity, write_address,
                      write_quantity, byte_count_write);
 
-    if (byte_count_write > 242)
+    if (byte_count_write > NMBS_READ_WRITE_REGISTERS_MAX * 2)
         return NMBS_ERROR_INVALID_REQUEST;
 
     err = recv(nmbs, byte_count_write);
     if (err != NMBS_ERROR_NONE)
         return err;
 
-#if defined(__STDC_NO_VLA__) || defined(_MSC_VER)
-    uint16_t registers[0x007B];
-#else
-    uint16_t registers[byte_count_write / 2];
-#endif
-    for (int i = 0; i < byte_count_write / 2; i++) {
-        registers[i] = get_2(nmbs);
-        NMBS_DEBUG_PRINT("%d ", registers[i]);
-    }
+    // Registers are converted in place once the footer has been checked
+    const uint16_t registers_idx = nmbs->msg.buf_idx;
+    discard_n(nmbs, byte_count_write);
 
     err = recv_msg_footer(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (read_quantity < 1 || read_quantity > 0x007D)
+        if (read_quantity < 1 || read_quantity > NMBS_READ_REGISTERS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
-        if (write_quantity < 1 || write_quantity > 0x007B)
+        if (write_quantity < 1 || write_quantity > NMBS_READ_WRITE_REGISTERS_MAX)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
 
         if (byte_count_write != write_quantity * 2)
@@ -1590,11 +3071,16 @@ static nmbs_error handle_read_write_registers(nmbs_t* nmbs) {
         if ((uint32_t) write_address + (uint32_t) write_quantity > ((uint32_t) 0xFFFF) + 1)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
 
-        if (!nmbs->callbacks.write_multiple_registers || !nmbs->callbacks.read_holding_registers)
+        if (!NMBS_CALLBACKS(nmbs).write_multiple_registers || !NMBS_CALLBACKS(nmbs).read_holding_registers)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
 
-        err = nmbs->callbacks.write_multiple_registers(write_address, write_quantity, registers, nmbs->msg.unit_id,
-                                                       nmbs->callbacks.arg);
+        nmbs->msg.buf_idx = registers_idx;
+        const uint16_t* registers = get_regs_in_place(nmbs, write_quantity);
+        for (int i = 0; i < write_quantity; i++)
+            NMBS_DEBUG_PRINT("%d ", registers[i]);
+
+        err = NMBS_CALLBACKS(nmbs).write_multiple_registers(write_address, write_quantity, registers, nmbs->msg.unit_id,
+                                                            NMBS_CALLBACKS_ARG(nmbs));
         if (err != NMBS_ERROR_NONE) {
             if (nmbs_error_is_exception(err))
                 return send_exception_msg(nmbs, err);
@@ -1603,13 +3089,15 @@ static nmbs_error handle_read_write_registers(nmbs_t* nmbs) {
         }
 
         if (!nmbs->msg.broadcast) {
-#if defined(__STDC_NO_VLA__) || defined(_MSC_VER)
-            uint16_t regs[125];
-#else
-            uint16_t regs[read_quantity];
-#endif
-            err = nmbs->callbacks.read_holding_registers(read_address, read_quantity, regs, nmbs->msg.unit_id,
-                                                         nmbs->callbacks.arg);
+            // The written registers are not needed anymore, the response overwrites them
+            const uint8_t regs_bytes = read_quantity * 2;
+            put_res_header(nmbs, 1 + regs_bytes);
+
+            put_1(nmbs, regs_bytes);
+
+            uint16_t* regs = regs_in_place(nmbs);
+            err = NMBS_CALLBACKS(nmbs).read_holding_registers(read_address, read_quantity, regs, nmbs->msg.unit_id,
+                                                              NMBS_CALLBACKS_ARG(nmbs));
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1617,18 +3105,13 @@ static nmbs_error handle_read_write_registers(nmbs_t* nmbs) {
                 return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
             }
 
-            const uint8_t regs_bytes = read_quantity * 2;
-            put_res_header(nmbs, 1 + regs_bytes);
-
-            put_1(nmbs, regs_bytes);
-
             NMBS_DEBUG_PRINT("b %d\t", regs_bytes);
 
             NMBS_DEBUG_PRINT("regs ");
-            for (int i = 0; i < read_quantity; i++) {
-                put_2(nmbs, regs[i]);
+            for (int i = 0; i < read_quantity; i++)
                 NMBS_DEBUG_PRINT("%d ", regs[i]);
-            }
+
+            put_regs_in_place(nmbs, read_quantity, regs_bytes);
 
             err = send_msg(nmbs);
             if (err != NMBS_ERROR_NONE)
@@ -1660,7 +3143,7 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
         return err;
 
     if (!nmbs->msg.ignored) {
-        if (!nmbs->callbacks.read_device_identification_map || !nmbs->callbacks.read_device_identification)
+        if (!NMBS_CALLBACKS(nmbs).read_device_identification_map || !NMBS_CALLBACKS(nmbs).read_device_identification)
             return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
 
         if (mei_type != 0x0E)
@@ -1678,7 +3161,7 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
             nmbs_bitfield_256 map;
             nmbs_bitfield_reset(map);
 
-            err = nmbs->callbacks.read_device_identification_map(map);
+            err = NMBS_CALLBACKS(nmbs).read_device_identification_map(map);
             if (err != NMBS_ERROR_NONE) {
                 if (nmbs_error_is_exception(err))
                     return send_exception_msg(nmbs, err);
@@ -1700,7 +3183,7 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
                 put_1(nmbs, 1);    // Number of objects
 
                 str[0] = 0;
-                err = nmbs->callbacks.read_device_identification(object_id, str);
+                err = NMBS_CALLBACKS(nmbs).read_device_identification(object_id, str);
                 if (err != NMBS_ERROR_NONE) {
                     if (nmbs_error_is_exception(err))
                         return send_exception_msg(nmbs, err);
@@ -1726,7 +3209,7 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
             const uint8_t number_of_objects_idx = nmbs->msg.buf_idx;
             put_1(nmbs, 0);
 
-            int16_t res_size_left = 253 - 7;
+            int16_t res_size_left = NMBS_MAX_PDU_SIZE - 7;
 
             uint8_t last_id = 0;
             uint8_t msg_size = 6;
@@ -1763,7 +3246,7 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
                 }
 
                 str[0] = 0;
-                err = nmbs->callbacks.read_device_identification((uint8_t) id, str);
+                err = NMBS_CALLBACKS(nmbs).read_device_identification((uint8_t) id, str);
                 if (err != NMBS_ERROR_NONE) {
                     if (nmbs_error_is_exception(err))
                         return send_exception_msg(nmbs, err);
@@ -1807,9 +3290,113 @@ static nmbs_error handle_read_device_identification(nmbs_t* nmbs) {
 #endif
 
 
+static nmbs_error handle_custom_fc(nmbs_t* nmbs, nmbs_custom_fc_handler handler) {
+    const uint16_t data_idx = nmbs->msg.buf_idx;
+    uint16_t length = 0;
+
+    nmbs_error err = recv_pdu_data(nmbs, false, &length);
+    if (err == NMBS_ERROR_INVALID_ARGUMENT) {
+        flush(nmbs);
+        if (nmbs->msg.ignored)
+            return NMBS_ERROR_NONE;
+
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+    }
+
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (nmbs->msg.ignored)
+        return NMBS_ERROR_NONE;
+
+    NMBS_DEBUG_PRINT("l %d", length);
+
+    err = handler(nmbs->msg.fc, nmbs->msg.buf + data_idx, &length, nmbs->msg.unit_id, NMBS_CALLBACKS_ARG(nmbs));
+    if (err != NMBS_ERROR_NONE) {
+        if (nmbs_error_is_exception(err))
+            return send_exception_msg(nmbs, err);
+
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+    }
+
+    if (length > NMBS_MAX_PDU_SIZE - 1)
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+
+    if (!nmbs->msg.broadcast) {
+        // The response header has the same size as the request one, the response data is already in place
+        put_res_header(nmbs, length);
+        discard_n(nmbs, length);
+
+        err = send_msg(nmbs);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+    }
+
+    return NMBS_ERROR_NONE;
+}
+
+
+static nmbs_error handle_forward(nmbs_t* nmbs) {
+    const uint16_t data_idx = nmbs->msg.buf_idx;
+    uint16_t length = 0;
+
+    nmbs_error err = recv_pdu_data(nmbs, false, &length);
+    if (err == NMBS_ERROR_INVALID_ARGUMENT) {
+        flush(nmbs);
+        if (nmbs->msg.ignored)
+            return NMBS_ERROR_NONE;
+
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+    }
+
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (nmbs->msg.ignored)
+        return NMBS_ERROR_NONE;
+
+    NMBS_DEBUG_PRINT("forward l %d", length);
+
+    // The PDU starts with the function code, just before the data
+    uint8_t* pdu = nmbs->msg.buf + data_idx - 1;
+    uint16_t pdu_length = (uint16_t) (length + 1);
+
+    err = NMBS_CALLBACKS(nmbs).forward(nmbs->msg.unit_id, pdu, &pdu_length, NMBS_CALLBACKS_ARG(nmbs));
+    if (err != NMBS_ERROR_NONE) {
+        if (nmbs_error_is_exception(err))
+            return send_exception_msg(nmbs, err);
+
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+    }
+
+    if (pdu_length > NMBS_MAX_PDU_SIZE)
+        return send_exception_msg(nmbs, NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+
+    // An empty response PDU means no response, as for broadcasts
+    if (!nmbs->msg.broadcast && pdu_length > 0) {
+        nmbs->msg.fc = pdu[0];
+        put_res_header(nmbs, (uint16_t) (pdu_length - 1));
+        discard_n(nmbs, (uint16_t) (pdu_length - 1));
+
+        err = send_msg(nmbs);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+    }
+
+    return NMBS_ERROR_NONE;
+}
+
+
 static nmbs_error handle_req_fc(nmbs_t* nmbs) {
     NMBS_DEBUG_PRINT("fc %d\t", nmbs->msg.fc);
 
+    if (NMBS_CALLBACKS(nmbs).forward)
+        return handle_forward(nmbs);
+
+    const nmbs_custom_fc_table* custom_fc_table = NMBS_CALLBACKS(nmbs).custom_fc_table;
+    if (custom_fc_table && custom_fc_table->handlers[nmbs->msg.fc])
+        return handle_custom_fc(nmbs, custom_fc_table->handlers[nmbs->msg.fc]);
+
     nmbs_error err = NMBS_ERROR_NONE;
     switch (nmbs->msg.fc) {
 #ifndef NMBS_SERVER_READ_COILS_DISABLED
@@ -1899,9 +3486,24 @@ void nmbs_callbacks_create(nmbs_callbacks* callbacks) {
 }
 
 
+void nmbs_custom_fc_table_create(nmbs_custom_fc_table* table) {
+    memset(table, 0, sizeof(nmbs_custom_fc_table));
+}
+
+
+nmbs_error nmbs_custom_fc_register(nmbs_custom_fc_table* table, uint8_t fc, nmbs_custom_fc_handler handler) {
+    if (!table || fc < 1 || fc > 127)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    table->handlers[fc] = handler;
+    return NMBS_ERROR_NONE;
+}
+
+
+#ifndef NMBS_SHARED_PROFILE
 nmbs_error nmbs_server_create(nmbs_t* nmbs, uint8_t address_rtu, const nmbs_platform_conf* platform_conf,
                               const nmbs_callbacks* callbacks) {
-    if (platform_conf->transport == NMBS_TRANSPORT_RTU && address_rtu == 0)
+    if (is_rtu_transport(platform_conf->transport) && address_rtu == 0)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if (!callbacks || callbacks->initialized != 0xFFFFDEBE)
@@ -1916,10 +3518,12 @@ nmbs_error nmbs_server_create(nmbs_t* nmbs, uint8_t address_rtu, const nmbs_plat
 
     return NMBS_ERROR_NONE;
 }
+#endif
 
 
-nmbs_error nmbs_server_poll(nmbs_t* nmbs) {
+static nmbs_error server_poll(nmbs_t* nmbs) {
     msg_state_reset(nmbs);
+    nmbs->deadline_set = false;
 
     bool first_byte_received = false;
     nmbs_error err = recv_req_header(nmbs, &first_byte_received);
@@ -1931,9 +3535,9 @@ nmbs_error nmbs_server_poll(nmbs_t* nmbs) {
     }
 
 #ifdef NMBS_DEBUG
-    printf("%d ", nmbs->address_rtu);
+    printf("%d ", NMBS_ADDRESS_RTU(nmbs));
     printf("NMBS req <- ");
-    if (nmbs->platform.transport == NMBS_TRANSPORT_RTU) {
+    if (NMBS_RTU_FRAMING(nmbs)) {
         if (nmbs->msg.broadcast)
             printf("broadcast\t");
         else
@@ -1943,7 +3547,8 @@ nmbs_error nmbs_server_poll(nmbs_t* nmbs) {
 
     err = handle_req_fc(nmbs);
     if (err != NMBS_ERROR_NONE) {
-        if (err != NMBS_ERROR_TIMEOUT)
+        // Exceptions come from complete responses to requests addressed to other servers, nothing to discard
+        if (err != NMBS_ERROR_TIMEOUT && !nmbs_error_is_exception(err))
             flush(nmbs);
 
         return err;
@@ -1952,26 +3557,94 @@ nmbs_error nmbs_server_poll(nmbs_t* nmbs) {
     return NMBS_ERROR_NONE;
 }
 
+
+nmbs_error nmbs_server_poll(nmbs_t* nmbs) {
+    const nmbs_error err = server_poll(nmbs);
+#ifdef NMBS_BUFFER_POOL
+    nmbs_release_buffer(nmbs);
+#endif
+    return err;
+}
+
+
 void nmbs_set_callbacks_arg(nmbs_t* nmbs, void* arg) {
-    nmbs->callbacks.arg = arg;
+    NMBS_CALLBACKS_ARG(nmbs) = arg;
 }
 #endif
 
 
 #ifndef NMBS_CLIENT_DISABLED
+#ifndef NMBS_SHARED_PROFILE
 nmbs_error nmbs_client_create(nmbs_t* nmbs, const nmbs_platform_conf* platform_conf) {
     return nmbs_create(nmbs, platform_conf);
 }
+#endif
+
+
+void nmbs_rtt_table_init(nmbs_rtt_table* table, nmbs_rtt* entries, uint16_t count, int32_t min_timeout_ms,
+                         int32_t max_timeout_ms) {
+    memset(entries, 0, count * sizeof(nmbs_rtt));
+    table->entries = entries;
+    table->count = count;
+    table->min_timeout_ms = min_timeout_ms < 0 ? 0 : min_timeout_ms;
+    if (max_timeout_ms <= 0)
+        table->max_timeout_ms = 0;
+    else
+        table->max_timeout_ms = max_timeout_ms < table->min_timeout_ms ? table->min_timeout_ms : max_timeout_ms;
+}
+
+
+void nmbs_set_rtt_table(nmbs_t* nmbs, nmbs_rtt_table* table) {
+    nmbs->rtt_table = table && table->count ? table : NULL;
+}
+
+
+int32_t nmbs_get_response_timeout(const nmbs_t* nmbs, uint8_t unit_id) {
+    return rtt_timeout_ms(nmbs, unit_id);
+}
+
+
+void nmbs_health_table_init(nmbs_health_table* table, nmbs_unit_health* entries, uint16_t count, uint16_t threshold,
+                            uint32_t min_backoff_ms, uint32_t max_backoff_ms) {
+    memset(entries, 0, count * sizeof(nmbs_unit_health));
+    table->entries = entries;
+    table->count = count;
+    table->threshold = threshold ? threshold : 1;
+    table->min_backoff_ms = min_backoff_ms;
+    table->max_backoff_ms = max_backoff_ms < min_backoff_ms ? min_backoff_ms : max_backoff_ms;
+}
+
+
+void nmbs_set_health_table(nmbs_t* nmbs, nmbs_health_table* table) {
+    nmbs->health_table = table && table->count ? table : NULL;
+}
+
+
+nmbs_error nmbs_get_unit_health(const nmbs_t* nmbs, uint8_t unit_id, nmbs_unit_health* health_out) {
+    if (!nmbs->health_table)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    const nmbs_unit_health* health = health_entry(nmbs, unit_id, false);
+    if (health)
+        *health_out = *health;
+    else
+        memset(health_out, 0, sizeof(nmbs_unit_health));
+
+    return NMBS_ERROR_NONE;
+}
 
 
 static nmbs_error read_discrete(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint16_t quantity, nmbs_bitfield values) {
-    if (quantity < 1 || quantity > NMBS_BITFIELD_MAX)
+    if (quantity < 1 || quantity > NMBS_READ_BITS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    msg_state_req(nmbs, fc);
+    nmbs_error err = msg_state_req(nmbs, fc);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 4);
 
     put_2(nmbs, address);
@@ -1979,7 +3652,7 @@ static nmbs_error read_discrete(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint
 
     NMBS_DEBUG_PRINT("a %d\tq %d", address, quantity);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -1996,14 +3669,17 @@ nmbs_error nmbs_read_discrete_inputs(nmbs_t* nmbs, uint16_t address, uint16_t qu
     return read_discrete(nmbs, 2, address, quantity, inputs_out);
 }
 
-static nmbs_error read_registers(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint16_t quantity, uint16_t* registers) {
-    if (quantity < 1 || quantity > 125)
+static nmbs_error read_registers_req(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint16_t quantity) {
+    if (quantity < 1 || quantity > NMBS_READ_REGISTERS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    msg_state_req(nmbs, fc);
+    nmbs_error err = msg_state_req(nmbs, fc);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 4);
 
     put_2(nmbs, address);
@@ -2011,7 +3687,12 @@ static nmbs_error read_registers(nmbs_t* nmbs, uint8_t fc, uint16_t address, uin
 
     NMBS_DEBUG_PRINT("a %d\tq %d ", address, quantity);
 
-    const nmbs_error err = send_msg(nmbs);
+    return send_msg(nmbs);
+}
+
+
+static nmbs_error read_registers(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint16_t quantity, uint16_t* registers) {
+    const nmbs_error err = read_registers_req(nmbs, fc, address, quantity);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2019,6 +3700,31 @@ static nmbs_error read_registers(nmbs_t* nmbs, uint8_t fc, uint16_t address, uin
 }
 
 
+static nmbs_error read_registers_values(nmbs_t* nmbs, uint8_t fc, uint16_t address, uint16_t count, void* values_out,
+                                        uint8_t value_size, nmbs_word_order order) {
+    if (value_size != 2 && value_size != 4 && value_size != 8)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    const uint32_t quantity = (uint32_t) count * value_size / 2;
+    if (quantity > NMBS_READ_REGISTERS_MAX)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    nmbs_error err = read_registers_req(nmbs, fc, address, (uint16_t) quantity);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    const uint8_t* data = NULL;
+    err = recv_read_registers_data(nmbs, (uint16_t) quantity, &data);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (values_out)
+        nmbs_values_decode(values_out, data, count, value_size, order);
+
+    return NMBS_ERROR_NONE;
+}
+
+
 nmbs_error nmbs_read_holding_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, uint16_t* registers_out) {
     return read_registers(nmbs, 3, address, quantity, registers_out);
 }
@@ -2029,8 +3735,23 @@ nmbs_error nmbs_read_input_registers(nmbs_t* nmbs, uint16_t address, uint16_t qu
 }
 
 
+nmbs_error nmbs_read_holding_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, void* values_out,
+                                              uint8_t value_size, nmbs_word_order order) {
+    return read_registers_values(nmbs, 3, address, count, values_out, value_size, order);
+}
+
+
+nmbs_error nmbs_read_input_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, void* values_out,
+                                            uint8_t value_size, nmbs_word_order order) {
+    return read_registers_values(nmbs, 4, address, count, values_out, value_size, order);
+}
+
+
 nmbs_error nmbs_write_single_coil(nmbs_t* nmbs, uint16_t address, bool value) {
-    msg_state_req(nmbs, 5);
+    nmbs_error err = msg_state_req(nmbs, 5);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 4);
 
     const uint16_t value_req = value ? 0xFF00 : 0;
@@ -2040,7 +3761,7 @@ nmbs_error nmbs_write_single_coil(nmbs_t* nmbs, uint16_t address, bool value) {
 
     NMBS_DEBUG_PRINT("a %d\tvalue %d ", address, value_req);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2052,7 +3773,10 @@ nmbs_error nmbs_write_single_coil(nmbs_t* nmbs, uint16_t address, bool value) {
 
 
 nmbs_error nmbs_write_single_register(nmbs_t* nmbs, uint16_t address, uint16_t value) {
-    msg_state_req(nmbs, 6);
+    nmbs_error err = msg_state_req(nmbs, 6);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 4);
 
     put_2(nmbs, address);
@@ -2060,7 +3784,7 @@ nmbs_error nmbs_write_single_register(nmbs_t* nmbs, uint16_t address, uint16_t v
 
     NMBS_DEBUG_PRINT("a %d\tvalue %d", address, value);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2072,7 +3796,7 @@ nmbs_error nmbs_write_single_register(nmbs_t* nmbs, uint16_t address, uint16_t v
 
 
 nmbs_error nmbs_write_multiple_coils(nmbs_t* nmbs, uint16_t address, uint16_t quantity, const nmbs_bitfield coils) {
-    if (quantity < 1 || quantity > 0x07B0)
+    if (quantity < 1 || quantity > NMBS_WRITE_BITS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
@@ -2080,7 +3804,10 @@ nmbs_error nmbs_write_multiple_coils(nmbs_t* nmbs, uint16_t address, uint16_t qu
 
     uint8_t coils_bytes = (quantity + 7) / 8;
 
-    msg_state_req(nmbs, 15);
+    nmbs_error err = msg_state_req(nmbs, 15);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 5 + coils_bytes);
 
     put_2(nmbs, address);
@@ -2094,7 +3821,7 @@ nmbs_error nmbs_write_multiple_coils(nmbs_t* nmbs, uint16_t address, uint16_t qu
         NMBS_DEBUG_PRINT("%d ", coils[i]);
     }
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2105,8 +3832,9 @@ nmbs_error nmbs_write_multiple_coils(nmbs_t* nmbs, uint16_t address, uint16_t qu
 }
 
 
-nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, const uint16_t* registers) {
-    if (quantity < 1 || quantity > 0x007B)
+static nmbs_error write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, const void* values,
+                                           uint8_t value_size, nmbs_word_order order) {
+    if (quantity < 1 || quantity > NMBS_WRITE_REGISTERS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) address + (uint32_t) quantity > ((uint32_t) 0xFFFF) + 1)
@@ -2114,7 +3842,10 @@ nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_
 
     const uint8_t registers_bytes = quantity * 2;
 
-    msg_state_req(nmbs, 16);
+    nmbs_error err = msg_state_req(nmbs, 16);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 5 + registers_bytes);
 
     put_2(nmbs, address);
@@ -2122,13 +3853,14 @@ nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_
     put_1(nmbs, registers_bytes);
     NMBS_DEBUG_PRINT("a %d\tq %d\tb %d\t", address, quantity, registers_bytes);
 
+    uint8_t* data = get_n(nmbs, registers_bytes);
+    nmbs_values_encode(data, values, registers_bytes / value_size, value_size, order);
+
     NMBS_DEBUG_PRINT("regs ");
-    for (int i = 0; i < quantity; i++) {
-        put_2(nmbs, registers[i]);
-        NMBS_DEBUG_PRINT("%d ", registers[i]);
-    }
+    for (int i = 0; i < quantity; i++)
+        NMBS_DEBUG_PRINT("%d ", data[i * 2] << 8 | data[i * 2 + 1]);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2139,6 +3871,24 @@ nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_
 }
 
 
+nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, const uint16_t* registers) {
+    return write_multiple_registers(nmbs, address, quantity, registers, 2, NMBS_ORDER_ABCD);
+}
+
+
+nmbs_error nmbs_write_multiple_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, const void* values,
+                                                uint8_t value_size, nmbs_word_order order) {
+    if (value_size != 2 && value_size != 4 && value_size != 8)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    const uint32_t quantity = (uint32_t) count * value_size / 2;
+    if (quantity > NMBS_WRITE_REGISTERS_MAX)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    return write_multiple_registers(nmbs, address, (uint16_t) quantity, values, value_size, order);
+}
+
+
 nmbs_error nmbs_read_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t record_number, uint16_t* registers,
                                  uint16_t count) {
     if (file_number == 0x0000)
@@ -2148,10 +3898,13 @@ nmbs_error nmbs_read_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t re
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     // In expected response: max PDU length = 253, assuming a single file request, (253 - 1 - 1 - 1 - 1) / 2 = 124
-    if (count > 124)
+    if (count > NMBS_READ_FILE_RECORD_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    msg_state_req(nmbs, 20);
+    nmbs_error err = msg_state_req(nmbs, 20);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 8);
 
     put_1(nmbs, 7);    // add Byte Count
@@ -2161,7 +3914,7 @@ nmbs_error nmbs_read_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t re
     put_2(nmbs, count);
     NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fread ", file_number, record_number, count);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2177,12 +3930,15 @@ nmbs_error nmbs_write_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t r
     if (record_number > 0x270F)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    if (count > 122)
+    if (count > NMBS_WRITE_FILE_RECORD_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     const uint16_t data_size = count * 2;
 
-    msg_state_req(nmbs, 21);
+    nmbs_error err = msg_state_req(nmbs, 21);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 8 + data_size);
 
     put_1(nmbs, 7 + data_size);    // add Byte Count
@@ -2193,7 +3949,7 @@ nmbs_error nmbs_write_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t r
     put_regs(nmbs, registers, count);
     NMBS_DEBUG_PRINT("a %d\tr %d\tl %d\t fwrite ", file_number, record_number, count);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2207,13 +3963,13 @@ nmbs_error nmbs_write_file_record(nmbs_t* nmbs, uint16_t file_number, uint16_t r
 nmbs_error nmbs_read_write_registers(nmbs_t* nmbs, uint16_t read_address, uint16_t read_quantity,
                                      uint16_t* registers_out, uint16_t write_address, uint16_t write_quantity,
                                      const uint16_t* registers) {
-    if (read_quantity < 1 || read_quantity > 0x007D)
+    if (read_quantity < 1 || read_quantity > NMBS_READ_REGISTERS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) read_address + (uint32_t) read_quantity > ((uint32_t) 0xFFFF) + 1)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    if (write_quantity < 1 || write_quantity > 0x0079)
+    if (write_quantity < 1 || write_quantity > NMBS_READ_WRITE_REGISTERS_MAX)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
     if ((uint32_t) write_address + (uint32_t) write_quantity > ((uint32_t) 0xFFFF) + 1)
@@ -2221,7 +3977,10 @@ nmbs_error nmbs_read_write_registers(nmbs_t* nmbs, uint16_t read_address, uint16
 
     const uint8_t registers_bytes = write_quantity * 2;
 
-    msg_state_req(nmbs, 23);
+    nmbs_error err = msg_state_req(nmbs, 23);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 9 + registers_bytes);
 
     put_2(nmbs, read_address);
@@ -2234,12 +3993,12 @@ nmbs_error nmbs_read_write_registers(nmbs_t* nmbs, uint16_t read_address, uint16
     NMBS_DEBUG_PRINT("write a %d\tq %d\tb %d\t", write_address, write_quantity, registers_bytes);
 
     NMBS_DEBUG_PRINT("regs ");
-    for (int i = 0; i < write_quantity; i++) {
-        put_2(nmbs, registers[i]);
+    for (int i = 0; i < write_quantity; i++)
         NMBS_DEBUG_PRINT("%d ", registers[i]);
-    }
 
-    const nmbs_error err = send_msg(nmbs);
+    put_regs(nmbs, registers, write_quantity);
+
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2255,13 +4014,16 @@ nmbs_error nmbs_read_device_identification_basic(nmbs_t* nmbs, char* vendor_name
     uint8_t next_object_id = 0x00;
 
     while (next_object_id != 0x7F) {
-        msg_state_req(nmbs, 43);
+        nmbs_error err = msg_state_req(nmbs, 43);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+
         put_msg_header(nmbs, 3);
         put_1(nmbs, 0x0E);
         put_1(nmbs, 1);
         put_1(nmbs, next_object_id);
 
-        nmbs_error err = send_msg(nmbs);
+        err = send_msg(nmbs);
         if (err != NMBS_ERROR_NONE)
             return err;
 
@@ -2291,13 +4053,16 @@ nmbs_error nmbs_read_device_identification_regular(nmbs_t* nmbs, char* vendor_ur
     uint8_t next_object_id = 0x03;
 
     while (next_object_id != 0x7F) {
-        msg_state_req(nmbs, 43);
+        nmbs_error err = msg_state_req(nmbs, 43);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+
         put_req_header(nmbs, 3);
         put_1(nmbs, 0x0E);
         put_1(nmbs, 2);
         put_1(nmbs, next_object_id);
 
-        nmbs_error err = send_msg(nmbs);
+        err = send_msg(nmbs);
         if (err != NMBS_ERROR_NONE)
             return err;
 
@@ -2329,13 +4094,16 @@ nmbs_error nmbs_read_device_identification_extended(nmbs_t* nmbs, uint8_t object
     uint8_t next_object_id = object_id_start;
 
     while (next_object_id != 0x7F) {
-        msg_state_req(nmbs, 43);
+        nmbs_error err = msg_state_req(nmbs, 43);
+        if (err != NMBS_ERROR_NONE)
+            return err;
+
         put_req_header(nmbs, 3);
         put_1(nmbs, 0x0E);
         put_1(nmbs, 3);
         put_1(nmbs, next_object_id);
 
-        nmbs_error err = send_msg(nmbs);
+        err = send_msg(nmbs);
         if (err != NMBS_ERROR_NONE)
             return err;
 
@@ -2359,13 +4127,16 @@ nmbs_error nmbs_read_device_identification(nmbs_t* nmbs, uint8_t object_id, char
     if (object_id > 0x06 && object_id < 0x80)
         return NMBS_ERROR_INVALID_ARGUMENT;
 
-    msg_state_req(nmbs, 43);
+    nmbs_error err = msg_state_req(nmbs, 43);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_req_header(nmbs, 3);
     put_1(nmbs, 0x0E);
     put_1(nmbs, 4);
     put_1(nmbs, object_id);
 
-    const nmbs_error err = send_msg(nmbs);
+    err = send_msg(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
 
@@ -2375,20 +4146,27 @@ nmbs_error nmbs_read_device_identification(nmbs_t* nmbs, uint8_t object_id, char
 
 
 nmbs_error nmbs_send_raw_pdu(nmbs_t* nmbs, uint8_t fc, const uint8_t* data, uint16_t data_len) {
-    msg_state_req(nmbs, fc);
+    if (data_len > NMBS_MAX_PDU_SIZE - 1)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
+    nmbs_error err = msg_state_req(nmbs, fc);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
     put_msg_header(nmbs, data_len);
 
     NMBS_DEBUG_PRINT("raw ");
-    for (uint16_t i = 0; i < data_len; i++) {
-        put_1(nmbs, data[i]);
+    for (uint16_t i = 0; i < data_len; i++)
         NMBS_DEBUG_PRINT("%d ", data[i]);
-    }
 
-    return send_msg(nmbs);
+    return send_msg_data(nmbs, data, data_len);
 }
 
 
 nmbs_error nmbs_receive_raw_pdu_response(nmbs_t* nmbs, uint8_t* data_out, uint8_t data_out_len) {
+    if (data_out_len > NMBS_MAX_PDU_SIZE - 1)
+        return NMBS_ERROR_INVALID_ARGUMENT;
+
     nmbs_error err = recv_res_header(nmbs);
     if (err != NMBS_ERROR_NONE)
         return err;
@@ -2412,12 +4190,57 @@ nmbs_error nmbs_receive_raw_pdu_response(nmbs_t* nmbs, uint8_t* data_out, uint8_
 
     return NMBS_ERROR_NONE;
 }
+
+
+nmbs_error nmbs_receive_raw_pdu_response_full(nmbs_t* nmbs, uint8_t* pdu_out, uint16_t* pdu_length) {
+    const uint16_t req_transaction_id = nmbs->msg.transaction_id;
+    const uint8_t req_unit_id = nmbs->msg.unit_id;
+    const uint8_t req_fc = nmbs->msg.fc;
+
+    nmbs_error err = recv_res_msg_header(nmbs);
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    if (NMBS_MBAP_FRAMING(nmbs) && nmbs->msg.transaction_id != req_transaction_id)
+        return NMBS_ERROR_INVALID_TCP_MBAP;
+
+    if (NMBS_RTU_FRAMING(nmbs) && nmbs->msg.unit_id != req_unit_id)
+        return NMBS_ERROR_INVALID_UNIT_ID;
+
+    // Exception responses are returned as they are
+    if (nmbs->msg.fc != req_fc && nmbs->msg.fc != (uint8_t) (req_fc | 0x80))
+        return NMBS_ERROR_INVALID_RESPONSE;
+
+    res_header_valid(nmbs, req_unit_id);
+
+    NMBS_DEBUG_PRINT("%d NMBS res <- address_rtu %d\tfc %d\t", NMBS_ADDRESS_RTU(nmbs), nmbs->msg.unit_id, nmbs->msg.fc);
+
+    const uint16_t data_idx = nmbs->msg.buf_idx;
+    uint16_t length = 0;
+    err = recv_pdu_data(nmbs, true, &length);
+    if (err == NMBS_ERROR_INVALID_REQUEST)
+        return NMBS_ERROR_INVALID_RESPONSE;
+
+    if (err != NMBS_ERROR_NONE)
+        return err;
+
+    *pdu_length = (uint16_t) (length + 1);
+    memcpy(pdu_out, nmbs->msg.buf + data_idx - 1, *pdu_length);
+
+    return NMBS_ERROR_NONE;
+}
 #endif
 
 
 #ifndef NMBS_STRERROR_DISABLED
 const char* nmbs_strerror(nmbs_error error) {
     switch (error) {
+        case NMBS_ERROR_UNIT_OFFLINE:
+            return "unit offline";
+
+        case NMBS_ERROR_NO_BUFFER:
+            return "no buffer available";
+
         case NMBS_ERROR_INVALID_REQUEST:
             return "invalid request received";
 
@@ -54,6 +54,8 @@ extern "C" {
  */
 typedef enum nmbs_error {
     // Library errors
+    NMBS_ERROR_UNIT_OFFLINE = -10,    /**< Request not sent, the server is considered offline */
+    NMBS_ERROR_NO_BUFFER = -9,        /**< No frame buffer available in the buffer pool */
     NMBS_ERROR_INVALID_REQUEST = -8,  /**< Received invalid request from client */
     NMBS_ERROR_INVALID_UNIT_ID = -7,  /**< Received invalid unit ID in response from server */
     NMBS_ERROR_INVALID_TCP_MBAP = -6, /**< Received invalid TCP MBAP */
@@ -123,15 +125,126 @@ typedef uint8_t nmbs_bitfield_256[32];
  */
 #define nmbs_bitfield_reset(bf) memset(bf, 0, sizeof(bf))
 
+/**
+ * Copy count bits from bitfield src, starting at bit src_offset, to bitfield dst, starting at bit dst_offset.
+ * Bits of dst outside of the destination range are left untouched. The two ranges must not overlap.
+ * Works with any nmbs_bitfield, nmbs_bitfield_256 or plain uint8_t array using the same bit order.
+ */
+void nmbs_bitfield_copy(uint8_t* dst, uint16_t dst_offset, const uint8_t* src, uint16_t src_offset, uint16_t count);
+
+/**
+ * Pack count values (one per byte, any non-zero value is a 1, e.g. a bool array) into bitfield bf, starting at bit
+ * offset. Bits of bf outside of the destination range are left untouched.
+ */
+void nmbs_bitfield_pack(uint8_t* bf, uint16_t offset, const uint8_t* values, uint16_t count);
+
+/**
+ * Unpack count bits of bitfield bf, starting at bit offset, into values, one 0 or 1 byte per bit (e.g. a bool array).
+ */
+void nmbs_bitfield_unpack(uint8_t* values, const uint8_t* bf, uint16_t offset, uint16_t count);
+
+/**
+ * Byte order of values spanning multiple registers, as they appear on the wire. A is the most significant byte of a
+ * 32-bit value. 64-bit values follow the same pattern over 4 registers (e.g. NMBS_ORDER_CDAB is GHEFCDAB).
+ */
+typedef enum nmbs_word_order {
+    NMBS_ORDER_ABCD = 0,    // Big-endian, the Modbus register order
+    NMBS_ORDER_CDAB = 1,    // Big-endian registers, least significant register first
+    NMBS_ORDER_BADC = 2,    // Little-endian registers, most significant register first
+    NMBS_ORDER_DCBA = 3,    // Little-endian
+} nmbs_word_order;
+
+/**
+ * Decode count values of value_size bytes (2, 4 or 8, e.g. sizeof(float)) from wire bytes in the given order.
+ * Works with any type of that size: integers, float, double. values_out and data must not overlap.
+ */
+void nmbs_values_decode(void* values_out, const uint8_t* data, uint16_t count, uint8_t value_size,
+                        nmbs_word_order order);
+
+/**
+ * Encode count values of value_size bytes (2, 4 or 8) to wire bytes in the given order.
+ * data_out and values must not overlap.
+ */
+void nmbs_values_encode(uint8_t* data_out, const void* values, uint16_t count, uint8_t value_size,
+                        nmbs_word_order order);
+
+/**
+ * Decode count values of value_size bytes (2, 4 or 8) from an array of registers, as received by server callbacks or
+ * returned by nmbs_read_holding_registers(). values_out and registers must not overlap.
+ */
+void nmbs_values_from_registers(void* values_out, const uint16_t* registers, uint16_t count, uint8_t value_size,
+                                nmbs_word_order order);
+
+/**
+ * Encode count values of value_size bytes (2, 4 or 8) to an array of registers.
+ * registers_out and values must not overlap.
+ */
+void nmbs_values_to_registers(uint16_t* registers_out, const void* values, uint16_t count, uint8_t value_size,
+                              nmbs_word_order order);
+
 /**
  * Modbus transport type.
  */
 typedef enum nmbs_transport {
     NMBS_TRANSPORT_RTU = 1,
     NMBS_TRANSPORT_TCP = 2,
+    NMBS_TRANSPORT_RTU_OVER_TCP = 3, /*!< RTU frames, unit id and CRC with no MBAP header, on a stream socket */
+    NMBS_TRANSPORT_UDP = 4,          /*!< MBAP frames, one per datagram */
 } nmbs_transport;
 
 
+/**
+ * Maximum PDU size (function code and data) exchanged by an instance. Defaults to the 253 bytes allowed by the
+ * protocol, it can be defined to a lower value on targets with little RAM to shrink the frame buffer and the stack
+ * usage of server handlers. Clients refuse to send requests for larger quantities, servers answer them with
+ * NMBS_EXCEPTION_ILLEGAL_DATA_VALUE, and frames longer than that are discarded as invalid.
+ */
+#ifndef NMBS_MAX_PDU_SIZE
+#define NMBS_MAX_PDU_SIZE 253
+#endif
+
+#if NMBS_MAX_PDU_SIZE < 12 || NMBS_MAX_PDU_SIZE > 253
+#error "NMBS_MAX_PDU_SIZE must be between 12 and 253"
+#endif
+
+/**
+ * Size of the frame buffer of an instance, enough for the largest RTU or TCP ADU.
+ */
+#define NMBS_MSG_BUF_SIZE (NMBS_MAX_PDU_SIZE + 7)
+
+
+#ifdef NMBS_BUFFER_POOL
+/**
+ * Frame buffer of a nmbs_buffer_pool.
+ */
+typedef struct nmbs_buffer {
+    uint8_t data[NMBS_MSG_BUF_SIZE];
+    uint32_t next;    // Freelist link, index + 1 of the next free buffer
+} nmbs_buffer;
+
+
+/**
+ * Pool of frame buffers shared by a set of instances, see nmbs_buffer_pool_init().
+ * The freelist is lock-free, so instances using the same pool can be polled from different threads.
+ * All struct members are to be considered private, it is not advisable to read/write them directly.
+ */
+typedef struct nmbs_buffer_pool {
+    nmbs_buffer* buffers;
+    uint32_t count;
+    uint64_t head;    // Index + 1 of the first free buffer in the low 32 bits, ABA counter in the high 32 bits
+} nmbs_buffer_pool;
+#endif
+
+
+/**
+ * Contiguous part of a frame passed to the writev() platform function.
+ */
+typedef struct nmbs_segment {
+    const uint8_t* data;
+    uint16_t length;
+} nmbs_segment;
+
+
 /**
  * nanoMODBUS platform configuration struct.
  * Passed to nmbs_server_create() and nmbs_client_create().
@@ -150,10 +263,29 @@ typedef enum nmbs_transport {
  * A return value between `0` and `count - 1` will be treated as if a timeout occurred on the transport side. All other
  * values will be treated as transport errors.
  *
+ * With NMBS_TRANSPORT_UDP every read() call should receive a single datagram, waiting up to `byte_timeout_ms` for it,
+ * and return its size, or `0` if the timeout expired. `count` is the size of the whole frame buffer. Every write() call
+ * sends a single datagram.
+ *
+ * An optional writev() function can be defined to send a frame made of `count` segments with a single call, like
+ * POSIX writev(). It should behave like write(), with the total size of the segments in place of `count`. It lets
+ * responses and raw PDUs whose data lives in application memory (e.g. the read_holding_registers_raw() callback) be
+ * sent without copying it into the frame buffer first. When it is not defined, or a capture() or custom crc_calc()
+ * function needs the whole frame, the segments are copied into the frame buffer and sent with write().
+ *
  * Additionally, an optional crc_calc() function can be defined to override the default nanoMODBUS CRC calculation function.
  *
+ * An optional capture() function can be defined to receive a copy of every complete ADU (MBAP header or RTU CRC
+ * included) received or sent by the instance, e.g. to write traffic dumps. `tx` is true for sent frames. The function is
+ * called from inside the request/response processing, so it should return quickly.
+ *
+ * An optional clock_us() function can be defined to return the time of a monotonic clock in microseconds. It is
+ * required by the transaction timeout, see nmbs_set_transaction_timeout().
+ *
  * These methods accept a pointer to arbitrary user-data, which is the arg member of this struct.
  * After the creation of an instance it can be changed with nmbs_set_platform_arg().
+ *
+ * If NMBS_BUFFER_POOL is defined, buffer_pool is the pool the instance borrows its frame buffer from. It is required.
  */
 typedef struct nmbs_platform_conf {
     nmbs_transport transport; /*!< Transport type */
@@ -161,12 +293,71 @@ typedef struct nmbs_platform_conf {
                     void* arg); /*!< Bytes read transport function pointer */
     int32_t (*write)(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms,
                      void* arg); /*!< Bytes write transport function pointer */
+    int32_t (*writev)(const nmbs_segment* segments, uint8_t count, int32_t byte_timeout_ms,
+                      void* arg); /*!< Gathered write transport function pointer. Optional */
     uint16_t (*crc_calc)(const uint8_t* data, uint32_t length,
                          void* arg); /*!< CRC calculation function pointer. Optional */
-    void* arg;                       /*!< User data, will be passed to functions above */
+    void (*capture)(const uint8_t* buf, uint16_t count, bool tx,
+                    void* arg); /*!< Frame capture function pointer. Optional */
+    uint64_t (*clock_us)(void* arg); /*!< Monotonic clock function pointer, in microseconds. Optional */
+    void* arg;                  /*!< User data, will be passed to functions above */
+#ifdef NMBS_BUFFER_POOL
+    nmbs_buffer_pool* buffer_pool; /*!< Pool of frame buffers */
+#endif
     uint32_t initialized; /*!< Reserved, workaround for older user code not calling nmbs_platform_conf_create() */
 } nmbs_platform_conf;
 
+/**
+ * Compile-time platform binding.
+ *
+ * Defining NMBS_PLATFORM_TRANSPORT to one of the nmbs_transport values fixes the transport of every instance, so that
+ * the compiler can drop the framing code of the other ones. nmbs_platform_conf_create() then sets it in the
+ * platform configuration, and instances with a different transport can't be created.
+ *
+ * Defining NMBS_PLATFORM_READ, NMBS_PLATFORM_WRITE or NMBS_PLATFORM_CRC_CALC to the name of a function with external
+ * linkage and the signature of the matching nmbs_platform_conf member binds it in place of the function pointer, which
+ * is then ignored and can be left NULL. Bound functions are called directly, and can be inlined when they are built in
+ * the same translation unit as nanomodbus.c (e.g. including nanomodbus.c after their definitions) or with link-time
+ * optimization.
+ */
+#ifdef NMBS_PLATFORM_READ
+int32_t NMBS_PLATFORM_READ(uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg);
+#endif
+
+#ifdef NMBS_PLATFORM_WRITE
+int32_t NMBS_PLATFORM_WRITE(const uint8_t* buf, uint16_t count, int32_t byte_timeout_ms, void* arg);
+#endif
+
+#ifdef NMBS_PLATFORM_CRC_CALC
+uint16_t NMBS_PLATFORM_CRC_CALC(const uint8_t* data, uint32_t length, void* arg);
+#endif
+
+
+#ifndef NMBS_SERVER_DISABLED
+/**
+ * Custom function code handler, see nmbs_custom_fc_register().
+ *
+ * `data` points to the request PDU data in the message buffer of the server instance, after the function code, and
+ * `length` holds its size. The handler writes the response PDU data in place, up to NMBS_MAX_PDU_SIZE - 1 bytes, and
+ * sets `length` to its size. Returning a Modbus exception makes the server answer with it, any other error with
+ * NMBS_EXCEPTION_SERVER_DEVICE_FAILURE.
+ *
+ * On RTU the request length is not known in advance, so its end is detected when no more bytes arrive within the byte
+ * timeout. Custom function codes are answered with NMBS_EXCEPTION_ILLEGAL_FUNCTION if the byte timeout is infinite.
+ * The same applies on RTU over TCP, except for standard function codes, whose requests are framed by their layout.
+ */
+typedef nmbs_error (*nmbs_custom_fc_handler)(uint8_t fc, uint8_t* data, uint16_t* length, uint8_t unit_id, void* arg);
+
+
+/**
+ * Table of custom function code handlers, indexed by function code. Set in nmbs_callbacks.custom_fc_table.
+ * It can be shared by multiple server instances.
+ */
+typedef struct nmbs_custom_fc_table {
+    nmbs_custom_fc_handler handlers[256];
+} nmbs_custom_fc_table;
+#endif
+
 
 /**
  * Modbus server request callbacks. Passed to nmbs_server_create().
@@ -175,6 +366,16 @@ typedef struct nmbs_platform_conf {
  * to nmbs_server_create together with this struct.
  *
  * `unit_id` is the RTU unit ID of the request sender. It is always 0 on TCP.
+ *
+ * Coil and register arrays passed to callbacks point into the message buffer of the server instance. Only the first
+ * `quantity` (or `count`) items can be accessed, and only for the duration of the call.
+ *
+ * When `forward` is set, every request is passed to it as a raw PDU instead, starting with the function code, with
+ * `unit_id` taken from the request as received. `pdu` points into the message buffer and `pdu_length` holds its size.
+ * The callback writes the response PDU in place, up to NMBS_MAX_PDU_SIZE bytes, function code included, and sets
+ * `pdu_length` to its size; the server wraps it with the MBAP header or the CRC and sends it. Setting `pdu_length` to
+ * 0 sends no response. Returning a Modbus exception makes the server answer with it, any other error with
+ * NMBS_EXCEPTION_SERVER_DEVICE_FAILURE. On RTU the end of the request is detected as for custom function codes.
  */
 typedef struct nmbs_callbacks {
 #ifndef NMBS_SERVER_DISABLED
@@ -197,6 +398,18 @@ typedef struct nmbs_callbacks {
                                        void* arg);
 #endif
 
+    // Optional, replace the callbacks above with ones pointing `data_out` to `quantity` registers in application memory,
+    // already big-endian as on the wire, which must stay valid until the response is sent
+#ifndef NMBS_SERVER_READ_HOLDING_REGISTERS_DISABLED
+    nmbs_error (*read_holding_registers_raw)(uint16_t address, uint16_t quantity, const uint8_t** data_out,
+                                             uint8_t unit_id, void* arg);
+#endif
+
+#ifndef NMBS_SERVER_READ_INPUT_REGISTERS_DISABLED
+    nmbs_error (*read_input_registers_raw)(uint16_t address, uint16_t quantity, const uint8_t** data_out,
+                                           uint8_t unit_id, void* arg);
+#endif
+
 #ifndef NMBS_SERVER_WRITE_SINGLE_COIL_DISABLED
     nmbs_error (*write_single_coil)(uint16_t address, bool value, uint8_t unit_id, void* arg);
 #endif
@@ -230,6 +443,11 @@ typedef struct nmbs_callbacks {
     nmbs_error (*read_device_identification)(uint8_t object_id, char buffer[NMBS_DEVICE_IDENTIFICATION_STRING_LENGTH]);
     nmbs_error (*read_device_identification_map)(nmbs_bitfield_256 map);
 #endif
+
+    const nmbs_custom_fc_table* custom_fc_table;    // Optional, checked before the built-in function codes
+
+    // Optional, replaces the handling of all requests, for gateways and transparent proxies
+    nmbs_error (*forward)(uint8_t unit_id, uint8_t* pdu, uint16_t* pdu_length, void* arg);
 #endif
 
     void* arg;               // User data, will be passed to functions above
@@ -237,13 +455,118 @@ typedef struct nmbs_callbacks {
 } nmbs_callbacks;
 
 
+#ifndef NMBS_CLIENT_DISABLED
+/**
+ * Round-trip time estimate of a unit id, see nmbs_rtt_table_init().
+ */
+typedef struct nmbs_rtt {
+    uint32_t srtt_us;      // Smoothed round-trip time
+    uint32_t rttvar_us;    // Round-trip time variation
+    uint8_t unit_id;
+    uint8_t backoff;    // Response timeouts in a row, each one doubles the timeout
+    bool valid;
+} nmbs_rtt;
+
+
+/**
+ * Adaptive response timeouts of a client, see nmbs_rtt_table_init().
+ * All struct members are to be considered private, it is not advisable to read/write them directly.
+ */
+typedef struct nmbs_rtt_table {
+    nmbs_rtt* entries;
+    uint16_t count;
+    int32_t min_timeout_ms;
+    int32_t max_timeout_ms;    // 0 for the read timeout of the instance
+} nmbs_rtt_table;
+
+
+/**
+ * Health state and counters of a unit id, see nmbs_health_table_init() and nmbs_get_unit_health().
+ */
+typedef struct nmbs_unit_health {
+    uint32_t requests;            // Requests sent, probes included
+    uint32_t responses;           // Responses received, exceptions included
+    uint32_t timeouts;            // Response timeouts
+    uint32_t rejected;            // Requests failed with NMBS_ERROR_UNIT_OFFLINE, without being sent
+    uint32_t backoff_ms;          // Interval between probes while offline
+    uint64_t next_probe_us;       // Time of the next probe while offline, on the clock_us() clock
+    uint16_t timeouts_in_row;     // Response timeouts since the last response
+    uint8_t unit_id;
+    bool offline;
+    bool valid;
+} nmbs_unit_health;
+
+
+/**
+ * Health tracking of the servers of a client, see nmbs_health_table_init().
+ * All struct members are to be considered private, it is not advisable to read/write them directly.
+ */
+typedef struct nmbs_health_table {
+    nmbs_unit_health* entries;
+    uint16_t count;
+    uint16_t threshold;
+    uint32_t min_backoff_ms;
+    uint32_t max_backoff_ms;
+} nmbs_health_table;
+#endif
+
+
+#ifndef NMBS_RTU_TIMING_DISABLED
+/**
+ * RTU inter-frame timing of an instance and its turnaround statistics, see nmbs_rtu_timing_init().
+ * The statistics can be read directly, the other struct members are to be considered private.
+ */
+typedef struct nmbs_rtu_timing {
+    uint32_t t15_us;    // Longest silence within a frame
+    uint32_t t35_us;    // Shortest silence between frames
+
+    uint32_t frames;               // Frames sent
+    uint32_t waits;                // Frames delayed to keep t3.5 of silence before them
+    uint64_t wait_us;              // Total delay
+    uint32_t max_wait_us;          // Longest delay
+    uint64_t turnaround_us;        // Total time from the last byte on the bus to the start of the frames
+    uint32_t max_turnaround_us;    // Longest turnaround
+
+    uint64_t bus_activity_us;    // Last byte received or sent, on the clock_us() clock
+    void (*delay_us)(uint32_t us, void* arg);
+} nmbs_rtu_timing;
+#endif
+
+
+/**
+ * nanoMODBUS instance profile. Holds the configuration of an instance: platform functions, server callbacks,
+ * timeouts and RTU address. Created with nmbs_profile_server_create() or nmbs_profile_client_create().
+ *
+ * Any number of instances can be created from the same profile with nmbs_create_from_profile(). If NMBS_SHARED_PROFILE
+ * is defined, instances keep a pointer to the profile instead of a copy, so the profile has to outlive them and changes
+ * to it (e.g. timeouts) apply to all of them.
+ * All struct members are to be considered private, it is not advisable to read/write them directly.
+ */
+typedef struct nmbs_profile {
+    nmbs_platform_conf platform;
+    nmbs_callbacks callbacks;
+
+    int32_t byte_timeout_ms;
+    int32_t read_timeout_ms;
+    int32_t transaction_timeout_ms;
+
+    uint8_t address_rtu;
+} nmbs_profile;
+
+
 /**
  * nanoMODBUS client/server instance type. All struct members are to be considered private,
  * it is not advisable to read/write them directly.
  */
 typedef struct nmbs_t {
     struct {
-        uint8_t buf[260];
+#ifdef NMBS_BUFFER_POOL
+        uint8_t* buf;    // Borrowed from the buffer pool, NULL when idle
+        uint8_t first_byte;
+        bool first_byte_pending;
+#else
+        uint8_t buf[NMBS_MSG_BUF_SIZE];
+#endif
         uint16_t buf_idx;
 
         uint8_t unit_id;
@@ -254,16 +577,40 @@ typedef struct nmbs_t {
         bool complete;
     } msg;
 
+#ifdef NMBS_SHARED_PROFILE
+    const nmbs_profile* profile;
+
+    void* platform_arg;
+    void* callbacks_arg;
+#else
     nmbs_callbacks callbacks;
 
     int32_t byte_timeout_ms;
     int32_t read_timeout_ms;
+    int32_t transaction_timeout_ms;
 
     nmbs_platform_conf platform;
 
     uint8_t address_rtu;
+#endif
     uint8_t dest_address_rtu;
     uint16_t current_tid;
+
+    uint64_t deadline_us;    // End of the current transaction on the platform clock, if deadline_set
+    bool deadline_set;
+
+#ifndef NMBS_RTU_TIMING_DISABLED
+    nmbs_rtu_timing* rtu_timing;
+#endif
+
+#ifndef NMBS_CLIENT_DISABLED
+    nmbs_rtt_table* rtt_table;
+    nmbs_health_table* health_table;
+    uint64_t req_start_us;
+    bool req_pending;       // Request to count in the health table once it's sent
+    uint8_t res_unit_id;    // Unit id of a validated response header, credited once its footer is received
+    bool res_pending;
+#endif
 } nmbs_t;
 
 /**
@@ -271,6 +618,7 @@ typedef struct nmbs_t {
  */
 static const uint8_t NMBS_BROADCAST_ADDRESS = 0;
 
+#ifndef NMBS_SHARED_PROFILE
 /** Set the request/response timeout.
  * If the target instance is a server, sets the timeout of the nmbs_server_poll() function.
  * If the target instance is a client, sets the response timeout after sending a request. In case of timeout,
@@ -286,6 +634,39 @@ void nmbs_set_read_timeout(nmbs_t* nmbs, int32_t timeout_ms);
  */
 void nmbs_set_byte_timeout(nmbs_t* nmbs, int32_t timeout_ms);
 
+/** Set the maximum duration of a whole transaction.
+ * For a client it runs from the start of a request to the end of its response, for a server from the first byte of a
+ * request to the end of its response. Every read and write is given at most the time left, so the response timeout
+ * and the byte timeouts can't add up beyond it. When it expires, the called method returns NMBS_ERROR_TIMEOUT.
+ * Requires the clock_us() platform function, it has no effect otherwise.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param timeout_ms timeout in milliseconds. If < 0, the timeout is disabled.
+ */
+void nmbs_set_transaction_timeout(nmbs_t* nmbs, int32_t timeout_ms);
+#endif
+
+#ifndef NMBS_RTU_TIMING_DISABLED
+/** Initialize the RTU inter-frame timing of the Modbus serial line specification for a baud rate.
+ * t1.5 and t3.5 are computed for 11-bit characters, and fixed at 750 and 1750 microseconds above 19200 baud. Before
+ * sending a frame an instance using the timing then waits until the bus has been silent for t3.5 since the last byte
+ * read or written, and no longer. The wait is done by `delay_us`, or by busy-polling the clock_us() platform function
+ * without it; busy-polling ends early if the clock stops advancing.
+ * The write() platform function should return once the bytes are on the wire (e.g. after tcdrain()), or the silence
+ * is counted from when they were queued.
+ * @param timing pointer to the nmbs_rtu_timing instance
+ * @param baud_rate baud rate of the serial line
+ * @param delay_us function waiting for `us` microseconds, called with the platform arg of the instance. Optional
+ */
+void nmbs_rtu_timing_init(nmbs_rtu_timing* timing, uint32_t baud_rate, void (*delay_us)(uint32_t us, void* arg));
+
+/** Set the RTU inter-frame timing of an instance, which also collects its turnaround statistics. Each instance
+ * should have its own timing. Requires the clock_us() platform function, it has no effect otherwise.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param timing pointer to the nmbs_rtu_timing instance, or NULL to disable the inter-frame timing
+ */
+void nmbs_set_rtu_timing(nmbs_t* nmbs, nmbs_rtu_timing* timing);
+#endif
+
 /** Create a new nmbs_platform_conf struct.
  * @param platform_conf pointer to the nmbs_platform_conf instance
  */
@@ -297,12 +678,75 @@ void nmbs_platform_conf_create(nmbs_platform_conf* platform_conf);
  */
 void nmbs_set_platform_arg(nmbs_t* nmbs, void* arg);
 
+#ifdef NMBS_BUFFER_POOL
+/** Initialize a pool of frame buffers.
+ * Server instances borrow a buffer only while receiving and answering a request, so idle connections hold none. If
+ * the pool is exhausted, nmbs_server_poll() returns NMBS_ERROR_NO_BUFFER leaving the rest of the request on the
+ * transport, and can be called again later.
+ * Client instances borrow a buffer when sending a request and keep it until nmbs_release_buffer() is called.
+ * @param pool pointer to the nmbs_buffer_pool instance
+ * @param buffers array of buffers, must outlive the pool
+ * @param count number of buffers
+ */
+void nmbs_buffer_pool_init(nmbs_buffer_pool* pool, nmbs_buffer* buffers, uint32_t count);
+
+/** Return the frame buffer borrowed by an instance to its pool, if any.
+ * @param nmbs pointer to the nmbs_t instance
+ */
+void nmbs_release_buffer(nmbs_t* nmbs);
+#endif
+
+/** Set the request/response timeout of the instances created from a profile. See nmbs_set_read_timeout().
+ * @param profile pointer to the nmbs_profile instance
+ * @param timeout_ms timeout in milliseconds. If < 0, the timeout is disabled.
+ */
+void nmbs_profile_set_read_timeout(nmbs_profile* profile, int32_t timeout_ms);
+
+/** Set the byte timeout of the instances created from a profile. See nmbs_set_byte_timeout().
+ * @param profile pointer to the nmbs_profile instance
+ * @param timeout_ms timeout in milliseconds. If < 0, the timeout is disabled.
+ */
+void nmbs_profile_set_byte_timeout(nmbs_profile* profile, int32_t timeout_ms);
+
+/** Set the transaction timeout of the instances created from a profile. See nmbs_set_transaction_timeout().
+ * @param profile pointer to the nmbs_profile instance
+ * @param timeout_ms timeout in milliseconds. If < 0, the timeout is disabled.
+ */
+void nmbs_profile_set_transaction_timeout(nmbs_profile* profile, int32_t timeout_ms);
+
+/** Create a new client/server instance from a profile.
+ * The platform and callbacks user data arguments of the instance are initialized from the profile, and can be
+ * changed per instance with nmbs_set_platform_arg() and nmbs_set_callbacks_arg().
+ * @param nmbs pointer to the nmbs_t instance
+ * @param profile nmbs_profile created with nmbs_profile_server_create() or nmbs_profile_client_create(). If
+ * NMBS_SHARED_PROFILE is defined, it must not be discarded while the instance is in use.
+ *
+ * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT otherwise.
+ */
+nmbs_error nmbs_create_from_profile(nmbs_t* nmbs, const nmbs_profile* profile);
+
 #ifndef NMBS_SERVER_DISABLED
 /** Create a new nmbs_callbacks struct.
  * @param callbacks pointer to the nmbs_callbacks instance
  */
 void nmbs_callbacks_create(nmbs_callbacks* callbacks);
 
+/** Initialize an empty custom function code handler table.
+ * @param table pointer to the nmbs_custom_fc_table instance
+ */
+void nmbs_custom_fc_table_create(nmbs_custom_fc_table* table);
+
+/** Register a handler for a function code in a custom function code table.
+ * Handlers take precedence over the built-in function codes, and are dispatched with a single table lookup.
+ * @param table pointer to the nmbs_custom_fc_table instance
+ * @param fc function code, between 1 and 127
+ * @param handler handler function, or NULL to unregister the function code
+ *
+ * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT otherwise.
+ */
+nmbs_error nmbs_custom_fc_register(nmbs_custom_fc_table* table, uint8_t fc, nmbs_custom_fc_handler handler);
+
+#ifndef NMBS_SHARED_PROFILE
 /** Create a new Modbus server.
  * @param nmbs pointer to the nmbs_t instance where the client will be created.
  * @param address_rtu RTU address of this server. Can be 0 if transport is not RTU.
@@ -313,6 +757,18 @@ void nmbs_callbacks_create(nmbs_callbacks* callbacks);
  */
 nmbs_error nmbs_server_create(nmbs_t* nmbs, uint8_t address_rtu, const nmbs_platform_conf* platform_conf,
                               const nmbs_callbacks* callbacks);
+#endif
+
+/** Create a new Modbus server profile, to be used with nmbs_create_from_profile().
+ * @param profile pointer to the nmbs_profile instance
+ * @param address_rtu RTU address of the server. Can be 0 if transport is not RTU.
+ * @param platform_conf nmbs_platform_conf struct with platform configuration. It may be discarded after calling this method.
+ * @param callbacks nmbs_callbacks struct with server request callbacks. It may be discarded after calling this method.
+ *
+ * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT otherwise.
+ */
+nmbs_error nmbs_profile_server_create(nmbs_profile* profile, uint8_t address_rtu,
+                                      const nmbs_platform_conf* platform_conf, const nmbs_callbacks* callbacks);
 
 /** Handle incoming requests to the server.
  * This function should be called in a loop in order to serve any incoming request. Its maximum duration, in case of no
@@ -331,6 +787,7 @@ void nmbs_set_callbacks_arg(nmbs_t* nmbs, void* arg);
 #endif
 
 #ifndef NMBS_CLIENT_DISABLED
+#ifndef NMBS_SHARED_PROFILE
 /** Create a new Modbus client.
  * @param nmbs pointer to the nmbs_t instance where the client will be created.
  * @param platform_conf nmbs_platform_conf struct with platform configuration. It may be discarded after calling this method.
@@ -338,6 +795,15 @@ void nmbs_set_callbacks_arg(nmbs_t* nmbs, void* arg);
 * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT otherwise.
  */
 nmbs_error nmbs_client_create(nmbs_t* nmbs, const nmbs_platform_conf* platform_conf);
+#endif
+
+/** Create a new Modbus client profile, to be used with nmbs_create_from_profile().
+ * @param profile pointer to the nmbs_profile instance
+ * @param platform_conf nmbs_platform_conf struct with platform configuration. It may be discarded after calling this method.
+ *
+ * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT otherwise.
+ */
+nmbs_error nmbs_profile_client_create(nmbs_profile* profile, const nmbs_platform_conf* platform_conf);
 
 /** Set the recipient server address of the next request on RTU transport.
  * @param nmbs pointer to the nmbs_t instance
@@ -345,6 +811,73 @@ nmbs_error nmbs_client_create(nmbs_t* nmbs, const nmbs_platform_conf* platform_c
  */
 void nmbs_set_destination_rtu_address(nmbs_t* nmbs, uint8_t address);
 
+/** Initialize a table of adaptive response timeouts.
+ * The round-trip time of every response is measured with the clock_us() platform function, and smoothed per unit id
+ * like the TCP retransmission timeout estimator (RFC 6298). The response timeout of a unit id is then its smoothed
+ * round-trip time plus four times its variation, doubled after every response timeout in a row, and limited to
+ * [min_timeout_ms, max_timeout_ms]. Unit ids with no measured response use the read timeout of the instance.
+ * Each unit id takes an entry with its first response and keeps it, so `count` should be at least the number of
+ * servers of the client: unit ids answering after all entries are taken keep the read timeout.
+ * @param table pointer to the nmbs_rtt_table instance
+ * @param entries array of entries, must outlive the table
+ * @param count number of entries
+ * @param min_timeout_ms lower limit of the response timeouts, in milliseconds
+ * @param max_timeout_ms upper limit of the response timeouts, in milliseconds. If <= 0 the read timeout of the instance
+ * is the upper limit, so that a response timeout is never 0 (a non-blocking read) once a round-trip time is measured
+ */
+void nmbs_rtt_table_init(nmbs_rtt_table* table, nmbs_rtt* entries, uint16_t count, int32_t min_timeout_ms,
+                         int32_t max_timeout_ms);
+
+/** Set the table of adaptive response timeouts of a client, replacing its read timeout for the unit ids with a
+ * measured round-trip time. Each connection should have its own table, a table can be shared by instances only if
+ * they are not used concurrently. Requires the clock_us() platform function, it has no effect otherwise.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param table pointer to the nmbs_rtt_table instance, or NULL to disable adaptive timeouts
+ */
+void nmbs_set_rtt_table(nmbs_t* nmbs, nmbs_rtt_table* table);
+
+/** Get the response timeout the next request to a unit id would use.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param unit_id unit id, or RTU address
+ *
+ * @return the response timeout in milliseconds, < 0 if infinite.
+ */
+int32_t nmbs_get_response_timeout(const nmbs_t* nmbs, uint8_t unit_id);
+
+/** Initialize a table of server health states.
+ * After `threshold` response timeouts in a row from a unit id, it is considered offline: requests to it fail
+ * immediately with NMBS_ERROR_UNIT_OFFLINE, except for one probe request let through every backoff interval. The
+ * interval starts at min_backoff_ms and doubles after every failed probe, up to max_backoff_ms. Any response, Modbus
+ * exceptions included, brings the unit id back online.
+ * Each unit id takes an entry the first time a request is sent to it and keeps it, so `count` should be at least the
+ * number of servers of the client: unit ids seen after all entries are taken are not tracked.
+ * @param table pointer to the nmbs_health_table instance
+ * @param entries array of entries, must outlive the table
+ * @param count number of entries
+ * @param threshold response timeouts in a row after which a unit id is considered offline, at least 1
+ * @param min_backoff_ms first interval between probes, in milliseconds
+ * @param max_backoff_ms longest interval between probes, in milliseconds
+ */
+void nmbs_health_table_init(nmbs_health_table* table, nmbs_unit_health* entries, uint16_t count, uint16_t threshold,
+                            uint32_t min_backoff_ms, uint32_t max_backoff_ms);
+
+/** Set the table of server health states of a client. Each connection should have its own table, a table can be
+ * shared by instances only if they are not used concurrently. Requires the clock_us() platform function, it has no
+ * effect otherwise.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param table pointer to the nmbs_health_table instance, or NULL to disable health tracking
+ */
+void nmbs_set_health_table(nmbs_t* nmbs, nmbs_health_table* table);
+
+/** Get the health state and counters of a unit id.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param unit_id unit id, or RTU address
+ * @param health_out where the state is copied. It is zeroed if the unit id has no state yet
+ *
+ * @return NMBS_ERROR_NONE if successful, NMBS_ERROR_INVALID_ARGUMENT if the instance has no health table.
+ */
+nmbs_error nmbs_get_unit_health(const nmbs_t* nmbs, uint8_t unit_id, nmbs_unit_health* health_out);
+
 /** Send a FC 01 (0x01) Read Coils request
  * @param nmbs pointer to the nmbs_t instance
  * @param address starting address
@@ -385,6 +918,34 @@ nmbs_error nmbs_read_holding_registers(nmbs_t* nmbs, uint16_t address, uint16_t
  */
 nmbs_error nmbs_read_input_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, uint16_t* registers_out);
 
+/** Send a FC 03 (0x03) Read Holding Registers request for values spanning multiple registers, decoding them directly
+ * from the response
+ * @param nmbs pointer to the nmbs_t instance
+ * @param address starting address
+ * @param count quantity of values. The quantity of registers is count * value_size / 2
+ * @param values_out array where the values will be stored, e.g. a float array
+ * @param value_size size of each value in bytes: 2, 4 or 8
+ * @param order byte order of the values
+ *
+ * @return NMBS_ERROR_NONE if successful, other errors otherwise.
+ */
+nmbs_error nmbs_read_holding_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, void* values_out,
+                                              uint8_t value_size, nmbs_word_order order);
+
+/** Send a FC 04 (0x04) Read Input Registers request for values spanning multiple registers, decoding them directly
+ * from the response
+ * @param nmbs pointer to the nmbs_t instance
+ * @param address starting address
+ * @param count quantity of values. The quantity of registers is count * value_size / 2
+ * @param values_out array where the values will be stored, e.g. a float array
+ * @param value_size size of each value in bytes: 2, 4 or 8
+ * @param order byte order of the values
+ *
+ * @return NMBS_ERROR_NONE if successful, other errors otherwise.
+ */
+nmbs_error nmbs_read_input_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, void* values_out,
+                                            uint8_t value_size, nmbs_word_order order);
+
 /** Send a FC 05 (0x05) Write Single Coil request
  * @param nmbs pointer to the nmbs_t instance
  * @param address coil address
@@ -423,6 +984,20 @@ nmbs_error nmbs_write_multiple_coils(nmbs_t* nmbs, uint16_t address, uint16_t qu
  */
 nmbs_error nmbs_write_multiple_registers(nmbs_t* nmbs, uint16_t address, uint16_t quantity, const uint16_t* registers);
 
+/** Send a FC 16 (0x10) Write Multiple Registers request for values spanning multiple registers, encoding them directly
+ * into the request
+ * @param nmbs pointer to the nmbs_t instance
+ * @param address starting address
+ * @param count quantity of values. The quantity of registers is count * value_size / 2
+ * @param values array of values, e.g. a float array
+ * @param value_size size of each value in bytes: 2, 4 or 8
+ * @param order byte order of the values
+ *
+ * @return NMBS_ERROR_NONE if successful, other errors otherwise.
+ */
+nmbs_error nmbs_write_multiple_registers_values(nmbs_t* nmbs, uint16_t address, uint16_t count, const void* values,
+                                                uint8_t value_size, nmbs_word_order order);
+
 /** Send a FC 20 (0x14) Read File Record
  * @param nmbs pointer to the nmbs_t instance
  * @param file_number file number (1 to 65535)
@@ -515,6 +1090,7 @@ nmbs_error nmbs_read_device_identification(nmbs_t* nmbs, uint8_t object_id, char
 
 /** Send a raw Modbus PDU.
  * CRC on RTU will be calculated and sent by this function.
+ * With a writev() platform function, data is sent from where it is instead of being copied into the frame buffer.
  * @param nmbs pointer to the nmbs_t instance
  * @param fc request function code
  * @param data request data. It's up to the caller to convert this data to network byte order
@@ -532,6 +1108,18 @@ nmbs_error nmbs_send_raw_pdu(nmbs_t* nmbs, uint8_t fc, const uint8_t* data, uint
  * @return NMBS_ERROR_NONE if successful, other errors otherwise.
  */
 nmbs_error nmbs_receive_raw_pdu_response(nmbs_t* nmbs, uint8_t* data_out, uint8_t data_out_len);
+
+/** Receive a raw response Modbus PDU of any length, function code included.
+ * Exception responses are not converted to errors, they are returned like any other response PDU, with bit 7 of the
+ * function code set. On RTU the end of the response is detected when no more bytes arrive within the byte timeout,
+ * which must not be infinite. On RTU over TCP, responses to standard function codes are framed by their layout.
+ * @param nmbs pointer to the nmbs_t instance
+ * @param pdu_out response PDU, it must be able to hold NMBS_MAX_PDU_SIZE bytes
+ * @param pdu_length set to the length of the response PDU
+ *
+ * @return NMBS_ERROR_NONE if successful, other errors otherwise.
+ */
+nmbs_error nmbs_receive_raw_pdu_response_full(nmbs_t* nmbs, uint8_t* pdu_out, uint16_t* pdu_length);
 #endif
 
 /** Calculate the Modbus CRC of some data.
@@ -0,0 +1,193 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nanomodbus.h"
+#include "ring_transport.h"
+#include "test_common.h"
+
+#define CONNECTIONS 4
+#define REGISTERS 16
+#define ITERATIONS 200
+
+// Servers share a pool with fewer buffers than connections, and so do clients
+nmbs_buffer server_buffers[1];
+nmbs_buffer_pool server_pool;
+nmbs_buffer client_buffers[2];
+nmbs_buffer_pool client_pool;
+
+ring_transport buses[CONNECTIONS];
+nmbs_t servers[CONNECTIONS];
+nmbs_t clients[CONNECTIONS];
+uint16_t server_registers[CONNECTIONS][REGISTERS];
+test_registers server_regs[CONNECTIONS];
+int client_results[CONNECTIONS];
+
+
+void* run_client(void* arg) {
+    const int c = *(const int*) arg;
+    nmbs_t* client = &clients[c];
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint16_t regs[REGISTERS];
+        for (int r = 0; r < REGISTERS; r++)
+            regs[r] = (uint16_t) (c * 1000 + i + r);
+
+        nmbs_error err;
+        do {
+            err = nmbs_write_multiple_registers(client, 0, REGISTERS, regs);
+        } while (err == NMBS_ERROR_NO_BUFFER);
+
+        if (err == NMBS_ERROR_NONE) {
+            uint16_t regs_read[REGISTERS];
+            err = nmbs_read_holding_registers(client, 0, REGISTERS, regs_read);
+            if (err == NMBS_ERROR_NONE && memcmp(regs, regs_read, sizeof(regs)) != 0) {
+                fprintf(stderr, "Registers mismatch from server %d\n", c);
+                client_results[c] = 1;
+            }
+        }
+
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error from server %d %s\n", c, nmbs_strerror(err));
+            client_results[c] = 1;
+        }
+
+        nmbs_release_buffer(client);
+    }
+
+    return NULL;
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    nmbs_buffer_pool_init(&server_pool, server_buffers, 1);
+    nmbs_buffer_pool_init(&client_pool, client_buffers, 2);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    for (int i = 0; i < CONNECTIONS; i++) {
+        ring_transport_init(&buses[i], 2);
+
+        nmbs_platform_conf c_conf;
+        ring_transport_platform_conf(&buses[i], 0, NMBS_TRANSPORT_TCP, &c_conf);
+        c_conf.buffer_pool = &client_pool;
+
+        nmbs_platform_conf s_conf;
+        ring_transport_platform_conf(&buses[i], 1, NMBS_TRANSPORT_TCP, &s_conf);
+        s_conf.buffer_pool = &server_pool;
+
+        server_regs[i].values = server_registers[i];
+        server_regs[i].count = REGISTERS;
+        callbacks.arg = &server_regs[i];
+        nmbs_error err = nmbs_server_create(&servers[i], 0, &s_conf, &callbacks);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error creating modbus server %d\n", i);
+            return 1;
+        }
+
+        nmbs_set_read_timeout(&servers[i], 0);
+        nmbs_set_byte_timeout(&servers[i], 100);
+
+        err = nmbs_client_create(&clients[i], &c_conf);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error creating modbus client %d\n", i);
+            return 1;
+        }
+
+        nmbs_set_read_timeout(&clients[i], 5000);
+        nmbs_set_byte_timeout(&clients[i], 100);
+    }
+
+    // Idle servers hold no buffer
+    nmbs_error err = nmbs_server_poll(&servers[0]);
+    if (err != NMBS_ERROR_NONE || servers[0].msg.buf != NULL) {
+        fprintf(stderr, "Idle server poll failed %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    // Client 1 borrows the only server buffer, as if server 1 was in the middle of a request
+    nmbs_platform_conf hog_conf;
+    ring_transport_platform_conf(&buses[1], 0, NMBS_TRANSPORT_TCP, &hog_conf);
+    hog_conf.buffer_pool = &server_pool;
+    nmbs_t hog;
+    nmbs_client_create(&hog, &hog_conf);
+
+    const uint8_t read_req[] = {0x00, 0x00, 0x00, 0x01};
+    err = nmbs_send_raw_pdu(&hog, 3, read_req, sizeof(read_req));
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error sending request %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    // Server 0 gets a request but the pool is exhausted, the request is left on the transport
+    err = nmbs_send_raw_pdu(&clients[0], 3, read_req, sizeof(read_req));
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error sending request %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    err = nmbs_server_poll(&servers[0]);
+    if (err != NMBS_ERROR_NO_BUFFER) {
+        fprintf(stderr, "Expected no buffer error, got %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    nmbs_release_buffer(&hog);
+
+    err = nmbs_server_poll(&servers[0]);
+    if (err != NMBS_ERROR_NONE || servers[0].msg.buf != NULL) {
+        fprintf(stderr, "Server poll failed after buffer release %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    uint8_t res[3];
+    err = nmbs_receive_raw_pdu_response(&clients[0], res, sizeof(res));
+    if (err != NMBS_ERROR_NONE || res[0] != 2) {
+        fprintf(stderr, "Error receiving response %s\n", nmbs_strerror(err));
+        return 1;
+    }
+
+    nmbs_release_buffer(&clients[0]);
+
+    // Discard the request of the hog client
+    nmbs_server_poll(&servers[1]);
+
+    // Concurrent clients and servers contending for the pools
+    pthread_t pollers[2];
+    test_servers polled[2] = {{servers, CONNECTIONS / 2}, {servers + CONNECTIONS / 2, CONNECTIONS / 2}};
+    for (int i = 0; i < 2; i++) {
+        if (pthread_create(&pollers[i], NULL, poll_servers, &polled[i]) != 0) {
+            fprintf(stderr, "Error creating thread\n");
+            return 1;
+        }
+    }
+
+    pthread_t client_threads[CONNECTIONS];
+    int ids[CONNECTIONS];
+    for (int i = 0; i < CONNECTIONS; i++) {
+        ids[i] = i;
+        if (pthread_create(&client_threads[i], NULL, run_client, &ids[i]) != 0) {
+            fprintf(stderr, "Error creating thread\n");
+            return 1;
+        }
+    }
+
+    int result = 0;
+    for (int i = 0; i < CONNECTIONS; i++) {
+        pthread_join(client_threads[i], NULL);
+        result |= client_results[i];
+    }
+
+    run = 0;
+    pthread_join(pollers[0], NULL);
+    pthread_join(pollers[1], NULL);
+
+    return result;
+}
@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nanomodbus.h"
+#include "ring_transport.h"
+#include "test_common.h"
+
+// Built with NMBS_MAX_PDU_SIZE 32: up to 15 registers and 240 coils can be read, up to 13 registers written
+#define READ_REGISTERS_MAX 15
+#define WRITE_REGISTERS_MAX 13
+#define READ_BITS_MAX 240
+
+ring_transport bus;
+nmbs_t server;
+uint16_t server_registers[64];
+test_registers server_regs = {server_registers, 64};
+
+
+nmbs_error read_coils(uint16_t address, uint16_t quantity, nmbs_bitfield coils_out, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+    for (uint16_t i = 0; i < quantity; i++)
+        nmbs_bitfield_write(coils_out, i, (address + i) % 3 == 0);
+
+    return NMBS_ERROR_NONE;
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    int result = 0;
+
+    printf("NMBS_MAX_PDU_SIZE %d, sizeof(nmbs_t) %zu\n", NMBS_MAX_PDU_SIZE, sizeof(nmbs_t));
+    check(NMBS_MSG_BUF_SIZE == NMBS_MAX_PDU_SIZE + 7);
+
+    ring_transport_init(&bus, 2);
+
+    nmbs_platform_conf c_conf;
+    ring_transport_platform_conf(&bus, 0, NMBS_TRANSPORT_RTU, &c_conf);
+
+    nmbs_platform_conf s_conf;
+    ring_transport_platform_conf(&bus, 1, NMBS_TRANSPORT_RTU, &s_conf);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.arg = &server_regs;
+    callbacks.read_coils = read_coils;
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    nmbs_error err = nmbs_server_create(&server, 1, &s_conf, &callbacks);
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&server, 100);
+    nmbs_set_byte_timeout(&server, 100);
+
+    nmbs_t client;
+    err = nmbs_client_create(&client, &c_conf);
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus client\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&client, 5000);
+    nmbs_set_byte_timeout(&client, 100);
+    nmbs_set_destination_rtu_address(&client, 1);
+
+    test_servers polled = {&server, 1};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, poll_servers, &polled) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    // Largest quantities that fit
+    uint16_t regs[WRITE_REGISTERS_MAX];
+    for (int i = 0; i < WRITE_REGISTERS_MAX; i++)
+        regs[i] = (uint16_t) (0x1000 + i);
+
+    check(nmbs_write_multiple_registers(&client, 2, WRITE_REGISTERS_MAX, regs) == NMBS_ERROR_NONE);
+
+    uint16_t regs_read[READ_REGISTERS_MAX];
+    check(nmbs_read_holding_registers(&client, 0, READ_REGISTERS_MAX, regs_read) == NMBS_ERROR_NONE);
+    check(memcmp(regs_read + 2, regs, sizeof(regs)) == 0);
+
+    nmbs_bitfield coils;
+    check(nmbs_read_coils(&client, 1, READ_BITS_MAX, coils) == NMBS_ERROR_NONE);
+    check(nmbs_bitfield_read(coils, 1) == 0 && nmbs_bitfield_read(coils, 2) == 1);
+    check(nmbs_bitfield_read(coils, READ_BITS_MAX - 1) == (READ_BITS_MAX % 3 == 0));
+
+    // Clients refuse larger quantities
+    check(nmbs_read_holding_registers(&client, 0, READ_REGISTERS_MAX + 1, regs_read) == NMBS_ERROR_INVALID_ARGUMENT);
+    check(nmbs_write_multiple_registers(&client, 0, WRITE_REGISTERS_MAX + 1, regs_read) ==
+          NMBS_ERROR_INVALID_ARGUMENT);
+    check(nmbs_read_coils(&client, 0, READ_BITS_MAX + 1, coils) == NMBS_ERROR_INVALID_ARGUMENT);
+
+    uint8_t raw[NMBS_MAX_PDU_SIZE];
+    check(nmbs_send_raw_pdu(&client, 3, raw, NMBS_MAX_PDU_SIZE) == NMBS_ERROR_INVALID_ARGUMENT);
+
+    // Servers answer larger quantities with ILLEGAL_DATA_VALUE
+    const uint8_t read_req[] = {0x00, 0x00, 0x00, READ_REGISTERS_MAX + 1};
+    check(nmbs_send_raw_pdu(&client, 3, read_req, sizeof(read_req)) == NMBS_ERROR_NONE);
+    check(nmbs_receive_raw_pdu_response(&client, raw, 1) == NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    const uint8_t coils_req[] = {0x00, 0x00, 0x00, READ_BITS_MAX + 1};
+    check(nmbs_send_raw_pdu(&client, 1, coils_req, sizeof(coils_req)) == NMBS_ERROR_NONE);
+    check(nmbs_receive_raw_pdu_response(&client, raw, 1) == NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    const uint8_t write_req[] = {0x00, 0x00, 0x00, WRITE_REGISTERS_MAX + 1, 0x02, 0x00, 0x01};
+    check(nmbs_send_raw_pdu(&client, 16, write_req, sizeof(write_req)) == NMBS_ERROR_NONE);
+    check(nmbs_receive_raw_pdu_response(&client, raw, 1) == NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    run = 0;
+    pthread_join(thread, NULL);
+
+    return result;
+}
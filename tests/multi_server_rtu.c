@@ -2,72 +2,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "nanomodbus.h"
+#include "ring_transport.h"
 
-#define WIRE_SIZE 1024
 #define UNUSED_PARAM(x) ((x) = (x))
 
 uint32_t run = 1;
 
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
 nmbs_t server1 = {0};
 nmbs_t server2 = {0};
 
-uint32_t index_w = 0;
-uint32_t indices_r[3] = {0};
-
-uint8_t wire[WIRE_SIZE];
-
-
-int32_t read_wire(uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
-    while (1) {
-        pthread_mutex_lock(&mutex);
-
-        uint64_t index = (uint64_t) arg;
-        uint32_t read = 0;
-        for (int i = 0; i < count; i++) {
-            if (indices_r[index] == index_w)
-                break;
+// Client, server 1 and server 2 on the same RTU bus
+ring_transport bus;
 
-            indices_r[index] = (indices_r[index] + 1) % WIRE_SIZE;
-            buf[i] = wire[indices_r[index]];
-            read++;
-        }
-
-        pthread_mutex_unlock(&mutex);
-
-        if (read != 0)
-            return (int32_t) read;
-
-        if (timeout_ms != 0)
-            usleep(timeout_ms * 1000);
-        else
-            return 0;
-
-        timeout_ms = 0;
-    }
-}
-
-int32_t write_wire(const uint8_t* buf, uint16_t count, int32_t timeout_ms, void* arg) {
-    UNUSED_PARAM(timeout_ms);
-    pthread_mutex_lock(&mutex);
-
-    uint64_t index = (uint64_t) arg;
-    uint32_t written = 0;
-    for (int i = 0; i < count; i++) {
-        index_w = (index_w + 1) % WIRE_SIZE;
-        indices_r[index] = index_w;
-        wire[index_w] = buf[i];
-        written++;
-    }
-
-    pthread_mutex_unlock(&mutex);
-
-    return (int32_t) written;
-}
 
 nmbs_error read_coils(uint16_t address, uint16_t quantity, nmbs_bitfield coils_out, uint8_t unit_id, void* arg) {
     UNUSED_PARAM(arg);
@@ -100,19 +48,16 @@ int main(int argc, char* argv[]) {
     UNUSED_PARAM(argc);
     UNUSED_PARAM(argv);
 
+    ring_transport_init(&bus, 3);
+
     nmbs_platform_conf c_conf;
-    nmbs_platform_conf_create(&c_conf);
-    c_conf.arg = wire;
-    c_conf.transport = NMBS_TRANSPORT_RTU;
-    c_conf.read = read_wire;
-    c_conf.write = write_wire;
-    c_conf.arg = 0;
+    ring_transport_platform_conf(&bus, 0, NMBS_TRANSPORT_RTU, &c_conf);
 
-    nmbs_platform_conf s1_conf = c_conf;
-    s1_conf.arg = (void*) 1;
+    nmbs_platform_conf s1_conf;
+    ring_transport_platform_conf(&bus, 1, NMBS_TRANSPORT_RTU, &s1_conf);
 
-    nmbs_platform_conf s2_conf = c_conf;
-    s2_conf.arg = (void*) 2;
+    nmbs_platform_conf s2_conf;
+    ring_transport_platform_conf(&bus, 2, NMBS_TRANSPORT_RTU, &s2_conf);
 
     nmbs_t client = {0};
     nmbs_error err = nmbs_client_create(&client, &c_conf);
@@ -159,8 +104,6 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    sleep(1);
-
     nmbs_bitfield coils;
     for (uint32_t c = 0; c < 10; c++) {
         nmbs_bitfield_write(coils, c, rand() % 1);
@@ -203,8 +146,6 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "Coils mismatch from %d\n", 99);
     }
 
-    sleep(5);
-
     run = 0;
     pthread_join(thread1, NULL);
     pthread_join(thread2, NULL);
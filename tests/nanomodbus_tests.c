@@ -54,14 +54,14 @@ void test_server_create(nmbs_transport transport) {
 
     reset(nmbs);
     err = nmbs_server_create(&nmbs, 0, &platform_conf_empty, &callbacks_empty);
-    if (transport == NMBS_TRANSPORT_RTU)
+    if (transport != NMBS_TRANSPORT_TCP)
         expect(err == NMBS_ERROR_INVALID_ARGUMENT);
     else
         expect(err == NMBS_ERROR_NONE);
 
     reset(nmbs);
     nmbs_platform_conf conf = platform_conf_empty;
-    conf.transport = 3;
+    conf.transport = 0;
     err = nmbs_server_create(&nmbs, 0, &conf, &callbacks_empty);
     expect(err == NMBS_ERROR_INVALID_ARGUMENT);
 
@@ -272,7 +272,7 @@ void test_fc1(nmbs_transport transport) {
     expect(nmbs_bitfield_read(bf, 8) == 1);
     expect(nmbs_bitfield_read(bf, 9) == 0);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -359,7 +359,7 @@ void test_fc2(nmbs_transport transport) {
     expect(nmbs_bitfield_read(bf, 8) == 1);
     expect(nmbs_bitfield_read(bf, 9) == 0);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -412,6 +412,19 @@ nmbs_error read_registers(uint16_t address, uint16_t quantity, uint16_t* registe
         registers_out[2] = 200;
     }
 
+    if (address == 20 && quantity == 4) {
+        // 123.456f and -2.5f in CDAB order
+        registers_out[0] = 0xE979;
+        registers_out[1] = 0x42F6;
+        registers_out[2] = 0x0000;
+        registers_out[3] = 0xC020;
+    }
+
+    if (address >= 1000) {
+        for (int i = 0; i < quantity; i++)
+            registers_out[i] = (uint16_t) (((address + i) << 8) | (quantity + i));
+    }
+
     return NMBS_ERROR_NONE;
 }
 
@@ -472,7 +485,26 @@ void test_fc3(nmbs_transport transport) {
     expect(regs[1] == 0);
     expect(regs[2] == 200);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    should("read any quantity of registers with no error");
+    uint16_t regs_all[125];
+    for (uint16_t q = 1; q <= 125; q++) {
+        check(nmbs_read_holding_registers(&CLIENT, 1000 + q, q, regs_all));
+        for (uint16_t i = 0; i < q; i++)
+            expect(regs_all[i] == (uint16_t) (((1000 + q + i) << 8) | (q + i)));
+    }
+
+    should("read values spanning multiple registers, decoded with the given word order");
+    float floats[2];
+    check(nmbs_read_holding_registers_values(&CLIENT, 20, 2, floats, sizeof(float), NMBS_ORDER_CDAB));
+    expect(floats[0] == 123.456f);
+    expect(floats[1] == -2.5f);
+
+    should("immediately return NMBS_ERROR_INVALID_ARGUMENT when reading values spanning more than 125 registers");
+    double doubles[32];
+    expect(nmbs_read_holding_registers_values(&CLIENT, 0, 32, doubles, sizeof(double), NMBS_ORDER_ABCD) ==
+           NMBS_ERROR_INVALID_ARGUMENT);
+
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -547,7 +579,7 @@ void test_fc4(nmbs_transport transport) {
     expect(regs[1] == 0);
     expect(regs[2] == 200);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -638,7 +670,7 @@ void test_fc5(nmbs_transport transport) {
     expect(((uint16_t*) raw_res)[0] == ntohs(4));
     expect(((uint16_t*) raw_res)[1] == ntohs(0xFF00));
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("ignore response when sending to broadcast address");
@@ -722,7 +754,7 @@ void test_fc6(nmbs_transport transport) {
     expect(((uint16_t*) raw_res)[0] == ntohs(4));
     expect(((uint16_t*) raw_res)[1] == ntohs(0x123));
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("ignore response when sending to broadcast address");
@@ -862,7 +894,7 @@ void test_fc15(nmbs_transport transport) {
     expect(((uint16_t*) raw_res)[0] == ntohs(7));
     expect(((uint16_t*) raw_res)[1] == ntohs(1));
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("ignore response when sending to broadcast address");
@@ -925,6 +957,19 @@ nmbs_error write_registers(uint16_t address, uint16_t quantity, const uint16_t*
         return NMBS_ERROR_NONE;
     }
 
+    if (address == 8) {
+        if (quantity != 4)
+            return NMBS_EXCEPTION_SERVER_DEVICE_FAILURE;
+
+        // 123.456f and -2.5f in BADC order
+        expect(registers[0] == 0xF642);
+        expect(registers[1] == 0x79E9);
+        expect(registers[2] == 0x20C0);
+        expect(registers[3] == 0x0000);
+
+        return NMBS_ERROR_NONE;
+    }
+
     return NMBS_ERROR_NONE;
 }
 
@@ -996,6 +1041,10 @@ void test_fc16(nmbs_transport transport) {
     registers[26] = 26;
     check(nmbs_write_multiple_registers(&CLIENT, 6, 27, registers));
 
+    should("write values spanning multiple registers, encoded with the given word order");
+    const float floats[2] = {123.456f, -2.5f};
+    check(nmbs_write_multiple_registers_values(&CLIENT, 8, 2, floats, sizeof(float), NMBS_ORDER_BADC));
+
     should("echo request's address and value");
     check(nmbs_send_raw_pdu(&CLIENT, fc, (uint8_t*) (uint16_t[]) {htons(7), htons(1), htons(0x0200), htons(0)}, 7));
     check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 4));
@@ -1003,7 +1052,7 @@ void test_fc16(nmbs_transport transport) {
     expect(((uint16_t*) raw_res)[0] == ntohs(7));
     expect(((uint16_t*) raw_res)[1] == ntohs(1));
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("ignore response when sending to broadcast address");
@@ -1050,6 +1099,11 @@ nmbs_error read_file(uint16_t file_number, uint16_t record_number, uint16_t* reg
     if (file_number == 255 && record_number == 9999 && count == 124)
         registers[123] = 42;
 
+    if (file_number == 5) {
+        for (uint16_t i = 0; i < count; i++)
+            registers[i] = (uint16_t) (record_number + i);
+    }
+
     return NMBS_ERROR_NONE;
 }
 
@@ -1100,7 +1154,35 @@ void test_fc20(nmbs_transport transport) {
     check(nmbs_read_file_record(&CLIENT, 255, 9999, registers, 124));
     expect(registers[123] == 42);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    should("read multiple sub-requests with no error");
+    const uint8_t subreqs[] = {14, 0x06, 0, 4, 0, 4, 0, 4, 0x06, 0, 4, 0, 4, 0, 4};
+    const uint8_t subres[] = {9, 0x06, 0x00, 0x00, 0x00, 0xFF, 0xAA, 0x55, 0xFF, 0xFF};
+    uint8_t raw_res[21];
+    check(nmbs_send_raw_pdu(&CLIENT, 20, subreqs, sizeof(subreqs)));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, sizeof(raw_res)));
+    expect(raw_res[0] == 20);
+    expect(memcmp(raw_res + 1, subres, sizeof(subres)) == 0);
+    expect(memcmp(raw_res + 11, subres, sizeof(subres)) == 0);
+
+    should("read sub-requests whose response fits in the PDU, in the order of the sub-requests");
+    const uint8_t subreqs_long_short[] = {14, 0x06, 0, 5, 0, 0, 0, 122, 0x06, 0, 5, 0, 100, 0, 1};
+    uint8_t raw_long[251];
+    check(nmbs_send_raw_pdu(&CLIENT, 20, subreqs_long_short, sizeof(subreqs_long_short)));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_long, sizeof(raw_long)));
+    expect(raw_long[0] == 250 && raw_long[1] == 245 && raw_long[2] == 0x06);
+    expect(raw_long[3] == 0 && raw_long[4] == 0 && raw_long[245] == 0 && raw_long[246] == 121);
+    expect(memcmp(raw_long + 247, (uint8_t[]) {3, 0x06, 0, 100}, 4) == 0);
+
+    const uint8_t subreqs_short_long_short[] = {21,   0x06, 0, 5, 0, 7, 0, 1, 0x06, 0, 5, 0, 0,
+                                                0,    120,  0x06, 0, 5, 0, 9, 0, 1};
+    check(nmbs_send_raw_pdu(&CLIENT, 20, subreqs_short_long_short, sizeof(subreqs_short_long_short)));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_long, sizeof(raw_long)));
+    expect(raw_long[0] == 250);
+    expect(memcmp(raw_long + 1, (uint8_t[]) {3, 0x06, 0, 7, 241, 0x06, 0, 0}, 8) == 0);
+    expect(raw_long[245] == 0 && raw_long[246] == 119);
+    expect(memcmp(raw_long + 247, (uint8_t[]) {3, 0x06, 0, 9}, 4) == 0);
+
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -1190,7 +1272,7 @@ void test_fc21(nmbs_transport transport) {
     registers[121] = 42;
     check(nmbs_write_file_record(&CLIENT, 255, 9999, registers, 122));
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("ignore response when sending to broadcast address");
@@ -1251,7 +1333,7 @@ void test_fc23(nmbs_transport transport) {
     expect(((uint16_t*) raw_res)[1] == ntohs(1));
     */
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending to broadcast address");
@@ -1443,7 +1525,7 @@ void test_fc43_14(nmbs_transport transport) {
     expect(strcmp(buffers[3],
                   "90byteslongextendedobjectthatcombinedwithotheronesisdefinitelygonnaexceedthepdusize0123456") == 0);
 
-    if (transport == NMBS_TRANSPORT_RTU) {
+    if (transport != NMBS_TRANSPORT_TCP) {
         nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
 
         should("receive no response when sending valid request to broadcast address");
@@ -1458,6 +1540,915 @@ void test_fc43_14(nmbs_transport transport) {
     stop_client_and_server();
 }
 
+typedef struct captured_frames {
+    uint8_t frames[4][260];
+    uint16_t lengths[4];
+    bool tx[4];
+    unsigned int count;
+    pthread_mutex_t m;
+} captured_frames;
+
+captured_frames captured_server = {.m = PTHREAD_MUTEX_INITIALIZER};
+captured_frames captured_client = {.m = PTHREAD_MUTEX_INITIALIZER};
+
+
+void capture_frame(captured_frames* captured, const uint8_t* buf, uint16_t count, bool tx) {
+    expect(pthread_mutex_lock(&captured->m) == 0);
+    if (captured->count < 4) {
+        memcpy(captured->frames[captured->count], buf, count);
+        captured->lengths[captured->count] = count;
+        captured->tx[captured->count] = tx;
+        captured->count++;
+    }
+    expect(pthread_mutex_unlock(&captured->m) == 0);
+}
+
+
+void capture_frame_server(const uint8_t* buf, uint16_t count, bool tx, void* arg) {
+    UNUSED_PARAM(arg);
+    capture_frame(&captured_server, buf, count, tx);
+}
+
+
+void capture_frame_client(const uint8_t* buf, uint16_t count, bool tx, void* arg) {
+    UNUSED_PARAM(arg);
+    capture_frame(&captured_client, buf, count, tx);
+}
+
+
+nmbs_error custom_fc(uint8_t fc, uint8_t* data, uint16_t* length, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+
+    if (check_user_data(arg) != 1)
+        return NMBS_EXCEPTION_SERVER_DEVICE_FAILURE;
+
+    if (fc == 66)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_VALUE;
+
+    if (fc == 67) {
+        *length = NMBS_MAX_PDU_SIZE;
+        return NMBS_ERROR_NONE;
+    }
+
+    // Echoes the request reversed, followed by its length
+    for (uint16_t i = 0; i < *length / 2; i++) {
+        const uint8_t tmp = data[i];
+        data[i] = data[*length - 1 - i];
+        data[*length - 1 - i] = tmp;
+    }
+
+    data[*length] = (uint8_t) *length;
+    (*length)++;
+    return NMBS_ERROR_NONE;
+}
+
+
+void test_custom_fc(nmbs_transport transport) {
+    uint8_t raw_res[260];
+    nmbs_custom_fc_table table;
+    nmbs_custom_fc_table_create(&table);
+
+    should("refuse to register handlers for function codes outside 1-127");
+    expect(nmbs_custom_fc_register(&table, 0, custom_fc) == NMBS_ERROR_INVALID_ARGUMENT);
+    expect(nmbs_custom_fc_register(&table, 128, custom_fc) == NMBS_ERROR_INVALID_ARGUMENT);
+
+    check(nmbs_custom_fc_register(&table, 65, custom_fc));
+    check(nmbs_custom_fc_register(&table, 66, custom_fc));
+    check(nmbs_custom_fc_register(&table, 67, custom_fc));
+    check(nmbs_custom_fc_register(&table, 3, custom_fc));
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.custom_fc_table = &table;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+
+    should("answer a custom function code with the response written by its handler");
+    const uint8_t req[] = {1, 2, 3, 4, 5};
+    check(nmbs_send_raw_pdu(&CLIENT, 65, req, sizeof(req)));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 6));
+    expect(memcmp(raw_res, (uint8_t[]) {5, 4, 3, 2, 1, 5}, 6) == 0);
+
+    should("answer a custom function code with no data");
+    check(nmbs_send_raw_pdu(&CLIENT, 65, NULL, 0));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 1));
+    expect(raw_res[0] == 0);
+
+    should("return exceptions returned by the handler");
+    check(nmbs_send_raw_pdu(&CLIENT, 66, req, sizeof(req)));
+    expect(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 1) == NMBS_EXCEPTION_ILLEGAL_DATA_VALUE);
+
+    should("return NMBS_EXCEPTION_SERVER_DEVICE_FAILURE when the response is too long");
+    check(nmbs_send_raw_pdu(&CLIENT, 67, req, sizeof(req)));
+    expect(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 1) == NMBS_EXCEPTION_SERVER_DEVICE_FAILURE);
+
+    should("dispatch built-in function codes to registered handlers");
+    check(nmbs_send_raw_pdu(&CLIENT, 3, req, 4));
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 5));
+    expect(memcmp(raw_res, (uint8_t[]) {4, 3, 2, 1, 4}, 5) == 0);
+
+    should("return NMBS_EXCEPTION_ILLEGAL_FUNCTION for unregistered function codes");
+    check(nmbs_send_raw_pdu(&CLIENT, 68, req, sizeof(req)));
+    expect(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 1) == NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+
+    if (transport != NMBS_TRANSPORT_TCP) {
+        nmbs_set_destination_rtu_address(&CLIENT, NMBS_BROADCAST_ADDRESS);
+
+        should("receive no response when sending to broadcast address");
+        check(nmbs_send_raw_pdu(&CLIENT, 65, req, sizeof(req)));
+        expect(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 6) == NMBS_ERROR_TIMEOUT);
+    }
+
+    stop_client_and_server();
+}
+
+
+nmbs_error forward(uint8_t unit_id, uint8_t* pdu, uint16_t* pdu_length, void* arg) {
+    if (check_user_data(arg) != 1)
+        return NMBS_EXCEPTION_SERVER_DEVICE_FAILURE;
+
+    switch (pdu[0]) {
+        case 65:
+            // Echoes the request data reversed, followed by the unit id
+            for (uint16_t i = 1; i < 1 + (*pdu_length - 1) / 2; i++) {
+                const uint8_t tmp = pdu[i];
+                pdu[i] = pdu[*pdu_length - i];
+                pdu[*pdu_length - i] = tmp;
+            }
+
+            pdu[(*pdu_length)++] = unit_id;
+            return NMBS_ERROR_NONE;
+        case 66:
+            // Exception response, as a downstream server would send it
+            pdu[0] |= 0x80;
+            pdu[1] = NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+            *pdu_length = 2;
+            return NMBS_ERROR_NONE;
+        case 67:
+            *pdu_length = 0;
+            return NMBS_ERROR_NONE;
+        case 3:
+            // One register, whatever the request
+            pdu[1] = 2;
+            pdu[2] = 0x12;
+            pdu[3] = 0x34;
+            *pdu_length = 4;
+            return NMBS_ERROR_NONE;
+        default:
+            return NMBS_EXCEPTION_ILLEGAL_FUNCTION;
+    }
+}
+
+
+void test_forward(nmbs_transport transport) {
+    uint8_t pdu[NMBS_MAX_PDU_SIZE];
+    uint16_t pdu_length = 0;
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_registers;
+    callbacks.forward = forward;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+
+    should("pass the whole request PDU to the forward callback and send back its response");
+    const uint8_t req[] = {1, 2, 3, 4, 5};
+    check(nmbs_send_raw_pdu(&CLIENT, 65, req, sizeof(req)));
+    check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+    expect(pdu_length == 7);
+    expect(memcmp(pdu, (uint8_t[]) {65, 5, 4, 3, 2, 1, TEST_SERVER_ADDR}, 7) == 0);
+
+    should("forward requests with no data");
+    check(nmbs_send_raw_pdu(&CLIENT, 65, NULL, 0));
+    check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+    expect(pdu_length == 2);
+    expect(pdu[0] == 65 && pdu[1] == TEST_SERVER_ADDR);
+
+    should("receive exception responses as raw PDUs");
+    check(nmbs_send_raw_pdu(&CLIENT, 66, req, sizeof(req)));
+    check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+    expect(pdu_length == 2);
+    expect(pdu[0] == (66 | 0x80) && pdu[1] == NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+    should("return exceptions returned by the forward callback");
+    check(nmbs_send_raw_pdu(&CLIENT, 68, req, sizeof(req)));
+    check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+    expect(pdu_length == 2);
+    expect(pdu[0] == (68 | 0x80) && pdu[1] == NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+
+    should("bypass the built-in function code handlers");
+    uint16_t reg = 0;
+    check(nmbs_read_holding_registers(&CLIENT, 100, 1, &reg));
+    expect(reg == 0x1234);
+
+    should("send no response when the forward callback returns an empty PDU");
+    check(nmbs_send_raw_pdu(&CLIENT, 67, req, sizeof(req)));
+    expect(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length) == NMBS_ERROR_TIMEOUT);
+
+    if (transport == NMBS_TRANSPORT_RTU_OVER_TCP) {
+        should("frame standard PDUs by their layout, with no byte timeout");
+        nmbs_set_byte_timeout(&CLIENT, -1);
+        check(nmbs_send_raw_pdu(&CLIENT, 3, req, 4));
+        check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+        expect(pdu_length == 4);
+        expect(memcmp(pdu, (uint8_t[]) {3, 2, 0x12, 0x34}, 4) == 0);
+
+        check(nmbs_send_raw_pdu(&CLIENT, 68, req, sizeof(req)));
+        check(nmbs_receive_raw_pdu_response_full(&CLIENT, pdu, &pdu_length));
+        expect(pdu_length == 2 && pdu[0] == (68 | 0x80));
+    }
+
+    stop_client_and_server();
+}
+
+
+void test_capture(nmbs_transport transport) {
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.write_single_register = write_register;
+
+    captured_server.count = 0;
+    captured_client.count = 0;
+    capture_server = capture_frame_server;
+    capture_client = capture_frame_client;
+
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+
+    should("pass every sent and received frame to the capture function");
+    check(nmbs_write_single_register(&CLIENT, 4, 123));
+
+    stop_client_and_server();
+    capture_server = NULL;
+    capture_client = NULL;
+
+    expect(captured_client.count == 2);
+    expect(captured_server.count == 2);
+    expect(captured_client.tx[0] && !captured_client.tx[1]);
+    expect(!captured_server.tx[0] && captured_server.tx[1]);
+
+    should("capture the full ADU, identical on both sides");
+    const uint16_t adu_len = transport == NMBS_TRANSPORT_TCP ? 7 + 5 : 1 + 5 + 2;
+    for (int i = 0; i < 2; i++) {
+        expect(captured_client.lengths[i] == adu_len);
+        expect(captured_server.lengths[i] == adu_len);
+        expect(memcmp(captured_client.frames[i], captured_server.frames[i], adu_len) == 0);
+    }
+}
+
+// Returns a byte every 50 ms, or nothing if the timeout is shorter
+int32_t read_trickle(uint8_t* buf, uint16_t count, int32_t timeout, void* arg) {
+    UNUSED_PARAM(arg);
+    if (timeout >= 0 && timeout < 50) {
+        usleep(timeout * 1000);
+        return 0;
+    }
+
+    usleep(50 * 1000);
+    memset(buf, 1, count);
+    return (int32_t) count;
+}
+
+
+nmbs_error read_registers_slow(uint16_t address, uint16_t quantity, uint16_t* registers_out, uint8_t unit_id,
+                               void* arg) {
+    UNUSED_PARAM(unit_id);
+    UNUSED_PARAM(arg);
+
+    if (address == 100)
+        usleep(300 * 1000);
+
+    for (int i = 0; i < quantity; i++)
+        registers_out[i] = (uint16_t) (address + i);
+
+    return NMBS_ERROR_NONE;
+}
+
+
+void test_transaction_timeout(nmbs_transport transport) {
+    if (transport != NMBS_TRANSPORT_TCP) {
+        should("stop receiving a request trickling in past the transaction timeout");
+        nmbs_t server;
+        nmbs_platform_conf platform_conf;
+        nmbs_platform_conf_create(&platform_conf);
+        platform_conf.transport = transport;
+        platform_conf.read = read_trickle;
+        platform_conf.write = write_empty;
+        platform_conf.clock_us = clock_us_monotonic;
+
+        nmbs_callbacks callbacks_empty;
+        nmbs_callbacks_create(&callbacks_empty);
+
+        reset(server);
+        check(nmbs_server_create(&server, TEST_SERVER_ADDR, &platform_conf, &callbacks_empty));
+        nmbs_set_read_timeout(&server, 1000);
+        nmbs_set_byte_timeout(&server, 100);
+        nmbs_set_transaction_timeout(&server, 120);
+
+        const uint64_t start = now_ms();
+        expect(nmbs_server_poll(&server) == NMBS_ERROR_TIMEOUT);
+        expect(now_ms() - start < 50 + 120 + 50);
+    }
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_registers_slow;
+
+    clock_client = clock_us_monotonic;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_transaction_timeout(&CLIENT, 150);
+
+    should("complete transactions within the transaction timeout");
+    uint16_t regs[2];
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    expect(regs[0] == 10 && regs[1] == 11);
+
+    should("return NMBS_ERROR_TIMEOUT when a response doesn't arrive within the transaction timeout");
+    const uint64_t start = now_ms();
+    expect(nmbs_read_holding_registers(&CLIENT, 100, 2, regs) == NMBS_ERROR_TIMEOUT);
+    const uint64_t diff = now_ms() - start;
+    expect(diff >= 150 && diff < 300);
+
+    stop_client_and_server();
+    clock_client = NULL;
+}
+
+
+void test_adaptive_timeout(nmbs_transport transport) {
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_registers_slow;
+
+    nmbs_rtt rtt_entries[248];
+    nmbs_rtt_table rtt_table;
+    nmbs_rtt_table_init(&rtt_table, rtt_entries, 248, 10, 500);
+
+    clock_client = clock_us_monotonic;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_rtt_table(&CLIENT, &rtt_table);
+
+    should("use the read timeout for unit ids with no measured response");
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 1000);
+
+    should("adapt the response timeout to the measured round-trip time, within the limits");
+    uint16_t regs[2];
+    for (int i = 0; i < 5; i++)
+        check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 10);
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR + 1) == 1000);
+
+    // The TCP server answers requests to any unit id
+    if (transport == NMBS_TRANSPORT_TCP) {
+        should("keep the entry of a unit id once taken, and not measure unit ids once all entries are taken");
+        nmbs_rtt_table_init(&rtt_table, rtt_entries, 1, 10, 500);
+        check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+        nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR + 1);
+        check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+        expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR + 1) == 1000);
+        expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 10);
+        nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR);
+    }
+
+    should("time out after the adaptive timeout and back off");
+    const uint64_t start = now_ms();
+    expect(nmbs_read_holding_registers(&CLIENT, 100, 2, regs) == NMBS_ERROR_TIMEOUT);
+    expect(now_ms() - start < 100);
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 20);
+
+    should("restore the timeout with the next response");
+    usleep(350 * 1000);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 10);
+
+    should("limit the response timeout to the read timeout if no upper limit is set");
+    nmbs_rtt_table_init(&rtt_table, rtt_entries, 248, 0, 0);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    int32_t timeout_ms = nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR);
+    expect(timeout_ms > 0 && timeout_ms < 1000);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    expect(nmbs_read_holding_registers(&CLIENT, 100, 2, regs) == NMBS_ERROR_TIMEOUT);
+    usleep(350 * 1000);
+    nmbs_set_read_timeout(&CLIENT, 1);
+    expect(nmbs_get_response_timeout(&CLIENT, TEST_SERVER_ADDR) == 1);
+
+    stop_client_and_server();
+    clock_client = NULL;
+}
+
+
+// RTU response served by read_reply after every request written with write_reply
+static uint8_t reply[16];
+static uint16_t reply_len;
+static uint16_t reply_idx;
+static uint16_t reply_armed;
+static bool reply_write_error;
+
+
+void set_reply(uint8_t unit_id, bool crc_valid) {
+    const uint8_t res[] = {unit_id, 3, 4, 0, 10, 0, 11};
+    memcpy(reply, res, sizeof(res));
+    uint16_t crc = nmbs_crc_calc(reply, sizeof(res), NULL);
+    if (!crc_valid)
+        crc ^= 1;
+
+    reply[sizeof(res)] = (uint8_t) (crc >> 8);
+    reply[sizeof(res) + 1] = (uint8_t) crc;
+    reply_armed = sizeof(res) + 2;
+}
+
+
+int32_t write_reply(const uint8_t* buf, uint16_t count, int32_t timeout, void* arg) {
+    UNUSED_PARAM(buf);
+    UNUSED_PARAM(timeout);
+    UNUSED_PARAM(arg);
+    if (reply_write_error)
+        return -1;
+
+    reply_len = reply_armed;
+    reply_idx = 0;
+    return count;
+}
+
+
+int32_t read_reply(uint8_t* buf, uint16_t count, int32_t timeout, void* arg) {
+    UNUSED_PARAM(arg);
+    const uint16_t left = reply_len - reply_idx;
+    if (left == 0) {
+        if (timeout > 0)
+            usleep(timeout * 1000);
+
+        return 0;
+    }
+
+    const uint16_t n = count < left ? count : left;
+    memcpy(buf, reply + reply_idx, n);
+    reply_idx += n;
+    return n;
+}
+
+
+void test_health(nmbs_transport transport) {
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_registers_slow;
+
+    nmbs_unit_health health_entries[248];
+    nmbs_health_table health_table;
+    nmbs_health_table_init(&health_table, health_entries, 248, 2, 100, 400);
+
+    clock_client = clock_us_monotonic;
+    start_client_and_server(transport, &callbacks);
+
+    nmbs_unit_health health;
+    should("return NMBS_ERROR_INVALID_ARGUMENT when getting the health of a unit id without a health table");
+    expect(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health) == NMBS_ERROR_INVALID_ARGUMENT);
+
+    nmbs_set_health_table(&CLIENT, &health_table);
+    nmbs_set_read_timeout(&CLIENT, 50);
+
+    should("count requests and responses of a unit id");
+    uint16_t regs[2];
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(health.requests == 1 && health.responses == 1 && !health.offline);
+
+    should("consider a unit id offline after the configured response timeouts in a row");
+    stop_client_and_server();
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(!health.offline && health.timeouts_in_row == 1);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(health.offline && health.timeouts == 2 && health.backoff_ms == 100);
+
+    should("fail requests to an offline unit id immediately with NMBS_ERROR_UNIT_OFFLINE");
+    uint64_t start = now_ms();
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_UNIT_OFFLINE);
+    expect(now_ms() - start < 20);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(health.rejected == 1 && health.requests == 3);
+
+    should("probe an offline unit id after the backoff interval, doubling it if the probe fails");
+    usleep(110 * 1000);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_UNIT_OFFLINE);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(health.offline && health.backoff_ms == 200 && health.requests == 4 && health.rejected == 2);
+
+    should("bring a unit id back online with the first response");
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_health_table(&CLIENT, &health_table);
+    usleep(210 * 1000);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(!health.offline && health.timeouts_in_row == 0 && health.responses == 3);
+
+    stop_client_and_server();
+
+    if (transport == NMBS_TRANSPORT_RTU) {
+        nmbs_t client;
+        nmbs_platform_conf platform_conf;
+        nmbs_platform_conf_create(&platform_conf);
+        platform_conf.transport = transport;
+        platform_conf.read = read_reply;
+        platform_conf.write = write_reply;
+        platform_conf.clock_us = clock_us_monotonic;
+
+        reset(client);
+        check(nmbs_client_create(&client, &platform_conf));
+        nmbs_set_destination_rtu_address(&client, TEST_SERVER_ADDR);
+        nmbs_set_read_timeout(&client, 50);
+        nmbs_set_byte_timeout(&client, 10);
+
+        nmbs_rtt rtt_entries[8];
+        nmbs_rtt_table rtt_table;
+        nmbs_rtt_table_init(&rtt_table, rtt_entries, 8, 10, 500);
+        nmbs_set_rtt_table(&client, &rtt_table);
+        nmbs_health_table_init(&health_table, health_entries, 8, 1, 10, 10);
+        nmbs_set_health_table(&client, &health_table);
+
+        reply_armed = 0;
+        expect(nmbs_read_holding_registers(&client, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+
+        should("not count responses from other unit ids or with an invalid CRC as responses of a unit id");
+        usleep(20 * 1000);
+        set_reply(TEST_SERVER_ADDR + 1, true);
+        expect(nmbs_read_holding_registers(&client, 10, 2, regs) == NMBS_ERROR_INVALID_UNIT_ID);
+        usleep(20 * 1000);
+        set_reply(TEST_SERVER_ADDR, false);
+        expect(nmbs_read_holding_registers(&client, 10, 2, regs) == NMBS_ERROR_CRC);
+        check(nmbs_get_unit_health(&client, TEST_SERVER_ADDR, &health));
+        expect(health.offline && health.responses == 0 && health.requests == 3);
+        expect(nmbs_get_response_timeout(&client, TEST_SERVER_ADDR) == 50);
+
+        should("count a response once it has been validated");
+        usleep(20 * 1000);
+        set_reply(TEST_SERVER_ADDR, true);
+        check(nmbs_read_holding_registers(&client, 10, 2, regs));
+        expect(regs[0] == 10 && regs[1] == 11);
+        check(nmbs_get_unit_health(&client, TEST_SERVER_ADDR, &health));
+        expect(!health.offline && health.responses == 1);
+        expect(nmbs_get_response_timeout(&client, TEST_SERVER_ADDR) == 10);
+
+        should("count a request, and take the probe of an offline unit id, only once the request is sent");
+        reply_armed = 0;
+        expect(nmbs_read_holding_registers(&client, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+        usleep(20 * 1000);
+        reply_write_error = true;
+        expect(nmbs_read_holding_registers(&client, 10, 2, regs) == NMBS_ERROR_TRANSPORT);
+        reply_write_error = false;
+        check(nmbs_get_unit_health(&client, TEST_SERVER_ADDR, &health));
+        expect(health.offline && health.requests == 5 && health.rejected == 0);
+        set_reply(TEST_SERVER_ADDR, true);
+        check(nmbs_read_holding_registers(&client, 10, 2, regs));
+        check(nmbs_get_unit_health(&client, TEST_SERVER_ADDR, &health));
+        expect(!health.offline && health.requests == 6 && health.responses == 2);
+    }
+
+    should("keep the state of unit ids mapped to the same entry apart");
+    nmbs_health_table_init(&health_table, health_entries, 2, 1, 1000, 1000);
+    nmbs_set_health_table(&CLIENT, &health_table);
+    nmbs_set_read_timeout(&CLIENT, 50);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR + 2);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_UNIT_OFFLINE);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR, &health));
+    expect(health.offline && health.requests == 1 && health.rejected == 1);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR + 2, &health));
+    expect(health.offline && health.requests == 1 && health.rejected == 0);
+
+    should("not track unit ids once all entries are taken");
+    nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR + 4);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_TIMEOUT);
+    check(nmbs_get_unit_health(&CLIENT, TEST_SERVER_ADDR + 4, &health));
+    expect(!health.valid && health.requests == 0);
+    nmbs_set_destination_rtu_address(&CLIENT, TEST_SERVER_ADDR);
+    expect(nmbs_read_holding_registers(&CLIENT, 10, 2, regs) == NMBS_ERROR_UNIT_OFFLINE);
+
+    clock_client = NULL;
+}
+
+
+// Clock stopped at stopped_us once it's not 0
+static uint64_t stopped_us;
+
+
+uint64_t clock_us_stopping(void* arg) {
+    return stopped_us ? stopped_us : clock_us_monotonic(arg);
+}
+
+
+static unsigned int delays;
+
+
+void delay_us_counting(uint32_t us, void* arg) {
+    UNUSED_PARAM(arg);
+    delays++;
+    usleep(us);
+}
+
+
+void test_rtu_timing(nmbs_transport transport) {
+    if (transport != NMBS_TRANSPORT_RTU)
+        return;
+
+    nmbs_rtu_timing timing;
+
+    should("compute t1.5 and t3.5 from the baud rate, fixed above 19200 baud");
+    nmbs_rtu_timing_init(&timing, 9600, NULL);
+    expect(timing.t15_us == 1719 && timing.t35_us == 4011);
+
+    nmbs_rtu_timing_init(&timing, 19200, NULL);
+    expect(timing.t15_us == 860 && timing.t35_us == 2006);
+
+    nmbs_rtu_timing_init(&timing, 115200, NULL);
+    expect(timing.t15_us == 750 && timing.t35_us == 1750);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_registers_slow;
+
+    clock_client = clock_us_monotonic;
+    start_client_and_server(transport, &callbacks);
+    nmbs_rtu_timing_init(&timing, 9600, NULL);
+    nmbs_set_rtu_timing(&CLIENT, &timing);
+
+    should("keep t3.5 of silence on the bus before sending a frame");
+    uint16_t regs[2];
+    for (int i = 0; i < 10; i++)
+        check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+
+    expect(timing.frames == 10);
+    expect(timing.waits >= 1 && timing.waits <= 9);
+    expect(timing.turnaround_us >= 9 * 4011);
+    expect(timing.max_wait_us <= 4011);
+
+    should("keep no inter-frame timing without a timing set");
+    nmbs_set_rtu_timing(&CLIENT, NULL);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    expect(timing.frames == 10);
+
+    should("wait with the delay function if there is one");
+    delays = 0;
+    nmbs_rtu_timing_init(&timing, 9600, delay_us_counting);
+    nmbs_set_rtu_timing(&CLIENT, &timing);
+    for (int i = 0; i < 10; i++)
+        check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+
+    expect(timing.waits >= 1 && delays == timing.waits);
+    expect(timing.turnaround_us >= 9 * 4011);
+
+    stop_client_and_server();
+
+    should("end the wait if the clock stops advancing");
+    clock_client = clock_us_stopping;
+    start_client_and_server(transport, &callbacks);
+    nmbs_rtu_timing_init(&timing, 9600, NULL);
+    nmbs_set_rtu_timing(&CLIENT, &timing);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    stopped_us = clock_us_monotonic(NULL);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 2, regs));
+    expect(timing.frames == 2 && timing.waits == 1);
+    stopped_us = 0;
+
+    stop_client_and_server();
+    clock_client = NULL;
+}
+
+
+unsigned int writev_server_calls;
+unsigned int writev_client_calls;
+
+
+// Gathers the segments and writes them at once, counting the calls
+int32_t writev_socket(int fd, const nmbs_segment* segments, uint8_t count, int32_t timeout_ms) {
+    uint8_t buf[260];
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        memcpy(buf + total, segments[i].data, segments[i].length);
+        total += segments[i].length;
+    }
+
+    return write_fd(fd, buf, total, timeout_ms);
+}
+
+
+int32_t writev_socket_server(const nmbs_segment* segments, uint8_t count, int32_t timeout_ms, void* arg) {
+    UNUSED_PARAM(arg);
+    writev_server_calls++;
+    return writev_socket(sockets[0], segments, count, timeout_ms);
+}
+
+
+int32_t writev_socket_client(const nmbs_segment* segments, uint8_t count, int32_t timeout_ms, void* arg) {
+    UNUSED_PARAM(arg);
+    writev_client_calls++;
+    return writev_socket(sockets[1], segments, count, timeout_ms);
+}
+
+
+// Register i holds 0x1000 + i, big-endian as on the wire
+uint8_t raw_registers[2 * 200];
+
+
+nmbs_error read_registers_raw(uint16_t address, uint16_t quantity, const uint8_t** data_out, uint8_t unit_id,
+                              void* arg) {
+    UNUSED_PARAM(unit_id);
+
+    if (check_user_data(arg) != 1)
+        return NMBS_EXCEPTION_SERVER_DEVICE_FAILURE;
+
+    if (address + quantity > 200)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    *data_out = raw_registers + address * 2;
+    return NMBS_ERROR_NONE;
+}
+
+
+void test_writev(nmbs_transport transport) {
+    for (int i = 0; i < 200; i++) {
+        raw_registers[i * 2] = (uint8_t) ((0x1000 + i) >> 8);
+        raw_registers[i * 2 + 1] = (uint8_t) (0x1000 + i);
+    }
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers_raw = read_registers_raw;
+    callbacks.read_input_registers_raw = read_registers_raw;
+
+    uint16_t regs[125];
+
+    should("answer from application memory without a writev() function");
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+    check(nmbs_read_holding_registers(&CLIENT, 10, 3, regs));
+    expect(regs[0] == 0x100A && regs[1] == 0x100B && regs[2] == 0x100C);
+    stop_client_and_server();
+
+    writev_server_calls = 0;
+    writev_client_calls = 0;
+    writev_server = writev_socket_server;
+    writev_client = writev_socket_client;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+
+    should("send registers from application memory with writev()");
+    check(nmbs_read_holding_registers(&CLIENT, 50, 125, regs));
+    for (int i = 0; i < 125; i++)
+        expect(regs[i] == 0x1000 + 50 + i);
+
+    check(nmbs_read_input_registers(&CLIENT, 0, 1, regs));
+    expect(regs[0] == 0x1000);
+    expect(writev_server_calls == 2);
+
+    should("return exceptions returned by the raw handler");
+    expect(nmbs_read_holding_registers(&CLIENT, 199, 2, regs) == NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+
+    should("send raw PDUs with writev()");
+    const unsigned int calls = writev_client_calls;
+    check(nmbs_send_raw_pdu(&CLIENT, 3, (uint8_t[]) {0, 20, 0, 2}, 4));
+    uint8_t raw_res[5];
+    check(nmbs_receive_raw_pdu_response(&CLIENT, raw_res, 5));
+    expect(memcmp(raw_res, (uint8_t[]) {4, 0x10, 0x14, 0x10, 0x15}, 5) == 0);
+    expect(writev_client_calls == calls + 1);
+
+    stop_client_and_server();
+
+    should("fall back to write() when frames are captured");
+    captured_server.count = 0;
+    capture_server = capture_frame_server;
+    writev_server_calls = 0;
+    start_client_and_server(transport, &callbacks);
+    nmbs_set_callbacks_arg(&SERVER, (void*) &callbacks_user_data);
+    check(nmbs_read_holding_registers(&CLIENT, 0, 2, regs));
+    expect(regs[0] == 0x1000 && regs[1] == 0x1001);
+    expect(writev_server_calls == 0);
+    stop_client_and_server();
+
+    capture_server = NULL;
+    writev_server = NULL;
+    writev_client = NULL;
+}
+
+void test_bitfield(void) {
+    nmbs_bitfield src;
+    nmbs_bitfield dst;
+    nmbs_bitfield expected;
+    uint8_t values[NMBS_BITFIELD_MAX];
+    uint8_t values_out[NMBS_BITFIELD_MAX];
+
+    srand(1);
+    for (size_t i = 0; i < sizeof(src); i++)
+        src[i] = (uint8_t) rand();
+
+    const uint16_t offsets[] = {0, 1, 3, 7, 8, 9, 63, 64, 65, 100};
+    const uint16_t counts[] = {0, 1, 5, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 127, 128, 129, 1000, 1800};
+
+    should("copy bits between any offsets, leaving the rest of the destination untouched");
+    for (size_t so = 0; so < sizeof(offsets) / sizeof(offsets[0]); so++) {
+        for (size_t d = 0; d < sizeof(offsets) / sizeof(offsets[0]); d++) {
+            for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+                memset(dst, 0xA5, sizeof(dst));
+                memset(expected, 0xA5, sizeof(expected));
+                for (uint16_t b = 0; b < counts[c]; b++)
+                    nmbs_bitfield_write(expected, offsets[d] + b, nmbs_bitfield_read(src, offsets[so] + b));
+
+                nmbs_bitfield_copy(dst, offsets[d], src, offsets[so], counts[c]);
+                expect(memcmp(dst, expected, sizeof(dst)) == 0);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(values); i++)
+        values[i] = (uint8_t) (rand() % 3 == 0 ? 0 : rand());
+
+    should("pack values at any offset, any non-zero value being a 1");
+    for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            memset(dst, 0x5A, sizeof(dst));
+            memset(expected, 0x5A, sizeof(expected));
+            for (uint16_t b = 0; b < counts[c]; b++)
+                nmbs_bitfield_write(expected, offsets[o] + b, values[b] != 0);
+
+            nmbs_bitfield_pack(dst, offsets[o], values, counts[c]);
+            expect(memcmp(dst, expected, sizeof(dst)) == 0);
+        }
+    }
+
+    should("unpack bits at any offset to 0 or 1 values");
+    for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+            memset(values_out, 0xFF, sizeof(values_out));
+            nmbs_bitfield_unpack(values_out, src, offsets[o], counts[c]);
+            for (uint16_t b = 0; b < counts[c]; b++)
+                expect(values_out[b] == nmbs_bitfield_read(src, offsets[o] + b));
+
+            expect(values_out[counts[c]] == 0xFF);
+        }
+    }
+}
+
+
+void test_values(void) {
+    // 0x0102030405060708 and 0x11121314 in each order
+    const uint8_t wire_64[4][8] = {
+            {1, 2, 3, 4, 5, 6, 7, 8},
+            {7, 8, 5, 6, 3, 4, 1, 2},
+            {2, 1, 4, 3, 6, 5, 8, 7},
+            {8, 7, 6, 5, 4, 3, 2, 1},
+    };
+    const uint8_t wire_32[4][4] = {
+            {0x11, 0x12, 0x13, 0x14},
+            {0x13, 0x14, 0x11, 0x12},
+            {0x12, 0x11, 0x14, 0x13},
+            {0x14, 0x13, 0x12, 0x11},
+    };
+
+    should("decode, encode and convert to and from registers 32 and 64-bit values in any word order");
+    for (int o = 0; o < 4; o++) {
+        const nmbs_word_order order = (nmbs_word_order) o;
+        uint8_t wire[8 * 40];
+        uint16_t registers[4 * 40];
+        uint64_t values_64[40];
+        uint32_t values_32[40];
+
+        for (int i = 0; i < 40; i++)
+            memcpy(wire + i * 8, wire_64[o], 8);
+
+        nmbs_values_decode(values_64, wire, 40, 8, order);
+        for (int i = 0; i < 40; i++)
+            expect(values_64[i] == 0x0102030405060708ULL);
+
+        memset(wire, 0, sizeof(wire));
+        nmbs_values_encode(wire, values_64, 40, 8, order);
+        for (int i = 0; i < 40; i++)
+            expect(memcmp(wire + i * 8, wire_64[o], 8) == 0);
+
+        for (int i = 0; i < 40; i++)
+            memcpy(wire + i * 4, wire_32[o], 4);
+
+        nmbs_values_decode(values_32, wire, 40, 4, order);
+        for (int i = 0; i < 40; i++)
+            expect(values_32[i] == 0x11121314);
+
+        nmbs_values_to_registers(registers, values_32, 40, 4, order);
+        for (int i = 0; i < 80; i++)
+            expect(registers[i] == (wire_32[o][(i % 2) * 2] << 8 | wire_32[o][(i % 2) * 2 + 1]));
+
+        memset(values_32, 0, sizeof(values_32));
+        nmbs_values_from_registers(values_32, registers, 40, 4, order);
+        for (int i = 0; i < 40; i++)
+            expect(values_32[i] == 0x11121314);
+    }
+}
+
+
 nmbs_transport transports[2] = {NMBS_TRANSPORT_RTU, NMBS_TRANSPORT_TCP};
 const char* transports_str[2] = {"RTU", "TCP"};
 
@@ -1468,11 +2459,18 @@ void for_transports(void (*test_fn)(nmbs_transport), const char* should_str) {
     }
 }
 
+// RTU over TCP shares the framing of RTU, only tests of how it delimits frames are run on it
+void for_rtu_over_tcp(void (*test_fn)(nmbs_transport), const char* should_str) {
+    printf("Should %s on RTU over TCP:\n", should_str);
+    test(test_fn(NMBS_TRANSPORT_RTU_OVER_TCP));
+}
+
 int main(int argc, char* argv[]) {
     UNUSED_PARAM(argc);
     UNUSED_PARAM(argv);
 
     for_transports(test_server_create, "create a modbus server");
+    for_rtu_over_tcp(test_server_create, "create a modbus server");
 
     for_transports(test_server_receive_base, "receive no messages without failing");
 
@@ -1500,5 +2498,29 @@ int main(int argc, char* argv[]) {
 
     for_transports(test_fc43_14, "send and receive FC 43 / 14 (0x2B / 0x0E) Read Device Identification");
 
+    for_transports(test_custom_fc, "send and receive custom function codes");
+    for_rtu_over_tcp(test_custom_fc, "send and receive custom function codes");
+
+    for_transports(test_forward, "forward raw requests and receive raw responses");
+    for_rtu_over_tcp(test_forward, "forward raw requests and receive raw responses");
+
+    for_transports(test_capture, "capture sent and received frames");
+
+    for_transports(test_writev, "send frames in segments with writev()");
+
+    for_transports(test_transaction_timeout, "bound whole transactions with the transaction timeout");
+
+    for_transports(test_adaptive_timeout, "adapt response timeouts to the measured round-trip time");
+
+    for_transports(test_health, "track the health of servers and back off from offline ones");
+
+    for_transports(test_rtu_timing, "keep the RTU inter-frame timing");
+
+    printf("Should copy, pack and unpack bitfields:\n");
+    test(test_bitfield());
+
+    printf("Should decode and encode multi-register values:\n");
+    test(test_values());
+
     return 0;
 }
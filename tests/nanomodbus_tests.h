@@ -48,6 +48,14 @@ uint64_t now_ms(void) {
 }
 
 
+uint64_t clock_us_monotonic(void* arg) {
+    UNUSED_PARAM(arg);
+    struct timespec ts = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return (uint64_t) (ts.tv_sec) * 1000000 + (uint64_t) (ts.tv_nsec) / 1000;
+}
+
+
 void reset_sockets(void) {
     if (sockets[0] != -1)
         close(sockets[0]);
@@ -153,12 +161,21 @@ int32_t write_socket_client(const uint8_t* buf, uint16_t count, int32_t timeout_
 }
 
 
+void (*capture_server)(const uint8_t* buf, uint16_t count, bool tx, void* arg) = NULL;
+void (*capture_client)(const uint8_t* buf, uint16_t count, bool tx, void* arg) = NULL;
+int32_t (*writev_server)(const nmbs_segment* segments, uint8_t count, int32_t timeout_ms, void* arg) = NULL;
+int32_t (*writev_client)(const nmbs_segment* segments, uint8_t count, int32_t timeout_ms, void* arg) = NULL;
+uint64_t (*clock_client)(void* arg) = NULL;
+
+
 nmbs_platform_conf nmbs_platform_conf_server;
 nmbs_platform_conf* platform_conf_socket_server(nmbs_transport transport) {
     nmbs_platform_conf_create(&nmbs_platform_conf_server);
     nmbs_platform_conf_server.transport = transport;
     nmbs_platform_conf_server.read = read_socket_server;
     nmbs_platform_conf_server.write = write_socket_server;
+    nmbs_platform_conf_server.capture = capture_server;
+    nmbs_platform_conf_server.writev = writev_server;
     return &nmbs_platform_conf_server;
 }
 
@@ -169,6 +186,9 @@ nmbs_platform_conf* platform_conf_socket_client(nmbs_transport transport) {
     nmbs_platform_conf_client.transport = transport;
     nmbs_platform_conf_client.read = read_socket_client;
     nmbs_platform_conf_client.write = write_socket_client;
+    nmbs_platform_conf_client.capture = capture_client;
+    nmbs_platform_conf_client.writev = writev_client;
+    nmbs_platform_conf_client.clock_us = clock_client;
     return &nmbs_platform_conf_client;
 }
 
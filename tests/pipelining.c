@@ -0,0 +1,150 @@
+#include "platform.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "nanomodbus.h"
+#include "test_common.h"
+
+#define REQUESTS 8
+
+nmbs_t server;
+uint16_t server_registers[REQUESTS];
+test_registers server_regs = {server_registers, REQUESTS};
+
+
+void* poll_server(void* arg) {
+    UNUSED_PARAM(arg);
+    while (run)
+        server_poll_pipelined(&server, 50);
+
+    return NULL;
+}
+
+
+int tcp_connect(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(server_fd, (struct sockaddr*) &addr, &len) != 0)
+        return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr*) &addr, len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+// Waits up to 1 s for data, then returns what a single recv() gets
+ssize_t recv_once(int fd, uint8_t* buf, size_t size) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+    if (poll(&pfd, 1, 1000) <= 0)
+        return -1;
+
+    return recv(fd, buf, size, 0);
+}
+
+
+void put_request(uint8_t* req, uint16_t transaction_id, uint8_t fc, uint16_t address, uint16_t value) {
+    const uint8_t r[] = {(uint8_t) (transaction_id >> 8),
+                         (uint8_t) transaction_id,
+                         0x00,
+                         0x00,
+                         0x00,
+                         0x06,
+                         0xFF,
+                         fc,
+                         (uint8_t) (address >> 8),
+                         (uint8_t) address,
+                         (uint8_t) (value >> 8),
+                         (uint8_t) value};
+    memcpy(req, r, sizeof(r));
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    int result = 0;
+
+    if (create_tcp_server("127.0.0.1", "0") != 0) {
+        fprintf(stderr, "Error creating TCP server\n");
+        return 1;
+    }
+
+    nmbs_platform_conf conf;
+    nmbs_platform_conf_create(&conf);
+    conf.transport = NMBS_TRANSPORT_TCP;
+    conf.read = read_conn_buffered;
+    conf.write = write_conn_buffered;
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.arg = &server_regs;
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_single_register = write_single_register;
+
+    if (nmbs_server_create(&server, 0, &conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    pthread_t poller;
+    if (pthread_create(&poller, NULL, poll_server, NULL) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    int fd = tcp_connect();
+    check(fd >= 0);
+
+    // Writes followed by reads of the written registers, all sent at once, are answered in order with a single send()
+    uint8_t reqs[REQUESTS * 2 * 12];
+    for (uint16_t i = 0; i < REQUESTS; i++) {
+        put_request(reqs + i * 12, i, 6, i, (uint16_t) (0x100 + i));
+        put_request(reqs + (REQUESTS + i) * 12, (uint16_t) (REQUESTS + i), 3, i, 1);
+    }
+
+    check(send(fd, reqs, sizeof(reqs), 0) == sizeof(reqs));
+
+    uint8_t res[REQUESTS * (12 + 11)];
+    check(recv_once(fd, res, sizeof(res)) == sizeof(res));
+    for (int i = 0; i < REQUESTS; i++)
+        check(memcmp(res + i * 12, reqs + i * 12, 12) == 0);
+
+    for (int i = 0; i < REQUESTS; i++) {
+        const uint8_t* r = res + REQUESTS * 12 + i * 11;
+        check(r[1] == REQUESTS + i && r[7] == 3 && r[8] == 2 && r[9] == 0x01 && r[10] == i);
+    }
+
+    // A request split across segments is served once complete, an exception doesn't affect the following request
+    put_request(reqs, 1, 3, REQUESTS, 1);
+    put_request(reqs + 12, 2, 3, 0, 1);
+    check(send(fd, reqs, 7, 0) == 7);
+    nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 20000000}, NULL);
+    check(send(fd, reqs + 7, 17, 0) == 17);
+
+    check(recv_once(fd, res, 9 + 11) == 9 + 11);
+    check(res[1] == 1 && res[7] == 0x83 && res[8] == NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS);
+    check(res[9 + 1] == 2 && res[9 + 9] == 0x01 && res[9 + 10] == 0x00);
+
+    // An invalid MBAP length closes the connection
+    const uint8_t bad[] = {0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0xFF};
+    check(send(fd, bad, sizeof(bad), 0) == sizeof(bad));
+    check(recv_once(fd, res, sizeof(res)) == 0);
+    close(fd);
+
+    run = 0;
+    pthread_join(poller, NULL);
+    close_tcp_server();
+
+    return result;
+}
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE
+
+#include "serial.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nanomodbus.h"
+#include "test_common.h"
+
+#define ITERATIONS 200
+#define SERVER_ADDR 17
+
+serial_port server_port;
+serial_port client_port;
+nmbs_t server;
+uint16_t server_registers[32];
+test_registers server_regs = {server_registers, 32};
+
+
+int open_pty_master(void) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0)
+        return -1;
+
+    if (grantpt(master) != 0 || unlockpt(master) != 0) {
+        close(master);
+        return -1;
+    }
+
+    return master;
+}
+
+
+void sleep_ms(long ms) {
+    struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    int result = 0;
+
+    const int master = open_pty_master();
+    if (master < 0) {
+        printf("Pseudo-terminals are not available, skipping\n");
+        return 0;
+    }
+
+    // Pseudo-terminals refuse parity on both ends, 8N2 is used instead
+    check(serial_open(&client_port, "/dev/nonexistent", 19200, 'N') != 0);
+    check(serial_open(&client_port, ptsname(master), 12345, 'N') != 0);
+    check(serial_open(&client_port, ptsname(master), 19200, 'X') != 0);
+    check(serial_configure(&server_port, master, 19200, 'N') == 0);
+    check(serial_open(&client_port, ptsname(master), 19200, 'N') == 0);
+
+    // t3.5 is 4.01 ms at 9600 baud and 2.01 ms at 19200, fixed at 1.75 ms above
+    serial_port p;
+    p.baud = 9600;
+    p.char_time_us = 1146;
+    check(serial_frame_timeout_ms(&p) == 5);
+    check(serial_frame_timeout_ms(&client_port) == 3);
+    p.baud = 115200;
+    check(serial_frame_timeout_ms(&p) == 2);
+
+    // Pseudo-terminals have no RS-485 support
+    check(serial_set_rs485(&client_port, true, 0, 0) != 0);
+    check(serial_set_read_mode(&client_port, 0, 0) == 0);
+
+    nmbs_platform_conf s_conf;
+    serial_platform_conf(&server_port, &s_conf);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.arg = &server_regs;
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    if (nmbs_server_create(&server, SERVER_ADDR, &s_conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&server, 50);
+    nmbs_set_byte_timeout(&server, serial_frame_timeout_ms(&server_port));
+
+    nmbs_platform_conf c_conf;
+    serial_platform_conf(&client_port, &c_conf);
+
+    nmbs_t client;
+    if (nmbs_client_create(&client, &c_conf) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus client\n");
+        return 1;
+    }
+
+    nmbs_set_destination_rtu_address(&client, SERVER_ADDR);
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, serial_frame_timeout_ms(&client_port));
+
+    test_servers polled = {&server, 1};
+    pthread_t poller;
+    if (pthread_create(&poller, NULL, poll_servers, &polled) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    for (int i = 0; i < ITERATIONS && result == 0; i++) {
+        uint16_t regs[16];
+        for (int r = 0; r < 16; r++)
+            regs[r] = (uint16_t) (i * 100 + r);
+
+        check(nmbs_write_multiple_registers(&client, 0, 16, regs) == NMBS_ERROR_NONE);
+
+        uint16_t regs_read[16];
+        check(nmbs_read_holding_registers(&client, 0, 16, regs_read) == NMBS_ERROR_NONE);
+        check(memcmp(regs, regs_read, sizeof(regs)) == 0);
+    }
+
+    // Bytes already received are returned with the same read(), instead of one read() per byte
+    printf("%.2f bytes per read() on the server side\n",
+           (double) server_port.rx_bytes / (double) (server_port.rx_calls ? server_port.rx_calls : 1));
+    check(server_port.rx_bytes >= 2 * server_port.rx_calls);
+
+    // A request whose bytes are split by a pause shorter than t3.5 is a single frame, by a longer one it's discarded
+    const uint8_t req[] = {SERVER_ADDR, 0x03, 0x00, 0x00, 0x00, 0x01, 0x86, 0x9A};
+    uint8_t res[7];
+
+    check(write(client_port.fd, req, 4) == 4);
+    check(write(client_port.fd, req + 4, 4) == 4);
+    check(nmbs_receive_raw_pdu_response(&client, res, 3) == NMBS_ERROR_NONE);
+
+    check(write(client_port.fd, req, 4) == 4);
+    sleep_ms(50);
+    check(write(client_port.fd, req + 4, 4) == 4);
+    check(nmbs_receive_raw_pdu_response(&client, res, 3) == NMBS_ERROR_TIMEOUT);
+
+    // The server is still in sync
+    uint16_t reg;
+    check(nmbs_read_holding_registers(&client, 0, 1, &reg) == NMBS_ERROR_NONE);
+
+    run = 0;
+    pthread_join(poller, NULL);
+
+    serial_close(&server_port);
+    serial_close(&client_port);
+
+    return result;
+}
@@ -0,0 +1,132 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nanomodbus.h"
+#include "ring_transport.h"
+#include "test_common.h"
+
+#define CONNECTIONS 4
+#define REGISTERS 16
+
+// One client/server pair per connection, all the servers share one profile and all the clients share another
+ring_transport buses[CONNECTIONS];
+
+nmbs_t servers[CONNECTIONS];
+uint16_t server_registers[CONNECTIONS][REGISTERS];
+test_registers server_regs[CONNECTIONS];
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    printf("sizeof(nmbs_t) %zu, sizeof(nmbs_profile) %zu\n", sizeof(nmbs_t), sizeof(nmbs_profile));
+
+    nmbs_platform_conf c_conf[CONNECTIONS];
+    nmbs_platform_conf s_conf[CONNECTIONS];
+    for (int i = 0; i < CONNECTIONS; i++) {
+        ring_transport_init(&buses[i], 2);
+        ring_transport_platform_conf(&buses[i], 0, NMBS_TRANSPORT_TCP, &c_conf[i]);
+        ring_transport_platform_conf(&buses[i], 1, NMBS_TRANSPORT_TCP, &s_conf[i]);
+    }
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    nmbs_profile server_profile;
+    nmbs_error err = nmbs_profile_server_create(&server_profile, 0, &s_conf[0], &callbacks);
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating server profile\n");
+        return 1;
+    }
+
+    nmbs_profile_set_read_timeout(&server_profile, 1);
+    nmbs_profile_set_byte_timeout(&server_profile, 100);
+
+    nmbs_profile client_profile;
+    err = nmbs_profile_client_create(&client_profile, &c_conf[0]);
+    if (err != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating client profile\n");
+        return 1;
+    }
+
+    nmbs_profile_set_read_timeout(&client_profile, 5000);
+    nmbs_profile_set_byte_timeout(&client_profile, 100);
+
+    nmbs_t clients[CONNECTIONS];
+    for (int i = 0; i < CONNECTIONS; i++) {
+        err = nmbs_create_from_profile(&servers[i], &server_profile);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error creating modbus server %d\n", i);
+            return 1;
+        }
+
+        nmbs_set_platform_arg(&servers[i], s_conf[i].arg);
+        server_regs[i].values = server_registers[i];
+        server_regs[i].count = REGISTERS;
+        nmbs_set_callbacks_arg(&servers[i], &server_regs[i]);
+
+        err = nmbs_create_from_profile(&clients[i], &client_profile);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error creating modbus client %d\n", i);
+            return 1;
+        }
+
+        nmbs_set_platform_arg(&clients[i], c_conf[i].arg);
+    }
+
+    test_servers polled = {servers, CONNECTIONS};
+    pthread_t thread;
+    int ret = pthread_create(&thread, NULL, poll_servers, &polled);
+    if (ret != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    int result = 0;
+    for (int i = 0; i < CONNECTIONS; i++) {
+        uint16_t regs[REGISTERS];
+        for (int r = 0; r < REGISTERS; r++)
+            regs[r] = (uint16_t) (i * 1000 + r);
+
+        err = nmbs_write_multiple_registers(&clients[i], 0, REGISTERS, regs);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error writing registers to server %d %s\n", i, nmbs_strerror(err));
+            result = 1;
+        }
+    }
+
+    for (int i = 0; i < CONNECTIONS; i++) {
+        uint16_t regs[REGISTERS];
+        err = nmbs_read_holding_registers(&clients[i], 0, REGISTERS, regs);
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error reading registers from server %d %s\n", i, nmbs_strerror(err));
+            result = 1;
+            continue;
+        }
+
+        for (int r = 0; r < REGISTERS; r++) {
+            if (regs[r] != (uint16_t) (i * 1000 + r) || server_registers[i][r] != regs[r]) {
+                fprintf(stderr, "Registers mismatch from server %d\n", i);
+                result = 1;
+                break;
+            }
+        }
+    }
+
+    uint16_t reg;
+    err = nmbs_read_holding_registers(&clients[0], REGISTERS, 1, &reg);
+    if (err != NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS) {
+        fprintf(stderr, "Expected exception from server 0, got %s\n", nmbs_strerror(err));
+        result = 1;
+    }
+
+    run = 0;
+    pthread_join(thread, NULL);
+
+    return result;
+}
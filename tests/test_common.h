@@ -0,0 +1,91 @@
+#ifndef NMBS_TEST_COMMON_H
+#define NMBS_TEST_COMMON_H
+
+// Helpers of the build option and transport tests: a check() macro, register callbacks and a server poll loop
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nanomodbus.h"
+
+#ifndef UNUSED_PARAM
+#define UNUSED_PARAM(x) ((x) = (x))
+#endif
+
+// Marks the test as failed by setting `result` in the calling function, and goes on with the next checks
+#define check(expr)                                                                                                    \
+    do {                                                                                                               \
+        if (!(expr)) {                                                                                                 \
+            fprintf(stderr, "Check failed at line %d: %s\n", __LINE__, #expr);                                         \
+            result = 1;                                                                                                \
+        }                                                                                                              \
+    } while (0)
+
+volatile uint32_t run = 1;
+
+
+// Registers of a server, passed to the callbacks below as their arg
+typedef struct test_registers {
+    uint16_t* values;
+    uint16_t count;
+} test_registers;
+
+
+static inline nmbs_error read_holding_registers(uint16_t address, uint16_t quantity, uint16_t* registers_out,
+                                                uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    const test_registers* regs = (const test_registers*) arg;
+    if (address + quantity > regs->count)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    memcpy(registers_out, regs->values + address, quantity * sizeof(uint16_t));
+    return NMBS_ERROR_NONE;
+}
+
+
+static inline nmbs_error write_single_register(uint16_t address, uint16_t value, uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    test_registers* regs = (test_registers*) arg;
+    if (address >= regs->count)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    regs->values[address] = value;
+    return NMBS_ERROR_NONE;
+}
+
+
+static inline nmbs_error write_multiple_registers(uint16_t address, uint16_t quantity, const uint16_t* registers,
+                                                  uint8_t unit_id, void* arg) {
+    UNUSED_PARAM(unit_id);
+    test_registers* regs = (test_registers*) arg;
+    if (address + quantity > regs->count)
+        return NMBS_EXCEPTION_ILLEGAL_DATA_ADDRESS;
+
+    memcpy(regs->values + address, registers, quantity * sizeof(uint16_t));
+    return NMBS_ERROR_NONE;
+}
+
+
+// Servers polled in turn by a thread running poll_servers()
+typedef struct test_servers {
+    nmbs_t* servers;
+    int count;
+} test_servers;
+
+
+// Polls the servers until run is cleared. Timeouts of partial requests and running out of pool buffers are expected,
+// other errors are reported
+static inline void* poll_servers(void* arg) {
+    const test_servers* s = (const test_servers*) arg;
+    while (run) {
+        for (int i = 0; i < s->count; i++) {
+            const nmbs_error err = nmbs_server_poll(&s->servers[i]);
+            if (err != NMBS_ERROR_NONE && err != NMBS_ERROR_TIMEOUT && err != NMBS_ERROR_NO_BUFFER)
+                fprintf(stderr, "Error polling server %d %s\n", i, nmbs_strerror(err));
+        }
+    }
+
+    return NULL;
+}
+
+#endif    // NMBS_TEST_COMMON_H
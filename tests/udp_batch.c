@@ -0,0 +1,223 @@
+#define UDP_BATCH_SIZE 16
+#include "udp_batch.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nanomodbus.h"
+#include "test_common.h"
+
+#define CLIENTS 8
+#define REGISTERS 16
+#define ITERATIONS 500
+
+struct sockaddr_in server_addr;
+udp_batch server_batch;
+nmbs_t server;
+// Every client writes its own registers, at address client * REGISTERS
+uint16_t server_registers[CLIENTS][REGISTERS];
+test_registers server_regs = {&server_registers[0][0], CLIENTS * REGISTERS};
+
+udp_batch client_batches[CLIENTS];
+nmbs_t clients[CLIENTS];
+int client_results[CLIENTS];
+
+
+int udp_socket(struct sockaddr_in* addr) {
+    const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(struct sockaddr_in);
+    if (bind(fd, (struct sockaddr*) addr, len) != 0 || getsockname(fd, (struct sockaddr*) addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+void* run_client(void* arg) {
+    const int c = *(const int*) arg;
+    nmbs_t* client = &clients[c];
+    const uint16_t address = (uint16_t) (c * REGISTERS);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint16_t regs[REGISTERS];
+        for (int r = 0; r < REGISTERS; r++)
+            regs[r] = (uint16_t) (c * 1000 + i + r);
+
+        nmbs_error err = nmbs_write_multiple_registers(client, address, REGISTERS, regs);
+        if (err == NMBS_ERROR_NONE) {
+            uint16_t regs_read[REGISTERS];
+            err = nmbs_read_holding_registers(client, address, REGISTERS, regs_read);
+            if (err == NMBS_ERROR_NONE && memcmp(regs, regs_read, sizeof(regs)) != 0) {
+                fprintf(stderr, "Registers mismatch for client %d\n", c);
+                client_results[c] = 1;
+            }
+        }
+
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error from client %d %s\n", c, nmbs_strerror(err));
+            client_results[c] = 1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    int result = 0;
+
+    const int server_fd = udp_socket(&server_addr);
+    if (server_fd < 0) {
+        fprintf(stderr, "Error creating server socket\n");
+        return 1;
+    }
+
+    udp_batch_init(&server_batch, server_fd);
+
+    nmbs_platform_conf s_conf;
+    udp_batch_platform_conf(&server_batch, &s_conf);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.arg = &server_regs;
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    if (nmbs_server_create(&server, 0, &s_conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_read_timeout(&server, 100);
+    nmbs_set_byte_timeout(&server, 100);
+
+    for (int i = 0; i < CLIENTS; i++) {
+        struct sockaddr_in addr;
+        const int fd = udp_socket(&addr);
+        if (fd < 0) {
+            fprintf(stderr, "Error creating client socket\n");
+            return 1;
+        }
+
+        udp_batch_init(&client_batches[i], fd);
+        udp_batch_set_peer(&client_batches[i], (const struct sockaddr*) &server_addr, sizeof(server_addr));
+
+        nmbs_platform_conf c_conf;
+        udp_batch_platform_conf(&client_batches[i], &c_conf);
+        if (nmbs_client_create(&clients[i], &c_conf) != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error creating modbus client\n");
+            return 1;
+        }
+
+        nmbs_set_read_timeout(&clients[i], 1000);
+        nmbs_set_byte_timeout(&clients[i], 100);
+
+        server_registers[i][0] = (uint16_t) (0x100 + i);
+    }
+
+    // Requests from all the clients are received with a single recvmmsg() and answered with a single sendmmsg()
+    for (int i = 0; i < CLIENTS; i++) {
+        const uint8_t req[] = {0x00, (uint8_t) (i * REGISTERS), 0x00, 0x01};
+        check(nmbs_send_raw_pdu(&clients[i], 3, req, sizeof(req)) == NMBS_ERROR_NONE);
+        check(udp_batch_flush(&client_batches[i]) == 0);
+    }
+
+    for (int i = 0; i < CLIENTS; i++)
+        check(nmbs_server_poll(&server) == NMBS_ERROR_NONE);
+
+    check(server_batch.rx_calls == 1 && server_batch.rx_datagrams == CLIENTS);
+    check(server_batch.tx_calls == 0);
+
+    // Waiting for the next request sends the queued responses
+    check(nmbs_server_poll(&server) == NMBS_ERROR_NONE);
+    check(server_batch.tx_calls == 1 && server_batch.tx_datagrams == CLIENTS);
+
+    for (int i = 0; i < CLIENTS; i++) {
+        uint8_t res[3];
+        check(nmbs_receive_raw_pdu_response(&clients[i], res, sizeof(res)) == NMBS_ERROR_NONE);
+        check(res[0] == 2 && res[1] == 0x01 && res[2] == i);
+    }
+
+    // A datagram whose MBAP length doesn't match its size is discarded, without affecting the next one
+    const uint8_t bad[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01};
+    check(sendto(client_batches[0].fd, bad, sizeof(bad), 0, (const struct sockaddr*) &server_addr,
+                 sizeof(server_addr)) == sizeof(bad));
+
+    const uint8_t req[] = {0x00, 0x00, 0x00, 0x01};
+    check(nmbs_send_raw_pdu(&clients[0], 3, req, sizeof(req)) == NMBS_ERROR_NONE);
+    check(udp_batch_flush(&client_batches[0]) == 0);
+    check(nmbs_server_poll(&server) == NMBS_ERROR_INVALID_TCP_MBAP);
+    check(nmbs_server_poll(&server) == NMBS_ERROR_NONE);
+    check(nmbs_server_poll(&server) == NMBS_ERROR_NONE);
+    uint8_t res[3];
+    check(nmbs_receive_raw_pdu_response(&clients[0], res, sizeof(res)) == NMBS_ERROR_NONE);
+    check(res[0] == 2 && res[1] == 0x01 && res[2] == 0x00);
+
+    // Concurrent clients sharing the server socket
+    test_servers polled = {&server, 1};
+    pthread_t poller;
+    if (pthread_create(&poller, NULL, poll_servers, &polled) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    const uint64_t rx_calls = server_batch.rx_calls;
+    const uint64_t rx_datagrams = server_batch.rx_datagrams;
+    const uint64_t start = now_ns();
+
+    pthread_t client_threads[CLIENTS];
+    int ids[CLIENTS];
+    for (int i = 0; i < CLIENTS; i++) {
+        ids[i] = i;
+        if (pthread_create(&client_threads[i], NULL, run_client, &ids[i]) != 0) {
+            fprintf(stderr, "Error creating thread\n");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(client_threads[i], NULL);
+        result |= client_results[i];
+    }
+
+    const uint64_t elapsed = now_ns() - start;
+
+    run = 0;
+    pthread_join(poller, NULL);
+
+    const uint64_t calls = server_batch.rx_calls - rx_calls;
+    printf("%d requests in %.1f ms, %.2f datagrams per recvmmsg()\n", CLIENTS * ITERATIONS * 2, (double) elapsed / 1e6,
+           calls ? (double) (server_batch.rx_datagrams - rx_datagrams) / (double) calls : 0.0);
+
+    for (int i = 0; i < CLIENTS; i++)
+        close(client_batches[i].fd);
+
+    close(server_fd);
+
+    return result;
+}
@@ -0,0 +1,239 @@
+#include "uring_transport.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "nanomodbus.h"
+#include "test_common.h"
+
+#define CLIENTS 4
+#define REGISTERS 16
+#define ITERATIONS 500
+
+struct sockaddr_in server_addr;
+uring_loop server_loop;
+nmbs_t server;
+uint16_t server_registers[CLIENTS][REGISTERS];
+test_registers server_regs = {&server_registers[0][0], CLIENTS * REGISTERS};
+
+uring_loop client_loops[CLIENTS];
+int client_results[CLIENTS];
+
+
+int tcp_listen(struct sockaddr_in* addr) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(struct sockaddr_in);
+    if (bind(fd, (struct sockaddr*) addr, len) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr*) addr, &len) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int tcp_connect(void) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (const struct sockaddr*) &server_addr, sizeof(server_addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+// Reads exactly count bytes, returns false on timeout or EOF
+bool recv_all(int fd, uint8_t* buf, size_t count) {
+    size_t total = 0;
+    while (total < count) {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+        if (poll(&pfd, 1, 1000) <= 0)
+            return false;
+
+        const ssize_t r = recv(fd, buf + total, count - total, 0);
+        if (r <= 0)
+            return false;
+
+        total += (size_t) r;
+    }
+
+    return true;
+}
+
+
+void* run_server(void* arg) {
+    UNUSED_PARAM(arg);
+    while (run)
+        uring_server_run(&server_loop, &server, 50);
+
+    return NULL;
+}
+
+
+void* run_client(void* arg) {
+    const int c = *(const int*) arg;
+    const uint16_t address = (uint16_t) (c * REGISTERS);
+
+    const int fd = tcp_connect();
+    if (fd < 0 || uring_loop_init(&client_loops[c]) != 0) {
+        fprintf(stderr, "Error connecting client %d\n", c);
+        client_results[c] = 1;
+        return NULL;
+    }
+
+    uring_client_connect(&client_loops[c], fd);
+
+    nmbs_platform_conf conf;
+    uring_platform_conf(&client_loops[c], &conf);
+
+    nmbs_t client;
+    nmbs_client_create(&client, &conf);
+    nmbs_set_read_timeout(&client, 1000);
+    nmbs_set_byte_timeout(&client, 100);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint16_t regs[REGISTERS];
+        for (int r = 0; r < REGISTERS; r++)
+            regs[r] = (uint16_t) (c * 1000 + i + r);
+
+        nmbs_error err = nmbs_write_multiple_registers(&client, address, REGISTERS, regs);
+        if (err == NMBS_ERROR_NONE) {
+            uint16_t regs_read[REGISTERS];
+            err = nmbs_read_holding_registers(&client, address, REGISTERS, regs_read);
+            if (err == NMBS_ERROR_NONE && memcmp(regs, regs_read, sizeof(regs)) != 0) {
+                fprintf(stderr, "Registers mismatch for client %d\n", c);
+                client_results[c] = 1;
+            }
+        }
+
+        if (err != NMBS_ERROR_NONE) {
+            fprintf(stderr, "Error from client %d %s\n", c, nmbs_strerror(err));
+            client_results[c] = 1;
+            break;
+        }
+    }
+
+    uring_loop_close(&client_loops[c]);
+    return NULL;
+}
+
+
+int main(int argc, char* argv[]) {
+    UNUSED_PARAM(argc);
+    UNUSED_PARAM(argv);
+
+    int result = 0;
+
+    if (uring_loop_init(&server_loop) != 0) {
+        printf("io_uring is not available, skipping\n");
+        return 0;
+    }
+
+    const int listen_fd = tcp_listen(&server_addr);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Error creating server socket\n");
+        return 1;
+    }
+
+    uring_server_listen(&server_loop, listen_fd);
+
+    nmbs_platform_conf s_conf;
+    uring_platform_conf(&server_loop, &s_conf);
+
+    nmbs_callbacks callbacks;
+    nmbs_callbacks_create(&callbacks);
+    callbacks.arg = &server_regs;
+    callbacks.read_holding_registers = read_holding_registers;
+    callbacks.write_multiple_registers = write_multiple_registers;
+
+    if (nmbs_server_create(&server, 0, &s_conf, &callbacks) != NMBS_ERROR_NONE) {
+        fprintf(stderr, "Error creating modbus server\n");
+        return 1;
+    }
+
+    nmbs_set_byte_timeout(&server, 100);
+
+    server_registers[0][0] = 0x1234;
+    server_registers[0][1] = 0x5678;
+
+    pthread_t server_thread;
+    if (pthread_create(&server_thread, NULL, run_server, NULL) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        return 1;
+    }
+
+    // Pipelined requests sent with a single send() are answered in order, the last one being split across sends
+    int fd = tcp_connect();
+    check(fd >= 0);
+
+    const uint8_t reqs[] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x01,
+                            0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x01, 0x00, 0x01,
+                            0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x50};
+    check(send(fd, reqs, sizeof(reqs), 0) == sizeof(reqs));
+
+    uint8_t res[11];
+    check(recv_all(fd, res, sizeof(res)));
+    check(res[1] == 0x01 && res[7] == 0x03 && res[8] == 0x02 && res[9] == 0x12 && res[10] == 0x34);
+    check(recv_all(fd, res, sizeof(res)));
+    check(res[1] == 0x02 && res[7] == 0x03 && res[8] == 0x02 && res[9] == 0x56 && res[10] == 0x78);
+
+    // An unsupported function code is answered with an exception, without discarding the following request
+    const uint8_t rest[] = {0x00, 0x00, 0x00, 0x00,
+                            0x00, 0x04, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+    check(send(fd, rest, sizeof(rest), 0) == sizeof(rest));
+    check(recv_all(fd, res, 9));
+    check(res[1] == 0x03 && res[7] == 0xD0 && res[8] == NMBS_EXCEPTION_ILLEGAL_FUNCTION);
+    check(recv_all(fd, res, sizeof(res)));
+    check(res[1] == 0x04 && res[9] == 0x12 && res[10] == 0x34);
+
+    // An invalid MBAP length closes the connection
+    const uint8_t bad[] = {0x00, 0x05, 0x00, 0x00, 0x00, 0x01, 0x01};
+    check(send(fd, bad, sizeof(bad), 0) == sizeof(bad));
+    check(!recv_all(fd, res, 1));
+    close(fd);
+
+    // Concurrent io_uring clients
+    pthread_t client_threads[CLIENTS];
+    int ids[CLIENTS];
+    for (int i = 0; i < CLIENTS; i++) {
+        ids[i] = i;
+        if (pthread_create(&client_threads[i], NULL, run_client, &ids[i]) != 0) {
+            fprintf(stderr, "Error creating thread\n");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < CLIENTS; i++) {
+        pthread_join(client_threads[i], NULL);
+        result |= client_results[i];
+    }
+
+    const uint64_t enter_calls = server_loop.enter_calls;
+    printf("%d requests, %.2f io_uring_enter() calls per request\n", CLIENTS * ITERATIONS * 2,
+           (double) enter_calls / (CLIENTS * ITERATIONS * 2));
+
+    run = 0;
+    pthread_join(server_thread, NULL);
+
+    uring_loop_close(&server_loop);
+    close(listen_fd);
+
+    return result;
+}